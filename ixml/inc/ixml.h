@@ -42,6 +42,8 @@
 
 #include "UpnpGlobal.h" /* For UPNP_EXPORT_SPEC */
 
+#include <stddef.h> /* for size_t */
+
 /*!
  * \brief The type of DOM strings.
  */
@@ -198,6 +200,10 @@ typedef struct _IXML_Text
 
 /*!
  * \brief Data structure representing a list of nodes.
+ *
+ * The links of a list allocated by the library are the cells of one array,
+ * so that ixmlNodeList_item() takes constant time. An empty list is a single
+ * link whose \b nodeItem is NULL.
  */
 typedef struct _IXML_NodeList
 {
@@ -1031,6 +1037,33 @@ UPNP_EXPORT_SPEC int ixmlDocument_importNode(
 	/*! [out] A pointer to a new \b Node owned by \b doc. */
 	IXML_Node **rtNode);
 
+/*!
+ * \brief Moves a \b Node and its subtree from its \b Document into this
+ * \b Document.
+ *
+ * Unlike \b ixmlDocument_importNode, no copy is made: the \b Node is removed
+ * from its parent, if any, and the \c ownerDocument of the \b Node, its
+ * descendants and their attributes is set to \b doc. The \b Node can then
+ * be inserted into \b doc, and is freed with it.
+ *
+ * Nodes of a document parsed by \b ixmlParseBufferArena cannot be adopted,
+ * they must be copied with \b ixmlDocument_importNode.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The operation completed successfully.
+ *     \li \c IXML_INVALID_PARAMETER: Either \b doc or
+ *           \b adoptNode is not a valid pointer.
+ *     \li \c IXML_NOT_SUPPORTED_ERR: \b adoptNode is a
+ *           \b Document or an \b Attr, which cannot be adopted.
+ */
+UPNP_EXPORT_SPEC int ixmlDocument_adoptNode(
+	/*! [in] The \b Document into which to move the \b Node. */
+	IXML_Document *doc,
+	/*! [in] The \b Node to move. */
+	IXML_Node *adoptNode,
+	/*! [out] A pointer to the \b Node now owned by \b doc. */
+	IXML_Node **rtNode);
+
 /* @} Interface Document */
 
 /*!
@@ -1500,7 +1533,8 @@ UPNP_EXPORT_SPEC IXML_Node *ixmlNodeList_item(
 /*!
  * \brief Returns the number of \b Nodes in a \b NodeList.
  *
- * \return The number of \b Nodes in the \b NodeList.
+ * \return The number of \b Nodes in the \b NodeList, 0 for the empty list
+ * of a \b Node without children.
  */
 UPNP_EXPORT_SPEC unsigned long ixmlNodeList_length(
 	/*! [in] The \b NodeList for which to retrieve the number of \b Nodes.
@@ -1677,6 +1711,34 @@ UPNP_EXPORT_SPEC int ixmlParseBufferEx(
 	   \b NULL on an error. */
 	IXML_Document **doc);
 
+/*!
+ * \brief Parses an XML text buffer into a \b Document whose nodes and strings
+ * are allocated in a few large blocks.
+ *
+ * The \b ixmlParseBufferArena API differs from the \b ixmlParseBufferEx
+ * API in that the memory of the parsed nodes is owned by the \b Document and
+ * released all at once when it is freed, which makes parsing and freeing
+ * cheaper for documents that are read and then thrown away. The
+ * \b Document is read-only: it must only be read, its nodes must not be
+ * freed or adopted on their own nor used after it is freed, and it is
+ * freed with \b ixmlDocument_free. Use \b ixmlDocument_importNode to keep
+ * a copy of some of its nodes.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The operation completed successfully.
+ *     \li \c IXML_INVALID_PARAMETER: The \b buffer is not a valid
+ *           pointer.
+ *     \li \c IXML_INSUFFICIENT_MEMORY: Not enough free memory exists
+ *           to complete this operation.
+ */
+UPNP_EXPORT_SPEC int ixmlParseBufferArena(
+	/*! [in] The buffer that contains the XML text to convert to a \b
+	   Document. */
+	const char *buffer,
+	/*! [out] A point to store the \b Document if file correctly parses or
+	   \b NULL on an error. */
+	IXML_Document **doc);
+
 /*!
  * \brief Parses an XML text file converting it into an IXML DOM representation.
  *
@@ -1707,6 +1769,97 @@ UPNP_EXPORT_SPEC int ixmlLoadDocumentEx(
 	 * NULL on an error. */
 	IXML_Document **doc);
 
+/*!
+ * \brief Callbacks of a streaming parse, see \b ixmlSaxParser_create.
+ *
+ * Each callback returns \c IXML_SUCCESS to go on with the parse. Any other
+ * value stops it and is returned by \b ixmlSaxParser_parse, for instance
+ * \c IXML_FILE_DONE once the wanted values are found. Names are qualified
+ * names as written in the text, and values have their references replaced.
+ * The strings are only valid during the call. Any callback can be \c NULL.
+ */
+typedef struct _IXML_SaxHandler
+{
+	/*! An element starts. Its attributes follow. */
+	int (*startElement)(void *cookie, const char *name);
+	/*! An attribute of the element that just started. */
+	int (*attribute)(void *cookie, const char *name, const char *value);
+	/*! A text node or CDATA section of the current element. */
+	int (*text)(void *cookie, const char *value);
+	/*! The current element ends. */
+	int (*endElement)(void *cookie, const char *name);
+} IXML_SaxHandler;
+
+/*!
+ * \brief State of a streaming parse.
+ */
+typedef struct _IXML_SaxParser IXML_SaxParser;
+
+/*!
+ * \brief Creates a streaming parser, which reports the content of an XML
+ * text through callbacks without building a \b Document.
+ *
+ * \return The parser or \c NULL if \b handler is \c NULL or there is not
+ * enough memory.
+ */
+UPNP_EXPORT_SPEC IXML_SaxParser *ixmlSaxParser_create(
+	/*! [in] The callbacks, copied by the parser. */
+	const IXML_SaxHandler *handler,
+	/*! [in] Passed to the callbacks. */
+	void *cookie);
+
+/*!
+ * \brief Parses the next chunk of an XML text.
+ *
+ * The text can be split anywhere. The callbacks are called for every node
+ * complete so far; a node cut by the end of the chunk is reported with the
+ * next one, and so is a text node, which must be followed by markup. A
+ * syntax error may thus only be found with the last chunk.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The chunk was parsed, or with \b isFinal, the
+ *           whole text.
+ *     \li \c IXML_INVALID_PARAMETER: \b saxParser or \b chunk is not a
+ *           valid pointer.
+ *     \li \c IXML_SYNTAX_ERR: The text is not well formed.
+ *     \li \c IXML_INSUFFICIENT_MEMORY: Not enough free memory exists
+ *           to complete this operation.
+ *     \li The value returned by a callback that stopped the parse.
+ *
+ * Once the parse stopped, later calls return the same value, or
+ * \c IXML_FILE_DONE after the last chunk.
+ */
+UPNP_EXPORT_SPEC int ixmlSaxParser_parse(
+	/*! [in] The parser. */
+	IXML_SaxParser *saxParser,
+	/*! [in] The chunk of text, can be \c NULL if \b length is 0. */
+	const char *chunk,
+	/*! [in] The length of the chunk. */
+	size_t length,
+	/*! [in] \c 1 if this is the last chunk of the text. */
+	int isFinal);
+
+/*!
+ * \brief Frees a streaming parser.
+ */
+UPNP_EXPORT_SPEC void ixmlSaxParser_free(
+	/*! [in] The parser to free, can be \c NULL. */
+	IXML_SaxParser *saxParser);
+
+/*!
+ * \brief Parses an XML text buffer through callbacks, without building a
+ * \b Document.
+ *
+ * \return The same values as \b ixmlSaxParser_parse.
+ */
+UPNP_EXPORT_SPEC int ixmlParseBufferSax(
+	/*! [in] The buffer that contains the XML text. */
+	const char *buffer,
+	/*! [in] The callbacks. */
+	const IXML_SaxHandler *handler,
+	/*! [in] Passed to the callbacks. */
+	void *cookie);
+
 /*!
  * \brief Clones an existing \b DOMString.
  *
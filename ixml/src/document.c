@@ -34,6 +34,7 @@
  * \file
  */
 
+#include "ixmlarena.h"
 #include "ixmldebug.h"
 #include "ixmlparser.h"
 
@@ -58,7 +59,8 @@ void ixmlDocument_free(IXML_Document *doc)
  * When this function is called first time, nodeptr is the root of the subtree,
  * so it is not necessay to do two steps recursion.
  *
- * Internal function called by ixmlDocument_importNode
+ * Internal function called by ixmlDocument_importNode and
+ * ixmlDocument_adoptNode
  */
 static void ixmlDocument_setOwnerDocument(
 	/*! [in] The document node. */
@@ -68,6 +70,7 @@ static void ixmlDocument_setOwnerDocument(
 {
 	if (nodeptr) {
 		nodeptr->ownerDocument = doc;
+		ixmlDocument_setOwnerDocument(doc, nodeptr->firstAttr);
 		ixmlDocument_setOwnerDocument(
 			doc, ixmlNode_getFirstChild(nodeptr));
 		ixmlDocument_setOwnerDocument(
@@ -103,6 +106,37 @@ int ixmlDocument_importNode(
 	return IXML_SUCCESS;
 }
 
+int ixmlDocument_adoptNode(
+	IXML_Document *doc, IXML_Node *adoptNode, IXML_Node **rtNode)
+{
+	unsigned short nodeType;
+	int rc;
+
+	*rtNode = NULL;
+
+	if (!doc || !adoptNode) {
+		return IXML_INVALID_PARAMETER;
+	}
+
+	nodeType = ixmlNode_getNodeType(adoptNode);
+	if (nodeType == eDOCUMENT_NODE || nodeType == eATTRIBUTE_NODE) {
+		return IXML_NOT_SUPPORTED_ERR;
+	}
+
+	if (adoptNode->parentNode) {
+		rc = ixmlNode_removeChild(
+			adoptNode->parentNode, adoptNode, &adoptNode);
+		if (rc != IXML_SUCCESS) {
+			return rc;
+		}
+	}
+	/* Detached, so the recursion does not reach any sibling. */
+	ixmlDocument_setOwnerDocument(doc, adoptNode);
+	*rtNode = adoptNode;
+
+	return IXML_SUCCESS;
+}
+
 int ixmlDocument_createElementEx(
 	IXML_Document *doc, const DOMString tagName, IXML_Element **rtElement)
 {
@@ -114,33 +148,32 @@ int ixmlDocument_createElementEx(
 		goto ErrorHandler;
 	}
 
-	newElement = (IXML_Element *)malloc(sizeof(IXML_Element));
+	newElement =
+		(IXML_Element *)ixmlDocument_malloc(doc, sizeof(IXML_Element));
 	if (!newElement) {
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 
 	ixmlElement_init(newElement);
-	newElement->tagName = strdup(tagName);
+	newElement->n.ownerDocument = doc;
+	newElement->tagName = ixmlDocument_strdup(doc, tagName);
 	if (!newElement->tagName) {
-		ixmlElement_free(newElement);
+		ixmlDocument_releaseNode(doc, (IXML_Node *)newElement);
 		newElement = NULL;
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 	/* set the node fields */
 	newElement->n.nodeType = eELEMENT_NODE;
-	newElement->n.nodeName = strdup(tagName);
+	newElement->n.nodeName = ixmlDocument_strdup(doc, tagName);
 	if (!newElement->n.nodeName) {
-		free(newElement->tagName);
-		ixmlElement_free(newElement);
+		ixmlDocument_releaseNode(doc, (IXML_Node *)newElement);
 		newElement = NULL;
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 
-	newElement->n.ownerDocument = doc;
-
 ErrorHandler:
 	*rtElement = newElement;
 
@@ -217,26 +250,28 @@ int ixmlDocument_createTextNodeEx(
 		goto ErrorHandler;
 	}
 
-	returnNode = (IXML_Node *)malloc(sizeof(IXML_Node));
+	returnNode = (IXML_Node *)ixmlDocument_malloc(doc, sizeof(IXML_Node));
 	if (!returnNode) {
 		rc = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 	/* initialize the node */
 	ixmlNode_init(returnNode);
+	returnNode->ownerDocument = doc;
 
-	returnNode->nodeName = strdup((const char *)TEXTNODENAME);
+	returnNode->nodeName =
+		ixmlDocument_strdup(doc, (const char *)TEXTNODENAME);
 	if (!returnNode->nodeName) {
-		ixmlNode_free(returnNode);
+		ixmlDocument_releaseNode(doc, returnNode);
 		returnNode = NULL;
 		rc = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 	/* add in node value */
 	if (data) {
-		returnNode->nodeValue = strdup(data);
+		returnNode->nodeValue = ixmlDocument_strdup(doc, data);
 		if (!returnNode->nodeValue) {
-			ixmlNode_free(returnNode);
+			ixmlDocument_releaseNode(doc, returnNode);
 			returnNode = NULL;
 			rc = IXML_INSUFFICIENT_MEMORY;
 			goto ErrorHandler;
@@ -244,7 +279,6 @@ int ixmlDocument_createTextNodeEx(
 	}
 
 	returnNode->nodeType = eTEXT_NODE;
-	returnNode->ownerDocument = doc;
 
 ErrorHandler:
 	*textNode = returnNode;
@@ -270,22 +304,22 @@ int ixmlDocument_createAttributeEx(
 		errCode = IXML_INVALID_PARAMETER;
 		goto ErrorHandler;
 	}
-	attrNode = (IXML_Attr *)malloc(sizeof(IXML_Attr));
+	attrNode = (IXML_Attr *)ixmlDocument_malloc(doc, sizeof(IXML_Attr));
 	if (!attrNode) {
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 	ixmlAttr_init(attrNode);
 	attrNode->n.nodeType = eATTRIBUTE_NODE;
+	attrNode->n.ownerDocument = doc;
 	/* set the node fields */
-	attrNode->n.nodeName = strdup(name);
+	attrNode->n.nodeName = ixmlDocument_strdup(doc, name);
 	if (!attrNode->n.nodeName) {
-		ixmlAttr_free(attrNode);
+		ixmlDocument_releaseNode(doc, (IXML_Node *)attrNode);
 		attrNode = NULL;
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
-	attrNode->n.ownerDocument = doc;
 
 ErrorHandler:
 	*rtAttr = attrNode;
@@ -365,7 +399,8 @@ int ixmlDocument_createCDATASectionEx(
 		goto ErrorHandler;
 	}
 
-	cDSectionNode = (IXML_CDATASection *)malloc(sizeof(IXML_CDATASection));
+	cDSectionNode = (IXML_CDATASection *)ixmlDocument_malloc(
+		doc, sizeof(IXML_CDATASection));
 	if (!cDSectionNode) {
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
@@ -373,24 +408,24 @@ int ixmlDocument_createCDATASectionEx(
 
 	ixmlCDATASection_init(cDSectionNode);
 	cDSectionNode->n.nodeType = eCDATA_SECTION_NODE;
-	cDSectionNode->n.nodeName = strdup((const char *)CDATANODENAME);
+	cDSectionNode->n.ownerDocument = doc;
+	cDSectionNode->n.nodeName =
+		ixmlDocument_strdup(doc, (const char *)CDATANODENAME);
 	if (!cDSectionNode->n.nodeName) {
-		ixmlCDATASection_free(cDSectionNode);
+		ixmlDocument_releaseNode(doc, (IXML_Node *)cDSectionNode);
 		cDSectionNode = NULL;
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 
-	cDSectionNode->n.nodeValue = strdup(data);
+	cDSectionNode->n.nodeValue = ixmlDocument_strdup(doc, data);
 	if (!cDSectionNode->n.nodeValue) {
-		ixmlCDATASection_free(cDSectionNode);
+		ixmlDocument_releaseNode(doc, (IXML_Node *)cDSectionNode);
 		cDSectionNode = NULL;
 		errCode = IXML_INSUFFICIENT_MEMORY;
 		goto ErrorHandler;
 	}
 
-	cDSectionNode->n.ownerDocument = doc;
-
 ErrorHandler:
 	*rtCD = cDSectionNode;
 	return errCode;
@@ -0,0 +1,147 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ * Copyright (c) 2012 France Telecom All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+#ifndef IXML_ARENA_H
+#define IXML_ARENA_H
+
+/*!
+ * \file
+ *
+ * \brief Allocation arena of documents parsed by ixmlParseBufferArena().
+ *
+ * While the parser builds such a document, its nodes and strings are carved
+ * out of a few large blocks owned by the document, and they are all released
+ * with it. Arena documents are read-only once parsed, so nothing outside the
+ * parser ever frees arena memory on its own: the public functions keep using
+ * the heap and never look at the owner document of a node they free.
+ *
+ * An arena document is recognized by the identity of its node name, which
+ * lives in the public part of the document, before anything else of it is
+ * read. Heap documents, including the ones set up by the application with
+ * ixmlDocument_init(), never carry that name.
+ */
+
+#include "ixml.h"
+
+#include <stddef.h> /* for size_t */
+
+typedef struct _IXML_Arena IXML_Arena;
+
+/*!
+ * \brief Creates an empty arena document, to be filled by the parser.
+ *
+ * The document itself is the first allocation of its arena, and allocation
+ * in the arena is switched on until ixmlDocument_endArena() is called.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c IXML_SUCCESS: The operation completed successfully.
+ *     \li \c IXML_INSUFFICIENT_MEMORY: Not enough free memory exists.
+ */
+int ixmlDocument_createArenaDocument(
+	/*! [in] Size of the first block; later blocks grow from it. */
+	size_t blockSize,
+	/*! [out] The new document. */
+	IXML_Document **rtDoc);
+
+/*!
+ * \brief Switches allocation in the arena of a document off once the
+ * parser is done with it.
+ */
+void ixmlDocument_endArena(
+	/*! [in] The document, can be a heap document. */
+	IXML_Document *doc);
+
+/*!
+ * \brief Reports whether a document is an arena document.
+ *
+ * Only the public part of the document is read.
+ *
+ * \return 1 if it is.
+ */
+int ixmlDocument_isArena(
+	/*! [in] The document, can be NULL. */
+	const IXML_Document *doc);
+
+/*!
+ * \brief Frees an arena document and all the memory of its arena.
+ */
+void ixmlDocument_freeArena(
+	/*! [in] The document, must be an arena document. */
+	IXML_Document *doc);
+
+/*!
+ * \brief Allocates memory for a node or string of a document.
+ *
+ * \return The memory, from the arena of the document while the parser
+ * builds it, or from the heap. NULL if there is not enough memory.
+ */
+void *ixmlDocument_malloc(
+	/*! [in] The owner document, can be NULL. */
+	IXML_Document *doc,
+	/*! [in] The size to allocate. */
+	size_t size);
+
+/*!
+ * \brief Duplicates a string with ixmlDocument_malloc().
+ *
+ * \return The copy, or NULL if there is not enough memory.
+ */
+char *ixmlDocument_strdup(
+	/*! [in] The owner document, can be NULL. */
+	IXML_Document *doc,
+	/*! [in] The string to copy. */
+	const char *s);
+
+/*!
+ * \brief Frees memory allocated with ixmlDocument_malloc() for a node
+ * that is being built.
+ *
+ * While the parser builds an arena document, everything allocated for it
+ * belongs to the arena and is left to it, so the check takes constant time.
+ */
+void ixmlDocument_release(
+	/*! [in] The owner document, can be NULL. */
+	IXML_Document *doc,
+	/*! [in] The memory to free, can be NULL. */
+	void *p);
+
+/*!
+ * \brief Frees a node created for a document that is being built, see
+ * ixmlDocument_release().
+ */
+void ixmlDocument_releaseNode(
+	/*! [in] The owner document, can be NULL. */
+	IXML_Document *doc,
+	/*! [in] The node to free, can be NULL. */
+	IXML_Node *node);
+
+#endif /* IXML_ARENA_H */
@@ -136,7 +136,8 @@ void Parser_freeNodeContent(
 	/*! [in] The Node to process. */
 	IXML_Node *IXML_Nodeptr);
 
-int Parser_LoadDocument(IXML_Document **retDoc, const char *xmlFile, int file);
+int Parser_LoadDocument(
+	IXML_Document **retDoc, const char *xmlFile, int file, int arena);
 
 int Parser_setNodePrefixAndLocalName(IXML_Node *newIXML_NodeIXML_Attr);
 
@@ -175,8 +176,17 @@ int ixmlNamedNodeMap_addToNamedNodeMap(
 	/* [in] The node to add. */
 	IXML_Node *add);
 
+/*!
+ * \brief Allocates an empty nodelist.
+ *
+ * \return The nodelist, or NULL if there is not enough memory.
+ */
+IXML_NodeList *ixmlNodeList_new(void);
+
 /*!
  * \brief Add a node to nodelist.
+ *
+ * The list must have been allocated by the library: \b *nList can move.
  */
 int ixmlNodeList_addToNodeList(
 	/*! [in] The pointer to the nodelist. */
@@ -245,7 +255,8 @@ int ixmlNode_setNodeName(
 	const DOMString qualifiedName);
 
 /*!
- * \brief
+ * \brief Copies the value, local name, prefix and type of a parsed node into
+ * a node created for the document being built.
  *
  * \return
  */
@@ -34,7 +34,6 @@
  */
 
 #include "ixmldebug.h"
-#include "ixmlmembuf.h"
 #include "ixmlparser.h"
 
 #include <stdlib.h> /* for free() */
@@ -43,43 +42,120 @@
 #include "posix_overwrites.h" // IWYU pragma: keep
 
 /*!
- * \brief Appends a string to a buffer, substituting some characters by escape
- * sequences.
+ * \brief Output of the serializer.
+ *
+ * Documents are serialized twice: a first pass with a NULL \b out only adds
+ * up the length, then the exact amount of memory is allocated and the second
+ * pass writes the text.
+ */
+typedef struct
+{
+	/*! Where to write, or NULL to only compute the length. */
+	char *out;
+	/*! Number of bytes written, or that would have been written. */
+	size_t length;
+} ixml_writer;
+
+/*!
+ * \brief Appends bytes to the output.
+ */
+static void write_bytes(
+	/*! [in,out] The output. */
+	ixml_writer *w,
+	/*! [in] The bytes to append. */
+	const char *p,
+	/*! [in] The number of bytes. */
+	size_t n)
+{
+	if (w->out) {
+		memcpy(w->out + w->length, p, n);
+	}
+	w->length += n;
+}
+
+/*!
+ * \brief Appends a string to the output.
+ */
+static void write_str(
+	/*! [in,out] The output. */
+	ixml_writer *w,
+	/*! [in] The string to append, can be NULL. */
+	const char *p)
+{
+	if (p) {
+		write_bytes(w, p, strlen(p));
+	}
+}
+
+/*!
+ * \brief Skips the characters that need no escape sequence.
+ *
+ * \return Pointer to the first character to escape, or end.
+ */
+static const char *scan_plain(
+	/*! [in] Start of the string. */
+	const char *p,
+	/*! [in] End of the string. */
+	const char *end)
+{
+	while (p < end) {
+		switch (*p) {
+		case '<':
+		case '>':
+		case '&':
+		case '\'':
+		case '\"':
+			return p;
+		default:
+			p++;
+			break;
+		}
+	}
+
+	return p;
+}
+
+/*!
+ * \brief Appends a string to the output, substituting some characters by
+ * escape sequences.
  */
 static void copy_with_escape(
-	/*! [in,out] The input/output buffer. */
-	ixml_membuf *buf,
+	/*! [in,out] The output. */
+	ixml_writer *w,
 	/*! [in] The string to copy from. */
 	const char *p)
 {
-	size_t i;
-	size_t plen;
+	const char *end;
+	const char *plain;
 
 	if (!p) {
 		return;
 	}
-	plen = strlen(p);
-	for (i = (size_t)0; i < plen; ++i) {
-		switch (p[i]) {
+	end = p + strlen(p);
+	while (p < end) {
+		plain = scan_plain(p, end);
+		write_bytes(w, p, (size_t)(plain - p));
+		if (plain == end) {
+			break;
+		}
+		switch (*plain) {
 		case '<':
-			ixml_membuf_append_str(buf, "&lt;");
+			write_bytes(w, "&lt;", (size_t)4);
 			break;
 		case '>':
-			ixml_membuf_append_str(buf, "&gt;");
+			write_bytes(w, "&gt;", (size_t)4);
 			break;
 		case '&':
-			ixml_membuf_append_str(buf, "&amp;");
+			write_bytes(w, "&amp;", (size_t)5);
 			break;
 		case '\'':
-			ixml_membuf_append_str(buf, "&apos;");
-			break;
-		case '\"':
-			ixml_membuf_append_str(buf, "&quot;");
+			write_bytes(w, "&apos;", (size_t)6);
 			break;
 		default:
-			ixml_membuf_append(buf, &p[i]);
+			write_bytes(w, "&quot;", (size_t)6);
 			break;
 		}
+		p = plain + 1;
 	}
 }
 
@@ -91,7 +167,7 @@ static void ixmlPrintDomTreeRecursive(
 	/*! [in] \todo documentation. */
 	IXML_Node *nodeptr,
 	/*! [in] \todo documentation. */
-	ixml_membuf *buf)
+	ixml_writer *w)
 {
 	const char *nodeName = NULL;
 	const char *nodeValue = NULL;
@@ -103,72 +179,72 @@ static void ixmlPrintDomTreeRecursive(
 
 		switch (ixmlNode_getNodeType(nodeptr)) {
 		case eTEXT_NODE:
-			copy_with_escape(buf, nodeValue);
+			copy_with_escape(w, nodeValue);
 			break;
 
 		case eCDATA_SECTION_NODE:
-			ixml_membuf_append_str(buf, "<![CDATA[");
-			ixml_membuf_append_str(buf, nodeValue);
-			ixml_membuf_append_str(buf, "]]>");
+			write_str(w, "<![CDATA[");
+			write_str(w, nodeValue);
+			write_str(w, "]]>");
 			break;
 
 		case ePROCESSING_INSTRUCTION_NODE:
-			ixml_membuf_append_str(buf, "<?");
-			ixml_membuf_append_str(buf, nodeName);
-			ixml_membuf_append_str(buf, " ");
-			copy_with_escape(buf, nodeValue);
-			ixml_membuf_append_str(buf, "?>\n");
+			write_str(w, "<?");
+			write_str(w, nodeName);
+			write_str(w, " ");
+			copy_with_escape(w, nodeValue);
+			write_str(w, "?>\n");
 			break;
 
 		case eDOCUMENT_NODE:
 			ixmlPrintDomTreeRecursive(
-				ixmlNode_getFirstChild(nodeptr), buf);
+				ixmlNode_getFirstChild(nodeptr), w);
 			break;
 
 		case eATTRIBUTE_NODE:
-			ixml_membuf_append_str(buf, nodeName);
-			ixml_membuf_append_str(buf, "=\"");
-			copy_with_escape(buf, nodeValue);
-			ixml_membuf_append_str(buf, "\"");
+			write_str(w, nodeName);
+			write_str(w, "=\"");
+			copy_with_escape(w, nodeValue);
+			write_str(w, "\"");
 			if (nodeptr->nextSibling) {
-				ixml_membuf_append_str(buf, " ");
+				write_str(w, " ");
 				ixmlPrintDomTreeRecursive(
-					nodeptr->nextSibling, buf);
+					nodeptr->nextSibling, w);
 			}
 			break;
 
 		case eELEMENT_NODE:
-			ixml_membuf_append_str(buf, "<");
-			ixml_membuf_append_str(buf, nodeName);
+			write_str(w, "<");
+			write_str(w, nodeName);
 			if (nodeptr->firstAttr) {
-				ixml_membuf_append_str(buf, " ");
+				write_str(w, " ");
 				ixmlPrintDomTreeRecursive(
-					nodeptr->firstAttr, buf);
+					nodeptr->firstAttr, w);
 			}
 			child = ixmlNode_getFirstChild(nodeptr);
 			if (child &&
 				ixmlNode_getNodeType(child) == eELEMENT_NODE) {
-				ixml_membuf_append_str(buf, ">\r\n");
+				write_str(w, ">\r\n");
 			} else {
-				ixml_membuf_append_str(buf, ">");
+				write_str(w, ">");
 			}
 			/* output the children */
 			ixmlPrintDomTreeRecursive(
-				ixmlNode_getFirstChild(nodeptr), buf);
+				ixmlNode_getFirstChild(nodeptr), w);
 
 			/* Done with children.  Output the end tag. */
-			ixml_membuf_append_str(buf, "</");
-			ixml_membuf_append_str(buf, nodeName);
+			write_str(w, "</");
+			write_str(w, nodeName);
 
 			sibling = ixmlNode_getNextSibling(nodeptr);
 			if (sibling &&
 				ixmlNode_getNodeType(sibling) == eTEXT_NODE) {
-				ixml_membuf_append_str(buf, ">");
+				write_str(w, ">");
 			} else {
-				ixml_membuf_append_str(buf, ">\r\n");
+				write_str(w, ">\r\n");
 			}
 			ixmlPrintDomTreeRecursive(
-				ixmlNode_getNextSibling(nodeptr), buf);
+				ixmlNode_getNextSibling(nodeptr), w);
 			break;
 
 		default:
@@ -192,13 +268,13 @@ static void ixmlPrintDomTree(
 	/*! [in] \todo documentation. */
 	IXML_Node *nodeptr,
 	/*! [in] \todo documentation. */
-	ixml_membuf *buf)
+	ixml_writer *w)
 {
 	const char *nodeName = NULL;
 	const char *nodeValue = NULL;
 	IXML_Node *child = NULL;
 
-	if (!nodeptr || !buf) {
+	if (!nodeptr) {
 		return;
 	}
 
@@ -209,37 +285,37 @@ static void ixmlPrintDomTree(
 	case eCDATA_SECTION_NODE:
 	case ePROCESSING_INSTRUCTION_NODE:
 	case eDOCUMENT_NODE:
-		ixmlPrintDomTreeRecursive(nodeptr, buf);
+		ixmlPrintDomTreeRecursive(nodeptr, w);
 		break;
 
 	case eATTRIBUTE_NODE:
-		ixml_membuf_append_str(buf, nodeName);
-		ixml_membuf_append_str(buf, "=\"");
-		copy_with_escape(buf, nodeValue);
-		ixml_membuf_append_str(buf, "\"");
+		write_str(w, nodeName);
+		write_str(w, "=\"");
+		copy_with_escape(w, nodeValue);
+		write_str(w, "\"");
 		break;
 
 	case eELEMENT_NODE:
-		ixml_membuf_append_str(buf, "<");
-		ixml_membuf_append_str(buf, nodeName);
+		write_str(w, "<");
+		write_str(w, nodeName);
 		if (nodeptr->firstAttr) {
-			ixml_membuf_append_str(buf, " ");
-			ixmlPrintDomTreeRecursive(nodeptr->firstAttr, buf);
+			write_str(w, " ");
+			ixmlPrintDomTreeRecursive(nodeptr->firstAttr, w);
 		}
 		child = ixmlNode_getFirstChild(nodeptr);
 		if (child && ixmlNode_getNodeType(child) == eELEMENT_NODE) {
-			ixml_membuf_append_str(buf, ">\r\n");
+			write_str(w, ">\r\n");
 		} else {
-			ixml_membuf_append_str(buf, ">");
+			write_str(w, ">");
 		}
 
 		/* output the children */
-		ixmlPrintDomTreeRecursive(ixmlNode_getFirstChild(nodeptr), buf);
+		ixmlPrintDomTreeRecursive(ixmlNode_getFirstChild(nodeptr), w);
 
 		/* Done with children. Output the end tag. */
-		ixml_membuf_append_str(buf, "</");
-		ixml_membuf_append_str(buf, nodeName);
-		ixml_membuf_append_str(buf, ">\r\n");
+		write_str(w, "</");
+		write_str(w, nodeName);
+		write_str(w, ">\r\n");
 		break;
 
 	default:
@@ -262,13 +338,13 @@ static void ixmlDomTreetoString(
 	/*! [in] \todo documentation. */
 	IXML_Node *nodeptr,
 	/*! [in] \todo documentation. */
-	ixml_membuf *buf)
+	ixml_writer *w)
 {
 	const char *nodeName = NULL;
 	const char *nodeValue = NULL;
 	IXML_Node *child = NULL;
 
-	if (!nodeptr || !buf) {
+	if (!nodeptr) {
 		return;
 	}
 
@@ -280,37 +356,37 @@ static void ixmlDomTreetoString(
 	case eCDATA_SECTION_NODE:
 	case ePROCESSING_INSTRUCTION_NODE:
 	case eDOCUMENT_NODE:
-		ixmlPrintDomTreeRecursive(nodeptr, buf);
+		ixmlPrintDomTreeRecursive(nodeptr, w);
 		break;
 
 	case eATTRIBUTE_NODE:
-		ixml_membuf_append_str(buf, nodeName);
-		ixml_membuf_append_str(buf, "=\"");
-		copy_with_escape(buf, nodeValue);
-		ixml_membuf_append_str(buf, "\"");
+		write_str(w, nodeName);
+		write_str(w, "=\"");
+		copy_with_escape(w, nodeValue);
+		write_str(w, "\"");
 		break;
 
 	case eELEMENT_NODE:
-		ixml_membuf_append_str(buf, "<");
-		ixml_membuf_append_str(buf, nodeName);
+		write_str(w, "<");
+		write_str(w, nodeName);
 		if (nodeptr->firstAttr) {
-			ixml_membuf_append_str(buf, " ");
-			ixmlPrintDomTreeRecursive(nodeptr->firstAttr, buf);
+			write_str(w, " ");
+			ixmlPrintDomTreeRecursive(nodeptr->firstAttr, w);
 		}
 		child = ixmlNode_getFirstChild(nodeptr);
 		if (child && ixmlNode_getNodeType(child) == eELEMENT_NODE) {
-			ixml_membuf_append_str(buf, ">");
+			write_str(w, ">");
 		} else {
-			ixml_membuf_append_str(buf, ">");
+			write_str(w, ">");
 		}
 
 		/* output the children */
-		ixmlPrintDomTreeRecursive(ixmlNode_getFirstChild(nodeptr), buf);
+		ixmlPrintDomTreeRecursive(ixmlNode_getFirstChild(nodeptr), w);
 
 		/* Done with children. Output the end tag. */
-		ixml_membuf_append_str(buf, "</");
-		ixml_membuf_append_str(buf, nodeName);
-		ixml_membuf_append_str(buf, ">");
+		write_str(w, "</");
+		write_str(w, nodeName);
+		write_str(w, ">");
 		break;
 
 	default:
@@ -329,7 +405,7 @@ int ixmlLoadDocumentEx(const char *xmlFile, IXML_Document **doc)
 		return IXML_INVALID_PARAMETER;
 	}
 
-	return Parser_LoadDocument(doc, xmlFile, 1);
+	return Parser_LoadDocument(doc, xmlFile, 1, 0);
 }
 
 IXML_Document *ixmlLoadDocument(const char *xmlFile)
@@ -341,68 +417,67 @@ IXML_Document *ixmlLoadDocument(const char *xmlFile)
 	return doc;
 }
 
-DOMString ixmlPrintDocument(IXML_Document *doc)
+/*!
+ * \brief Serializes a node with one of the printing functions.
+ *
+ * \return The text, or NULL if it is empty or there is not enough memory.
+ */
+static DOMString ixmlSerialize(
+	/*! [in] The node to serialize. */
+	IXML_Node *node,
+	/*! [in] Text to output before the node, or NULL. */
+	const char *prolog,
+	/*! [in] ixmlPrintDomTree() or ixmlDomTreetoString(). */
+	void (*print)(IXML_Node *, ixml_writer *))
 {
-	IXML_Node *rootNode = (IXML_Node *)doc;
-	ixml_membuf memBuf;
-	ixml_membuf *buf = &memBuf;
+	ixml_writer w;
+	size_t length;
 
-	if (!rootNode) {
+	if (!node) {
+		return NULL;
+	}
+	w.out = NULL;
+	w.length = (size_t)0;
+	write_str(&w, prolog);
+	print(node, &w);
+	length = w.length;
+	if (length == (size_t)0) {
 		return NULL;
 	}
+	w.out = (char *)malloc(length + (size_t)1);
+	if (!w.out) {
+		return NULL;
+	}
+	w.length = (size_t)0;
+	write_str(&w, prolog);
+	print(node, &w);
+	w.out[length] = '\0';
 
-	ixml_membuf_init(buf);
-	ixml_membuf_append_str(buf, "<?xml version=\"1.0\"?>\r\n");
-	ixmlPrintDomTree(rootNode, buf);
+	return w.out;
+}
 
-	return buf->buf;
+DOMString ixmlPrintDocument(IXML_Document *doc)
+{
+	return ixmlSerialize((IXML_Node *)doc,
+		"<?xml version=\"1.0\"?>\r\n",
+		ixmlPrintDomTree);
 }
 
 DOMString ixmlPrintNode(IXML_Node *node)
 {
-	ixml_membuf memBuf;
-	ixml_membuf *buf = &memBuf;
-
-	if (!node) {
-		return NULL;
-	}
-
-	ixml_membuf_init(buf);
-	ixmlPrintDomTree(node, buf);
-
-	return buf->buf;
+	return ixmlSerialize(node, NULL, ixmlPrintDomTree);
 }
 
 DOMString ixmlDocumenttoString(IXML_Document *doc)
 {
-	IXML_Node *rootNode = (IXML_Node *)doc;
-	ixml_membuf memBuf;
-	ixml_membuf *buf = &memBuf;
-
-	if (!rootNode) {
-		return NULL;
-	}
-
-	ixml_membuf_init(buf);
-	ixml_membuf_append_str(buf, "<?xml version=\"1.0\"?>\r\n");
-	ixmlDomTreetoString(rootNode, buf);
-
-	return buf->buf;
+	return ixmlSerialize((IXML_Node *)doc,
+		"<?xml version=\"1.0\"?>\r\n",
+		ixmlDomTreetoString);
 }
 
 DOMString ixmlNodetoString(IXML_Node *node)
 {
-	ixml_membuf memBuf;
-	ixml_membuf *buf = &memBuf;
-
-	if (!node) {
-		return NULL;
-	}
-
-	ixml_membuf_init(buf);
-	ixmlDomTreetoString(node, buf);
-
-	return buf->buf;
+	return ixmlSerialize(node, NULL, ixmlDomTreetoString);
 }
 
 void ixmlRelaxParser(char errorChar) { Parser_setErrorChar(errorChar); }
@@ -423,7 +498,42 @@ int ixmlParseBufferEx(const char *buffer, IXML_Document **retDoc)
 		return IXML_INVALID_PARAMETER;
 	}
 
-	return Parser_LoadDocument(retDoc, buffer, 0);
+	return Parser_LoadDocument(retDoc, buffer, 0, 0);
+}
+
+int ixmlParseBufferArena(const char *buffer, IXML_Document **retDoc)
+{
+	if (!buffer || !retDoc) {
+		return IXML_INVALID_PARAMETER;
+	}
+	if (buffer[0] == '\0') {
+		return IXML_INVALID_PARAMETER;
+	}
+
+	return Parser_LoadDocument(retDoc, buffer, 0, 1);
+}
+
+int ixmlParseBufferSax(
+	const char *buffer, const IXML_SaxHandler *handler, void *cookie)
+{
+	IXML_SaxParser *saxParser;
+	int rc;
+
+	if (!buffer || !handler) {
+		return IXML_INVALID_PARAMETER;
+	}
+	if (buffer[0] == '\0') {
+		return IXML_INVALID_PARAMETER;
+	}
+
+	saxParser = ixmlSaxParser_create(handler, cookie);
+	if (!saxParser) {
+		return IXML_INSUFFICIENT_MEMORY;
+	}
+	rc = ixmlSaxParser_parse(saxParser, buffer, strlen(buffer), 1);
+	ixmlSaxParser_free(saxParser);
+
+	return rc;
 }
 
 IXML_Document *ixmlParseBuffer(const char *buffer)
@@ -0,0 +1,265 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ * Copyright (c) 2012 France Telecom All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Allocation arena of documents parsed by ixmlParseBufferArena().
+ */
+
+#include "ixmlarena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*! Alignment of the allocations, enough for the node structures. */
+#define IXML_ARENA_ALIGN sizeof(void *)
+
+/*! Smallest block size. */
+#define IXML_ARENA_MIN_BLOCK (size_t)1024
+
+/*! Largest block size reached by doubling. */
+#define IXML_ARENA_MAX_BLOCK ((size_t)256 * 1024)
+
+typedef struct _IXML_ArenaBlock
+{
+	/*! Next (older) block. */
+	struct _IXML_ArenaBlock *next;
+	/*! Size of the data. */
+	size_t size;
+	/*! Bytes of the data already allocated. */
+	size_t used;
+	/*! The data, aligned on IXML_ARENA_ALIGN. */
+	void *data[1];
+} IXML_ArenaBlock;
+
+struct _IXML_Arena
+{
+	/*! Blocks, the current one first. */
+	IXML_ArenaBlock *blocks;
+	/*! Size of the next block. */
+	size_t blockSize;
+	/*! Whether allocations go to the arena. */
+	int active;
+};
+
+/*!
+ * \brief An arena document.
+ *
+ * The arena is kept out of the public IXML_Document so that its layout does
+ * not change. Only documents whose node name is ixmlArena_documentName are
+ * allocated with this size.
+ */
+typedef struct _IXML_DocumentPrivate
+{
+	/*! The public part, must be first. */
+	IXML_Document doc;
+	/*! The arena holding the document and all its nodes. */
+	IXML_Arena *arena;
+} IXML_DocumentPrivate;
+
+/*! Node name of the arena documents, compared by address. */
+static char ixmlArena_documentName[] = DOCUMENTNODENAME;
+
+/*!
+ * \brief Allocates memory in the arena.
+ *
+ * \return The memory or NULL if there is not enough memory.
+ */
+static void *ixmlArena_alloc(
+	/*! [in] The arena. */
+	IXML_Arena *arena,
+	/*! [in] The size to allocate. */
+	size_t size)
+{
+	IXML_ArenaBlock *block = arena->blocks;
+	size_t blockSize;
+	char *p;
+
+	size = (size + IXML_ARENA_ALIGN - 1) & ~(IXML_ARENA_ALIGN - 1);
+	if (!block || block->size - block->used < size) {
+		blockSize = arena->blockSize;
+		if (blockSize < size) {
+			blockSize = size;
+		}
+		block = (IXML_ArenaBlock *)malloc(
+			offsetof(IXML_ArenaBlock, data) + blockSize);
+		if (!block) {
+			return NULL;
+		}
+		block->size = blockSize;
+		block->used = 0;
+		if (arena->blocks && blockSize != arena->blockSize) {
+			/* oversized: keep allocating from the current block */
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+			if (arena->blockSize < IXML_ARENA_MAX_BLOCK) {
+				arena->blockSize *= 2;
+			}
+		}
+	}
+	p = (char *)block->data + block->used;
+	block->used += size;
+
+	return p;
+}
+
+/*!
+ * \brief Frees an arena and all the memory allocated in it.
+ */
+static void ixmlArena_free(
+	/*! [in] The arena to free. */
+	IXML_Arena *arena)
+{
+	IXML_ArenaBlock *block;
+	IXML_ArenaBlock *next;
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+/*!
+ * \brief Returns the arena of a document.
+ *
+ * \return The arena, or NULL for a heap document.
+ */
+static IXML_Arena *ixmlDocument_getArena(
+	/*! [in] The document, can be NULL. */
+	const IXML_Document *doc)
+{
+	if (!ixmlDocument_isArena(doc)) {
+		return NULL;
+	}
+
+	return ((const IXML_DocumentPrivate *)doc)->arena;
+}
+
+int ixmlDocument_createArenaDocument(size_t blockSize, IXML_Document **rtDoc)
+{
+	IXML_Arena *arena;
+	IXML_DocumentPrivate *priv;
+
+	*rtDoc = NULL;
+	arena = (IXML_Arena *)malloc(sizeof(IXML_Arena));
+	if (!arena) {
+		return IXML_INSUFFICIENT_MEMORY;
+	}
+	arena->blocks = NULL;
+	arena->blockSize = blockSize < IXML_ARENA_MIN_BLOCK
+		? IXML_ARENA_MIN_BLOCK
+		: blockSize;
+	arena->active = 1;
+	priv = (IXML_DocumentPrivate *)ixmlArena_alloc(
+		arena, sizeof(IXML_DocumentPrivate));
+	if (!priv) {
+		ixmlArena_free(arena);
+		return IXML_INSUFFICIENT_MEMORY;
+	}
+	ixmlDocument_init(&priv->doc);
+	priv->doc.n.nodeName = ixmlArena_documentName;
+	priv->doc.n.nodeType = eDOCUMENT_NODE;
+	priv->doc.n.ownerDocument = &priv->doc;
+	priv->arena = arena;
+	*rtDoc = &priv->doc;
+
+	return IXML_SUCCESS;
+}
+
+void ixmlDocument_endArena(IXML_Document *doc)
+{
+	IXML_Arena *arena = ixmlDocument_getArena(doc);
+
+	if (arena) {
+		arena->active = 0;
+	}
+}
+
+int ixmlDocument_isArena(const IXML_Document *doc)
+{
+	return doc && doc->n.nodeName == ixmlArena_documentName;
+}
+
+void ixmlDocument_freeArena(IXML_Document *doc)
+{
+	/* the document is in the arena */
+	ixmlArena_free(((IXML_DocumentPrivate *)doc)->arena);
+}
+
+void *ixmlDocument_malloc(IXML_Document *doc, size_t size)
+{
+	IXML_Arena *arena = ixmlDocument_getArena(doc);
+
+	if (arena && arena->active) {
+		return ixmlArena_alloc(arena, size);
+	}
+
+	return malloc(size);
+}
+
+char *ixmlDocument_strdup(IXML_Document *doc, const char *s)
+{
+	size_t size = strlen(s) + (size_t)1;
+	char *copy;
+
+	copy = (char *)ixmlDocument_malloc(doc, size);
+	if (copy) {
+		memcpy(copy, s, size);
+	}
+
+	return copy;
+}
+
+void ixmlDocument_release(IXML_Document *doc, void *p)
+{
+	IXML_Arena *arena = ixmlDocument_getArena(doc);
+
+	if (arena && arena->active) {
+		return;
+	}
+	free(p);
+}
+
+void ixmlDocument_releaseNode(IXML_Document *doc, IXML_Node *node)
+{
+	IXML_Arena *arena = ixmlDocument_getArena(doc);
+
+	if (arena && arena->active) {
+		return;
+	}
+	ixmlNode_free(node);
+}
@@ -57,7 +57,6 @@ static int ixml_membuf_set_size(
 	/*! [in] The new lenght. */
 	size_t new_length)
 {
-	size_t diff;
 	size_t alloc_len;
 	char *temp_buf;
 
@@ -69,17 +68,19 @@ static int ixml_membuf_set_size(
 			return 0;
 		}
 
-		diff = new_length - m->length;
-		alloc_len = MAXVAL(m->size_inc, diff) + m->capacity;
+		/* grow geometrically */
+		alloc_len = m->capacity + MAXVAL(m->capacity, m->size_inc);
+		alloc_len = MAXVAL(alloc_len, new_length);
 	} else {
 		/* decrease length */
 		assert(new_length <= m->length);
 
-		/* if diff is 0..m->size_inc, don't free */
-		if ((m->capacity - new_length) <= m->size_inc) {
+		/* only give memory back when most of it would be unused */
+		if ((m->capacity - new_length) <= m->size_inc ||
+			new_length >= m->capacity / (size_t)4) {
 			return 0;
 		}
-		alloc_len = new_length + m->size_inc;
+		alloc_len = (size_t)2 * new_length + m->size_inc;
 	}
 
 	assert(alloc_len >= new_length);
@@ -38,6 +38,7 @@
 
 #include "ixmlparser.h"
 
+#include "ixmlarena.h"
 #include "ixmldebug.h"
 
 #include <assert.h>
@@ -1734,7 +1735,8 @@ static int Parser_addNamespace(
 		if (pCur->namespaceUri) {
 			/* it would be wrong that pNode->namespace != NULL. */
 			assert(pNode->namespaceURI == NULL);
-			pNode->namespaceURI = safe_strdup(pCur->namespaceUri);
+			pNode->namespaceURI = ixmlDocument_strdup(
+				pNode->ownerDocument, pCur->namespaceUri);
 			if (!pNode->namespaceURI)
 				return IXML_INSUFFICIENT_MEMORY;
 		}
@@ -1746,7 +1748,8 @@ static int Parser_addNamespace(
 			return IXML_FAILED;
 		namespaceUri = Parser_getNameSpace(xmlParser, pCur->prefix);
 		if (namespaceUri) {
-			pNode->namespaceURI = safe_strdup(namespaceUri);
+			pNode->namespaceURI = ixmlDocument_strdup(
+				pNode->ownerDocument, namespaceUri);
 			if (!pNode->namespaceURI)
 				return IXML_INSUFFICIENT_MEMORY;
 			xmlParser->pNeedPrefixNode = NULL;
@@ -2220,7 +2223,8 @@ static int Parser_setElementNamespace(
 		if (newElement->n.namespaceURI != NULL) {
 			return IXML_SYNTAX_ERR;
 		} else {
-			(newElement->n).namespaceURI = safe_strdup(nsURI);
+			(newElement->n).namespaceURI = ixmlDocument_strdup(
+				newElement->n.ownerDocument, nsURI);
 			if ((newElement->n).namespaceURI == NULL) {
 				return IXML_INSUFFICIENT_MEMORY;
 			}
@@ -2285,14 +2289,14 @@ static int Parser_processAttributeName(
 
 	rc = ixmlNode_setNodeProperties((IXML_Node *)attr, newNode);
 	if (rc != IXML_SUCCESS) {
-		ixmlAttr_free(attr);
+		ixmlDocument_releaseNode(rootDoc, (IXML_Node *)attr);
 		return rc;
 	}
 
 	rc = ixmlElement_setAttributeNode(
 		(IXML_Element *)xmlParser->currentNodePtr, attr, NULL);
 	if (rc != IXML_SUCCESS) {
-		ixmlAttr_free(attr);
+		ixmlDocument_releaseNode(rootDoc, (IXML_Node *)attr);
 	}
 	return rc;
 }
@@ -2429,7 +2433,7 @@ static int Parser_processElementName(
 
 	rc = ixmlNode_setNodeProperties((IXML_Node *)newElement, newNode);
 	if (rc != IXML_SUCCESS) {
-		ixmlElement_free(newElement);
+		ixmlDocument_releaseNode(rootDoc, (IXML_Node *)newElement);
 		return rc;
 	}
 
@@ -2464,7 +2468,7 @@ static int Parser_processElementName(
 	rc = ixmlNode_appendChild(
 		xmlParser->currentNodePtr, (IXML_Node *)newElement);
 	if (rc != IXML_SUCCESS) {
-		ixmlElement_free(newElement);
+		ixmlDocument_releaseNode(rootDoc, (IXML_Node *)newElement);
 		return rc;
 	}
 
@@ -2569,7 +2573,9 @@ static int Parser_parseDocument(
 	/*! [out] The XML document. */
 	IXML_Document **retDoc,
 	/*! [in] The XML parser. */
-	Parser *xmlParser)
+	Parser *xmlParser,
+	/*! [in] 1 to build the document in an arena. */
+	int arena)
 {
 	IXML_Document *gRootDoc = NULL;
 	IXML_Node newNode;
@@ -2582,7 +2588,13 @@ static int Parser_parseDocument(
 	 * can go wrong on the error handler. */
 	ixmlNode_init(&newNode);
 
-	rc = ixmlDocument_createDocumentEx(&gRootDoc);
+	if (arena) {
+		/* nodes and strings take about twice the size of the text */
+		rc = ixmlDocument_createArenaDocument(
+			(size_t)2 * strlen(xmlParser->dataBuffer), &gRootDoc);
+	} else {
+		rc = ixmlDocument_createDocumentEx(&gRootDoc);
+	}
 	if (rc != IXML_SUCCESS) {
 		goto ErrorHandler;
 	}
@@ -2626,7 +2638,8 @@ static int Parser_parseDocument(
 						xmlParser->currentNodePtr,
 						tempNode);
 					if (rc != IXML_SUCCESS) {
-						ixmlNode_free(tempNode);
+						ixmlDocument_releaseNode(
+							gRootDoc, tempNode);
 						goto ErrorHandler;
 					}
 
@@ -2644,7 +2657,9 @@ static int Parser_parseDocument(
 						xmlParser->currentNodePtr,
 						(IXML_Node *)cdataSecNode);
 					if (rc != IXML_SUCCESS) {
-						ixmlNode_free((IXML_Node *)
+						ixmlDocument_releaseNode(
+							gRootDoc,
+							(IXML_Node *)
 								cdataSecNode);
 						goto ErrorHandler;
 					}
@@ -2689,6 +2704,7 @@ static int Parser_parseDocument(
 		goto ErrorHandler;
 	}
 
+	ixmlDocument_endArena(gRootDoc);
 	*retDoc = (IXML_Document *)gRootDoc;
 	Parser_free(xmlParser);
 	return rc;
@@ -2827,7 +2843,9 @@ int Parser_LoadDocument(
 	const char *xmlFileName,
 	/*! [in] 1 if you want to read from a file, 0 if xmlFileName is
 	 * the buffer to copy to the parser. */
-	int file)
+	int file,
+	/*! [in] 1 to build the document in an arena. */
+	int arena)
 {
 	int rc = IXML_SUCCESS;
 	Parser *xmlParser = NULL;
@@ -2844,10 +2862,296 @@ int Parser_LoadDocument(
 	}
 
 	xmlParser->curPtr = xmlParser->dataBuffer;
-	rc = Parser_parseDocument(retDoc, xmlParser);
+	rc = Parser_parseDocument(retDoc, xmlParser, arena);
 	return rc;
 }
 
+/*!
+ * \brief State of a streaming parse.
+ */
+struct _IXML_SaxParser
+{
+	/*! The tokenizer. Its data buffer holds the text not parsed yet. */
+	Parser *xmlParser;
+	/*! Length of the text in the data buffer. */
+	size_t length;
+	/*! Size of the data buffer. */
+	size_t size;
+	/*! The callbacks. */
+	IXML_SaxHandler handler;
+	/*! Passed to the callbacks. */
+	void *cookie;
+	/*! The result that stopped the parse, or IXML_SUCCESS. */
+	int status;
+};
+
+/*!
+ * \brief Appends a chunk of text to the data buffer of a streaming parse,
+ * after dropping the text already parsed.
+ *
+ * \return IXML_SUCCESS or an error code.
+ */
+static int Parser_saxAppend(
+	/*! [in] The streaming parser. */
+	IXML_SaxParser *saxParser,
+	/*! [in] The chunk of text. */
+	const char *chunk,
+	/*! [in] The length of the chunk. */
+	size_t length)
+{
+	Parser *xmlParser = saxParser->xmlParser;
+	size_t parsed;
+	size_t size;
+	char *data;
+
+	if (length > (size_t)0 && memchr(chunk, '\0', length) != NULL) {
+		return IXML_SYNTAX_ERR;
+	}
+	/* the prolog is parsed again until the root element starts */
+	if (xmlParser->bHasTopLevel) {
+		parsed = (size_t)(xmlParser->curPtr - xmlParser->dataBuffer);
+		saxParser->length -= parsed;
+		memmove(xmlParser->dataBuffer,
+			xmlParser->curPtr,
+			saxParser->length + (size_t)1);
+	}
+	if (saxParser->length + length >= saxParser->size) {
+		size = saxParser->size ? saxParser->size : (size_t)1024;
+		while (saxParser->length + length >= size) {
+			size *= (size_t)2;
+		}
+		data = (char *)realloc(xmlParser->dataBuffer, size);
+		if (data == NULL) {
+			return IXML_INSUFFICIENT_MEMORY;
+		}
+		xmlParser->dataBuffer = data;
+		saxParser->size = size;
+	}
+	if (length > (size_t)0) {
+		memcpy(xmlParser->dataBuffer + saxParser->length, chunk, length);
+	}
+	saxParser->length += length;
+	xmlParser->dataBuffer[saxParser->length] = '\0';
+	xmlParser->curPtr = xmlParser->dataBuffer;
+
+	return IXML_SUCCESS;
+}
+
+/*!
+ * \brief Decides whether a node read by Parser_getNextNode() may have been
+ * cut by the end of the text received so far.
+ *
+ * \return 1 if the node must be read again with more text.
+ */
+static int Parser_saxIncomplete(
+	/*! [in] The XML parser. */
+	Parser *xmlParser,
+	/*! [in] The node read. */
+	IXML_Node *node,
+	/*! [in] The result of Parser_getNextNode(). */
+	int rc)
+{
+	if (rc != IXML_SUCCESS) {
+		/* maybe a token was missing */
+		return 1;
+	}
+	if (*(xmlParser->curPtr) != '\0') {
+		return 0;
+	}
+	/* text only ends at markup, and markup ends with '>' */
+	return node->nodeType == eTEXT_NODE ||
+	       xmlParser->curPtr == xmlParser->dataBuffer ||
+	       *(xmlParser->curPtr - 1) != GREATERTHAN;
+}
+
+/*!
+ * \brief Checks a node read by a streaming parse and reports it.
+ *
+ * \return IXML_SUCCESS, an error code, or the result of the callback.
+ */
+static int Parser_saxReport(
+	/*! [in] The streaming parser. */
+	IXML_SaxParser *saxParser,
+	/*! [in] The node read. */
+	IXML_Node *node,
+	/*! [in] 1 if the node is the end of an element. */
+	int bETag)
+{
+	Parser *xmlParser = saxParser->xmlParser;
+	const IXML_SaxHandler *handler = &saxParser->handler;
+	int rc;
+
+	if (bETag) {
+		/* end tag, or end of an empty element */
+		if (!Parser_isValidEndElement(xmlParser, node)) {
+			return IXML_SYNTAX_ERR;
+		}
+		Parser_popElement(xmlParser);
+		xmlParser->state = eCONTENT;
+		if (handler->endElement == NULL) {
+			return IXML_SUCCESS;
+		}
+		return handler->endElement(saxParser->cookie, node->nodeName);
+	}
+
+	switch (node->nodeType) {
+	case eELEMENT_NODE:
+		if (xmlParser->bHasTopLevel) {
+			if (isTopLevelElement(xmlParser)) {
+				return IXML_SYNTAX_ERR;
+			}
+		} else {
+			xmlParser->bHasTopLevel = 1;
+		}
+		rc = Parser_pushElement(xmlParser, node);
+		if (rc != IXML_SUCCESS || handler->startElement == NULL) {
+			return rc;
+		}
+		return handler->startElement(saxParser->cookie, node->nodeName);
+	case eATTRIBUTE_NODE:
+		if (handler->attribute == NULL) {
+			return IXML_SUCCESS;
+		}
+		return handler->attribute(
+			saxParser->cookie, node->nodeName, node->nodeValue);
+	case eTEXT_NODE:
+	case eCDATA_SECTION_NODE:
+		/* a document can not have text children */
+		if (isTopLevelElement(xmlParser)) {
+			return IXML_SYNTAX_ERR;
+		}
+		if (handler->text == NULL) {
+			return IXML_SUCCESS;
+		}
+		return handler->text(saxParser->cookie, node->nodeValue);
+	default:
+		return IXML_SUCCESS;
+	}
+}
+
+/*!
+ * \brief Reports the nodes of the text received so far by a streaming parse.
+ *
+ * \return IXML_SUCCESS, an error code, or the result of a callback.
+ */
+static int Parser_saxParse(
+	/*! [in] The streaming parser. */
+	IXML_SaxParser *saxParser,
+	/*! [in] 1 if all the text was received. */
+	int isFinal)
+{
+	Parser *xmlParser = saxParser->xmlParser;
+	IXML_Node node;
+	PARSER_STATE state;
+	char *start;
+	int bETag;
+	int rc;
+
+	if (!xmlParser->bHasTopLevel) {
+		xmlParser->state = eELEMENT;
+		rc = Parser_skipProlog(xmlParser);
+		if (rc != IXML_SUCCESS) {
+			return isFinal ? rc : IXML_SUCCESS;
+		}
+	}
+
+	for (;;) {
+		start = xmlParser->curPtr;
+		state = xmlParser->state;
+		bETag = 0;
+		ixmlNode_init(&node);
+		rc = Parser_getNextNode(xmlParser, &node, &bETag);
+		if (rc == IXML_FILE_DONE) {
+			/* all the text is parsed */
+			Parser_freeNodeContent(&node);
+			break;
+		}
+		if (!isFinal && Parser_saxIncomplete(xmlParser, &node, rc)) {
+			/* read the node again with the next chunk */
+			Parser_freeNodeContent(&node);
+			xmlParser->curPtr = start;
+			xmlParser->state = state;
+			return IXML_SUCCESS;
+		}
+		if (rc == IXML_SUCCESS) {
+			rc = Parser_saxReport(saxParser, &node, bETag);
+		}
+		Parser_freeNodeContent(&node);
+		if (rc != IXML_SUCCESS) {
+			return rc;
+		}
+	}
+
+	if (isFinal &&
+		(!xmlParser->bHasTopLevel || xmlParser->pCurElement != NULL)) {
+		return IXML_SYNTAX_ERR;
+	}
+
+	return IXML_SUCCESS;
+}
+
+IXML_SaxParser *ixmlSaxParser_create(
+	const IXML_SaxHandler *handler, void *cookie)
+{
+	IXML_SaxParser *saxParser;
+
+	if (handler == NULL) {
+		return NULL;
+	}
+	saxParser = (IXML_SaxParser *)malloc(sizeof(IXML_SaxParser));
+	if (saxParser == NULL) {
+		return NULL;
+	}
+	memset(saxParser, 0, sizeof(IXML_SaxParser));
+	saxParser->xmlParser = Parser_init();
+	if (saxParser->xmlParser == NULL) {
+		free(saxParser);
+		return NULL;
+	}
+	saxParser->handler = *handler;
+	saxParser->cookie = cookie;
+	saxParser->status = IXML_SUCCESS;
+
+	return saxParser;
+}
+
+int ixmlSaxParser_parse(
+	IXML_SaxParser *saxParser, const char *chunk, size_t length, int isFinal)
+{
+	int rc;
+
+	if (saxParser == NULL || (chunk == NULL && length > (size_t)0)) {
+		return IXML_INVALID_PARAMETER;
+	}
+	if (saxParser->status != IXML_SUCCESS) {
+		return saxParser->status;
+	}
+
+	rc = Parser_saxAppend(saxParser, chunk, length);
+	/* no node can be complete before the next '>' */
+	if (rc == IXML_SUCCESS &&
+		(isFinal || (length > (size_t)0 &&
+				    memchr(chunk, GREATERTHAN, length)))) {
+		rc = Parser_saxParse(saxParser, isFinal);
+	}
+	if (rc != IXML_SUCCESS) {
+		saxParser->status = rc;
+	} else if (isFinal) {
+		saxParser->status = IXML_FILE_DONE;
+	}
+
+	return rc;
+}
+
+void ixmlSaxParser_free(IXML_SaxParser *saxParser)
+{
+	if (saxParser == NULL) {
+		return;
+	}
+	Parser_free(saxParser->xmlParser);
+	free(saxParser);
+}
+
 void Parser_freeNodeContent(IXML_Node *nodeptr)
 {
 	if (nodeptr == NULL) {
@@ -34,6 +34,7 @@
  * \file
  */
 
+#include "ixmlarena.h"
 #include "ixmlparser.h"
 
 #include <assert.h>
@@ -131,6 +132,12 @@ void ixmlNode_free(IXML_Node *nodeptr)
 	IXML_Node *curr_attr;
 	IXML_Node *next_attr;
 
+	if (nodeptr && nodeptr->nodeType == eDOCUMENT_NODE &&
+		ixmlDocument_isArena((IXML_Document *)nodeptr)) {
+		/* read-only, so all its nodes are in the arena */
+		ixmlDocument_freeArena((IXML_Document *)nodeptr);
+		return;
+	}
 	if (nodeptr) {
 #ifdef IXML_HAVE_SCRIPTSUPPORT
 		IXML_BeforeFreeNode_t hndlr = Parser_getBeforeFree();
@@ -1160,12 +1167,10 @@ IXML_NodeList *ixmlNode_getChildNodes(IXML_Node *nodeptr)
 	if (!nodeptr) {
 		return NULL;
 	}
-	newNodeList = (IXML_NodeList *)malloc(sizeof(IXML_NodeList));
+	newNodeList = ixmlNodeList_new();
 	if (!newNodeList) {
 		return NULL;
 	}
-
-	ixmlNodeList_init(newNodeList);
 	tempNode = nodeptr->firstChild;
 	while (tempNode) {
 		rc = ixmlNodeList_addToNodeList(&newNodeList, tempNode);
@@ -1383,8 +1388,37 @@ int ixmlNode_setNodeName(IXML_Node *node, const DOMString qualifiedName)
 	return rc;
 }
 
+/*!
+ * \brief Sets a string of a node that is being built.
+ *
+ * The string is allocated like the node, in the arena of the owner document
+ * while the parser builds it.
+ *
+ * \return IXML_SUCCESS or IXML_INSUFFICIENT_MEMORY.
+ */
+static int ixmlNode_setBuildString(
+	/*! [in] The node. */
+	IXML_Node *nodeptr,
+	/*! [in,out] The string field of the node. */
+	char **field,
+	/*! [in] The new value, can be NULL. */
+	const char *value)
+{
+	ixmlDocument_release(nodeptr->ownerDocument, *field);
+	*field = NULL;
+	if (value) {
+		*field = ixmlDocument_strdup(nodeptr->ownerDocument, value);
+		if (!*field) {
+			return IXML_INSUFFICIENT_MEMORY;
+		}
+	}
+
+	return IXML_SUCCESS;
+}
+
 int ixmlNode_setNodeProperties(IXML_Node *destNode, IXML_Node *src)
 {
+	IXML_Document *doc;
 	int rc;
 
 	assert(destNode && src);
@@ -1392,17 +1426,19 @@ int ixmlNode_setNodeProperties(IXML_Node *destNode, IXML_Node *src)
 		return IXML_INVALID_PARAMETER;
 	}
 
-	rc = ixmlNode_setNodeValue(destNode, src->nodeValue);
+	rc = ixmlNode_setBuildString(
+		destNode, &destNode->nodeValue, src->nodeValue);
 	if (rc != IXML_SUCCESS) {
 		goto ErrorHandler;
 	}
 
-	rc = ixmlNode_setLocalName(destNode, src->localName);
+	rc = ixmlNode_setBuildString(
+		destNode, &destNode->localName, src->localName);
 	if (rc != IXML_SUCCESS) {
 		goto ErrorHandler;
 	}
 
-	rc = ixmlNode_setPrefix(destNode, src->prefix);
+	rc = ixmlNode_setBuildString(destNode, &destNode->prefix, src->prefix);
 	if (rc != IXML_SUCCESS) {
 		goto ErrorHandler;
 	}
@@ -1412,18 +1448,13 @@ int ixmlNode_setNodeProperties(IXML_Node *destNode, IXML_Node *src)
 	return IXML_SUCCESS;
 
 ErrorHandler:
-	if (destNode->nodeName) {
-		free(destNode->nodeName);
-		destNode->nodeName = NULL;
-	}
-	if (destNode->nodeValue) {
-		free(destNode->nodeValue);
-		destNode->nodeValue = NULL;
-	}
-	if (destNode->localName) {
-		free(destNode->localName);
-		destNode->localName = NULL;
-	}
+	doc = destNode->ownerDocument;
+	ixmlDocument_release(doc, destNode->nodeName);
+	destNode->nodeName = NULL;
+	ixmlDocument_release(doc, destNode->nodeValue);
+	destNode->nodeValue = NULL;
+	ixmlDocument_release(doc, destNode->localName);
+	destNode->localName = NULL;
 
 	return IXML_INSUFFICIENT_MEMORY;
 }
@@ -37,8 +37,80 @@
 #include "ixmlparser.h"
 
 #include <assert.h>
+#include <stddef.h> /* for offsetof() */
 #include <string.h>
 
+/*! Number of nodes a list can hold when it is allocated. */
+#define IXML_NODELIST_MIN_SIZE 8lu
+
+/*!
+ * \brief A node list as allocated by the library.
+ *
+ * The links of the list are the cells of one array, still chained through
+ * their \b next field, so that IXML_NodeList keeps its layout while
+ * ixmlNodeList_item() and adding a node take constant time. The list handed
+ * out is the first cell.
+ */
+typedef struct _IXML_NodeListPrivate
+{
+	/*! Number of nodes in the list. */
+	unsigned long length;
+	/*! Number of cells allocated. */
+	unsigned long size;
+	/*! The cells. */
+	IXML_NodeList cells[1];
+} IXML_NodeListPrivate;
+
+/*!
+ * \brief Returns the private part of a list allocated by the library.
+ */
+#define ixmlNodeList_private(nList) \
+	((IXML_NodeListPrivate *)((char *)(nList) - \
+		offsetof(IXML_NodeListPrivate, cells)))
+
+/*!
+ * \brief Allocates or grows the cells of a list.
+ *
+ * \return The list, or NULL if there is not enough memory.
+ */
+static IXML_NodeListPrivate *ixmlNodeList_realloc(
+	/*! [in] The list to grow, or NULL to allocate one. */
+	IXML_NodeListPrivate *priv,
+	/*! [in] Number of cells. */
+	unsigned long size)
+{
+	unsigned long length = priv ? priv->length : 0lu;
+	unsigned long i;
+
+	priv = (IXML_NodeListPrivate *)realloc(priv,
+		offsetof(IXML_NodeListPrivate, cells) +
+			size * sizeof(IXML_NodeList));
+	if (!priv) {
+		return NULL;
+	}
+	priv->length = length;
+	priv->size = size;
+	/* the cells may have moved */
+	for (i = 1lu; i < length; ++i) {
+		priv->cells[i - 1lu].next = &priv->cells[i];
+	}
+
+	return priv;
+}
+
+IXML_NodeList *ixmlNodeList_new(void)
+{
+	IXML_NodeListPrivate *priv;
+
+	priv = ixmlNodeList_realloc(NULL, IXML_NODELIST_MIN_SIZE);
+	if (!priv) {
+		return NULL;
+	}
+	ixmlNodeList_init(&priv->cells[0]);
+
+	return &priv->cells[0];
+}
+
 void ixmlNodeList_init(IXML_NodeList *nList)
 {
 	assert(nList);
@@ -48,35 +120,22 @@ void ixmlNodeList_init(IXML_NodeList *nList)
 
 IXML_Node *ixmlNodeList_item(IXML_NodeList *nList, unsigned long index)
 {
-	IXML_NodeList *next;
-	unsigned int i;
-
 	/* if the list ptr is NULL */
 	if (!nList) {
 		return NULL;
 	}
 	/* if index is more than list length */
-	if (index > ixmlNodeList_length(nList) - 1lu) {
-		return NULL;
-	}
-
-	next = nList;
-	for (i = 0u; i < index && next; ++i) {
-		next = next->next;
-	}
-
-	if (!next) {
+	if (index >= ixmlNodeList_private(nList)->length) {
 		return NULL;
 	}
 
-	return next->nodeItem;
+	return nList[index].nodeItem;
 }
 
 int ixmlNodeList_addToNodeList(IXML_NodeList **nList, IXML_Node *add)
 {
-	IXML_NodeList *traverse = NULL;
-	IXML_NodeList *p = NULL;
-	IXML_NodeList *newListItem;
+	IXML_NodeListPrivate *priv;
+	IXML_NodeList *cell;
 
 	assert(add);
 
@@ -86,56 +145,44 @@ int ixmlNodeList_addToNodeList(IXML_NodeList **nList, IXML_Node *add)
 
 	if (!*nList) {
 		/* nodelist is empty */
-		*nList = (IXML_NodeList *)malloc(sizeof(IXML_NodeList));
+		*nList = ixmlNodeList_new();
 		if (!*nList) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
-
-		ixmlNodeList_init(*nList);
 	}
 
-	if (!(*nList)->nodeItem) {
-		(*nList)->nodeItem = add;
-	} else {
-		traverse = *nList;
-		while (traverse) {
-			p = traverse;
-			traverse = traverse->next;
-		}
-
-		newListItem = (IXML_NodeList *)malloc(sizeof(IXML_NodeList));
-		if (!newListItem) {
+	priv = ixmlNodeList_private(*nList);
+	if (priv->length == priv->size) {
+		priv = ixmlNodeList_realloc(priv, 2lu * priv->size);
+		if (!priv) {
 			return IXML_INSUFFICIENT_MEMORY;
 		}
-		p->next = newListItem;
-		newListItem->nodeItem = add;
-		newListItem->next = NULL;
+		*nList = &priv->cells[0];
 	}
+	cell = &priv->cells[priv->length];
+	cell->nodeItem = add;
+	cell->next = NULL;
+	if (priv->length > 0lu) {
+		priv->cells[priv->length - 1lu].next = cell;
+	}
+	++priv->length;
 
 	return IXML_SUCCESS;
 }
 
 unsigned long ixmlNodeList_length(IXML_NodeList *nList)
 {
-	IXML_NodeList *list;
-	unsigned long length = 0lu;
-
-	list = nList;
-	while (list) {
-		++length;
-		list = list->next;
+	if (!nList) {
+		return 0lu;
 	}
 
-	return length;
+	return ixmlNodeList_private(nList)->length;
 }
 
 void ixmlNodeList_free(IXML_NodeList *nList)
 {
-	IXML_NodeList *next;
-
-	while (nList) {
-		next = nList->next;
-		free(nList);
-		nList = next;
+	if (!nList) {
+		return;
 	}
+	free(ixmlNodeList_private(nList));
 }
@@ -71,6 +71,381 @@ static const char *get_ixml_error_string(IXML_ERRORCODE code)
 #undef CASE
 }
 
+/*
+ * Parses a printed document again in an arena, checks that it prints the same,
+ * and that a copy of its root element imported by another document survives
+ * it.
+ */
+static int check_arena(const char *printed)
+{
+	IXML_Document *doc = NULL;
+	IXML_Document *heapDoc = NULL;
+	IXML_Node *root;
+	IXML_Node *imported = NULL;
+	DOMString s;
+	DOMString before = NULL;
+	int rc;
+
+	if (ixmlParseBufferArena(printed, &doc) != IXML_SUCCESS) {
+		return -1;
+	}
+	s = ixmlPrintDocument(doc);
+	rc = s == NULL || strcmp(s, printed) != 0;
+	ixmlFreeDOMString(s);
+	root = ixmlNode_getFirstChild((IXML_Node *)doc);
+	while (root && ixmlNode_getNodeType(root) != eELEMENT_NODE) {
+		root = ixmlNode_getNextSibling(root);
+	}
+	if (root && ixmlDocument_createDocumentEx(&heapDoc) == IXML_SUCCESS) {
+		before = ixmlPrintNode(root);
+		if (ixmlDocument_importNode(heapDoc, root, 1, &imported) !=
+				IXML_SUCCESS ||
+			ixmlNode_getOwnerDocument(imported) != heapDoc) {
+			rc = 1;
+		}
+	}
+	ixmlDocument_free(doc);
+	if (imported) {
+		ixmlNode_appendChild((IXML_Node *)heapDoc, imported);
+		s = ixmlPrintNode(imported);
+		if (s == NULL || before == NULL || strcmp(s, before) != 0) {
+			rc = 1;
+		}
+		ixmlFreeDOMString(s);
+	}
+	ixmlFreeDOMString(before);
+	ixmlDocument_free(heapDoc);
+
+	return rc ? -1 : 0;
+}
+
+/*
+ * Changes and frees a node removed from its document after the document is
+ * freed, which must not look at the document. Relies on the memory checker
+ * the test runs under to catch any access to it.
+ */
+static int check_heap_free(void)
+{
+	IXML_Document *doc = NULL;
+	IXML_Element *element = NULL;
+	IXML_Node *removed = NULL;
+
+	if (ixmlDocument_createDocumentEx(&doc) != IXML_SUCCESS ||
+		ixmlDocument_createElementEx(doc, "a", &element) !=
+			IXML_SUCCESS ||
+		ixmlNode_appendChild((IXML_Node *)doc, (IXML_Node *)element) !=
+			IXML_SUCCESS ||
+		ixmlNode_removeChild((IXML_Node *)doc,
+			(IXML_Node *)element,
+			&removed) != IXML_SUCCESS) {
+		return -1;
+	}
+	ixmlDocument_free(doc);
+	ixmlNode_setNodeValue(removed, "value");
+	ixmlNode_free(removed);
+
+	return 0;
+}
+
+/*
+ * Checks that the node lists of a document hold the nodes of the tree in
+ * order.
+ */
+static int check_node_lists(IXML_Document *doc)
+{
+	IXML_NodeList *list;
+	IXML_NodeList *children;
+	IXML_NodeList *cell;
+	IXML_Node *n;
+	unsigned long i = 0lu;
+	int rc = 0;
+
+	list = ixmlDocument_getElementsByTagName(doc, "*");
+	children = ixmlNode_getChildNodes((IXML_Node *)doc);
+	/* preorder walk of the tree, without recursion */
+	n = ixmlNode_getFirstChild((IXML_Node *)doc);
+	while (n && rc == 0) {
+		if (ixmlNode_getNodeType(n) == eELEMENT_NODE &&
+			ixmlNodeList_item(list, i++) != n) {
+			rc = -1;
+		}
+		if (ixmlNode_getFirstChild(n)) {
+			n = ixmlNode_getFirstChild(n);
+			continue;
+		}
+		while (n && !ixmlNode_getNextSibling(n)) {
+			n = ixmlNode_getParentNode(n);
+		}
+		if (n) {
+			n = ixmlNode_getNextSibling(n);
+		}
+	}
+	if (ixmlNodeList_length(list) != i || ixmlNodeList_item(list, i)) {
+		rc = -1;
+	}
+	i = 0lu;
+	for (n = ixmlNode_getFirstChild((IXML_Node *)doc); n;
+		n = ixmlNode_getNextSibling(n)) {
+		if (ixmlNodeList_item(children, i++) != n) {
+			rc = -1;
+		}
+	}
+	if (ixmlNodeList_length(children) != i) {
+		rc = -1;
+	}
+	/* the links still chain the same nodes */
+	i = 0lu;
+	for (cell = list; cell && cell->nodeItem; cell = cell->next) {
+		if (cell->nodeItem != ixmlNodeList_item(list, i++)) {
+			rc = -1;
+		}
+	}
+	if (cell || ixmlNodeList_length(list) != i) {
+		rc = -1;
+	}
+	ixmlNodeList_free(children);
+	ixmlNodeList_free(list);
+
+	return rc;
+}
+
+/*
+ * Checks the list of a node without children: it is empty, and is still a
+ * single link without a node.
+ */
+static int check_empty_node_list(void)
+{
+	IXML_Document *doc = NULL;
+	IXML_Element *element = NULL;
+	IXML_NodeList *children;
+	int rc = 0;
+
+	if (ixmlDocument_createDocumentEx(&doc) != IXML_SUCCESS) {
+		return -1;
+	}
+	if (ixmlDocument_createElementEx(doc, "a", &element) != IXML_SUCCESS) {
+		ixmlDocument_free(doc);
+		return -1;
+	}
+	children = ixmlNode_getChildNodes((IXML_Node *)element);
+	if (!children || ixmlNodeList_length(children) != 0lu ||
+		ixmlNodeList_item(children, 0lu) || children->nodeItem ||
+		children->next) {
+		rc = -1;
+	}
+	ixmlNodeList_free(children);
+	ixmlElement_free(element);
+	ixmlDocument_free(doc);
+
+	return rc;
+}
+
+/* Events of a streaming parse, one per line. */
+struct events
+{
+	char *buf;
+	size_t length;
+	size_t size;
+	/* number of elements to report before stopping, or -1 */
+	int stopAfter;
+};
+
+static int add_event(
+	struct events *e, char kind, const char *name, const char *value)
+{
+	size_t needed = strlen(name) + strlen(value) + 5;
+	char *buf;
+
+	if (e->length + needed > e->size) {
+		e->size = 2 * (e->length + needed);
+		buf = realloc(e->buf, e->size);
+		if (!buf) {
+			return IXML_INSUFFICIENT_MEMORY;
+		}
+		e->buf = buf;
+	}
+	e->length += (size_t)sprintf(
+		e->buf + e->length, "%c %s %s\n", kind, name, value);
+
+	return IXML_SUCCESS;
+}
+
+static int on_start(void *cookie, const char *name)
+{
+	struct events *e = cookie;
+
+	if (e->stopAfter == 0) {
+		return IXML_FILE_DONE;
+	}
+	e->stopAfter--;
+	return add_event(e, 'S', name, "");
+}
+
+static int on_attribute(void *cookie, const char *name, const char *value)
+{
+	return add_event(cookie, 'A', name, value);
+}
+
+static int on_text(void *cookie, const char *value)
+{
+	return add_event(cookie, 'T', "", value);
+}
+
+static int on_end(void *cookie, const char *name)
+{
+	return add_event(cookie, 'E', name, "");
+}
+
+/* Lists the events a streaming parse must report for a tree. */
+static int tree_events(struct events *e, IXML_Node *n)
+{
+	IXML_Node *attr;
+	int rc = IXML_SUCCESS;
+
+	for (; n && rc == IXML_SUCCESS; n = n->nextSibling) {
+		switch (n->nodeType) {
+		case eELEMENT_NODE:
+			rc = add_event(e, 'S', n->nodeName, "");
+			for (attr = n->firstAttr; attr && rc == IXML_SUCCESS;
+				attr = attr->nextSibling) {
+				rc = add_event(
+					e, 'A', attr->nodeName, attr->nodeValue);
+			}
+			if (rc == IXML_SUCCESS) {
+				rc = tree_events(e, n->firstChild);
+			}
+			if (rc == IXML_SUCCESS) {
+				rc = add_event(e, 'E', n->nodeName, "");
+			}
+			break;
+		case eTEXT_NODE:
+		case eCDATA_SECTION_NODE:
+			rc = add_event(e, 'T', "", n->nodeValue);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return rc;
+}
+
+/*
+ * Parses a printed document with the streaming parser, in chunks of
+ * several sizes, and checks that it reports the nodes of its tree.
+ */
+static int check_sax(const char *printed)
+{
+	static const size_t chunks[] = {1, 2, 7, 64, 0};
+	IXML_SaxHandler handler = {on_start, on_attribute, on_text, on_end};
+	IXML_SaxParser *saxParser;
+	IXML_Document *doc = NULL;
+	struct events expected = {NULL, 0, 0, -1};
+	struct events e;
+	size_t length = strlen(printed);
+	size_t offset;
+	size_t chunk;
+	size_t i;
+	int rc;
+
+	rc = ixmlParseBufferEx(printed, &doc);
+	if (rc == IXML_SUCCESS) {
+		rc = tree_events(&expected, doc->n.firstChild);
+	}
+	ixmlDocument_free(doc);
+	for (i = 0; rc == IXML_SUCCESS && i < sizeof chunks / sizeof *chunks;
+		i++) {
+		memset(&e, 0, sizeof e);
+		e.stopAfter = -1;
+		if (chunks[i] == 0) {
+			/* whole buffer */
+			rc = ixmlParseBufferSax(printed, &handler, &e);
+		} else {
+			saxParser = ixmlSaxParser_create(&handler, &e);
+			for (offset = 0; rc == IXML_SUCCESS && offset < length;
+				offset += chunk) {
+				chunk = length - offset < chunks[i]
+					? length - offset
+					: chunks[i];
+				rc = ixmlSaxParser_parse(
+					saxParser, printed + offset, chunk, 0);
+			}
+			if (rc == IXML_SUCCESS) {
+				rc = ixmlSaxParser_parse(saxParser, NULL, 0, 1);
+			}
+			ixmlSaxParser_free(saxParser);
+		}
+		if (rc == IXML_SUCCESS &&
+			(e.length != expected.length ||
+				memcmp(e.buf, expected.buf, e.length) != 0)) {
+			rc = IXML_FAILED;
+		}
+		free(e.buf);
+	}
+	if (rc == IXML_SUCCESS) {
+		/* stop at the second element */
+		memset(&e, 0, sizeof e);
+		e.stopAfter = 1;
+		rc = ixmlParseBufferSax(printed, &handler, &e);
+		if (rc == IXML_SUCCESS) {
+			/* a single element */
+			rc = e.length == expected.length ? IXML_SUCCESS
+							 : IXML_FAILED;
+		} else if (rc == IXML_FILE_DONE) {
+			rc = memcmp(e.buf, expected.buf, e.length) == 0
+				? IXML_SUCCESS
+				: IXML_FAILED;
+		}
+		free(e.buf);
+	}
+	free(expected.buf);
+
+	return rc == IXML_SUCCESS ? 0 : -1;
+}
+
+/*
+ * Checks that text and attribute values are escaped, with the characters to
+ * escape at both ends and in the middle of long runs of plain text.
+ */
+static int check_escape(void)
+{
+	static const char value[] = "<0123456789abcdef&0123456789abcde'"
+				    "0123456789abcdef0123456789abcdef\">";
+	static const char expected[] =
+		"<e a=\"&lt;0123456789abcdef&amp;0123456789abcde&apos;"
+		"0123456789abcdef0123456789abcdef&quot;&gt;\">"
+		"&lt;0123456789abcdef&amp;0123456789abcde&apos;"
+		"0123456789abcdef0123456789abcdef&quot;&gt;</e>";
+	IXML_Document *doc = NULL;
+	IXML_Element *element = NULL;
+	IXML_Node *text = NULL;
+	DOMString s = NULL;
+	int rc = -1;
+
+	if (ixmlDocument_createDocumentEx(&doc) != IXML_SUCCESS) {
+		return -1;
+	}
+	if (ixmlDocument_createElementEx(doc, "e", &element) != IXML_SUCCESS ||
+		ixmlElement_setAttribute(element, "a", value) != IXML_SUCCESS ||
+		ixmlDocument_createTextNodeEx(doc, value, &text) !=
+			IXML_SUCCESS ||
+		ixmlNode_appendChild((IXML_Node *)element, text) !=
+			IXML_SUCCESS) {
+		goto exit_function;
+	}
+	text = NULL;
+	s = ixmlNodetoString((IXML_Node *)element);
+	rc = s == NULL || strcmp(s, expected) != 0 ? -1 : 0;
+
+exit_function:
+	ixmlFreeDOMString(s);
+	ixmlNode_free(text);
+	ixmlElement_free(element);
+	ixmlDocument_free(doc);
+
+	return rc;
+}
+
 int main(int argc, char *argv[])
 {
 	int i;
@@ -80,6 +455,30 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	printf("Escaping ... ");
+	fflush(stdout);
+	if (check_escape() != 0) {
+		fprintf(stderr, "** error : wrong escaped text\n");
+		exit(EXIT_FAILURE);
+	}
+	printf("OK\n");
+
+	printf("Empty node list ... ");
+	fflush(stdout);
+	if (check_empty_node_list() != 0) {
+		fprintf(stderr, "** error : wrong empty node list\n");
+		exit(EXIT_FAILURE);
+	}
+	printf("OK\n");
+
+	printf("Freeing heap nodes ... ");
+	fflush(stdout);
+	if (check_heap_free() != 0) {
+		fprintf(stderr, "** error : cannot build heap nodes\n");
+		exit(EXIT_FAILURE);
+	}
+	printf("OK\n");
+
 	for (i = 1; i < argc; i++) {
 		int rc;
 		IXML_Document *doc = NULL;
@@ -127,6 +526,44 @@ int main(int argc, char *argv[])
 
 		printf("OK\n");
 
+		printf("    Node lists ... ");
+		fflush(stdout);
+
+		if (check_node_lists(doc) != 0) {
+			fprintf(stderr,
+				"** error : node lists of '%s' do not match "
+				"the tree\n",
+				argv[i]);
+			exit(EXIT_FAILURE);
+		}
+
+		printf("OK\n");
+
+		printf("    Streaming ... ");
+		fflush(stdout);
+
+		if (check_sax(s) != 0) {
+			fprintf(stderr,
+				"** error : streaming parse of '%s' does not "
+				"match the tree\n",
+				argv[i]);
+			exit(EXIT_FAILURE);
+		}
+
+		printf("OK\n");
+
+		printf("    Arena ... ");
+		fflush(stdout);
+
+		if (check_arena(s) != 0) {
+			fprintf(stderr,
+				"** error : arena document differs '%s'\n",
+				argv[i]);
+			exit(EXIT_FAILURE);
+		}
+
+		printf("OK\n");
+
 		ixmlFreeDOMString(s);
 		ixmlDocument_free(doc);
 	}
@@ -1161,6 +1161,68 @@ UPNP_EXPORT_SPEC int UpnpSendAdvertisementLowPower(
 	/*! RegistrationState as defined by UPnP Low Power. */
 	int RegistrationState);
 
+/*!
+ * \brief Sets how much the periodic advertisements of a device are spread.
+ *
+ * Every renewal of the advertisements started by \b UpnpSendAdvertisement is
+ * sent up to \b Jitter percent of the renewal interval earlier, at random, so
+ * that devices registered at the same time do not keep advertising at the
+ * same time. The default is \c SSDP_ADVERTISE_JITTER. It applies from the
+ * next renewal scheduled.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid device
+ *             handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Jitter is not between 0 and 100.
+ */
+UPNP_EXPORT_SPEC int UpnpSetAdvertisementJitter(
+	/*! The device handle. */
+	UpnpDevice_Handle Hnd,
+	/*! The percentage of the renewal interval, 0 to renew on time. */
+	int Jitter);
+
+/*!
+ * \brief Sets the budget of the periodic advertisements of all the devices.
+ *
+ * Renewals of the advertisements are delayed so that, together, they do not
+ * send more than \b PacketsPerSecond SSDP packets per second, counting every
+ * copy. The advertisements sent by \b UpnpSendAdvertisement itself, and the
+ * replies to searches, are never delayed. A budget too small for the devices
+ * can delay the renewals past the expiration of the advertisements. The
+ * default is \c SSDP_ADVERTISE_RATE; \b UpnpInit2 restores it.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b PacketsPerSecond is negative.
+ */
+UPNP_EXPORT_SPEC int UpnpSetAdvertisementRate(
+	/*! The budget in packets per second, 0 for no budget. */
+	int PacketsPerSecond);
+
+/*!
+ * \brief Returns the statistics of the periodic advertisements of all the
+ * devices since the SDK was initialized.
+ *
+ * Only the renewals that were sent are counted; the ones cancelled by
+ * \b UpnpSendAdvertisement or by unregistering the device are not.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ */
+UPNP_EXPORT_SPEC int UpnpGetAdvertisementStats(
+	/*! [out] Number of renewals, or NULL. */
+	unsigned long *Rounds,
+	/*! [out] Number of packets of the renewals, counting every copy, or
+	 * NULL. */
+	unsigned long *Packets,
+	/*! [out] Number of renewals delayed by the budget, or NULL. */
+	unsigned long *Deferred,
+	/*! [out] Longest delay of a renewal, in milliseconds, or NULL. */
+	unsigned long *MaxDelay);
+
 /* @} Discovery */
 
 /******************************************************************************
@@ -1428,6 +1490,10 @@ UPNP_EXPORT_SPEC int UpnpSendActionExAsync(
  * The device application should call this function when it receives a
  * \c UPNP_EVENT_SUBSCRIPTION_REQUEST callback.
  *
+ * The values are copied verbatim into the property set, so they must not
+ * contain the characters that XML reserves unless they are meant as markup.
+ * \b UpnpPropertySetBuilder_add escapes them.
+ *
  * This function is synchronous and generates no callbacks.
  *
  * This function can be called during the execution of a callback function.
@@ -1506,6 +1572,10 @@ UPNP_EXPORT_SPEC int UpnpAcceptSubscriptionExt(
  * \brief Sends out an event change notification to all control points
  * subscribed to a particular service.
  *
+ * The values are copied verbatim into the property set, so they must not
+ * contain the characters that XML reserves unless they are meant as markup.
+ * \b UpnpPropertySetBuilder_add escapes them.
+ *
  * This function is synchronous and generates no callbacks.
  *
  * This function may be called during a callback function to send out a
@@ -1572,6 +1642,85 @@ UPNP_EXPORT_SPEC int UpnpNotifyExt(
 	 * Universal Plug and Play Device Architecture specification. */
 	IXML_Document *PropSet);
 
+/*!
+ * \brief Property set of an event, written as text as its variables are
+ * added, without building a DOM document.
+ *
+ * A builder can be reused for the next event once cleared.
+ */
+typedef struct s_UpnpPropertySetBuilder UpnpPropertySetBuilder;
+
+/*!
+ * \brief Creates an empty property set.
+ *
+ * \return The property set, or NULL if there is not enough memory.
+ */
+UPNP_EXPORT_SPEC UpnpPropertySetBuilder *UpnpPropertySetBuilder_new(void);
+
+/*!
+ * \brief Frees a property set.
+ */
+UPNP_EXPORT_SPEC void UpnpPropertySetBuilder_delete(
+	/*! [in] The property set, may be NULL. */
+	UpnpPropertySetBuilder *p);
+
+/*!
+ * \brief Removes all the variables of a property set, keeping its memory.
+ */
+UPNP_EXPORT_SPEC void UpnpPropertySetBuilder_clear(
+	/*! [in] The property set, may be NULL. */
+	UpnpPropertySetBuilder *p);
+
+/*!
+ * \brief Appends a variable to a property set.
+ *
+ * The characters of the value that XML reserves are written as entities, so
+ * a value such as a LastChange document is passed as plain text.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_PARAM: \b p, \b name or \b value is not a
+ *             valid pointer, or \b name is not an XML name.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to
+ *             complete this operation; the property set is unchanged.
+ */
+UPNP_EXPORT_SPEC int UpnpPropertySetBuilder_add(
+	/*! [in] The property set. */
+	UpnpPropertySetBuilder *p,
+	/*! [in] The name of the variable. */
+	const char *name,
+	/*! [in] The value of the variable. */
+	const char *value);
+
+/*!
+ * \brief Similar to \b UpnpNotifyExt except that it takes a property set
+ * built with \b UpnpPropertySetBuilder_add rather than a DOM document.
+ *
+ * This function is synchronous and generates no callbacks. The property set
+ * is not modified and can be cleared and reused once the function returns.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid device
+ *             handle.
+ *     \li \c UPNP_E_INVALID_SERVICE: The \b DevId/\b ServId
+ *             pair refers to an invalid service.
+ *     \li \c UPNP_E_INVALID_PARAM: Either \b DevID, \b ServID, or
+ *             \b PropSet is not a valid pointer.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to
+ *             complete this operation.
+ */
+UPNP_EXPORT_SPEC int UpnpNotifyPropertySet(
+	/*! [in] The handle to the device sending the event. */
+	UpnpDevice_Handle Hnd,
+	/*! [in] The device ID of the subdevice of the service generating the
+	   event. */
+	const char *DevID,
+	/*! [in] The unique identifier of the service generating the event. */
+	const char *ServID,
+	/*! [in] The property set. */
+	const UpnpPropertySetBuilder *PropSet);
+
 /*!
  * \brief Renews a subscription that is about to expire.
  *
@@ -2803,6 +2952,28 @@ UPNP_EXPORT_SPEC void UpnpSetHostValidateCallback(
  */
 UPNP_EXPORT_SPEC void UpnpSetAllowLiteralHostRedirection(int enable);
 
+/*!
+ * \brief Sets the limits for HTTP/1.1 persistent connections accepted by the
+ * internal web server, SOAP and GENA.
+ *
+ * A connection that stays idle for \b idleTimeout seconds, or that has served
+ * \b maxRequests requests, is closed. Setting \b maxRequests to 1 disables
+ * persistent connections. At most HTTP_KEEPALIVE_MAX_PERCENT percent of the
+ * miniserver threads serve persistent connections at a time, the clients
+ * beyond that are answered with "Connection: close".
+ *
+ * \return An integer representing one of the following:
+ *       \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *       \li \c UPNP_E_INVALID_PARAM: One of the limits is out of range.
+ */
+UPNP_EXPORT_SPEC int UpnpSetHttpKeepAlive(
+	/*! [in] Idle timeout in seconds, \c HTTP_KEEPALIVE_TIMEOUT by default.
+	 */
+	int idleTimeout,
+	/*! [in] Requests per connection, \c HTTP_KEEPALIVE_MAX_REQUESTS by
+	 * default. */
+	int maxRequests);
+
 /*!
  * \brief Assign the Access-Control-Allow-Origin specfied by the input
  * const char* cors_string parameterto the global CORS string
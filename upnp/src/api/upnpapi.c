@@ -54,6 +54,7 @@
 
 /* Needed for GENA */
 #include "gena.h"
+#include "gena_connpool.h"
 #include "miniserver.h"
 #include "service_table.h"
 
@@ -66,6 +67,7 @@
 #include <sys/stat.h>
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -148,6 +150,12 @@ void *gWebCallback_HostValidateCookie = 0;
 /*! Allow literal host names redirection to numeric host names. */
 int gAllowLiteralHostRedirection = 0;
 
+/*! Seconds an idle persistent HTTP connection is kept open. */
+int gHttpKeepAliveTimeout = HTTP_KEEPALIVE_TIMEOUT;
+
+/*! Maximum number of requests served on one HTTP connection. */
+int gHttpKeepAliveMaxRequests = HTTP_KEEPALIVE_MAX_REQUESTS;
+
 /*! Static buffer to contain interface name. (extern'ed in upnp.h) */
 char gIF_NAME[LINE_SIZE] = {'\0'};
 
@@ -183,8 +191,18 @@ unsigned short LOCAL_PORT_V6;
 /*! IPv6 ULA or GUA port for the mini-server */
 unsigned short LOCAL_PORT_V6_ULA_GUA;
 
-/*! UPnP device and control point handle table  */
-static void *HandleTable[NUM_HANDLE];
+/*! UPnP device and control point handle table, indexed by handle. It grows
+ * on demand and is guarded by GlobalHndRWLock. */
+static struct Handle_Info **HandleTable = NULL;
+
+/*! Number of slots in HandleTable. */
+static int HandleTableSize = 0;
+
+/*! Stack of unused handles below HandleTableSize. */
+static int *FreeHandles = NULL;
+
+/*! Number of entries in FreeHandles. */
+static int FreeHandleCount = 0;
 
 /*! a local dir which serves as webserver root */
 extern membuffer gDocumentRootDir;
@@ -222,11 +240,11 @@ static int UpnpSdkInit = 0;
 static int UpnpSdkClientRegistered = 0;
 
 /*! Global variable to denote the state of Upnp SDK IPv4 device registration.
- * == 0 if unregistered, == 1 if registered. */
+ * == 0 if unregistered, >= 1 if registered - registered devices count. */
 static int UpnpSdkDeviceRegisteredV4 = 0;
 
 /*! Global variable to denote the state of Upnp SDK IPv6 device registration.
- * == 0 if unregistered, == 1 if registered. */
+ * == 0 if unregistered, >= 1 if registered - registered devices count. */
 static int UpnpSdkDeviceregisteredV6 = 0;
 
 #ifdef UPNP_HAVE_OPTSSDP
@@ -248,6 +266,10 @@ typedef union
 		int handle;
 		int eventId;
 		void *Event;
+		/* Booking of a periodic advertisement, see AutoAdvertise. */
+		int pacePackets;
+		int paceShare;
+		int paceDelay;
 	} advertise;
 	struct UpnpNonblockParam action;
 } job_arg;
@@ -257,12 +279,37 @@ typedef union
  */
 static void free_advertise_arg(job_arg *arg)
 {
+#if defined(INCLUDE_DEVICE_APIS) && EXCLUDE_SSDP == 0
+	/* the booked round was not sent */
+	if (arg->advertise.paceShare > 0) {
+		ssdp_pace_cancel(arg->advertise.paceShare);
+	}
+#endif
 	if (arg->advertise.Event) {
 		free(arg->advertise.Event);
 	}
 	free(arg);
 }
 
+#ifdef INCLUDE_DEVICE_APIS
+/*!
+ * \brief Cancels the periodic advertisement scheduled for a device.
+ *
+ * Must be called with the handle table locked.
+ */
+static void CancelAutoAdvertise(struct Handle_Info *SInfo)
+{
+	ThreadPoolJob job;
+
+	if (SInfo->AdvertiseEventId != -1 &&
+		TimerThreadRemove(&gTimerThread, SInfo->AdvertiseEventId, &job) ==
+			0) {
+		job.free_func(job.arg);
+	}
+	SInfo->AdvertiseEventId = -1;
+}
+#endif /* INCLUDE_DEVICE_APIS */
+
 /*!
  * \brief Free memory associated with an action job's argument
  */
@@ -325,14 +372,37 @@ exit_function:
  */
 static int UpnpInitMutexes(void)
 {
+#if UPNP_USE_RWLOCK && defined(__GLIBC__)
+	ithread_rwlockattr_t attr;
+	int rc;
+#endif
+
 #ifdef __CYGWIN__
 	/* On Cygwin, pthread_mutex_init() fails without this memset. */
 	/* TODO: Fix Cygwin so we don't need this memset(). */
 	memset(&GlobalHndRWLock, 0, sizeof(GlobalHndRWLock));
 #endif
+#if UPNP_USE_RWLOCK && defined(__GLIBC__)
+	/* The rwlocks of glibc prefer readers by default: with a steady flow
+	 * of notify threads holding the read lock, UpnpNotify() and the
+	 * unregistration functions would never get the write lock. The
+	 * handle lock must therefore never be read-locked twice by the same
+	 * thread. */
+	if (ithread_rwlockattr_init(&attr) != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+	pthread_rwlockattr_setkind_np(
+		&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	rc = ithread_rwlock_init(&GlobalHndRWLock, &attr);
+	ithread_rwlockattr_destroy(&attr);
+	if (rc != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+#else
 	if (ithread_rwlock_init(&GlobalHndRWLock, NULL) != 0) {
 		return UPNP_E_INIT_FAILED;
 	}
+#endif
 
 	if (ithread_mutex_init(&gUUIDMutex, NULL) != 0) {
 		return UPNP_E_INIT_FAILED;
@@ -364,6 +434,7 @@ static int UpnpInitThreadPools(void)
 	TPAttrSetJobsPerThread(&attr, JOBS_PER_THREAD);
 	TPAttrSetIdleTime(&attr, THREAD_IDLE_TIME);
 	TPAttrSetMaxJobsTotal(&attr, maxJobsTotal);
+	TPAttrSetScheduler(&attr, THREAD_POOL_SCHEDULER);
 
 	if (ThreadPoolInit(&gSendThreadPool, &attr) != UPNP_E_SUCCESS) {
 		ret = UPNP_E_INIT_FAILED;
@@ -403,7 +474,6 @@ exit_function:
 static int UpnpInitPreamble(void)
 {
 	int retVal = UPNP_E_SUCCESS;
-	int i;
 #ifdef UPNP_HAVE_OPTSSDP
 	uuid_upnp nls_uuid;
 #endif /* UPNP_HAVE_OPTSSDP */
@@ -443,9 +513,10 @@ static int UpnpInitPreamble(void)
 
 	/* Initializes the handle list. */
 	HandleLock(__FILE__, __LINE__);
-	for (i = 0; i < NUM_HANDLE; ++i) {
-		HandleTable[i] = NULL;
-	}
+	HandleTable = NULL;
+	HandleTableSize = 0;
+	FreeHandles = NULL;
+	FreeHandleCount = 0;
 	HandleUnlock(__FILE__, __LINE__);
 
 	/* Initialize SDK global thread pools. */
@@ -454,10 +525,48 @@ static int UpnpInitPreamble(void)
 		return retVal;
 	}
 
+#if EXCLUDE_SSDP == 0
+	/* Initialize the cache of SSDP receive batches. */
+	retVal = ssdp_recv_batches_init();
+	if (retVal != UPNP_E_SUCCESS) {
+		UpnpFinish();
+
+		return retVal;
+	}
+#endif
+
+#if defined(INCLUDE_CLIENT_APIS) && EXCLUDE_SSDP == 0
+	/* Initialize the state of the SSDP searches. */
+	retVal = ssdp_ctrlpt_init();
+	if (retVal != UPNP_E_SUCCESS) {
+		UpnpFinish();
+
+		return retVal;
+	}
+#endif
+
 #ifdef INCLUDE_DEVICE_APIS
 	#if EXCLUDE_SOAP == 0
 	SetSoapCallback(soap_device_callback);
 	#endif
+	#if EXCLUDE_SSDP == 0
+	/* Initialize the state of the SSDP replies and advertisements. */
+	retVal = ssdp_device_init();
+	if (retVal != UPNP_E_SUCCESS) {
+		UpnpFinish();
+
+		return retVal;
+	}
+	#endif
+	#if EXCLUDE_GENA == 0
+	/* Initialize the pool of connections used for event delivery. */
+	retVal = gena_connpool_init();
+	if (retVal != UPNP_E_SUCCESS) {
+		UpnpFinish();
+
+		return retVal;
+	}
+	#endif
 #endif /* INCLUDE_DEVICE_APIS */
 
 #ifdef INTERNAL_WEB_SERVER
@@ -734,9 +843,31 @@ int UpnpFinish(void)
 	ThreadPoolShutdown(&gSendThreadPool);
 	PrintThreadPoolStats(
 		&gRecvThreadPool, __FILE__, __LINE__, "Recv Thread Pool");
+#if EXCLUDE_SSDP == 0
+	ssdp_recv_batches_destroy();
+#endif
+#ifdef INCLUDE_DEVICE_APIS
+	#if EXCLUDE_SSDP == 0
+	ssdp_device_destroy();
+	#endif
+	#if EXCLUDE_GENA == 0
+	gena_connpool_destroy();
+	#endif
+#endif
 #ifdef INCLUDE_CLIENT_APIS
+	#if EXCLUDE_SSDP == 0
+	ssdp_ctrlpt_destroy();
+	#endif
 	ithread_mutex_destroy(&GlobalClientSubscribeMutex);
 #endif
+	HandleLock(__FILE__, __LINE__);
+	free(HandleTable);
+	HandleTable = NULL;
+	HandleTableSize = 0;
+	free(FreeHandles);
+	FreeHandles = NULL;
+	FreeHandleCount = 0;
+	HandleUnlock(__FILE__, __LINE__);
 	ithread_rwlock_destroy(&GlobalHndRWLock);
 	ithread_mutex_destroy(&gUUIDMutex);
 	/* remove all virtual dirs */
@@ -820,23 +951,67 @@ char *UpnpGetServerUlaGuaIp6Address(void)
 }
 
 /*!
- * \brief Get a free handle.
+ * \brief Doubles the size of the handle table and pushes the new slots on
+ * the free handle stack, lowest handle on top.
  *
- * \return On success, an integer greater than zero or UPNP_E_OUTOF_HANDLE on
- * 	failure.
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_HANDLE.
  */
-static int GetFreeHandle(void)
+static int GrowHandleTable(void)
 {
+	struct Handle_Info **table;
+	int *stack;
+	int newSize;
+	int i;
+
+	if (HandleTableSize >= NUM_HANDLE) {
+		return UPNP_E_OUTOF_HANDLE;
+	}
+	newSize = HandleTableSize ? 2 * HandleTableSize : NUM_HANDLE_INITIAL;
+	if (newSize > NUM_HANDLE) {
+		newSize = NUM_HANDLE;
+	}
+	table = realloc(HandleTable, (size_t)newSize * sizeof *table);
+	if (!table) {
+		return UPNP_E_OUTOF_HANDLE;
+	}
+	HandleTable = table;
+	stack = realloc(FreeHandles, (size_t)newSize * sizeof *stack);
+	if (!stack) {
+		return UPNP_E_OUTOF_HANDLE;
+	}
+	FreeHandles = stack;
 	/* Handle 0 is not used as NULL translates to 0 when passed as a handle
 	 */
-	int i = 1;
+	HandleTable[0] = NULL;
+	for (i = newSize - 1; i >= HandleTableSize && i > 0; --i) {
+		HandleTable[i] = NULL;
+		FreeHandles[FreeHandleCount++] = i;
+	}
+	HandleTableSize = newSize;
 
-	while (i < NUM_HANDLE && HandleTable[i] != NULL)
-		++i;
-	if (i == NUM_HANDLE)
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Stores a handle structure in a free slot of the handle table.
+ *
+ * \return On success, an integer greater than zero or UPNP_E_OUTOF_HANDLE on
+ * 	failure.
+ */
+static int GetFreeHandle(
+	/*! [in] Handle structure to store. */
+	struct Handle_Info *HInfo)
+{
+	int i;
+
+	if (FreeHandleCount == 0 && GrowHandleTable() != UPNP_E_SUCCESS) {
 		return UPNP_E_OUTOF_HANDLE;
-	else
-		return i;
+	}
+	i = FreeHandles[--FreeHandleCount];
+	ithread_mutex_init(&HInfo->Mutex, NULL);
+	HandleTable[i] = HInfo;
+
+	return i;
 }
 
 /*!
@@ -856,7 +1031,7 @@ static int FreeHandle(
 		__LINE__,
 		"FreeHandle: entering, Handle is %d\n",
 		Upnp_Handle);
-	if (Upnp_Handle < 1 || Upnp_Handle >= NUM_HANDLE) {
+	if (Upnp_Handle < 1 || Upnp_Handle >= HandleTableSize) {
 		UpnpPrintf(UPNP_CRITICAL,
 			API,
 			__FILE__,
@@ -871,8 +1046,19 @@ static int FreeHandle(
 			"FreeHandle: HandleTable[%d] is NULL\n",
 			Upnp_Handle);
 	} else {
+#ifdef INCLUDE_DEVICE_APIS
+		if (HandleTable[Upnp_Handle]->HType == HND_DEVICE) {
+			CancelAutoAdvertise(HandleTable[Upnp_Handle]);
+	#if EXCLUDE_SSDP == 0
+			ssdp_cache_free(HandleTable[Upnp_Handle]->SsdpCache);
+	#endif
+			freeDescIndex(HandleTable[Upnp_Handle]->DescIndex);
+		}
+#endif
+		ithread_mutex_destroy(&HandleTable[Upnp_Handle]->Mutex);
 		free(HandleTable[Upnp_Handle]);
 		HandleTable[Upnp_Handle] = NULL;
+		FreeHandles[FreeHandleCount++] = Upnp_Handle;
 		ret = UPNP_E_SUCCESS;
 	}
 	UpnpPrintf(UPNP_ALL,
@@ -916,19 +1102,18 @@ int UpnpRegisterRootDevice(const char *DescUrl,
 		goto exit_function;
 	}
 
-	*Hnd = GetFreeHandle();
-	if (*Hnd == UPNP_E_OUTOF_HANDLE) {
-		retVal = UPNP_E_OUTOF_MEMORY;
-		goto exit_function;
-	}
-
 	HInfo = (struct Handle_Info *)malloc(sizeof(struct Handle_Info));
 	if (HInfo == NULL) {
 		retVal = UPNP_E_OUTOF_MEMORY;
 		goto exit_function;
 	}
 	memset(HInfo, 0, sizeof(struct Handle_Info));
-	HandleTable[*Hnd] = HInfo;
+	*Hnd = GetFreeHandle(HInfo);
+	if (*Hnd == UPNP_E_OUTOF_HANDLE) {
+		free(HInfo);
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto exit_function;
+	}
 
 	UpnpPrintf(UPNP_ALL,
 		API,
@@ -951,8 +1136,11 @@ int UpnpRegisterRootDevice(const char *DescUrl,
 	HInfo->Callback = Fun;
 	HInfo->Cookie = (void *)Cookie;
 	HInfo->MaxAge = DEFAULT_MAXAGE;
+	HInfo->AdvertiseJitter = SSDP_ADVERTISE_JITTER;
+	HInfo->AdvertiseEventId = -1;
 	HInfo->DeviceList = NULL;
 	HInfo->ServiceList = NULL;
+	HInfo->DescIndex = NULL;
 	HInfo->DescDocument = NULL;
 	#ifdef INCLUDE_CLIENT_APIS
 	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
@@ -1014,6 +1202,24 @@ int UpnpRegisterRootDevice(const char *DescUrl,
 			"RootDevice\n");
 	}
 
+	HInfo->DescIndex = buildDescIndex(HInfo->DescDocument);
+	if (!HInfo->DescIndex) {
+	#ifdef INCLUDE_CLIENT_APIS
+		ListDestroy(&HInfo->SsdpSearchList, 0);
+	#endif /* INCLUDE_CLIENT_APIS */
+		ixmlNodeList_free(HInfo->DeviceList);
+		ixmlNodeList_free(HInfo->ServiceList);
+		ixmlDocument_free(HInfo->DescDocument);
+		FreeHandle(*Hnd);
+		UpnpPrintf(UPNP_CRITICAL,
+			API,
+			__FILE__,
+			__LINE__,
+			"UpnpRegisterRootDevice: Cannot index the description\n");
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto exit_function;
+	}
+
 	#if EXCLUDE_GENA == 0
 	/*
 	 * GENA SET UP
@@ -1024,7 +1230,7 @@ int UpnpRegisterRootDevice(const char *DescUrl,
 		__LINE__,
 		"UpnpRegisterRootDevice: Gena Check\n");
 	memset(&HInfo->ServiceTable, 0, sizeof(HInfo->ServiceTable));
-	hasServiceTable = getServiceTable((IXML_Node *)HInfo->DescDocument,
+	hasServiceTable = getServiceTable(HInfo->DescIndex,
 		&HInfo->ServiceTable,
 		HInfo->DescURL);
 	if (hasServiceTable) {
@@ -1044,7 +1250,7 @@ int UpnpRegisterRootDevice(const char *DescUrl,
 	}
 	#endif /* EXCLUDE_GENA */
 
-	UpnpSdkDeviceRegisteredV4 = 1;
+	UpnpSdkDeviceRegisteredV4 += 1;
 
 	retVal = UPNP_E_SUCCESS;
 
@@ -1113,19 +1319,18 @@ int UpnpRegisterRootDevice2(Upnp_DescType descriptionType,
 		goto exit_function;
 	}
 
-	*Hnd = GetFreeHandle();
-	if (*Hnd == UPNP_E_OUTOF_HANDLE) {
-		retVal = UPNP_E_OUTOF_MEMORY;
-		goto exit_function;
-	}
-
 	HInfo = (struct Handle_Info *)malloc(sizeof(struct Handle_Info));
 	if (HInfo == NULL) {
 		retVal = UPNP_E_OUTOF_MEMORY;
 		goto exit_function;
 	}
 	memset(HInfo, 0, sizeof(struct Handle_Info));
-	HandleTable[*Hnd] = HInfo;
+	*Hnd = GetFreeHandle(HInfo);
+	if (*Hnd == UPNP_E_OUTOF_HANDLE) {
+		free(HInfo);
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto exit_function;
+	}
 
 	/* prevent accidental removal of a non-existent alias */
 	HInfo->aliasInstalled = 0;
@@ -1156,8 +1361,11 @@ int UpnpRegisterRootDevice2(Upnp_DescType descriptionType,
 	HInfo->Callback = Fun;
 	HInfo->Cookie = (void *)Cookie;
 	HInfo->MaxAge = DEFAULT_MAXAGE;
+	HInfo->AdvertiseJitter = SSDP_ADVERTISE_JITTER;
+	HInfo->AdvertiseEventId = -1;
 	HInfo->DeviceList = NULL;
 	HInfo->ServiceList = NULL;
+	HInfo->DescIndex = NULL;
 	#ifdef INCLUDE_CLIENT_APIS
 	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
 	HInfo->ClientSubList = NULL;
@@ -1203,6 +1411,24 @@ int UpnpRegisterRootDevice2(Upnp_DescType descriptionType,
 			"RootDevice\n");
 	}
 
+	HInfo->DescIndex = buildDescIndex(HInfo->DescDocument);
+	if (!HInfo->DescIndex) {
+	#ifdef INCLUDE_CLIENT_APIS
+		ListDestroy(&HInfo->SsdpSearchList, 0);
+	#endif /* INCLUDE_CLIENT_APIS */
+		ixmlNodeList_free(HInfo->DeviceList);
+		ixmlNodeList_free(HInfo->ServiceList);
+		ixmlDocument_free(HInfo->DescDocument);
+		FreeHandle(*Hnd);
+		UpnpPrintf(UPNP_CRITICAL,
+			API,
+			__FILE__,
+			__LINE__,
+			"UpnpRegisterRootDevice2: Cannot index the description\n");
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto exit_function;
+	}
+
 	#if EXCLUDE_GENA == 0
 	/*
 	 * GENA SET UP
@@ -1213,7 +1439,7 @@ int UpnpRegisterRootDevice2(Upnp_DescType descriptionType,
 		__LINE__,
 		"UpnpRegisterRootDevice2: Gena Check\n");
 	memset(&HInfo->ServiceTable, 0, sizeof(HInfo->ServiceTable));
-	hasServiceTable = getServiceTable((IXML_Node *)HInfo->DescDocument,
+	hasServiceTable = getServiceTable(HInfo->DescIndex,
 		&HInfo->ServiceTable,
 		HInfo->DescURL);
 	if (hasServiceTable) {
@@ -1233,7 +1459,7 @@ int UpnpRegisterRootDevice2(Upnp_DescType descriptionType,
 	}
 	#endif /* EXCLUDE_GENA */
 
-	UpnpSdkDeviceRegisteredV4 = 1;
+	UpnpSdkDeviceRegisteredV4 += 1;
 
 	retVal = UPNP_E_SUCCESS;
 
@@ -1298,18 +1524,18 @@ int UpnpRegisterRootDevice4(const char *DescUrl,
 		retVal = UPNP_E_INVALID_PARAM;
 		goto exit_function;
 	}
-	*Hnd = GetFreeHandle();
-	if (*Hnd == UPNP_E_OUTOF_HANDLE) {
-		retVal = UPNP_E_OUTOF_MEMORY;
-		goto exit_function;
-	}
 	HInfo = (struct Handle_Info *)malloc(sizeof(struct Handle_Info));
 	if (HInfo == NULL) {
 		retVal = UPNP_E_OUTOF_MEMORY;
 		goto exit_function;
 	}
 	memset(HInfo, 0, sizeof(struct Handle_Info));
-	HandleTable[*Hnd] = HInfo;
+	*Hnd = GetFreeHandle(HInfo);
+	if (*Hnd == UPNP_E_OUTOF_HANDLE) {
+		free(HInfo);
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto exit_function;
+	}
 	UpnpPrintf(UPNP_ALL,
 		API,
 		__FILE__,
@@ -1337,8 +1563,11 @@ int UpnpRegisterRootDevice4(const char *DescUrl,
 	HInfo->Callback = Fun;
 	HInfo->Cookie = (void *)Cookie;
 	HInfo->MaxAge = DEFAULT_MAXAGE;
+	HInfo->AdvertiseJitter = SSDP_ADVERTISE_JITTER;
+	HInfo->AdvertiseEventId = -1;
 	HInfo->DeviceList = NULL;
 	HInfo->ServiceList = NULL;
+	HInfo->DescIndex = NULL;
 	HInfo->DescDocument = NULL;
 	#ifdef INCLUDE_CLIENT_APIS
 	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
@@ -1392,6 +1621,24 @@ int UpnpRegisterRootDevice4(const char *DescUrl,
 			"RootDevice\n");
 	}
 
+	HInfo->DescIndex = buildDescIndex(HInfo->DescDocument);
+	if (!HInfo->DescIndex) {
+	#ifdef INCLUDE_CLIENT_APIS
+		ListDestroy(&HInfo->SsdpSearchList, 0);
+	#endif /* INCLUDE_CLIENT_APIS */
+		ixmlNodeList_free(HInfo->DeviceList);
+		ixmlNodeList_free(HInfo->ServiceList);
+		ixmlDocument_free(HInfo->DescDocument);
+		FreeHandle(*Hnd);
+		UpnpPrintf(UPNP_CRITICAL,
+			API,
+			__FILE__,
+			__LINE__,
+			"UpnpRegisterRootDevice4: Cannot index the description\n");
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto exit_function;
+	}
+
 	#if EXCLUDE_GENA == 0
 	/*
 	 * GENA SET UP
@@ -1402,7 +1649,7 @@ int UpnpRegisterRootDevice4(const char *DescUrl,
 		__LINE__,
 		"UpnpRegisterRootDevice4: Gena Check\n");
 	memset(&HInfo->ServiceTable, 0, sizeof(HInfo->ServiceTable));
-	hasServiceTable = getServiceTable((IXML_Node *)HInfo->DescDocument,
+	hasServiceTable = getServiceTable(HInfo->DescIndex,
 		&HInfo->ServiceTable,
 		HInfo->DescURL);
 	if (hasServiceTable) {
@@ -1424,10 +1671,10 @@ int UpnpRegisterRootDevice4(const char *DescUrl,
 
 	switch (AddressFamily) {
 	case AF_INET:
-		UpnpSdkDeviceRegisteredV4 = 1;
+		UpnpSdkDeviceRegisteredV4 += 1;
 		break;
 	default:
-		UpnpSdkDeviceregisteredV6 = 1;
+		UpnpSdkDeviceregisteredV6 += 1;
 	}
 
 	retVal = UPNP_E_SUCCESS;
@@ -1522,10 +1769,10 @@ int UpnpUnRegisterRootDeviceLowPower(UpnpDevice_Handle Hnd,
 	#endif /* INTERNAL_WEB_SERVER */
 	switch (HInfo->DeviceAf) {
 	case AF_INET:
-		UpnpSdkDeviceRegisteredV4 = 0;
+		UpnpSdkDeviceRegisteredV4 -= 1;
 		break;
 	case AF_INET6:
-		UpnpSdkDeviceregisteredV6 = 0;
+		UpnpSdkDeviceregisteredV6 -= 1;
 		break;
 	default:
 		break;
@@ -1566,10 +1813,6 @@ int UpnpRegisterClient(
 		HandleUnlock(__FILE__, __LINE__);
 		return UPNP_E_ALREADY_REGISTERED;
 	}
-	if ((*Hnd = GetFreeHandle()) == UPNP_E_OUTOF_HANDLE) {
-		HandleUnlock(__FILE__, __LINE__);
-		return UPNP_E_OUTOF_MEMORY;
-	}
 	HInfo = (struct Handle_Info *)malloc(sizeof(struct Handle_Info));
 	if (HInfo == NULL) {
 		HandleUnlock(__FILE__, __LINE__);
@@ -1585,7 +1828,11 @@ int UpnpRegisterClient(
 	HInfo->MaxSubscriptions = UPNP_INFINITE;
 	HInfo->MaxSubscriptionTimeOut = UPNP_INFINITE;
 	#endif
-	HandleTable[*Hnd] = HInfo;
+	if ((*Hnd = GetFreeHandle(HInfo)) == UPNP_E_OUTOF_HANDLE) {
+		free(HInfo);
+		HandleUnlock(__FILE__, __LINE__);
+		return UPNP_E_OUTOF_MEMORY;
+	}
 	UpnpSdkClientRegistered += 1;
 	HandleUnlock(__FILE__, __LINE__);
 
@@ -1915,6 +2162,60 @@ static int GetDescDocumentAndURL(Upnp_DescType descriptionType,
 
 #ifdef INCLUDE_DEVICE_APIS
 	#if EXCLUDE_SSDP == 0
+/*!
+ * \brief Schedules the next periodic advertisement of a device, replacing the
+ * one already scheduled.
+ *
+ * The renewal is brought forward by a random part of AdvertiseJitter percent
+ * of its interval, so that devices registered together drift apart.
+ *
+ * Must be called with the handle table locked. The argument is freed on
+ * failure.
+ *
+ * \return UPNP_E_SUCCESS or the error of TimerThreadSchedule().
+ */
+static int ScheduleAutoAdvertise(
+	/*! [in] Device handle information. */
+	struct Handle_Info *SInfo,
+	/*! [in] Argument of AutoAdvertise. */
+	job_arg *adEvent,
+	/*! [in] Expiration age of the advertisements, in seconds. */
+	int Exp)
+{
+	ThreadPoolJob job;
+	time_t delay;
+	time_t spread;
+	int retVal;
+
+		#ifdef SSDP_PACKET_DISTRIBUTE
+	delay = (time_t)((Exp / 2) - AUTO_ADVERTISEMENT_TIME) * 1000;
+		#else
+	delay = (time_t)(Exp - AUTO_ADVERTISEMENT_TIME) * 1000;
+		#endif
+	spread = delay / 100 * SInfo->AdvertiseJitter;
+	if (spread > 0)
+		delay -= (time_t)((double)rand() / ((double)RAND_MAX + 1.0) *
+			(double)(spread + 1));
+	CancelAutoAdvertise(SInfo);
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)AutoAdvertise, adEvent);
+	TPJobSetFreeFunction(&job, (free_routine)free_advertise_arg);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	retVal = TimerThreadSchedule(&gTimerThread,
+		delay,
+		REL_MSEC,
+		&job,
+		SHORT_TERM,
+		&(adEvent->advertise.eventId));
+	if (retVal != UPNP_E_SUCCESS) {
+		free_advertise_arg(adEvent);
+		return retVal;
+	}
+	SInfo->AdvertiseEventId = adEvent->advertise.eventId;
+
+	return UPNP_E_SUCCESS;
+}
+
 int UpnpSendAdvertisement(UpnpDevice_Handle Hnd, int Exp)
 {
 	UpnpPrintf(UPNP_ALL,
@@ -1934,9 +2235,6 @@ int UpnpSendAdvertisementLowPower(UpnpDevice_Handle Hnd,
 	struct Handle_Info *SInfo = NULL;
 	int retVal = 0, *ptrMx;
 	job_arg *adEvent;
-	ThreadPoolJob job;
-
-	memset(&job, 0, sizeof(job));
 
 	if (UpnpSdkInit != 1) {
 		return UPNP_E_FINISH;
@@ -1988,6 +2286,7 @@ int UpnpSendAdvertisementLowPower(UpnpDevice_Handle Hnd,
 		return UPNP_E_OUTOF_MEMORY;
 	}
 	*ptrMx = Exp;
+	memset(adEvent, 0, sizeof(job_arg));
 	adEvent->advertise.handle = Hnd;
 	adEvent->advertise.Event = ptrMx;
 
@@ -2001,35 +2300,7 @@ int UpnpSendAdvertisementLowPower(UpnpDevice_Handle Hnd,
 		free(ptrMx);
 		return UPNP_E_INVALID_HANDLE;
 	}
-		#ifdef SSDP_PACKET_DISTRIBUTE
-	TPJobInit(&job, (start_routine)AutoAdvertise, adEvent);
-	TPJobSetFreeFunction(&job, (free_routine)free_advertise_arg);
-	TPJobSetPriority(&job, MED_PRIORITY);
-	if ((retVal = TimerThreadSchedule(&gTimerThread,
-		     ((Exp / 2) - (AUTO_ADVERTISEMENT_TIME)),
-		     REL_SEC,
-		     &job,
-		     SHORT_TERM,
-		     &(adEvent->advertise.eventId))) != UPNP_E_SUCCESS) {
-		HandleUnlock(__FILE__, __LINE__);
-		free_advertise_arg(adEvent);
-		return retVal;
-	}
-		#else
-	TPJobInit(&job, (start_routine)AutoAdvertise, adEvent);
-	TPJobSetFreeFunction(&job, (free_routine)free_advertise_arg);
-	TPJobSetPriority(&job, MED_PRIORITY);
-	if ((retVal = TimerThreadSchedule(&gTimerThread,
-		     Exp - AUTO_ADVERTISEMENT_TIME,
-		     REL_SEC,
-		     &job,
-		     SHORT_TERM,
-		     &(adEvent->advertise.eventId))) != UPNP_E_SUCCESS) {
-		HandleUnlock(__FILE__, __LINE__);
-		free_advertise_arg(adEvent);
-		return retVal;
-	}
-		#endif
+	retVal = ScheduleAutoAdvertise(SInfo, adEvent, Exp);
 
 	HandleUnlock(__FILE__, __LINE__);
 	UpnpPrintf(UPNP_ALL,
@@ -2040,6 +2311,57 @@ int UpnpSendAdvertisementLowPower(UpnpDevice_Handle Hnd,
 
 	return retVal;
 }
+
+int UpnpSetAdvertisementJitter(UpnpDevice_Handle Hnd, int Jitter)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Jitter < 0 || Jitter > 100) {
+		return UPNP_E_INVALID_PARAM;
+	}
+
+	HandleLock(__FILE__, __LINE__);
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_DEVICE:
+		break;
+	default:
+		HandleUnlock(__FILE__, __LINE__);
+		return UPNP_E_INVALID_HANDLE;
+	}
+	SInfo->AdvertiseJitter = Jitter;
+	HandleUnlock(__FILE__, __LINE__);
+
+	return UPNP_E_SUCCESS;
+}
+
+int UpnpSetAdvertisementRate(int PacketsPerSecond)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (PacketsPerSecond < 0) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	ssdp_pace_set_rate(PacketsPerSecond);
+
+	return UPNP_E_SUCCESS;
+}
+
+int UpnpGetAdvertisementStats(unsigned long *Rounds,
+	unsigned long *Packets,
+	unsigned long *Deferred,
+	unsigned long *MaxDelay)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	ssdp_pace_stats(Rounds, Packets, Deferred, MaxDelay);
+
+	return UPNP_E_SUCCESS;
+}
 	#endif /* EXCLUDE_SSDP == 0 */
 #endif	       /* INCLUDE_DEVICE_APIS */
 
@@ -2689,6 +3011,51 @@ int UpnpNotifyExt(UpnpDevice_Handle Hnd,
 
 	return retVal;
 }
+
+int UpnpNotifyPropertySet(UpnpDevice_Handle Hnd,
+	const char *DevID_const,
+	const char *ServName_const,
+	const UpnpPropertySetBuilder *PropSet)
+{
+	struct Handle_Info *SInfo = NULL;
+	int retVal;
+	char *DevID = (char *)DevID_const;
+	char *ServName = (char *)ServName_const;
+
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+
+	UpnpPrintf(UPNP_ALL,
+		API,
+		__FILE__,
+		__LINE__,
+		"Inside UpnpNotifyPropertySet\n");
+
+	HandleReadLock(__FILE__, __LINE__);
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_DEVICE:
+		break;
+	default:
+		HandleUnlock(__FILE__, __LINE__);
+		return UPNP_E_INVALID_HANDLE;
+	}
+	if (DevID == NULL || ServName == NULL || PropSet == NULL) {
+		HandleUnlock(__FILE__, __LINE__);
+		return UPNP_E_INVALID_PARAM;
+	}
+
+	HandleUnlock(__FILE__, __LINE__);
+	retVal = genaNotifyAllPropertySet(Hnd, DevID, ServName, PropSet);
+
+	UpnpPrintf(UPNP_ALL,
+		API,
+		__FILE__,
+		__LINE__,
+		"Exiting UpnpNotifyPropertySet\n");
+
+	return retVal;
+}
 	#endif /* INCLUDE_DEVICE_APIS */
 
 	#ifdef INCLUDE_DEVICE_APIS
@@ -4156,15 +4523,7 @@ void UpnpThreadDistribution(struct UpnpNonblockParam *Param)
 }
 #endif /* INCLUDE_CLIENT_APIS */
 
-/*!
- * \brief Get callback function ptr from a handle.
- *
- * \return Upnp_FunPtr
- */
-Upnp_FunPtr GetCallBackFn(UpnpClient_Handle Hnd)
-{
-	return ((struct Handle_Info *)HandleTable[Hnd])->Callback;
-}
+int GetHandleTableSize(void) { return HandleTableSize; }
 
 /* Assumes at most one client */
 Upnp_Handle_Type GetClientHandleInfo(
@@ -4172,7 +4531,7 @@ Upnp_Handle_Type GetClientHandleInfo(
 {
 	UpnpClient_Handle client;
 
-	for (client = 1; client < NUM_HANDLE; client++) {
+	for (client = 1; client < HandleTableSize; client++) {
 		switch (GetHandleInfo(client, HndInfo)) {
 		case HND_CLIENT:
 			*client_handle_out = client;
@@ -4200,13 +4559,13 @@ Upnp_Handle_Type GetDeviceHandleInfo(UpnpDevice_Handle start,
 		*device_handle_out = -1;
 		return HND_INVALID;
 	}
-	if (start < 0 || start >= NUM_HANDLE - 1) {
+	if (start < 0 || start >= HandleTableSize - 1) {
 		*device_handle_out = -1;
 		return HND_INVALID;
 	}
 	++start;
 	/* Find it. */
-	for (*device_handle_out = start; *device_handle_out < NUM_HANDLE;
+	for (*device_handle_out = start; *device_handle_out < HandleTableSize;
 		(*device_handle_out)++) {
 		switch (GetHandleInfo(*device_handle_out, HndInfo)) {
 		case HND_DEVICE:
@@ -4239,7 +4598,7 @@ Upnp_Handle_Type GetDeviceHandleInfoForPath(const char *path,
 		return HND_INVALID;
 	}
 	/* Find it. */
-	for (*device_handle_out = 1; *device_handle_out < NUM_HANDLE;
+	for (*device_handle_out = 1; *device_handle_out < HandleTableSize;
 		(*device_handle_out)++) {
 		switch (GetHandleInfo(*device_handle_out, HndInfo)) {
 		case HND_DEVICE:
@@ -4277,7 +4636,7 @@ Upnp_Handle_Type GetHandleInfo(
 		"GetHandleInfo: entering, Handle is %d\n",
 		Hnd);
 #endif
-	if (Hnd < 1 || Hnd >= NUM_HANDLE) {
+	if (Hnd < 1 || Hnd >= HandleTableSize) {
 		UpnpPrintf(UPNP_ALL,
 			API,
 			__FILE__,
@@ -4293,8 +4652,8 @@ Upnp_Handle_Type GetHandleInfo(
 			Hnd);
 #endif
 	} else if (HandleTable[Hnd] != NULL) {
-		*HndInfo = (struct Handle_Info *)HandleTable[Hnd];
-		ret = ((struct Handle_Info *)*HndInfo)->HType;
+		*HndInfo = HandleTable[Hnd];
+		ret = (*HndInfo)->HType;
 	}
 
 #if 0
@@ -4308,7 +4667,7 @@ Upnp_Handle_Type GetHandleInfo(
 int PrintHandleInfo(UpnpClient_Handle Hnd)
 {
 	struct Handle_Info *HndInfo;
-	if (HandleTable[Hnd] != NULL) {
+	if (Hnd > 0 && Hnd < HandleTableSize && HandleTable[Hnd] != NULL) {
 		HndInfo = HandleTable[Hnd];
 		UpnpPrintf(UPNP_ALL,
 			API,
@@ -4344,14 +4703,97 @@ int PrintHandleInfo(UpnpClient_Handle Hnd)
 
 #ifdef INCLUDE_DEVICE_APIS
 	#if EXCLUDE_SSDP == 0
-void AutoAdvertise(void *input)
+/*!
+ * \brief Returns the device of a periodic advertisement if the advertisement
+ * is still the one scheduled for it.
+ *
+ * Unregistering the device, or sending a new advertisement, cancels the
+ * advertisement. Must be called with the handle table locked.
+ *
+ * \return The device handle information or NULL.
+ */
+static struct Handle_Info *GetAutoAdvertiseInfo(
+	/*! [in] Argument of AutoAdvertise. */
+	const job_arg *arg)
+{
+	struct Handle_Info *SInfo = NULL;
+
+	if (GetHandleInfo(arg->advertise.handle, &SInfo) != HND_DEVICE ||
+		SInfo->AdvertiseEventId != arg->advertise.eventId) {
+		return NULL;
+	}
+
+	return SInfo;
+}
+
+/*!
+ * \brief Sends a periodic advertisement booked by AutoAdvertise, and
+ * schedules the next one.
+ */
+static void SendAutoAdvertise(void *input)
 {
 	job_arg *arg = (job_arg *)input;
+	int current;
 
-	UpnpSendAdvertisement(
-		arg->advertise.handle, *((int *)arg->advertise.Event));
+	HandleReadLock(__FILE__, __LINE__);
+	current = GetAutoAdvertiseInfo(arg) != NULL;
+	HandleUnlock(__FILE__, __LINE__);
+	if (current) {
+		ssdp_pace_sent(
+			arg->advertise.pacePackets, arg->advertise.paceDelay);
+		arg->advertise.paceShare = 0;
+		UpnpSendAdvertisement(
+			arg->advertise.handle, *((int *)arg->advertise.Event));
+	}
 	free_advertise_arg(arg);
 }
+
+void AutoAdvertise(void *input)
+{
+	job_arg *arg = (job_arg *)input;
+	struct Handle_Info *SInfo = NULL;
+	ThreadPoolJob job;
+	int delay;
+
+	HandleReadLock(__FILE__, __LINE__);
+	SInfo = GetAutoAdvertiseInfo(arg);
+	HandleUnlock(__FILE__, __LINE__);
+	if (!SInfo) {
+		free_advertise_arg(arg);
+		return;
+	}
+	/* Book the round against the budget shared by all the devices. The
+	 * share is given back when the argument is freed without sending. */
+	delay = ssdp_pace_advertisement(arg->advertise.handle,
+		*((int *)arg->advertise.Event),
+		&arg->advertise.pacePackets,
+		&arg->advertise.paceShare);
+	arg->advertise.paceDelay = delay;
+	if (delay == 0) {
+		SendAutoAdvertise(arg);
+		return;
+	}
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)SendAutoAdvertise, arg);
+	TPJobSetFreeFunction(&job, (free_routine)free_advertise_arg);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	HandleLock(__FILE__, __LINE__);
+	SInfo = GetAutoAdvertiseInfo(arg);
+	if (!SInfo || TimerThreadSchedule(&gTimerThread,
+			      delay,
+			      REL_MSEC,
+			      &job,
+			      SHORT_TERM,
+			      &(arg->advertise.eventId)) != 0) {
+		if (SInfo)
+			SInfo->AdvertiseEventId = -1;
+		HandleUnlock(__FILE__, __LINE__);
+		free_advertise_arg(arg);
+		return;
+	}
+	SInfo->AdvertiseEventId = arg->advertise.eventId;
+	HandleUnlock(__FILE__, __LINE__);
+}
 	#endif /* EXCLUDE_SSDP == 0 */
 #endif	       /* INCLUDE_DEVICE_APIS */
 
@@ -4571,6 +5013,17 @@ void UpnpSetAllowLiteralHostRedirection(int enable)
 	gAllowLiteralHostRedirection = enable;
 }
 
+int UpnpSetHttpKeepAlive(int idleTimeout, int maxRequests)
+{
+	if (idleTimeout < 0 || maxRequests < 1) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	gHttpKeepAliveTimeout = idleTimeout;
+	gHttpKeepAliveMaxRequests = maxRequests;
+
+	return UPNP_E_SUCCESS;
+}
+
 int UpnpVirtualDir_set_GetInfoCallback(VDCallback_GetInfo callback)
 {
 	int ret = UPNP_E_SUCCESS;
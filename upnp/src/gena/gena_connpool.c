@@ -0,0 +1,302 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ */
+
+#include "config.h"
+
+#include "gena_connpool.h"
+
+#if EXCLUDE_GENA == 0
+	#ifdef INCLUDE_DEVICE_APIS
+
+		#include "httpreadwrite.h"
+		#include "ithread.h"
+		#include "sockpoll.h"
+		#include "upnp.h"
+		#include "upnpdebug.h"
+
+		#include <string.h>
+		#include <time.h>
+
+/*! An idle connection waiting in the pool. */
+typedef struct
+{
+	/*! Address and port the connection goes to. */
+	struct sockaddr_storage addr;
+	/*! Socket information of the connection. */
+	SOCKINFO info;
+	/*! When the connection was handed back to the pool, in seconds of
+	 * ConnPoolNow(). */
+	time_t last_used;
+} pooled_conn;
+
+/*! Protects the pool below. It is initialized statically so that the
+ * pool can be used and checked before gena_connpool_init() and after
+ * gena_connpool_destroy(). */
+static ithread_mutex_t gConnPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+/*! Idle connections. */
+static pooled_conn gConnPool[GENA_CONNPOOL_SIZE];
+/*! Number of valid entries in gConnPool. */
+static size_t gConnPoolCount = 0;
+/*! Non-zero between gena_connpool_init() and gena_connpool_destroy(). */
+static int gConnPoolInitialized = 0;
+
+/*!
+ * \brief Returns the current time of the pool clock in seconds.
+ *
+ * The clock is monotonic when the platform has one, so that setting the
+ * wall clock neither evicts every idle connection nor keeps them forever.
+ */
+static time_t ConnPoolNow(void)
+{
+		#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (time_t)ts.tv_sec;
+		#else
+	return time(NULL);
+		#endif
+}
+
+/*!
+ * \brief Compares the address family, address and port of two socket
+ * addresses.
+ *
+ * \return 1 if they designate the same endpoint, 0 otherwise.
+ */
+static int same_endpoint(
+	/*! [in] First address. */
+	const struct sockaddr_storage *a,
+	/*! [in] Second address. */
+	const struct sockaddr_storage *b)
+{
+	const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+	const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+	const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+	const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+
+	if (a->ss_family != b->ss_family) {
+		return 0;
+	}
+	switch (a->ss_family) {
+	case AF_INET:
+		return a4->sin_port == b4->sin_port &&
+		       a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	case AF_INET6:
+		return a6->sin6_port == b6->sin6_port &&
+		       a6->sin6_scope_id == b6->sin6_scope_id &&
+		       memcmp(&a6->sin6_addr,
+			       &b6->sin6_addr,
+			       sizeof a6->sin6_addr) == 0;
+	default:
+		return 0;
+	}
+}
+
+/*!
+ * \brief Removes an entry from the pool. The pool mutex must be held.
+ */
+static void remove_entry(
+	/*! [in] Index of the entry. */
+	size_t i)
+{
+	gConnPool[i] = gConnPool[--gConnPoolCount];
+}
+
+/*!
+ * \brief Closes the connections that have been idle for too long. The pool
+ * mutex must be held.
+ */
+static void evict_expired(
+	/*! [in] Current time of the pool clock. */
+	time_t now)
+{
+	size_t i = 0;
+
+	while (i < gConnPoolCount) {
+		if (now - gConnPool[i].last_used >=
+			GENA_CONNPOOL_IDLE_TIMEOUT) {
+			sock_destroy(&gConnPool[i].info, SD_BOTH);
+			remove_entry(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+/*!
+ * \brief Takes an idle connection to addr out of the pool, closing the
+ * connections that have been idle for too long on the way.
+ *
+ * \return 1 if a connection was stored in info, 0 otherwise.
+ */
+static int pool_take(
+	/*! [in] Address of the peer. */
+	const struct sockaddr_storage *addr,
+	/*! [out] Socket information of the connection. */
+	SOCKINFO *info)
+{
+	size_t i;
+	int found = 0;
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	if (gConnPoolInitialized) {
+		evict_expired(ConnPoolNow());
+		for (i = 0; i < gConnPoolCount; ++i) {
+			if (same_endpoint(&gConnPool[i].addr, addr)) {
+				*info = gConnPool[i].info;
+				remove_entry(i);
+				found = 1;
+				break;
+			}
+		}
+	}
+	ithread_mutex_unlock(&gConnPoolMutex);
+
+	return found;
+}
+
+/*!
+ * \brief Checks that an idle connection can still carry a request.
+ *
+ * A connection the peer has closed, or that has unsolicited data pending,
+ * becomes readable.
+ *
+ * \return 1 if the connection is usable, 0 otherwise.
+ */
+static int connection_is_healthy(
+	/*! [in] Socket information of the connection. */
+	SOCKINFO *info)
+{
+	return sockpoll_wait_one(info->socket, 0) == 0;
+}
+
+int gena_connpool_init(void)
+{
+	ithread_mutex_lock(&gConnPoolMutex);
+	gConnPoolCount = 0;
+	gConnPoolInitialized = 1;
+	ithread_mutex_unlock(&gConnPoolMutex);
+
+	return UPNP_E_SUCCESS;
+}
+
+void gena_connpool_destroy(void)
+{
+	size_t i;
+
+	ithread_mutex_lock(&gConnPoolMutex);
+	for (i = 0; i < gConnPoolCount; ++i) {
+		sock_destroy(&gConnPool[i].info, SD_BOTH);
+	}
+	gConnPoolCount = 0;
+	gConnPoolInitialized = 0;
+	ithread_mutex_unlock(&gConnPoolMutex);
+}
+
+int gena_connpool_get(
+	uri_type *destination_url, uri_type *url, SOCKINFO *info, int *reused)
+{
+	SOCKET conn_fd;
+	int ret_code;
+
+	*reused = 0;
+	ret_code = http_FixUrl(destination_url, url);
+	if (ret_code != UPNP_E_SUCCESS) {
+		return ret_code;
+	}
+	while (pool_take(&url->hostport.IPaddress, info)) {
+		if (connection_is_healthy(info)) {
+			UpnpPrintf(UPNP_ALL,
+				GENA,
+				__FILE__,
+				__LINE__,
+				"Reusing connection %d\n",
+				info->socket);
+			*reused = 1;
+			return UPNP_E_SUCCESS;
+		}
+		sock_destroy(info, SD_BOTH);
+	}
+	conn_fd = http_Connect(destination_url, url);
+	if (conn_fd < 0) {
+		return UPNP_E_SOCKET_CONNECT;
+	}
+	ret_code = sock_init(info, conn_fd);
+	if (ret_code != UPNP_E_SUCCESS) {
+		sock_close(conn_fd);
+	}
+
+	return ret_code;
+}
+
+void gena_connpool_put(const uri_type *url, SOCKINFO *info, int reusable)
+{
+	time_t now = ConnPoolNow();
+	size_t i;
+	size_t oldest = 0;
+
+	if (!reusable) {
+		sock_destroy(info, SD_BOTH);
+		return;
+	}
+	ithread_mutex_lock(&gConnPoolMutex);
+	if (!gConnPoolInitialized) {
+		ithread_mutex_unlock(&gConnPoolMutex);
+		sock_destroy(info, SD_BOTH);
+		return;
+	}
+	/* Connections to peers that are no longer notified are only
+	 * closed here, as nothing takes them. */
+	evict_expired(now);
+	if (gConnPoolCount == GENA_CONNPOOL_SIZE) {
+		for (i = 1; i < gConnPoolCount; ++i) {
+			if (gConnPool[i].last_used <
+				gConnPool[oldest].last_used) {
+				oldest = i;
+			}
+		}
+		sock_destroy(&gConnPool[oldest].info, SD_BOTH);
+		remove_entry(oldest);
+	}
+	gConnPool[gConnPoolCount].addr = url->hostport.IPaddress;
+	gConnPool[gConnPoolCount].info = *info;
+	gConnPool[gConnPoolCount].last_used = now;
+	++gConnPoolCount;
+	ithread_mutex_unlock(&gConnPoolMutex);
+}
+
+	#endif /* INCLUDE_DEVICE_APIS */
+#endif	       /* EXCLUDE_GENA */
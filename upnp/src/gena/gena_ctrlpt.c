@@ -592,7 +592,10 @@ int genaSubscribe(UpnpClient_Handle client_handle,
 	/* validate handle */
 	if (GetHandleInfo(client_handle, &handle_info) != HND_CLIENT) {
 		return_code = GENA_E_BAD_HANDLE;
+		/* the subscribe lock is always taken before the handle lock */
+		HandleUnlock(__FILE__, __LINE__);
 		SubscribeLock();
+		HandleLock(__FILE__, __LINE__);
 		goto error_handler;
 	}
 	HandleUnlock(__FILE__, __LINE__);
@@ -812,7 +815,7 @@ void gena_process_notification_event(SOCKINFO *info, http_message_t *event)
 		goto exit_function;
 	}
 
-	HandleLock(__FILE__, __LINE__);
+	HandleReadLock(__FILE__, __LINE__);
 
 	/* get client info */
 	if (GetClientHandleInfo(&client_handle_start, &handle_info) !=
@@ -824,9 +827,12 @@ void gena_process_notification_event(SOCKINFO *info, http_message_t *event)
 
 	HandleUnlock(__FILE__, __LINE__);
 
-	for (client_handle = client_handle_start; client_handle < NUM_HANDLE;
-		client_handle++) {
-		HandleLock(__FILE__, __LINE__);
+	for (client_handle = client_handle_start;; client_handle++) {
+		HandleReadLock(__FILE__, __LINE__);
+		if (client_handle >= GetHandleTableSize()) {
+			HandleUnlock(__FILE__, __LINE__);
+			break;
+		}
 
 		/* get client info */
 		if (GetHandleInfo(client_handle, &handle_info) != HND_CLIENT) {
@@ -853,8 +859,8 @@ void gena_process_notification_event(SOCKINFO *info, http_message_t *event)
 				 * subscribing) */
 				SubscribeLock();
 
-				/* get HandleLock again */
-				HandleLock(__FILE__, __LINE__);
+				/* get the handle read lock again */
+				HandleReadLock(__FILE__, __LINE__);
 
 				if (GetHandleInfo(client_handle,
 					    &handle_info) != HND_CLIENT) {
@@ -42,8 +42,10 @@
 	#ifdef INCLUDE_DEVICE_APIS
 
 		#include <assert.h>
+		#include <ctype.h>
 
 		#include "gena.h"
+		#include "gena_connpool.h"
 		#include "httpreadwrite.h"
 		#include "posix_overwrites.h" // IWYU pragma: keep
 		#include "ssdplib.h"
@@ -83,10 +85,203 @@ int genaUnregisterDevice(
 	return ret;
 }
 
+/*! Closing tag of a property set. */
+		#define XML_PROPERTYSET_FOOTER "</e:propertyset>\n\n"
+
+struct s_UpnpPropertySetBuilder
+{
+	/*! The header and the properties added so far. */
+	membuffer body;
+};
+
+/*!
+ * \brief Starts an empty property set.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int PropertySetInit(UpnpPropertySetBuilder *p)
+{
+	membuffer_init(&p->body);
+
+	return membuffer_append(&p->body,
+		XML_PROPERTYSET_HEADER,
+		sizeof(XML_PROPERTYSET_HEADER) - (size_t)1);
+}
+
+/*!
+ * \brief Appends text to a property set, replacing the characters that XML
+ * reserves by their entity, as ixml does.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+static int PropertySetAppendEscaped(UpnpPropertySetBuilder *p, const char *text)
+{
+	const char *entity;
+	size_t n;
+
+	for (;;) {
+		n = strcspn(text, "<>&'\"");
+		if (n > (size_t)0 && membuffer_append(&p->body, text, n) != 0)
+			return UPNP_E_OUTOF_MEMORY;
+		text += n;
+		switch (*text) {
+		case '\0':
+			return UPNP_E_SUCCESS;
+		case '<':
+			entity = "&lt;";
+			break;
+		case '>':
+			entity = "&gt;";
+			break;
+		case '&':
+			entity = "&amp;";
+			break;
+		case '\'':
+			entity = "&apos;";
+			break;
+		default:
+			entity = "&quot;";
+			break;
+		}
+		if (membuffer_append_str(&p->body, entity) != 0)
+			return UPNP_E_OUTOF_MEMORY;
+		text++;
+	}
+}
+
+/*!
+ * \brief Checks that a variable name is an XML name, so that it can be
+ * used as an element name in the property set.
+ *
+ * Bytes of multi-byte UTF-8 sequences are accepted as name characters.
+ *
+ * \return 1 if the name is valid, 0 otherwise.
+ */
+static int PropertySetIsValidName(const char *name)
+{
+	const unsigned char *c = (const unsigned char *)name;
+
+	if (!(isalpha(*c) || *c == '_' || *c == ':' || *c >= 0x80))
+		return 0;
+	for (c++; *c; c++) {
+		if (!(isalnum(*c) || *c == '_' || *c == ':' || *c == '-' ||
+			    *c == '.' || *c >= 0x80))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*!
+ * \brief Appends a variable to a property set.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY, in which case the
+ * property set is unchanged.
+ */
+static int PropertySetAdd(
+	/*! [in] The property set. */
+	UpnpPropertySetBuilder *p,
+	/*! [in] The name of the variable. */
+	const char *name,
+	/*! [in] The value of the variable. */
+	const char *value,
+	/*! [in] Non-zero to write the characters that XML reserves as
+	 * entities, zero to copy the value verbatim. */
+	int escape)
+{
+	size_t length = p->body.length;
+	int ret;
+
+	if (membuffer_append_str(&p->body, "<e:property>\n<") != 0 ||
+		membuffer_append_str(&p->body, name) != 0 ||
+		membuffer_append(&p->body, ">", (size_t)1) != 0) {
+		ret = UPNP_E_OUTOF_MEMORY;
+	} else if (escape) {
+		ret = PropertySetAppendEscaped(p, value);
+	} else {
+		ret = membuffer_append_str(&p->body, value) != 0
+			      ? UPNP_E_OUTOF_MEMORY
+			      : UPNP_E_SUCCESS;
+	}
+	if (ret != UPNP_E_SUCCESS ||
+		membuffer_append(&p->body, "</", (size_t)2) != 0 ||
+		membuffer_append_str(&p->body, name) != 0 ||
+		membuffer_append_str(&p->body, ">\n</e:property>\n") != 0) {
+		/* leave the property set as it was */
+		p->body.length = length;
+		p->body.buf[length] = '\0';
+		return UPNP_E_OUTOF_MEMORY;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+DOMString genaPropertySetString(const UpnpPropertySetBuilder *p)
+{
+	DOMString out;
+
+	out = malloc(p->body.length + sizeof(XML_PROPERTYSET_FOOTER));
+	if (out == NULL)
+		return NULL;
+	memcpy(out, p->body.buf, p->body.length);
+	memcpy(out + p->body.length,
+		XML_PROPERTYSET_FOOTER,
+		sizeof(XML_PROPERTYSET_FOOTER));
+
+	return out;
+}
+
+UpnpPropertySetBuilder *UpnpPropertySetBuilder_new(void)
+{
+	UpnpPropertySetBuilder *p;
+
+	p = malloc(sizeof(UpnpPropertySetBuilder));
+	if (p == NULL)
+		return NULL;
+	if (PropertySetInit(p) != UPNP_E_SUCCESS) {
+		membuffer_destroy(&p->body);
+		free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+void UpnpPropertySetBuilder_delete(UpnpPropertySetBuilder *p)
+{
+	if (p == NULL)
+		return;
+	membuffer_destroy(&p->body);
+	free(p);
+}
+
+void UpnpPropertySetBuilder_clear(UpnpPropertySetBuilder *p)
+{
+	if (p == NULL)
+		return;
+	/* Keeps the memory for the next event. */
+	p->body.length = sizeof(XML_PROPERTYSET_HEADER) - (size_t)1;
+	p->body.buf[p->body.length] = '\0';
+}
+
+int UpnpPropertySetBuilder_add(
+	UpnpPropertySetBuilder *p, const char *name, const char *value)
+{
+	if (p == NULL || name == NULL || value == NULL ||
+		!PropertySetIsValidName(name))
+		return UPNP_E_INVALID_PARAM;
+
+	return PropertySetAdd(p, name, value, 1);
+}
+
 /*!
  * \brief Generates XML property set for notifications.
  *
- * \return UPNP_E_SUCCESS if successful else returns GENA_E_BAD_HANDLE.
+ * The values are copied verbatim, as UpnpNotify() and
+ * UpnpAcceptSubscription() always did: applications may pass markup on
+ * purpose.
+ *
+ * \return XML_SUCCESS if successful else returns UPNP_E_OUTOF_MEMORY.
  *
  * \note The XML_VERSION comment is NOT sent due to interoperability issues
  * 	with other UPnP vendors.
@@ -101,41 +296,23 @@ static int GeneratePropertySet(
 	/*! [out] PropertySet node in the string format. */
 	DOMString *out)
 {
-	char *buffer;
-	int counter = 0;
-	size_t size = 0;
+	UpnpPropertySetBuilder builder;
+	int ret;
+	int counter;
 
-	/*size += strlen(XML_VERSION);*/
-	size += strlen(XML_PROPERTYSET_HEADER);
-	size += strlen("</e:propertyset>\n\n");
-	for (counter = 0; counter < count; counter++) {
-		size += strlen("<e:property>\n</e:property>\n");
-		size += 2 * strlen(names[counter]) + strlen(values[counter]) +
-			strlen("<></>\n");
+	ret = PropertySetInit(&builder);
+	for (counter = 0; ret == UPNP_E_SUCCESS && counter < count; counter++) {
+		ret = PropertySetAdd(
+			&builder, names[counter], values[counter], 0);
 	}
+	if (ret == UPNP_E_SUCCESS) {
+		*out = genaPropertySetString(&builder);
+		if (*out == NULL)
+			ret = UPNP_E_OUTOF_MEMORY;
+	}
+	membuffer_destroy(&builder.body);
 
-	buffer = (char *)malloc(size + 1);
-	if (buffer == NULL)
-		return UPNP_E_OUTOF_MEMORY;
-	memset(buffer, 0, size + 1);
-	/*
-	strcpy(buffer,XML_VERSION);
-	strcat(buffer, XML_PROPERTYSET_HEADER);
-	*/
-	strcpy(buffer, XML_PROPERTYSET_HEADER);
-	for (counter = 0; counter < count; counter++) {
-		strcat(buffer, "<e:property>\n");
-		sprintf(&buffer[strlen(buffer)],
-			"<%s>%s</%s>\n</e:property>\n",
-			names[counter],
-			values[counter],
-			names[counter]);
-	}
-	strcat(buffer, "</e:propertyset>\n\n");
-	*out = ixmlCloneDOMString(buffer);
-	free(buffer);
-
-	return XML_SUCCESS;
+	return ret == UPNP_E_SUCCESS ? XML_SUCCESS : ret;
 }
 
 /*!
@@ -159,9 +336,105 @@ static void free_notify_struct(
 	free(p);
 }
 
+/*!
+ * \brief Sends a notify message on a connection and reads the reply.
+ *
+ * \return on success returns UPNP_E_SUCCESS, otherwise returns a UPNP error.
+ */
+static int notify_exchange(
+	/*! [in] Connection to the control point. */
+	SOCKINFO *info,
+	/*! [in] Start line and headers. */
+	membuffer *start_msg,
+	/*! [in] The evented XML. */
+	char *propertySet,
+	/*! [out] The response from the control point. */
+	http_parser_t *response,
+	/*! [out] On failure, non-zero if the control point cannot have
+	 * handled the message: the send failed, or the connection was closed or
+	 * reset before any byte of the reply. A timeout or a partial reply is
+	 * not retryable, since the event may have been delivered. */
+	int *retryable)
+{
+	int ret_code;
+	int err_code;
+	int timeout;
+	const char *CRLF = "\r\n";
+
+	*retryable = 0;
+	timeout = GENA_NOTIFICATION_SENDING_TIMEOUT;
+	/* send msg (note: end of notification will contain "\r\n" twice) */
+	ret_code = http_SendMessage(info,
+		&timeout,
+		"bbb",
+		start_msg->buf,
+		start_msg->length,
+		propertySet,
+		strlen(propertySet),
+		CRLF,
+		strlen(CRLF));
+	if (ret_code) {
+		*retryable = 1;
+		return ret_code;
+	}
+	timeout = GENA_NOTIFICATION_ANSWERING_TIMEOUT;
+	ret_code = http_RecvMessage(
+		info, response, HTTPMETHOD_NOTIFY, &timeout, &err_code);
+	if (ret_code) {
+		/* UPNP_E_BAD_HTTPMSG without data is an orderly close */
+		*retryable = response->msg.msg.length == 0 &&
+			     (ret_code == UPNP_E_SOCKET_ERROR ||
+				     ret_code == UPNP_E_BAD_HTTPMSG);
+		httpmsg_destroy(&response->msg);
+		return ret_code;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Checks whether the connection a notify reply came in on can carry
+ * another notify message.
+ *
+ * \return 1 if the connection can be reused, 0 otherwise.
+ */
+static int notify_response_allows_reuse(
+	/*! [in] The response from the control point. */
+	http_parser_t *response)
+{
+	http_message_t *msg = &response->msg;
+	http_header_t *header;
+	memptr value;
+
+	if (msg->major_version != 1 || msg->minor_version < 1) {
+		return 0;
+	}
+	/* A body delimited by the end of the connection, or bytes past the
+	 * end of the reply, leave the connection in an unknown state. */
+	if (response->position != POS_COMPLETE ||
+		response->ent_position == ENTREAD_UNTIL_CLOSE ||
+		msg->msg.length >
+			response->entity_start_position + msg->entity.length) {
+		return 0;
+	}
+	header = httpmsg_find_hdr_str(msg, "CONNECTION");
+	if (header) {
+		value.buf = header->value.buf;
+		value.length = header->value.length;
+		if (raw_find_str(&value, "close") >= 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 /*!
  * \brief Sends the notify message and returns a reply.
  *
+ * The connection is borrowed from the GENA connection pool and handed back
+ * to it afterwards if the control point keeps it open.
+ *
  * \return on success returns UPNP_E_SUCCESS, otherwise returns a UPNP error.
  *
  * \note called by genaNotify
@@ -180,10 +453,9 @@ static UPNP_INLINE int notify_send_and_recv(
 	SOCKET conn_fd;
 	membuffer start_msg;
 	int ret_code;
-	int err_code;
-	int timeout;
+	int reused;
+	int retryable;
 	SOCKINFO info;
-	const char *CRLF = "\r\n";
 
 	/* connect */
 	UpnpPrintf(UPNP_ALL,
@@ -194,57 +466,58 @@ static UPNP_INLINE int notify_send_and_recv(
 		(int)destination_url->hostport.text.size,
 		destination_url->hostport.text.buff);
 
-	conn_fd = http_Connect(destination_url, &url);
-	if (conn_fd < 0)
-		/* return UPNP error */
-		return UPNP_E_SOCKET_CONNECT;
-	ret_code = sock_init(&info, conn_fd);
+	ret_code = gena_connpool_get(destination_url, &url, &info, &reused);
 	if (ret_code) {
-		sock_destroy(&info, SD_BOTH);
+		/* return UPNP error */
 		return ret_code;
 	}
 	/* make start line and HOST header */
 	membuffer_init(&start_msg);
-	if (http_MakeMessage(&start_msg,
-		    1,
-		    1,
-		    "q"
-		    "s",
-		    HTTPMETHOD_NOTIFY,
-		    &url,
-		    mid_msg->buf) != 0) {
+	if (membuffer_reserve(&start_msg,
+		    mid_msg->length + url.pathquery.size +
+			    url.hostport.text.size + (size_t)32) != 0 ||
+		http_MakeMessage(&start_msg,
+			1,
+			1,
+			"q"
+			"s",
+			HTTPMETHOD_NOTIFY,
+			&url,
+			mid_msg->buf) != 0) {
 		membuffer_destroy(&start_msg);
-		sock_destroy(&info, SD_BOTH);
+		gena_connpool_put(&url, &info, 0);
 		return UPNP_E_OUTOF_MEMORY;
 	}
-	timeout = GENA_NOTIFICATION_SENDING_TIMEOUT;
-	/* send msg (note: end of notification will contain "\r\n" twice) */
-	ret_code = http_SendMessage(&info,
-		&timeout,
-		"bbb",
-		start_msg.buf,
-		start_msg.length,
-		propertySet,
-		strlen(propertySet),
-		CRLF,
-		strlen(CRLF));
-	if (ret_code) {
-		membuffer_destroy(&start_msg);
+	ret_code = notify_exchange(
+		&info, &start_msg, propertySet, response, &retryable);
+	if (ret_code && reused && retryable) {
+		/* The control point closed the pooled connection before it
+		 * got the message, try once more on a new one. Any other
+		 * failure may come after the event was handled, and sending
+		 * it again would deliver it twice. */
 		sock_destroy(&info, SD_BOTH);
-		return ret_code;
+		conn_fd = http_Connect(destination_url, &url);
+		if (conn_fd < 0) {
+			membuffer_destroy(&start_msg);
+			return UPNP_E_SOCKET_CONNECT;
+		}
+		ret_code = sock_init(&info, conn_fd);
+		if (ret_code != UPNP_E_SUCCESS) {
+			sock_close(conn_fd);
+			membuffer_destroy(&start_msg);
+			return ret_code;
+		}
+		ret_code = notify_exchange(
+			&info, &start_msg, propertySet, response, &retryable);
 	}
-	timeout = GENA_NOTIFICATION_ANSWERING_TIMEOUT;
-	ret_code = http_RecvMessage(
-		&info, response, HTTPMETHOD_NOTIFY, &timeout, &err_code);
+	membuffer_destroy(&start_msg);
 	if (ret_code) {
-		membuffer_destroy(&start_msg);
+		/* should shutdown completely when closing socket */
 		sock_destroy(&info, SD_BOTH);
-		httpmsg_destroy(&response->msg);
 		return ret_code;
 	}
-	/* should shutdown completely when closing socket */
-	sock_destroy(&info, SD_BOTH);
-	membuffer_destroy(&start_msg);
+	gena_connpool_put(
+		&url, &info, notify_response_allows_reuse(response));
 
 	return UPNP_E_SUCCESS;
 }
@@ -277,17 +550,20 @@ static int genaNotify(
 	int return_code = -1;
 
 	membuffer_init(&mid_msg);
-	if (http_MakeMessage(&mid_msg,
-		    1,
-		    1,
-		    "s"
-		    "ssc"
-		    "sdcc",
-		    headers,
-		    "SID: ",
-		    sub->sid,
-		    "SEQ: ",
-		    sub->ToSendEventKey) != 0) {
+	/* room for the SID and SEQ lines */
+	if (membuffer_reserve(&mid_msg,
+		    strlen(headers) + strlen(sub->sid) + (size_t)32) != 0 ||
+		http_MakeMessage(&mid_msg,
+			1,
+			1,
+			"s"
+			"ssc"
+			"sdcc",
+			headers,
+			"SID: ",
+			sub->sid,
+			"SEQ: ",
+			sub->ToSendEventKey) != 0) {
 		membuffer_destroy(&mid_msg);
 		return UPNP_E_OUTOF_MEMORY;
 	}
@@ -338,12 +614,17 @@ static void genaNotifyThread(
 	int return_code;
 	struct Handle_Info *handle_info;
 
-	/* This should be a HandleLock and not a HandleReadLock otherwise if
-	 * there is a lot of notifications, then multiple threads will acquire a
-	 * read lock and the thread which sends the notification will be blocked
-	 * forever on the HandleLock at the end of this function. */
-	/*HandleReadLock(__FILE__, __LINE__); */
-	HandleLock(__FILE__, __LINE__);
+	/* The read lock keeps the handle alive and excludes the writers; the
+	 * handle mutex serializes the notify threads of this handle, so that
+	 * the notifications of different devices complete in parallel. This
+	 * relies on the handle lock preferring writers (see
+	 * UpnpInitMutexes()): with the reader preference of glibc, a flood of
+	 * notify threads would keep the read lock taken and UpnpNotify() and
+	 * the unregistration functions would wait forever for the write lock.
+	 * Where writers are not preferred, that starvation is the price of
+	 * the parallel completions. The notification itself is sent without
+	 * any lock. */
+	HandleReadLock(__FILE__, __LINE__);
 	/* validate context */
 
 	if (GetHandleInfo(in->device_handle, &handle_info) != HND_DEVICE) {
@@ -352,33 +633,38 @@ static void genaNotifyThread(
 		return;
 	}
 
+	ithread_mutex_lock(&handle_info->Mutex);
 	if (!(service = FindServiceId(
 		      &handle_info->ServiceTable, in->servId, in->UDN)) ||
 		!service->active ||
 		!(sub = GetSubscriptionSID(in->sid, service)) ||
 		copy_subscription(sub, &sub_copy) != HTTP_SUCCESS) {
 		free_notify_struct(in);
+		ithread_mutex_unlock(&handle_info->Mutex);
 		HandleUnlock(__FILE__, __LINE__);
 		return;
 	}
+	ithread_mutex_unlock(&handle_info->Mutex);
 
 	HandleUnlock(__FILE__, __LINE__);
 
 	/* send the notify */
 	return_code = genaNotify(in->headers, in->propertySet, &sub_copy);
 	freeSubscription(&sub_copy);
-	HandleLock(__FILE__, __LINE__);
+	HandleReadLock(__FILE__, __LINE__);
 	if (GetHandleInfo(in->device_handle, &handle_info) != HND_DEVICE) {
 		free_notify_struct(in);
 		HandleUnlock(__FILE__, __LINE__);
 		return;
 	}
+	ithread_mutex_lock(&handle_info->Mutex);
 	/* validate context */
 	if (!(service = FindServiceId(
 		      &handle_info->ServiceTable, in->servId, in->UDN)) ||
 		!service->active ||
 		!(sub = GetSubscriptionSID(in->sid, service))) {
 		free_notify_struct(in);
+		ithread_mutex_unlock(&handle_info->Mutex);
 		HandleUnlock(__FILE__, __LINE__);
 		return;
 	}
@@ -409,6 +695,7 @@ static void genaNotifyThread(
 		RemoveSubscriptionSID(in->sid, service);
 	free_notify_struct(in);
 
+	ithread_mutex_unlock(&handle_info->Mutex);
 	HandleUnlock(__FILE__, __LINE__);
 }
 
@@ -1042,6 +1329,49 @@ ExitFunction:
 	return ret;
 }
 
+int genaNotifyAllPropertySet(UpnpDevice_Handle device_handle,
+	char *UDN,
+	char *servId,
+	const UpnpPropertySetBuilder *PropSet)
+{
+	int ret = GENA_SUCCESS;
+	int line = 0;
+
+	DOMString propertySet = NULL;
+
+	UpnpPrintf(UPNP_INFO,
+		GENA,
+		__FILE__,
+		__LINE__,
+		"GENA BEGIN NOTIFY ALL PROPERTY SET\n");
+
+	propertySet = genaPropertySetString(PropSet);
+	if (propertySet == NULL) {
+		line = __LINE__;
+		ret = UPNP_E_OUTOF_MEMORY;
+		goto ExitFunction;
+	}
+	UpnpPrintf(UPNP_INFO,
+		GENA,
+		__FILE__,
+		__LINE__,
+		"GENERATED PROPERTY SET IN NOTIFY: %s\n",
+		propertySet);
+
+	ret = genaNotifyAllCommon(device_handle, UDN, servId, propertySet);
+
+ExitFunction:
+
+	UpnpPrintf(UPNP_INFO,
+		GENA,
+		__FILE__,
+		line,
+		"GENA END NOTIFY ALL PROPERTY SET, ret = %d\n",
+		ret);
+
+	return ret;
+}
+
 /*!
  * \brief Returns OK message in the case of a subscription request.
  *
@@ -1511,9 +1841,7 @@ void gena_process_subscription_request(SOCKINFO *info, http_message_t *request)
 		goto exit_function;
 	}
 	/* add to subscription list */
-	sub->next = service->subscriptionList;
-	service->subscriptionList = sub;
-	service->TotalSubscriptions++;
+	AddSubscription(service, sub);
 
 	/* finally generate callback for init table dump */
 	UpnpSubscriptionRequest_strcpy_ServiceId(
@@ -52,6 +52,7 @@
 	#include "ThreadPool.h"
 	#include "httpreadwrite.h"
 	#include "ithread.h"
+	#include "sockpoll.h"
 	#include "ssdplib.h"
 	#include "statcodes.h"
 	#include "unixutil.h" /* for socklen_t, EAFNOSUPPORT */ // IWYU pragma: keep
@@ -111,6 +112,10 @@ struct active_connection_t
 static MiniServerCallback gGetCallback = NULL;
 static MiniServerCallback gSoapCallback = NULL;
 static MiniServerCallback gGenaCallback = NULL;
+/*! Connections kept alive, protected by gActiveConnectionsMutex */
+static int gKeepAliveConnections = 0;
+/*! Limit of gKeepAliveConnections, -1 for none */
+static int gKeepAliveMaxConnections = -1;
 
 static const int ENABLE_IPV6 =
 		#ifdef UPNP_ENABLE_IPV6
@@ -343,6 +348,8 @@ static int dispatch_request(
 
 			getNumericHostRedirection(
 				(int)info->socket, host_port, sizeof host_port);
+			/* The redirection has no body length. */
+			info->keep_alive = 0;
 			membuffer_init(&redir_buf);
 			snprintf(redir_str,
 				sizeof redir_str,
@@ -404,6 +411,7 @@ static void add_active_connection(SOCKET sock)
 	if (!gActiveConnectionsInitialized) {
 		ListInit(&gActiveConnections, active_connection_cmp, free);
 		ithread_mutex_init(&gActiveConnectionsMutex, NULL);
+		gKeepAliveConnections = 0;
 		gActiveConnectionsInitialized = 1;
 	}
 
@@ -455,6 +463,45 @@ static void remove_active_connection(SOCKET sock)
 	ithread_mutex_unlock(&gActiveConnectionsMutex);
 }
 
+/*!
+ * \brief Reserves one of the gKeepAliveMaxConnections slots for a
+ * connection that is to be kept alive.
+ *
+ * \return 1 if the connection may be kept alive, 0 if the limit is reached.
+ */
+static int reserve_keep_alive(void)
+{
+	int ret = 0;
+
+	if (!gActiveConnectionsInitialized) {
+		return 0;
+	}
+	ithread_mutex_lock(&gActiveConnectionsMutex);
+	if (gKeepAliveMaxConnections < 0 ||
+		gKeepAliveConnections < gKeepAliveMaxConnections) {
+		++gKeepAliveConnections;
+		ret = 1;
+	}
+	ithread_mutex_unlock(&gActiveConnectionsMutex);
+
+	return ret;
+}
+
+/*!
+ * \brief Releases a slot taken with reserve_keep_alive().
+ */
+static void release_keep_alive(void)
+{
+	if (!gActiveConnectionsInitialized) {
+		return;
+	}
+	ithread_mutex_lock(&gActiveConnectionsMutex);
+	if (gKeepAliveConnections > 0) {
+		--gKeepAliveConnections;
+	}
+	ithread_mutex_unlock(&gActiveConnectionsMutex);
+}
+
 /*!
  * \brief Shutdown all active socket connections
  */
@@ -521,7 +568,76 @@ static void free_handle_request_arg(
 }
 
 /*!
- * \brief Receive the request and dispatch it for handling.
+ * \brief Checks whether the connection may be reused once the request held
+ * by the parser has been answered.
+ *
+ * \return 1 if the connection can be kept alive, 0 otherwise.
+ */
+static int request_allows_keep_alive(
+	/*! [in] HTTP parser object holding the request. */
+	http_parser_t *parser)
+{
+	http_message_t *hmsg = &parser->msg;
+	http_header_t *header;
+	memptr value;
+
+	/* Persistent connections are only the default since HTTP/1.1. */
+	if (hmsg->major_version != 1 || hmsg->minor_version < 1) {
+		return 0;
+	}
+	/* Web POST bodies are consumed by the callback and chunked bodies
+	 * leave no reliable request boundary behind them. */
+	if (parser->position != POS_COMPLETE ||
+		hmsg->method == HTTPMETHOD_POST ||
+		httpmsg_find_hdr(hmsg, HDR_TRANSFER_ENCODING, NULL)) {
+		return 0;
+	}
+	/* Bytes of a pipelined request were read along with this one. */
+	if (hmsg->msg.length >
+		parser->entity_start_position + hmsg->entity.length) {
+		return 0;
+	}
+	header = httpmsg_find_hdr_str(hmsg, "CONNECTION");
+	if (header) {
+		value.buf = header->value.buf;
+		value.length = header->value.length;
+		if (raw_find_str(&value, "close") >= 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*!
+ * \brief Waits for the next request on a persistent connection.
+ *
+ * \return 1 if data is available, 0 if the peer closed the connection, the
+ * idle timeout expired or the wait failed.
+ */
+static int wait_for_next_request(
+	/*! [in] Socket Information object. */
+	SOCKINFO *info,
+	/*! [in] Idle timeout in seconds. */
+	int timeout_secs)
+{
+	char c;
+
+	/* poll() rather than select(), the socket may be past FD_SETSIZE */
+	if (sockpoll_wait_one(info->socket, timeout_secs * 1000) != 1) {
+		return 0;
+	}
+	/* A readable socket without data means an orderly shutdown. */
+	return recv(info->socket, &c, 1, MSG_PEEK) > 0;
+}
+
+/*!
+ * \brief Receive the requests of a connection and dispatch them for handling.
+ *
+ * HTTP/1.1 connections are kept open for further requests until the client
+ * asks to close, stays idle for gHttpKeepAliveTimeout seconds or has sent
+ * gHttpKeepAliveMaxRequests requests. Each of them holds a thread while it
+ * waits, so only gKeepAliveMaxConnections of them are kept at a time.
  */
 static void handle_request(
 	/*! [in] Request Message to be handled. */
@@ -530,11 +646,13 @@ static void handle_request(
 	SOCKINFO info;
 	int http_error_code;
 	int ret_code;
-	int major = 1;
-	int minor = 1;
+	int major;
+	int minor;
+	int num_requests = 0;
+	int keep_alive_reserved = 0;
 	http_parser_t parser;
 	http_message_t *hmsg = NULL;
-	int timeout = HTTP_DEFAULT_TIMEOUT;
+	int timeout;
 	struct mserv_request_t *request = (struct mserv_request_t *)args;
 	SOCKET connfd = request->connfd;
 
@@ -553,43 +671,63 @@ static void handle_request(
 		httpmsg_destroy(hmsg);
 		return;
 	}
-	/* read */
-	ret_code = http_RecvMessage(
-		&info, &parser, HTTPMETHOD_UNKNOWN, &timeout, &http_error_code);
-	if (ret_code != 0) {
-		goto error_handler;
-	}
-	UpnpPrintf(UPNP_INFO,
-		MSERV,
-		__FILE__,
-		__LINE__,
-		"miniserver %d: PROCESSING...\n",
-		connfd);
-	/* dispatch */
-	http_error_code = dispatch_request(&info, &parser);
-	if (http_error_code != 0) {
-		goto error_handler;
-	}
-	http_error_code = 0;
-
-error_handler:
-	if (http_error_code > 0) {
-		if (hmsg) {
-			major = hmsg->major_version;
-			minor = hmsg->minor_version;
+	do {
+		http_error_code = 0;
+		/* read */
+		timeout = HTTP_DEFAULT_TIMEOUT;
+		ret_code = http_RecvMessage(&info,
+			&parser,
+			HTTPMETHOD_UNKNOWN,
+			&timeout,
+			&http_error_code);
+		if (ret_code == 0) {
+			++num_requests;
+			info.keep_alive =
+				num_requests < gHttpKeepAliveMaxRequests &&
+				gMServState == MSERV_RUNNING &&
+				request_allows_keep_alive(&parser);
+			if (info.keep_alive && !keep_alive_reserved) {
+				keep_alive_reserved = reserve_keep_alive();
+				info.keep_alive = keep_alive_reserved;
+			}
+			UpnpPrintf(UPNP_INFO,
+				MSERV,
+				__FILE__,
+				__LINE__,
+				"miniserver %d: PROCESSING...\n",
+				connfd);
+			/* dispatch */
+			http_error_code = dispatch_request(&info, &parser);
+		}
+		if (ret_code != 0 || http_error_code != 0) {
+			info.keep_alive = 0;
 		}
-		handle_error(&info, http_error_code, major, minor);
+		if (http_error_code > 0) {
+			major = 1;
+			minor = 1;
+			if (hmsg) {
+				major = hmsg->major_version;
+				minor = hmsg->minor_version;
+			}
+			handle_error(&info, http_error_code, major, minor);
+		}
+		httpmsg_destroy(hmsg);
+	} while (info.keep_alive &&
+		 wait_for_next_request(&info, gHttpKeepAliveTimeout));
+	if (keep_alive_reserved) {
+		release_keep_alive();
 	}
+	remove_active_connection(connfd);
 	sock_destroy(&info, SD_BOTH);
-	httpmsg_destroy(hmsg);
 	free(request);
 
 	UpnpPrintf(UPNP_INFO,
 		MSERV,
 		__FILE__,
 		__LINE__,
-		"miniserver %d: COMPLETE\n",
-		connfd);
+		"miniserver %d: COMPLETE (%d requests)\n",
+		connfd,
+		num_requests);
 }
 
 /*!
@@ -646,14 +784,7 @@ static UPNP_INLINE void schedule_request_job(
 }
 	#endif
 
-static UPNP_INLINE void fdset_if_valid(SOCKET sock, fd_set *set)
-{
-	if (sock != INVALID_SOCKET) {
-		FD_SET(sock, set);
-	}
-}
-
-static void web_server_accept(SOCKET lsock, fd_set *set)
+static void web_server_accept(SOCKET lsock)
 {
 	#ifdef INTERNAL_WEB_SERVER
 	SOCKET asock;
@@ -661,45 +792,40 @@ static void web_server_accept(SOCKET lsock, fd_set *set)
 	struct sockaddr_storage clientAddr;
 	char errorBuffer[ERROR_BUFFER_LEN];
 
-	if (lsock != INVALID_SOCKET && FD_ISSET(lsock, set)) {
-		clientLen = sizeof(clientAddr);
-		asock = accept(
-			lsock, (struct sockaddr *)&clientAddr, &clientLen);
-		if (asock == INVALID_SOCKET) {
-			strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
-			UpnpPrintf(UPNP_INFO,
-				MSERV,
-				__FILE__,
-				__LINE__,
-				"miniserver: Error in accept(): %s\n",
-				errorBuffer);
-		} else {
-			schedule_request_job(
-				asock, (struct sockaddr *)&clientAddr);
-		}
+	clientLen = sizeof(clientAddr);
+	asock = accept(lsock, (struct sockaddr *)&clientAddr, &clientLen);
+	if (asock == INVALID_SOCKET) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		UpnpPrintf(UPNP_INFO,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"miniserver: Error in accept(): %s\n",
+			errorBuffer);
+	} else {
+		schedule_request_job(asock, (struct sockaddr *)&clientAddr);
 	}
 	#endif /* INTERNAL_WEB_SERVER */
 }
 
-static void ssdp_read(SOCKET *rsock, fd_set *set)
+static void ssdp_read(sockpoll *sp, SOCKET *rsock)
 {
-	if (*rsock != INVALID_SOCKET && FD_ISSET(*rsock, set)) {
-		int ret = readFromSSDPSocket(*rsock);
-		if (ret != 0) {
-			UpnpPrintf(UPNP_INFO,
-				MSERV,
-				__FILE__,
-				__LINE__,
-				"miniserver: Error in readFromSSDPSocket(%d): "
-				"closing socket\n",
-				*rsock);
-			sock_close(*rsock);
-			*rsock = INVALID_SOCKET;
-		}
+	int ret = readFromSSDPSocket(*rsock);
+	if (ret != 0) {
+		UpnpPrintf(UPNP_INFO,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"miniserver: Error in readFromSSDPSocket(%d): "
+			"closing socket\n",
+			*rsock);
+		sockpoll_remove(sp, *rsock);
+		sock_close(*rsock);
+		*rsock = INVALID_SOCKET;
 	}
 }
 
-static int receive_from_stopSock(SOCKET ssock, fd_set *set)
+static int receive_from_stopSock(SOCKET ssock)
 {
 	ssize_t byteReceived;
 	socklen_t clientLen;
@@ -707,45 +833,117 @@ static int receive_from_stopSock(SOCKET ssock, fd_set *set)
 	char requestBuf[256];
 	char buf_ntop[INET6_ADDRSTRLEN];
 
-	if (FD_ISSET(ssock, set)) {
-		clientLen = sizeof(clientAddr);
-		memset((char *)&clientAddr, 0, sizeof(clientAddr));
-		byteReceived = recvfrom(ssock,
+	clientLen = sizeof(clientAddr);
+	memset((char *)&clientAddr, 0, sizeof(clientAddr));
+	byteReceived = recvfrom(ssock,
+		requestBuf,
+		(size_t)25,
+		0,
+		(struct sockaddr *)&clientAddr,
+		&clientLen);
+	if (byteReceived > 0) {
+		requestBuf[byteReceived] = '\0';
+		inet_ntop(AF_INET,
+			&((struct sockaddr_in *)&clientAddr)->sin_addr,
+			buf_ntop,
+			sizeof(buf_ntop));
+		UpnpPrintf(UPNP_INFO,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"Received response: %s From host %s \n",
 			requestBuf,
-			(size_t)25,
-			0,
-			(struct sockaddr *)&clientAddr,
-			&clientLen);
-		if (byteReceived > 0) {
-			requestBuf[byteReceived] = '\0';
-			inet_ntop(AF_INET,
-				&((struct sockaddr_in *)&clientAddr)->sin_addr,
-				buf_ntop,
-				sizeof(buf_ntop));
-			UpnpPrintf(UPNP_INFO,
-				MSERV,
-				__FILE__,
-				__LINE__,
-				"Received response: %s From host %s \n",
-				requestBuf,
-				buf_ntop);
-			UpnpPrintf(UPNP_PACKET,
-				MSERV,
-				__FILE__,
-				__LINE__,
-				"Received multicast packet: \n %s\n",
-				requestBuf);
-			if (NULL != strstr(requestBuf, "ShutDown")) {
-				return 1;
-			}
-		} else {
-			UpnpPrintf(UPNP_INFO,
-				MSERV,
-				__FILE__,
-				__LINE__,
-				"miniserver: stopSock Error, aborting...\n");
+			buf_ntop);
+		UpnpPrintf(UPNP_PACKET,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"Received multicast packet: \n %s\n",
+			requestBuf);
+		if (NULL != strstr(requestBuf, "ShutDown")) {
 			return 1;
 		}
+	} else {
+		UpnpPrintf(UPNP_INFO,
+			MSERV,
+			__FILE__,
+			__LINE__,
+			"miniserver: stopSock Error, aborting...\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Registers every valid socket of the array with the poller.
+ *
+ * \return UPNP_E_SUCCESS or the first error returned by sockpoll_add().
+ */
+static int miniserver_poll_register(
+	/*! [in,out] Poller. */
+	sockpoll *sp,
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	SOCKET socks[] = {
+		miniSock->miniServerStopSock,
+		miniSock->miniServerSock4,
+		miniSock->miniServerSock6,
+		miniSock->miniServerSock6UlaGua,
+		miniSock->ssdpSock4,
+		miniSock->ssdpSock6,
+		miniSock->ssdpSock6UlaGua,
+	#ifdef INCLUDE_CLIENT_APIS
+		miniSock->ssdpReqSock4,
+		miniSock->ssdpReqSock6,
+	#endif /* INCLUDE_CLIENT_APIS */
+	};
+	size_t i;
+	int ret;
+
+	for (i = 0; i < sizeof socks / sizeof socks[0]; ++i) {
+		ret = sockpoll_add(sp, socks[i]);
+		if (ret != UPNP_E_SUCCESS) {
+			return ret;
+		}
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Services one socket reported ready by the poller.
+ *
+ * \return 1 if the stop socket asked the miniserver to shut down, 0
+ * otherwise.
+ */
+static int miniserver_handle_ready(
+	/*! [in,out] Poller. */
+	sockpoll *sp,
+	/*! [in,out] Socket Array. */
+	MiniServerSockArray *miniSock,
+	/*! [in] Ready socket. */
+	SOCKET sock)
+{
+	if (sock == miniSock->miniServerSock4 ||
+		sock == miniSock->miniServerSock6 ||
+		sock == miniSock->miniServerSock6UlaGua) {
+		web_server_accept(sock);
+	} else if (sock == miniSock->ssdpSock4) {
+		ssdp_read(sp, &miniSock->ssdpSock4);
+	} else if (sock == miniSock->ssdpSock6) {
+		ssdp_read(sp, &miniSock->ssdpSock6);
+	} else if (sock == miniSock->ssdpSock6UlaGua) {
+		ssdp_read(sp, &miniSock->ssdpSock6UlaGua);
+	#ifdef INCLUDE_CLIENT_APIS
+	} else if (sock == miniSock->ssdpReqSock4) {
+		ssdp_read(sp, &miniSock->ssdpReqSock4);
+	} else if (sock == miniSock->ssdpReqSock6) {
+		ssdp_read(sp, &miniSock->ssdpReqSock6);
+	#endif /* INCLUDE_CLIENT_APIS */
+	} else if (sock == miniSock->miniServerStopSock) {
+		return receive_from_stopSock(sock);
 	}
 
 	return 0;
@@ -763,78 +961,45 @@ static void RunMiniServer(
 	MiniServerSockArray *miniSock)
 {
 	char errorBuffer[ERROR_BUFFER_LEN];
-	fd_set expSet;
-	fd_set rdSet;
-	SOCKET maxMiniSock;
+	SOCKET ready[SOCKPOLL_MAX_SOCKETS];
 	int ret = 0;
+	int i;
 	int stopSock = 0;
 
-	maxMiniSock = 0;
-	maxMiniSock = max(maxMiniSock, miniSock->miniServerSock4);
-	maxMiniSock = max(maxMiniSock, miniSock->miniServerSock6);
-	maxMiniSock = max(maxMiniSock, miniSock->miniServerSock6UlaGua);
-	maxMiniSock = max(maxMiniSock, miniSock->miniServerStopSock);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpSock4);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpSock6);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpSock6UlaGua);
-	#ifdef INCLUDE_CLIENT_APIS
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpReqSock4);
-	maxMiniSock = max(maxMiniSock, miniSock->ssdpReqSock6);
-	#endif /* INCLUDE_CLIENT_APIS */
-	++maxMiniSock;
-
 	gMServState = MSERV_RUNNING;
 	while (!stopSock) {
-		FD_ZERO(&rdSet);
-		FD_ZERO(&expSet);
-		/* FD_SET()'s */
-		FD_SET(miniSock->miniServerStopSock, &expSet);
-		FD_SET(miniSock->miniServerStopSock, &rdSet);
-		fdset_if_valid(miniSock->miniServerSock4, &rdSet);
-		fdset_if_valid(miniSock->miniServerSock6, &rdSet);
-		fdset_if_valid(miniSock->miniServerSock6UlaGua, &rdSet);
-		fdset_if_valid(miniSock->ssdpSock4, &rdSet);
-		fdset_if_valid(miniSock->ssdpSock6, &rdSet);
-		fdset_if_valid(miniSock->ssdpSock6UlaGua, &rdSet);
-	#ifdef INCLUDE_CLIENT_APIS
-		fdset_if_valid(miniSock->ssdpReqSock4, &rdSet);
-		fdset_if_valid(miniSock->ssdpReqSock6, &rdSet);
-	#endif /* INCLUDE_CLIENT_APIS */
-		/* select() */
-		ret = select((int)maxMiniSock, &rdSet, NULL, &expSet, NULL);
-		if (ret == SOCKET_ERROR && errno == EINTR) {
-			continue;
-		}
-		if (ret == SOCKET_ERROR) {
+		ret = sockpoll_wait(
+			&miniSock->poll, ready, SOCKPOLL_MAX_SOCKETS, -1);
+		if (ret == UPNP_E_SOCKET_ERROR) {
 			strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
 			UpnpPrintf(UPNP_CRITICAL,
 				SSDP,
 				__FILE__,
 				__LINE__,
-				"Error in select(): %s\n",
+				"Error in sockpoll_wait(): %s\n",
 				errorBuffer);
 			continue;
-		} else {
-			web_server_accept(miniSock->miniServerSock4, &rdSet);
-			web_server_accept(miniSock->miniServerSock6, &rdSet);
-			web_server_accept(
-				miniSock->miniServerSock6UlaGua, &rdSet);
-	#ifdef INCLUDE_CLIENT_APIS
-			ssdp_read(&miniSock->ssdpReqSock4, &rdSet);
-			ssdp_read(&miniSock->ssdpReqSock6, &rdSet);
-	#endif /* INCLUDE_CLIENT_APIS */
-			ssdp_read(&miniSock->ssdpSock4, &rdSet);
-			ssdp_read(&miniSock->ssdpSock6, &rdSet);
-			ssdp_read(&miniSock->ssdpSock6UlaGua, &rdSet);
-			stopSock = receive_from_stopSock(
-				miniSock->miniServerStopSock, &rdSet);
+		}
+		for (i = 0; i < ret && !stopSock; ++i) {
+			stopSock = miniserver_handle_ready(
+				&miniSock->poll, miniSock, ready[i]);
 		}
 	}
+	sockpoll_destroy(&miniSock->poll);
 
 	/* shutdown connections */
 	shutdown_all_active_connections();
 
 	/* Close all sockets. */
+	#ifdef INCLUDE_DEVICE_APIS
+	/* SSDP packets still queued must not use them; this waits for the
+	 * ones being sent. */
+	ssdp_set_send_sockets(INVALID_SOCKET, INVALID_SOCKET);
+	#endif /* INCLUDE_DEVICE_APIS */
+	#ifdef INCLUDE_CLIENT_APIS
+	/* Likewise for the searches repeated by the timer thread. */
+	ssdp_set_req_sockets(INVALID_SOCKET, INVALID_SOCKET);
+	#endif /* INCLUDE_CLIENT_APIS */
 	sock_close(miniSock->miniServerSock4);
 	sock_close(miniSock->miniServerSock6);
 	sock_close(miniSock->miniServerSock6UlaGua);
@@ -1346,6 +1511,9 @@ int StartMiniServer(
 	int max_count = 10000;
 	MiniServerSockArray *miniSocket;
 	ThreadPoolJob job;
+	#ifdef INTERNAL_WEB_SERVER
+	ThreadPoolAttr attr;
+	#endif
 
 	memset(&job, 0, sizeof(job));
 
@@ -1362,6 +1530,14 @@ int StartMiniServer(
 	}
 	InitMiniServerSockArray(miniSocket);
 	#ifdef INTERNAL_WEB_SERVER
+	/* The miniserver itself takes one of the threads */
+	if (ThreadPoolGetAttr(&gMiniServerThreadPool, &attr) == 0 &&
+		attr.maxThreads != INFINITE_THREADS) {
+		gKeepAliveMaxConnections = (attr.maxThreads - 1) *
+					   HTTP_KEEPALIVE_MAX_PERCENT / 100;
+	} else {
+		gKeepAliveMaxConnections = -1;
+	}
 	/* V4 and V6 http listeners. */
 	ret_code = get_miniserver_sockets(
 		miniSocket, *listen_port4, *listen_port6, *listen_port6UlaGua);
@@ -1389,11 +1565,35 @@ int StartMiniServer(
 		free(miniSocket);
 		return ret_code;
 	}
+	/* Readiness notification for all of the above. */
+	ret_code = sockpoll_init(&miniSocket->poll);
+	if (ret_code == UPNP_E_SUCCESS) {
+		ret_code = miniserver_poll_register(&miniSocket->poll, miniSocket);
+		if (ret_code != UPNP_E_SUCCESS) {
+			sockpoll_destroy(&miniSocket->poll);
+		}
+	}
+	if (ret_code != UPNP_E_SUCCESS) {
+		sock_close(miniSocket->miniServerSock4);
+		sock_close(miniSocket->miniServerSock6);
+		sock_close(miniSocket->miniServerSock6UlaGua);
+		sock_close(miniSocket->miniServerStopSock);
+		sock_close(miniSocket->ssdpSock4);
+		sock_close(miniSocket->ssdpSock6);
+		sock_close(miniSocket->ssdpSock6UlaGua);
+	#ifdef INCLUDE_CLIENT_APIS
+		sock_close(miniSocket->ssdpReqSock4);
+		sock_close(miniSocket->ssdpReqSock6);
+	#endif /* INCLUDE_CLIENT_APIS */
+		free(miniSocket);
+		return ret_code;
+	}
 	TPJobInit(&job, (start_routine)RunMiniServer, (void *)miniSocket);
 	TPJobSetPriority(&job, MED_PRIORITY);
 	TPJobSetFreeFunction(&job, (free_routine)free);
 	ret_code = ThreadPoolAddPersistent(&gMiniServerThreadPool, &job, NULL);
 	if (ret_code < 0) {
+		sockpoll_destroy(&miniSocket->poll);
 		sock_close(miniSocket->miniServerSock4);
 		sock_close(miniSocket->miniServerSock6);
 		sock_close(miniSocket->miniServerSock6UlaGua);
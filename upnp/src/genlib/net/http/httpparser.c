@@ -55,6 +55,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "posix_overwrites.h" // IWYU pragma: keep
+
 /* entity positions */
 
 #define NUM_HTTP_METHODS 11
@@ -71,8 +73,7 @@ static str_int_entry Http_Method_Table[NUM_HTTP_METHODS] = {
 	{"POST", SOAPMETHOD_POST},
 	{"PUT", HTTPMETHOD_PUT}};
 
-#define NUM_HTTP_HEADER_NAMES 33
-str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
+str_int_entry Http_Header_Names[] = {
 	{"ACCEPT", HDR_ACCEPT},
 	{"ACCEPT-CHARSET", HDR_ACCEPT_CHARSET},
 	{"ACCEPT-ENCODING", HDR_ACCEPT_ENCODING},
@@ -108,6 +109,91 @@ str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES] = {
 	{"USN", HDR_USN},
 };
 
+/*! Size of Http_Header_Hash, a power of two. */
+#define HTTP_HEADER_HASH_SIZE 128
+
+/*! Perfect hash of the names in Http_Header_Names, see header_name_hash().
+ * Maps a hash to an index in Http_Header_Names, or -1. Must be regenerated
+ * when a name is added. */
+static const signed char Http_Header_Hash[HTTP_HEADER_HASH_SIZE] = {
+	17, 2, -1, -1, -1, -1, 7, -1, -1, -1, -1, -1, -1, 32, -1, -1,
+	26, -1, -1, -1, 9, -1, -1, -1, -1, -1, -1, -1, 19, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, 30, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, 23, -1, -1, -1, -1, 6, 4,
+	-1, -1, -1, -1, -1, -1, -1, -1, 0, -1, -1, -1, 24, 14, -1, 21,
+	1, -1, -1, 5, 15, -1, -1, -1, -1, -1, -1, -1, 13, -1, 20, -1,
+	-1, 3, 12, 11, -1, -1, 8, -1, 27, 25, 16, -1, -1, -1, -1, 29,
+	-1, -1, -1, -1, 31, -1, 10, -1, -1, 22, 28, -1, -1, 18, -1, -1,
+};
+
+/*! Fails to compile when cond is false. */
+#define HTTPPARSER_STATIC_ASSERT(cond, name) typedef char name[(cond) ? 1 : -1]
+
+/* NUM_HTTP_HEADER_NAMES must match the table, every name has its own slot
+ * in http_message_t.known_headers, and every index in Http_Header_Names
+ * fits in Http_Header_Hash, whose size is used as a mask. */
+HTTPPARSER_STATIC_ASSERT(sizeof Http_Header_Names /
+					 sizeof Http_Header_Names[0] ==
+				 NUM_HTTP_HEADER_NAMES,
+	http_header_names_count_check);
+HTTPPARSER_STATIC_ASSERT(
+	NUM_HTTP_HEADER_NAMES < HDR_NUM_IDS && HDR_TE < HDR_NUM_IDS,
+	http_header_ids_check);
+HTTPPARSER_STATIC_ASSERT(NUM_HTTP_HEADER_NAMES < HTTP_HEADER_HASH_SIZE &&
+				 (HTTP_HEADER_HASH_SIZE &
+					 (HTTP_HEADER_HASH_SIZE - 1)) == 0,
+	http_header_hash_check);
+
+/************************************************************************
+ * Function :	header_name_hash
+ *
+ * Parameters :
+ *	IN const char* name ;	header name, not null-terminated
+ *	IN size_t length ;	length of the name, greater than 0
+ *
+ * Description :	Case insensitive hash of a header name, without
+ *	collisions for the names in Http_Header_Names.
+ *
+ * Return : size_t ; index in Http_Header_Hash
+ ************************************************************************/
+static UPNP_INLINE size_t header_name_hash(const char *name, size_t length)
+{
+	return (length + (size_t)2 * (size_t)toupper((unsigned char)name[0]) +
+		       (size_t)16 *
+			       (size_t)toupper(
+				       (unsigned char)name[length - (size_t)1])) &
+	       (size_t)(HTTP_HEADER_HASH_SIZE - 1);
+}
+
+/************************************************************************
+ * Function :	header_name_to_index
+ *
+ * Parameters :
+ *	IN const char* name ;	header name, not null-terminated
+ *	IN size_t length ;	length of the name
+ *
+ * Description :	Looks up a header name, ignoring case.
+ *
+ * Return : int ; index in Http_Header_Names, or -1 if the name is not
+ *	known
+ ************************************************************************/
+static int header_name_to_index(const char *name, size_t length)
+{
+	int index;
+	const char *known;
+
+	if (length == (size_t)0)
+		return -1;
+	index = Http_Header_Hash[header_name_hash(name, length)];
+	if (index < 0)
+		return -1;
+	known = Http_Header_Names[index].name;
+	if (strlen(known) != length || strncasecmp(known, name, length))
+		return -1;
+
+	return index;
+}
+
 /***********************************************************************/
 /*************                 scanner                     *************/
 /***********************************************************************/
@@ -401,6 +487,7 @@ void httpmsg_init(http_message_t *msg)
 	msg->entity.buf = NULL;
 	msg->entity.length = (size_t)0;
 	ListInit(&msg->headers, httpmsg_compare, httpheader_free);
+	memset(msg->known_headers, 0, sizeof(msg->known_headers));
 	membuffer_init(&msg->msg);
 	membuffer_init(&msg->status_msg);
 }
@@ -426,6 +513,7 @@ void httpmsg_destroy(http_message_t *msg)
 		membuffer_destroy(&msg->msg);
 		membuffer_destroy(&msg->status_msg);
 		free(msg->urlbuf);
+		memset(msg->known_headers, 0, sizeof msg->known_headers);
 		msg->initialized = 0;
 	}
 }
@@ -475,6 +563,8 @@ http_header_t *httpmsg_find_hdr_str(
  *	OUT memptr* value ;		 Buffer to get the ouput to.
  *
  * Description :	Finds header from a list, with the given 'name_id'.
+ *	Headers added by the parser are found in constant time, other
+ *	headers by a search of the list.
  *
  * Return : http_header_t*  - Pointer to a header on success;
  *				NULL on failure
@@ -488,12 +578,20 @@ http_header_t *httpmsg_find_hdr(
 	ListNode *node;
 	http_header_t *data;
 
-	header.name_id = header_name_id;
-	node = ListFind(&msg->headers, NULL, &header);
-	if (node == NULL) {
+	data = NULL;
+	if (header_name_id >= 0 && header_name_id < HDR_NUM_IDS) {
+		/* the parser keeps known headers in their slot */
+		data = msg->known_headers[header_name_id];
+	}
+	if (data == NULL) {
+		/* headers added to the list by hand have no slot */
+		header.name_id = header_name_id;
+		node = ListFind(&msg->headers, NULL, &header);
+		data = node ? (http_header_t *)node->item : NULL;
+	}
+	if (data == NULL) {
 		return NULL;
 	}
-	data = (http_header_t *)node->item;
 	if (value != NULL) {
 		value->buf = data->value.buf;
 		value->length = data->value.length;
@@ -1215,6 +1313,109 @@ static UPNP_INLINE void parser_init(http_parser_t *parser)
 	scanner_init(&parser->scanner, &parser->msg.msg);
 }
 
+/************************************************************************
+ * Function: parser_match_version_number
+ *
+ * Parameters:
+ *	INOUT const char** cursor	; start of the number, moved past it
+ *	IN const char* end		; end of the buffer
+ *	OUT int* number			; the number
+ *
+ * Description: Reads the one to three digits of an HTTP version number.
+ *
+ * Returns:
+ *	PARSE_OK
+ *	PARSE_NO_MATCH
+ ************************************************************************/
+static parse_status_t parser_match_version_number(
+	const char **cursor, const char *end, int *number)
+{
+	const char *start = *cursor;
+	const char *p = start;
+
+	*number = 0;
+	while (p < end && p - start < 3 && *p >= '0' && *p <= '9') {
+		*number = *number * 10 + (*p - '0');
+		p++;
+	}
+	if (p == start || (p < end && *p >= '0' && *p <= '9'))
+		return PARSE_NO_MATCH;
+	*cursor = p;
+
+	return PARSE_OK;
+}
+
+/************************************************************************
+ * Function: parser_match_requestline_fast
+ *
+ * Parameters:
+ *	INOUT http_parser_t* parser	; HTTP Parser object
+ *	OUT memptr* method_str		; method
+ *	OUT memptr* url_str		; request URI
+ *
+ * Description: Matches a "METHOD URI HTTP/x.y" request line, as sent for
+ *	GET, POST, SUBSCRIBE, NOTIFY, M-SEARCH and the other methods, in one
+ *	pass over the buffer, without the token scanner. Only plain lines
+ *	are matched: the whole line must be in the buffer, single spaces
+ *	must separate the parts, the URI must be printable ASCII and the
+ *	version must be "HTTP/" and two numbers of at most three digits.
+ *	The version is stored in the message and the scanner is moved past
+ *	the line on success; they are left untouched otherwise, so that the
+ *	general path can handle the line.
+ *
+ * Returns:
+ *	PARSE_OK
+ *	PARSE_NO_MATCH
+ ************************************************************************/
+static parse_status_t parser_match_requestline_fast(
+	http_parser_t *parser, memptr *method_str, memptr *url_str)
+{
+	scanner_t *scanner = &parser->scanner;
+	const char *start = scanner->msg->buf + scanner->cursor;
+	const char *end = scanner->msg->buf + scanner->msg->length;
+	const char *cursor = start;
+	int major;
+	int minor;
+
+	/* method */
+	while (cursor < end && is_identifier_char(*cursor))
+		cursor++;
+	if (cursor == start || cursor == end || *cursor != ' ')
+		return PARSE_NO_MATCH;
+	method_str->buf = (char *)start;
+	method_str->length = (size_t)(cursor - start);
+	cursor++;
+	/* request URI */
+	url_str->buf = (char *)cursor;
+	while (cursor < end && *cursor > ' ' && *cursor < 127)
+		cursor++;
+	if (cursor == url_str->buf || cursor == end || *cursor != ' ')
+		return PARSE_NO_MATCH;
+	url_str->length = (size_t)(cursor - url_str->buf);
+	cursor++;
+	/* version */
+	if (end - cursor < 5 || memcmp(cursor, "HTTP/", (size_t)5) != 0)
+		return PARSE_NO_MATCH;
+	cursor += 5;
+	if (parser_match_version_number(&cursor, end, &major) != PARSE_OK ||
+		cursor == end || *cursor != '.')
+		return PARSE_NO_MATCH;
+	cursor++;
+	if (parser_match_version_number(&cursor, end, &minor) != PARSE_OK)
+		return PARSE_NO_MATCH;
+	/* end of line */
+	if (cursor < end && *cursor == TOKCHAR_CR)
+		cursor++;
+	if (cursor == end || *cursor != TOKCHAR_LF)
+		return PARSE_NO_MATCH;
+	cursor++;
+	parser->msg.major_version = major;
+	parser->msg.minor_version = minor;
+	scanner->cursor += (size_t)(cursor - start);
+
+	return PARSE_OK;
+}
+
 /************************************************************************
  * Function: parser_parse_requestline
  *
@@ -1247,6 +1448,11 @@ static parse_status_t parser_parse_requestline(http_parser_t *parser)
 	if (status != (parse_status_t)PARSE_OK) {
 		return status;
 	}
+	if (parser_match_requestline_fast(parser, &method_str, &url_str) ==
+		PARSE_OK) {
+		num_scanned = 2;
+		goto store_url;
+	}
 	/*simple get http 0.9 as described in http 1.0 spec */
 
 	status = match(&parser->scanner, "%s\t%S%w%c", &method_str, &url_str);
@@ -1303,6 +1509,20 @@ static parse_status_t parser_parse_requestline(http_parser_t *parser)
 	if (status != (parse_status_t)PARSE_OK) {
 		return status;
 	}
+	/* scan version */
+	save_char = version_str.buf[version_str.length];
+	version_str.buf[version_str.length] = '\0'; /* null-terminate */
+#ifdef _WIN32
+	num_scanned = sscanf_s(version_str.buf,
+#else
+	num_scanned = sscanf(version_str.buf,
+#endif
+		"%d . %d",
+		&hmsg->major_version,
+		&hmsg->minor_version);
+	version_str.buf[version_str.length] = save_char; /* restore */
+
+store_url:
 	/* remove excessive leading slashes, keep one slash */
 	while (url_str.length >= 2 && url_str.buf[0] == '/' &&
 		url_str.buf[1] == '/') {
@@ -1332,18 +1552,6 @@ static parse_status_t parser_parse_requestline(http_parser_t *parser)
 		return PARSE_FAILURE;
 	}
 
-	/* scan version */
-	save_char = version_str.buf[version_str.length];
-	version_str.buf[version_str.length] = '\0'; /* null-terminate */
-#ifdef _WIN32
-	num_scanned = sscanf_s(version_str.buf,
-#else
-	num_scanned = sscanf(version_str.buf,
-#endif
-		"%d . %d",
-		&hmsg->major_version,
-		&hmsg->minor_version);
-	version_str.buf[version_str.length] = save_char; /* restore */
 	if (num_scanned != 2 ||
 		/* HTTP version equals to 1.0 should fail for MSEARCH as
 		 * required by the UPnP certification tool */
@@ -1444,6 +1652,182 @@ parse_status_t parser_parse_responseline(http_parser_t *parser)
 	return PARSE_OK;
 }
 
+/************************************************************************
+ * Function: parser_add_header
+ *
+ * Parameters:
+ *	INOUT http_parser_t* parser	; HTTP Parser object
+ *	IN memptr* token		; header name
+ *	IN memptr* hdr_value		; header value
+ *
+ * Description: Adds a header to the message, or appends its value to a
+ *	header of the same name already in the message.
+ *
+ * Returns:
+ *	PARSE_OK
+ *	PARSE_FAILURE
+ ************************************************************************/
+static parse_status_t parser_add_header(
+	http_parser_t *parser, memptr *token, memptr *hdr_value)
+{
+	http_header_t *header;
+	int header_id;
+	int ret = 0;
+	int index;
+	http_header_t *orig_header;
+	char save_char;
+	int ret2;
+	static char zero = 0;
+
+	/* find header */
+	index = header_name_to_index(token->buf, token->length);
+	header_id = index != -1 ? Http_Header_Names[index].id : HDR_UNKNOWN;
+	if (header_id >= 0 && header_id < HDR_NUM_IDS) {
+		/*Check if it is a soap header */
+		if (header_id == HDR_SOAPACTION) {
+			parser->msg.method = SOAPMETHOD_POST;
+		}
+		orig_header = parser->msg.known_headers[header_id];
+	} else {
+		header_id = HDR_UNKNOWN;
+		save_char = token->buf[token->length];
+		token->buf[token->length] = '\0';
+		orig_header = httpmsg_find_hdr_str(&parser->msg, token->buf);
+		token->buf[token->length] = save_char; /* restore */
+	}
+	if (orig_header == NULL) {
+		/* add new header */
+		header = (http_header_t *)malloc(sizeof(http_header_t));
+		if (header == NULL) {
+			parser->http_error_code = HTTP_INTERNAL_SERVER_ERROR;
+			return PARSE_FAILURE;
+		}
+		membuffer_init(&header->name_buf);
+		membuffer_init(&header->value);
+		/* value can be 0 length */
+		if (hdr_value->length == (size_t)0) {
+			hdr_value->buf = &zero;
+			hdr_value->length = (size_t)1;
+		}
+		/* save in header in buffers */
+		if (membuffer_assign(
+			    &header->name_buf, token->buf, token->length) ||
+			membuffer_assign(&header->value,
+				hdr_value->buf,
+				hdr_value->length)) {
+			/* not enough mem */
+			membuffer_destroy(&header->value);
+			membuffer_destroy(&header->name_buf);
+			free(header);
+			parser->http_error_code = HTTP_INTERNAL_SERVER_ERROR;
+			return PARSE_FAILURE;
+		}
+		header->name.buf = header->name_buf.buf;
+		header->name.length = header->name_buf.length;
+		header->name_id = header_id;
+		if (!ListAddTail(&parser->msg.headers, header)) {
+			membuffer_destroy(&header->value);
+			membuffer_destroy(&header->name_buf);
+			free(header);
+			parser->http_error_code = HTTP_INTERNAL_SERVER_ERROR;
+			return PARSE_FAILURE;
+		}
+		if (header_id >= 0 && header_id < HDR_NUM_IDS) {
+			parser->msg.known_headers[header_id] = header;
+		}
+	} else if (hdr_value->length > (size_t)0) {
+		/* append value to existing header */
+		/* append space */
+		ret = membuffer_append_str(&orig_header->value, ", ");
+		/* append continuation of header value */
+		ret2 = membuffer_append(
+			&orig_header->value, hdr_value->buf, hdr_value->length);
+		if (ret == UPNP_E_OUTOF_MEMORY || ret2 == UPNP_E_OUTOF_MEMORY) {
+			/* not enuf mem */
+			parser->http_error_code = HTTP_INTERNAL_SERVER_ERROR;
+			return PARSE_FAILURE;
+		}
+	}
+
+	return PARSE_OK;
+}
+
+/************************************************************************
+ * Function: parser_match_header_fast
+ *
+ * Parameters:
+ *	INOUT http_parser_t* parser	; HTTP Parser object
+ *	OUT memptr* token		; header name
+ *	OUT memptr* hdr_value		; header value
+ *
+ * Description: Matches a "name: value" header line in one pass over the
+ *	buffer, without the token scanner. Only plain lines are matched:
+ *	the whole line and the first character of the next line must be in
+ *	the buffer, the next line must not continue the value and the value
+ *	must be printable ASCII without quotes. The scanner is moved past the
+ *	line on success and left untouched otherwise, so that the general
+ *	path can handle the line.
+ *
+ * Returns:
+ *	PARSE_OK
+ *	PARSE_NO_MATCH
+ ************************************************************************/
+static parse_status_t parser_match_header_fast(
+	http_parser_t *parser, memptr *token, memptr *hdr_value)
+{
+	scanner_t *scanner = &parser->scanner;
+	char *start = scanner->msg->buf + scanner->cursor;
+	char *end = scanner->msg->buf + scanner->msg->length;
+	char *cursor = start;
+	char *value_end;
+	int c;
+
+	/* name */
+	while (cursor < end && is_identifier_char(*cursor))
+		cursor++;
+	if (cursor == start || cursor == end)
+		return PARSE_NO_MATCH;
+	token->buf = start;
+	token->length = (size_t)(cursor - start);
+	while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+		cursor++;
+	if (cursor == end || *cursor != ':')
+		return PARSE_NO_MATCH;
+	cursor++;
+	while (cursor < end && (*cursor == ' ' || *cursor == '\t'))
+		cursor++;
+	/* value */
+	hdr_value->buf = cursor;
+	for (;;) {
+		if (cursor == end)
+			return PARSE_NO_MATCH;
+		c = (unsigned char)*cursor;
+		if (c == TOKCHAR_CR || c == TOKCHAR_LF)
+			break;
+		if ((c < 32 && c != '\t') || c > 126 || c == '"')
+			return PARSE_NO_MATCH;
+		cursor++;
+	}
+	value_end = cursor;
+	/* end of line */
+	if (*cursor == TOKCHAR_CR) {
+		cursor++;
+		if (cursor == end || *cursor != TOKCHAR_LF)
+			return PARSE_NO_MATCH;
+	}
+	cursor++;
+	/* a continuation line belongs to the value */
+	if (cursor == end || *cursor == ' ' || *cursor == '\t')
+		return PARSE_NO_MATCH;
+	while (value_end > hdr_value->buf &&
+		(value_end[-1] == ' ' || value_end[-1] == '\t'))
+		value_end--;
+	hdr_value->length = (size_t)(value_end - hdr_value->buf);
+	scanner->cursor += (size_t)(cursor - start);
+
+	return PARSE_OK;
+}
+
 /************************************************************************
  * Function: parser_parse_headers
  *
@@ -1467,19 +1851,19 @@ parse_status_t parser_parse_headers(http_parser_t *parser)
 	token_type_t tok_type;
 	scanner_t *scanner = &parser->scanner;
 	size_t save_pos;
-	http_header_t *header;
-	int header_id;
-	int ret = 0;
-	int index;
-	http_header_t *orig_header;
-	char save_char;
-	int ret2;
-	static char zero = 0;
 
 	assert(parser->position == (parser_pos_t)POS_HEADERS ||
 		parser->ent_position == ENTREAD_CHUNKY_HEADERS);
 
 	while (1) {
+		if (parser_match_header_fast(parser, &token, &hdr_value) ==
+			PARSE_OK) {
+			status = parser_add_header(parser, &token, &hdr_value);
+			if (status != PARSE_OK) {
+				return status;
+			}
+			continue;
+		}
 		save_pos = scanner->cursor;
 		/* check end of headers */
 		status = scanner_get_token(scanner, &token, &tok_type);
@@ -1514,84 +1898,9 @@ parse_status_t parser_parse_headers(http_parser_t *parser)
 			return status;
 		}
 		/* add header */
-		/* find header */
-		index = map_str_to_int(token.buf,
-			token.length,
-			Http_Header_Names,
-			NUM_HTTP_HEADER_NAMES,
-			0);
-		if (index != -1) {
-			/*Check if it is a soap header */
-			if (Http_Header_Names[index].id == HDR_SOAPACTION) {
-				parser->msg.method = SOAPMETHOD_POST;
-			}
-			header_id = Http_Header_Names[index].id;
-			orig_header =
-				httpmsg_find_hdr(&parser->msg, header_id, NULL);
-		} else {
-			header_id = HDR_UNKNOWN;
-			save_char = token.buf[token.length];
-			token.buf[token.length] = '\0';
-			orig_header =
-				httpmsg_find_hdr_str(&parser->msg, token.buf);
-			token.buf[token.length] = save_char; /* restore */
-		}
-		if (orig_header == NULL) {
-			/* add new header */
-			header = (http_header_t *)malloc(sizeof(http_header_t));
-			if (header == NULL) {
-				parser->http_error_code =
-					HTTP_INTERNAL_SERVER_ERROR;
-				return PARSE_FAILURE;
-			}
-			membuffer_init(&header->name_buf);
-			membuffer_init(&header->value);
-			/* value can be 0 length */
-			if (hdr_value.length == (size_t)0) {
-				hdr_value.buf = &zero;
-				hdr_value.length = (size_t)1;
-			}
-			/* save in header in buffers */
-			if (membuffer_assign(&header->name_buf,
-				    token.buf,
-				    token.length) ||
-				membuffer_assign(&header->value,
-					hdr_value.buf,
-					hdr_value.length)) {
-				/* not enough mem */
-				membuffer_destroy(&header->value);
-				membuffer_destroy(&header->name_buf);
-				free(header);
-				parser->http_error_code =
-					HTTP_INTERNAL_SERVER_ERROR;
-				return PARSE_FAILURE;
-			}
-			header->name.buf = header->name_buf.buf;
-			header->name.length = header->name_buf.length;
-			header->name_id = header_id;
-			if (!ListAddTail(&parser->msg.headers, header)) {
-				membuffer_destroy(&header->value);
-				membuffer_destroy(&header->name_buf);
-				free(header);
-				parser->http_error_code =
-					HTTP_INTERNAL_SERVER_ERROR;
-				return PARSE_FAILURE;
-			}
-		} else if (hdr_value.length > (size_t)0) {
-			/* append value to existing header */
-			/* append space */
-			ret = membuffer_append_str(&orig_header->value, ", ");
-			/* append continuation of header value */
-			ret2 = membuffer_append(&orig_header->value,
-				hdr_value.buf,
-				hdr_value.length);
-			if (ret == UPNP_E_OUTOF_MEMORY ||
-				ret2 == UPNP_E_OUTOF_MEMORY) {
-				/* not enuf mem */
-				parser->http_error_code =
-					HTTP_INTERNAL_SERVER_ERROR;
-				return PARSE_FAILURE;
-			}
+		status = parser_add_header(parser, &token, &hdr_value);
+		if (status != PARSE_OK) {
+			return status;
 		}
 	} /* end while */
 }
@@ -489,6 +489,37 @@ ExitFunction:
 	return ret;
 }
 
+#if EXCLUDE_WEB_SERVER == 0 && defined(HAVE_SENDFILE)
+/*!
+ * \brief Checks whether a file response can be sent with sendfile().
+ *
+ * The file must be a regular one read in full or in a known range, and its
+ * bytes must go to the socket unchanged.
+ *
+ * \return 1 if sendfile() can be used, 0 otherwise.
+ */
+static int can_sendfile(
+	/*! [in] Socket Information object. */
+	SOCKINFO *info,
+	/*! [in] Send Instruction object, may be NULL. */
+	struct SendInstruction *Instr)
+{
+	if (!Instr || Instr->IsVirtualFile || Instr->IsChunkActive ||
+		Instr->ReadSendSize < 0) {
+		return 0;
+	}
+	#ifdef UPNP_ENABLE_OPEN_SSL
+	if (info->ssl) {
+		return 0;
+	}
+	#else
+	(void)info;
+	#endif
+
+	return 1;
+}
+#endif /* EXCLUDE_WEB_SERVER == 0 && HAVE_SENDFILE */
+
 int http_SendMessage(SOCKINFO *info, int *TimeOut, const char *fmt, ...)
 {
 #if EXCLUDE_WEB_SERVER == 0
@@ -527,14 +558,6 @@ int http_SendMessage(SOCKINFO *info, int *TimeOut, const char *fmt, ...)
 				amount_to_be_read = (off_t)Data_Buf_Size;
 			if (amount_to_be_read < (off_t)WEB_SERVER_BUF_SIZE)
 				Data_Buf_Size = (size_t)amount_to_be_read;
-			ChunkBuf = malloc(
-				(size_t)(Data_Buf_Size + CHUNK_HEADER_SIZE +
-					 CHUNK_TAIL_SIZE));
-			if (!ChunkBuf) {
-				RetVal = UPNP_E_OUTOF_MEMORY;
-				goto ExitFunction;
-			}
-			file_buf = ChunkBuf + CHUNK_HEADER_SIZE;
 		} else if (c == 'f') {
 			/* file name */
 			filename = va_arg(argp, char *);
@@ -570,6 +593,30 @@ int http_SendMessage(SOCKINFO *info, int *TimeOut, const char *fmt, ...)
 					goto Cleanup_File;
 				}
 			}
+	#ifdef HAVE_SENDFILE
+			if (can_sendfile(info, Instr)) {
+				RetVal = sock_sendfile(info,
+					fileno(Fp),
+					ftello(Fp),
+					amount_to_be_read,
+					TimeOut);
+				if (RetVal != UPNP_E_FILE_READ_ERROR) {
+					/* Send error nothing we can do. */
+					if (RetVal != UPNP_E_SUCCESS)
+						info->keep_alive = 0;
+					RetVal = 0;
+				}
+				goto Cleanup_File;
+			}
+	#endif /* HAVE_SENDFILE */
+			ChunkBuf = malloc(
+				(size_t)(Data_Buf_Size + CHUNK_HEADER_SIZE +
+					 CHUNK_TAIL_SIZE));
+			if (!ChunkBuf) {
+				RetVal = UPNP_E_OUTOF_MEMORY;
+				goto Cleanup_File;
+			}
+			file_buf = ChunkBuf + CHUNK_HEADER_SIZE;
 			while (amount_to_be_read) {
 				if (Instr) {
 					int nr;
@@ -657,10 +704,12 @@ int http_SendMessage(SOCKINFO *info, int *TimeOut, const char *fmt, ...)
 						num_written !=
 							num_read +
 								strlen(Chunk_Header) +
-								(size_t)2)
+								(size_t)2) {
 						/* Send error nothing we can do.
 						 */
+						info->keep_alive = 0;
 						goto Cleanup_File;
+					}
 				} else {
 					/* write data */
 					nw = sock_write(info,
@@ -679,6 +728,7 @@ int http_SendMessage(SOCKINFO *info, int *TimeOut, const char *fmt, ...)
 					num_written = (size_t)nw;
 					if (nw <= 0 ||
 						num_written != num_read) {
+						info->keep_alive = 0;
 						goto Cleanup_File;
 					}
 				}
@@ -715,6 +765,7 @@ int http_SendMessage(SOCKINFO *info, int *TimeOut, const char *fmt, ...)
 						buf_length,
 						num_written);
 					if (num_written != buf_length) {
+						info->keep_alive = 0;
 						RetVal = 0;
 						goto ExitFunction;
 					}
@@ -727,6 +778,10 @@ ExitFunction:
 #if EXCLUDE_WEB_SERVER == 0
 	free(ChunkBuf);
 #endif /* EXCLUDE_WEB_SERVER */
+	if (RetVal != 0) {
+		/* The peer cannot tell where this response ends. */
+		info->keep_alive = 0;
+	}
 	return RetVal;
 }
 
@@ -1646,8 +1701,9 @@ int http_SendStatusResponse(SOCKINFO *info,
 	ret = http_MakeMessage(&membuf,
 		response_major,
 		response_minor,
-		"RSCB",
+		"RSkB",
 		http_status_code,
+		info,
 		http_status_code);
 	if (ret == 0) {
 		timeout = HTTP_DEFAULT_TIMEOUT;
@@ -1857,6 +1913,16 @@ int http_MakeMessage(membuffer *buf,
 					    buf, "CONNECTION: close\r\n"))
 					goto error_handler;
 			}
+		} else if (c == 'k') {
+			/* connection header, unless the connection persists */
+			SOCKINFO *info = (SOCKINFO *)va_arg(argp, SOCKINFO *);
+			assert(info);
+			if (!info->keep_alive &&
+				http_MakeMessage(buf,
+					http_major_version,
+					http_minor_version,
+					"C") != 0)
+				goto error_handler;
 		} else if (c == 'N') {
 			/* content-length header */
 			bignum = (off_t)va_arg(argp, off_t);
@@ -132,7 +132,6 @@ static const char *gMediaTypes[] = {
 
 	/* general */
 	#define NUM_MEDIA_TYPES 70
-	#define NUM_HTTP_HEADER_NAMES 33
 
 	#define ASCTIME_R_BUFFER_SIZE 26
 	#ifdef _WIN32
@@ -246,7 +245,6 @@ membuffer gWebserverCorsString;
 /*! XML document. */
 static struct xml_alias_t gAliasDoc;
 static ithread_mutex_t gWebMutex;
-extern str_int_entry Http_Header_Names[NUM_HTTP_HEADER_NAMES];
 
 /*!
  * \brief Decodes list and stores it in gMediaTypeList.
@@ -1436,7 +1434,7 @@ static int process_request(
 			    "s"
 			    "tcS"
 			    "Xc"
-			    "ECc",
+			    "Ekc",
 			    HTTP_PARTIAL_CONTENT, /* status code */
 			    UpnpFileInfo_get_ContentType(
 				    finfo), /* content type */
@@ -1446,7 +1444,8 @@ static int process_request(
 			    "LAST-MODIFIED: ",
 			    &aux_LastModified,
 			    X_USER_AGENT,
-			    UpnpFileInfo_get_ExtraHeadersList(finfo)) != 0) {
+			    UpnpFileInfo_get_ExtraHeadersList(finfo),
+			    info) != 0) {
 			goto error_handler;
 		}
 	} else if (RespInstr->IsRangeActive && !RespInstr->IsChunkActive) {
@@ -1461,7 +1460,7 @@ static int process_request(
 			    "s"
 			    "tcS"
 			    "Xc"
-			    "ECc",
+			    "Ekc",
 			    HTTP_PARTIAL_CONTENT,    /* status code */
 			    RespInstr->ReadSendSize, /* content length */
 			    UpnpFileInfo_get_ContentType(
@@ -1472,7 +1471,8 @@ static int process_request(
 			    "LAST-MODIFIED: ",
 			    &aux_LastModified,
 			    X_USER_AGENT,
-			    UpnpFileInfo_get_ExtraHeadersList(finfo)) != 0) {
+			    UpnpFileInfo_get_ExtraHeadersList(finfo),
+			    info) != 0) {
 			goto error_handler;
 		}
 	} else if (!RespInstr->IsRangeActive && RespInstr->IsChunkActive) {
@@ -1485,7 +1485,7 @@ static int process_request(
 			    "s"
 			    "tcS"
 			    "Xc"
-			    "ECc",
+			    "Ekc",
 			    HTTP_OK, /* status code */
 			    UpnpFileInfo_get_ContentType(
 				    finfo), /* content type */
@@ -1494,7 +1494,8 @@ static int process_request(
 			    "LAST-MODIFIED: ",
 			    &aux_LastModified,
 			    X_USER_AGENT,
-			    UpnpFileInfo_get_ExtraHeadersList(finfo)) != 0) {
+			    UpnpFileInfo_get_ExtraHeadersList(finfo),
+			    info) != 0) {
 			goto error_handler;
 		}
 	} else {
@@ -1509,7 +1510,7 @@ static int process_request(
 				    "s"
 				    "tcS"
 				    "Xc"
-				    "ECc",
+				    "Ekc",
 				    HTTP_OK, /* status code */
 				    RespInstr
 					    ->ReadSendSize, /* content length */
@@ -1520,11 +1521,14 @@ static int process_request(
 				    "LAST-MODIFIED: ",
 				    &aux_LastModified,
 				    X_USER_AGENT,
-				    UpnpFileInfo_get_ExtraHeadersList(finfo)) !=
-				0) {
+				    UpnpFileInfo_get_ExtraHeadersList(finfo),
+				    info) != 0) {
 				goto error_handler;
 			}
 		} else {
+			/* The body is only delimited by closing the
+			 * connection. */
+			info->keep_alive = 0;
 			if (http_MakeMessage(headers,
 				    resp_major,
 				    resp_minor,
@@ -1533,7 +1537,7 @@ static int process_request(
 				    "s"
 				    "tcS"
 				    "Xc"
-				    "ECc",
+				    "Ekc",
 				    HTTP_OK, /* status code */
 				    UpnpFileInfo_get_ContentType(
 					    finfo), /* content type */
@@ -1542,8 +1546,8 @@ static int process_request(
 				    "LAST-MODIFIED: ",
 				    &aux_LastModified,
 				    X_USER_AGENT,
-				    UpnpFileInfo_get_ExtraHeadersList(finfo)) !=
-				0) {
+				    UpnpFileInfo_get_ExtraHeadersList(finfo),
+				    info) != 0) {
 				goto error_handler;
 			}
 		}
@@ -1799,6 +1803,7 @@ void web_server_callback(
 			break;
 		case RESP_POST:
 			/* headers only */
+			info->keep_alive = 0;
 			ret = http_RecvPostMessage(
 				parser, info, filename.buf, &RespInstr);
 			/* Send response. */
@@ -61,6 +61,14 @@
 	#include <openssl/ssl.h>
 #endif
 
+#ifdef HAVE_SENDFILE
+	#include <limits.h>  /* for SSIZE_MAX */
+	#include <poll.h>
+	#include <pthread.h> /* for pthread_sigmask */
+	#include <signal.h>
+	#include <sys/sendfile.h>
+#endif
+
 #ifndef MSG_NOSIGNAL
 	#define MSG_NOSIGNAL 0
 #endif
@@ -290,6 +298,83 @@ int sock_write(
 	return sock_read_write(info, (char *)buffer, bufsize, timeoutSecs, 0);
 }
 
+#ifdef HAVE_SENDFILE
+int sock_sendfile(
+	SOCKINFO *info, int fd, off_t offset, off_t count, int *timeoutSecs)
+{
+	int retCode;
+	int ret = UPNP_E_SUCCESS;
+	int saved_errno = 0;
+	int pipe_pending;
+	struct pollfd pfd;
+	int timeout_ms;
+	struct timespec no_wait = {0, 0};
+	sigset_t pipe_set;
+	sigset_t old_set;
+	sigset_t pending;
+	time_t start_time = time(NULL);
+	SOCKET sockfd = info->socket;
+	ssize_t num_written;
+	size_t len;
+
+	/* sendfile() has no MSG_NOSIGNAL, so hold SIGPIPE back while sending
+	 * and discard the one raised by a peer that went away. */
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	sigpending(&pending);
+	pipe_pending = sigismember(&pending, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+	/* poll() works for any descriptor value, unlike select(). */
+	if (*timeoutSecs < 0)
+		timeout_ms = -1;
+	else if (*timeoutSecs > INT_MAX / 1000)
+		timeout_ms = INT_MAX;
+	else
+		timeout_ms = *timeoutSecs * 1000;
+	while (count > 0) {
+		pfd.fd = sockfd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		retCode = poll(&pfd, 1, timeout_ms);
+		if (retCode == 0) {
+			ret = UPNP_E_TIMEDOUT;
+			break;
+		}
+		if (retCode == -1) {
+			if (errno == EINTR)
+				continue;
+			ret = UPNP_E_SOCKET_ERROR;
+			break;
+		}
+		len = count > (off_t)SSIZE_MAX ? (size_t)SSIZE_MAX
+					       : (size_t)count;
+		num_written = sendfile(sockfd, fd, &offset, len);
+		if (num_written == -1) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			saved_errno = errno;
+			ret = UPNP_E_SOCKET_ERROR;
+			break;
+		}
+		if (num_written == 0) {
+			/* The file is shorter than announced. */
+			ret = UPNP_E_FILE_READ_ERROR;
+			break;
+		}
+		count -= (off_t)num_written;
+	}
+	if (saved_errno == EPIPE && !pipe_pending) {
+		sigtimedwait(&pipe_set, NULL, &no_wait);
+	}
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	/* subtract time used for writing. */
+	if (*timeoutSecs > 0)
+		*timeoutSecs -= (int)(time(NULL) - start_time);
+
+	return ret;
+}
+#endif /* HAVE_SENDFILE */
+
 int sock_make_blocking(SOCKET sock)
 {
 #ifdef _WIN32
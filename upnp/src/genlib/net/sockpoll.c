@@ -0,0 +1,234 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \addtogroup Sock
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Implements socket readiness notification with epoll or select.
+ */
+
+#include "config.h"
+
+#include "sockpoll.h"
+
+#include "upnp.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_EPOLL
+	#include <sys/epoll.h>
+	#include <unistd.h>
+#endif
+#ifndef _WIN32
+	#include <poll.h>
+#endif
+
+int sockpoll_init(sockpoll *sp)
+{
+	assert(sp);
+
+	memset(sp, 0, sizeof *sp);
+#ifdef HAVE_EPOLL
+	sp->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (sp->epfd == -1) {
+		return UPNP_E_OUTOF_SOCKET;
+	}
+#endif
+
+	return UPNP_E_SUCCESS;
+}
+
+void sockpoll_destroy(sockpoll *sp)
+{
+#ifdef HAVE_EPOLL
+	if (sp->epfd != -1) {
+		close(sp->epfd);
+		sp->epfd = -1;
+	}
+#endif
+	sp->count = 0;
+}
+
+int sockpoll_add(sockpoll *sp, SOCKET sock)
+{
+#ifdef HAVE_EPOLL
+	struct epoll_event ev;
+#endif
+
+	if (sock == INVALID_SOCKET) {
+		return UPNP_E_SUCCESS;
+	}
+	if (sp->count >= SOCKPOLL_MAX_SOCKETS) {
+		return UPNP_E_OUTOF_SOCKET;
+	}
+#ifdef HAVE_EPOLL
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.fd = sock;
+	if (epoll_ctl(sp->epfd, EPOLL_CTL_ADD, sock, &ev) == -1) {
+		return UPNP_E_SOCKET_ERROR;
+	}
+#endif
+	sp->socks[sp->count++] = sock;
+
+	return UPNP_E_SUCCESS;
+}
+
+void sockpoll_remove(sockpoll *sp, SOCKET sock)
+{
+	size_t i;
+
+	for (i = 0; i < sp->count; ++i) {
+		if (sp->socks[i] == sock) {
+#ifdef HAVE_EPOLL
+			epoll_ctl(sp->epfd, EPOLL_CTL_DEL, sock, NULL);
+#endif
+			sp->socks[i] = sp->socks[--sp->count];
+			return;
+		}
+	}
+}
+
+#ifdef HAVE_EPOLL
+int sockpoll_wait(
+	sockpoll *sp, SOCKET *ready, size_t max_ready, int timeout_ms)
+{
+	struct epoll_event events[SOCKPOLL_MAX_SOCKETS];
+	int n;
+	int i;
+
+	if (max_ready > SOCKPOLL_MAX_SOCKETS) {
+		max_ready = SOCKPOLL_MAX_SOCKETS;
+	}
+	n = epoll_wait(sp->epfd, events, (int)max_ready, timeout_ms);
+	if (n == -1) {
+		return errno == EINTR ? 0 : UPNP_E_SOCKET_ERROR;
+	}
+	for (i = 0; i < n; ++i) {
+		ready[i] = events[i].data.fd;
+	}
+
+	return n;
+}
+#else  /* HAVE_EPOLL */
+int sockpoll_wait(
+	sockpoll *sp, SOCKET *ready, size_t max_ready, int timeout_ms)
+{
+	fd_set rdSet;
+	fd_set expSet;
+	struct timeval tv;
+	SOCKET maxSock = 0;
+	size_t i;
+	size_t n = 0;
+	int ret;
+
+	FD_ZERO(&rdSet);
+	FD_ZERO(&expSet);
+	for (i = 0; i < sp->count; ++i) {
+		FD_SET(sp->socks[i], &rdSet);
+		FD_SET(sp->socks[i], &expSet);
+		if (sp->socks[i] > maxSock) {
+			maxSock = sp->socks[i];
+		}
+	}
+	if (timeout_ms >= 0) {
+		tv.tv_sec = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+	}
+	ret = select((int)maxSock + 1,
+		&rdSet,
+		NULL,
+		&expSet,
+		timeout_ms >= 0 ? &tv : NULL);
+	if (ret == SOCKET_ERROR) {
+		return errno == EINTR ? 0 : UPNP_E_SOCKET_ERROR;
+	}
+	for (i = 0; i < sp->count && n < max_ready; ++i) {
+		if (FD_ISSET(sp->socks[i], &rdSet) ||
+			FD_ISSET(sp->socks[i], &expSet)) {
+			ready[n++] = sp->socks[i];
+		}
+	}
+
+	return (int)n;
+}
+#endif /* HAVE_EPOLL */
+
+#ifndef _WIN32
+int sockpoll_wait_one(SOCKET sock, int timeout_ms)
+{
+	struct pollfd pfd;
+	int ret;
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret == -1) {
+		return errno == EINTR ? 0 : UPNP_E_SOCKET_ERROR;
+	}
+
+	return ret > 0;
+}
+#else  /* _WIN32 */
+int sockpoll_wait_one(SOCKET sock, int timeout_ms)
+{
+	/* A Windows fd_set is a list of handles, any socket fits. */
+	fd_set rdSet;
+	fd_set expSet;
+	struct timeval tv;
+	int ret;
+
+	FD_ZERO(&rdSet);
+	FD_ZERO(&expSet);
+	FD_SET(sock, &rdSet);
+	FD_SET(sock, &expSet);
+	if (timeout_ms >= 0) {
+		tv.tv_sec = timeout_ms / 1000;
+		tv.tv_usec = (timeout_ms % 1000) * 1000;
+	}
+	ret = select(
+		0, &rdSet, NULL, &expSet, timeout_ms >= 0 ? &tv : NULL);
+	if (ret == SOCKET_ERROR) {
+		return UPNP_E_SOCKET_ERROR;
+	}
+
+	return ret > 0;
+}
+#endif /* _WIN32 */
+
+/* @} Sock */
@@ -42,7 +42,380 @@
 
 #ifdef INCLUDE_DEVICE_APIS
 
+	/*! Offset basis of the FNV-1a hash. */
+	#define HASH_SEED (size_t)2166136261u
+
+/*!
+ * \brief Continues an FNV-1a hash over a buffer.
+ *
+ * \return The updated hash value.
+ */
+static size_t hash_buffer(
+	/*! [in] Hash of the preceding data, or HASH_SEED. */
+	size_t hash,
+	/*! [in] Data to hash. */
+	const char *buf,
+	/*! [in] Length of the data. */
+	size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= (unsigned char)buf[i];
+		hash *= (size_t)16777619u;
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Returns the first child element of a node with a given name.
+ */
+static IXML_Node *childElement(
+	/*! [in] The parent node. */
+	IXML_Node *node,
+	/*! [in] The element name. */
+	const char *name)
+{
+	IXML_Node *child;
+
+	for (child = ixmlNode_getFirstChild(node); child;
+		child = ixmlNode_getNextSibling(child)) {
+		if (ixmlNode_getNodeType(child) == eELEMENT_NODE &&
+			!strcmp(ixmlNode_getNodeName(child), name)) {
+			return child;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Returns the text of the first child element of a node with a given
+ * name, the same way as getElementValue().
+ *
+ * \return The text, owned by the document, or NULL.
+ */
+static const char *childElementValue(
+	/*! [in] The parent node. */
+	IXML_Node *node,
+	/*! [in] The element name. */
+	const char *name)
+{
+	IXML_Node *child = childElement(node, name);
+
+	if (child) {
+		child = ixmlNode_getFirstChild(child);
+	}
+	if (child && ixmlNode_getNodeType(child) == eTEXT_NODE) {
+		return ixmlNode_getNodeValue(child);
+	}
+
+	return NULL;
+}
+
+/*! State of the string pool while an index is built. */
+typedef struct
+{
+	/*! The pool. */
+	char *strings;
+	/*! Bytes of the pool in use. */
+	size_t used;
+	/*! Open addressing hash table of the pooled strings. */
+	const char **table;
+	/*! Number of entries in table, a power of two. */
+	size_t tableSize;
+} desc_pool;
+
+/*!
+ * \brief Replaces a string pointing into the document by its copy in the
+ * pool, storing it first if the pool has no equal string yet.
+ */
+static void internString(
+	/*! [in,out] The pool, large enough for all the strings. */
+	desc_pool *pool,
+	/*! [in,out] The string, can point to NULL. */
+	const char **s)
+{
+	size_t len;
+	size_t i;
+
+	if (!*s) {
+		return;
+	}
+	len = strlen(*s);
+	i = hash_buffer(HASH_SEED, *s, len) & (pool->tableSize - 1);
+	while (pool->table[i]) {
+		if (!strcmp(pool->table[i], *s)) {
+			*s = pool->table[i];
+			return;
+		}
+		i = (i + 1) & (pool->tableSize - 1);
+	}
+	memcpy(pool->strings + pool->used, *s, len + 1);
+	*s = pool->table[i] = pool->strings + pool->used;
+	pool->used += len + 1;
+}
+
+/*!
+ * \brief Moves the strings of an index, which point into the document, to
+ * the pool of the index.
+ *
+ * \return 0 or -1 if there is not enough memory.
+ */
+static int internDescIndex(
+	/*! [in,out] The index. */
+	desc_index *index)
+{
+	desc_pool pool;
+	size_t count = 1 + 2 * index->numDevices + 5 * index->numServices;
+	size_t size = index->URLBase ? strlen(index->URLBase) + 1 : 0;
+	size_t i;
+
+	for (i = 0; i < index->numDevices; i++) {
+		if (index->devices[i].deviceType)
+			size += strlen(index->devices[i].deviceType) + 1;
+		if (index->devices[i].UDN)
+			size += strlen(index->devices[i].UDN) + 1;
+	}
+	for (i = 0; i < index->numServices; i++) {
+		if (index->services[i].serviceType)
+			size += strlen(index->services[i].serviceType) + 1;
+		if (index->services[i].serviceId)
+			size += strlen(index->services[i].serviceId) + 1;
+		if (index->services[i].SCPDURL)
+			size += strlen(index->services[i].SCPDURL) + 1;
+		if (index->services[i].controlURL)
+			size += strlen(index->services[i].controlURL) + 1;
+		if (index->services[i].eventURL)
+			size += strlen(index->services[i].eventURL) + 1;
+	}
+	pool.used = 0;
+	pool.tableSize = 1;
+	while (pool.tableSize < 2 * count) {
+		pool.tableSize <<= 1;
+	}
+	pool.strings = malloc(size ? size : 1);
+	pool.table = calloc(pool.tableSize, sizeof *pool.table);
+	if (!pool.strings || !pool.table) {
+		free(pool.strings);
+		free(pool.table);
+		return -1;
+	}
+	internString(&pool, &index->URLBase);
+	for (i = 0; i < index->numDevices; i++) {
+		internString(&pool, &index->devices[i].deviceType);
+		internString(&pool, &index->devices[i].UDN);
+	}
+	for (i = 0; i < index->numServices; i++) {
+		internString(&pool, &index->services[i].serviceType);
+		internString(&pool, &index->services[i].serviceId);
+		internString(&pool, &index->services[i].SCPDURL);
+		internString(&pool, &index->services[i].controlURL);
+		internString(&pool, &index->services[i].eventURL);
+	}
+	free(pool.table);
+	index->strings = pool.strings;
+
+	return 0;
+}
+
+desc_index *buildDescIndex(IXML_Document *doc)
+{
+	desc_index *index;
+	desc_device *device;
+	desc_service *services;
+	IXML_NodeList *deviceList = NULL;
+	IXML_NodeList *serviceList = NULL;
+	IXML_Node *root;
+	IXML_Node *node;
+	size_t allocated = 0;
+	size_t i;
+	size_t j;
+
+	index = calloc(1, sizeof *index);
+	if (!index) {
+		return NULL;
+	}
+	root = childElement((IXML_Node *)doc, "root");
+	if (!root) {
+		return index;
+	}
+	index->URLBase = childElementValue(root, "URLBase");
+	deviceList =
+		ixmlElement_getElementsByTagName((IXML_Element *)root, "device");
+	if (ixmlNodeList_length(deviceList) > 0) {
+		index->devices = calloc(
+			ixmlNodeList_length(deviceList), sizeof *index->devices);
+		if (!index->devices) {
+			goto error_handler;
+		}
+	}
+	for (i = 0; (node = ixmlNodeList_item(deviceList, i)) != NULL; i++) {
+		device = &index->devices[index->numDevices++];
+		device->deviceType = childElementValue(node, "deviceType");
+		device->UDN = childElementValue(node, "UDN");
+		device->firstService = index->numServices;
+		/* Only the serviceList directly below the device, the
+		 * services of embedded devices belong to them. */
+		node = childElement(node, "serviceList");
+		if (!node) {
+			continue;
+		}
+		serviceList = ixmlElement_getElementsByTagName(
+			(IXML_Element *)node, "service");
+		for (j = 0; (node = ixmlNodeList_item(serviceList, j)) != NULL;
+			j++) {
+			if (index->numServices == allocated) {
+				allocated = allocated ? 2 * allocated : 8;
+				services = realloc(index->services,
+					allocated * sizeof *services);
+				if (!services) {
+					goto error_handler;
+				}
+				index->services = services;
+			}
+			services = &index->services[index->numServices++];
+			services->serviceType =
+				childElementValue(node, "serviceType");
+			services->serviceId =
+				childElementValue(node, "serviceId");
+			services->SCPDURL = childElementValue(node, "SCPDURL");
+			services->controlURL =
+				childElementValue(node, "controlURL");
+			services->eventURL =
+				childElementValue(node, "eventSubURL");
+		}
+		ixmlNodeList_free(serviceList);
+		serviceList = NULL;
+		device->numServices = index->numServices - device->firstService;
+	}
+	ixmlNodeList_free(deviceList);
+	deviceList = NULL;
+	if (internDescIndex(index) != 0) {
+		goto error_handler;
+	}
+
+	return index;
+
+error_handler:
+	ixmlNodeList_free(serviceList);
+	ixmlNodeList_free(deviceList);
+	freeDescIndex(index);
+
+	return NULL;
+}
+
+void freeDescIndex(desc_index *index)
+{
+	if (!index) {
+		return;
+	}
+	free(index->devices);
+	free(index->services);
+	free(index->strings);
+	free(index);
+}
+
 	#if EXCLUDE_GENA == 0
+		/*! Initial number of buckets of a service SID index. */
+		#define SUBSCRIPTION_INDEX_INITIAL (size_t)16
+
+/*!
+ * \brief Returns the SID index bucket of a subscription ID.
+ */
+static size_t sid_bucket(const service_info *service, const char *sid)
+{
+	return hash_buffer(HASH_SEED, sid, strlen(sid)) &
+	       (service->subscriptionIndexSize - 1);
+}
+
+/*!
+ * \brief Rebuilds the SID index of a service with a new number of buckets.
+ *
+ * The index is left unchanged if memory is short; it is only a shortcut
+ * over the subscription list.
+ */
+static void resizeSubscriptionIndex(
+	/*! [in] Service object providing the list of subscriptions. */
+	service_info *service,
+	/*! [in] New number of buckets, a power of two. */
+	size_t size)
+{
+	subscription **index;
+	subscription *sub;
+	size_t bucket;
+
+	index = calloc(size, sizeof *index);
+	if (!index) {
+		return;
+	}
+	free(service->subscriptionIndex);
+	service->subscriptionIndex = index;
+	service->subscriptionIndexSize = size;
+	for (sub = service->subscriptionList; sub; sub = sub->next) {
+		bucket = sid_bucket(service, sub->sid);
+		sub->hashNext = index[bucket];
+		index[bucket] = sub;
+	}
+}
+
+/*!
+ * \brief Returns the subscription of a service with a given SID, whether
+ * expired or not.
+ */
+static subscription *findSubscription(service_info *service, const char *sid)
+{
+	subscription *sub;
+
+	if (service->subscriptionIndex) {
+		sub = service->subscriptionIndex[sid_bucket(service, sid)];
+		for (; sub; sub = sub->hashNext) {
+			if (!strcmp(sub->sid, sid)) {
+				return sub;
+			}
+		}
+		return NULL;
+	}
+	for (sub = service->subscriptionList; sub; sub = sub->next) {
+		if (!strcmp(sub->sid, sid)) {
+			return sub;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Unlinks a subscription from the list and the SID index of a service
+ * and frees it.
+ */
+static void removeSubscription(service_info *service, subscription *sub)
+{
+	subscription **link;
+
+	if (service->subscriptionIndex) {
+		link = &service->subscriptionIndex[sid_bucket(service, sub->sid)];
+		while (*link && *link != sub) {
+			link = &(*link)->hashNext;
+		}
+		if (*link) {
+			*link = sub->hashNext;
+		}
+	}
+	if (sub->prev) {
+		sub->prev->next = sub->next;
+	} else {
+		service->subscriptionList = sub->next;
+	}
+	if (sub->next) {
+		sub->next->prev = sub->prev;
+	}
+	sub->next = NULL;
+	freeSubscriptionList(sub);
+	service->TotalSubscriptions--;
+}
+
 /************************************************************************
  *	Function :	copy_subscription
  *
@@ -72,9 +445,36 @@ int copy_subscription(subscription *in, subscription *out)
 	}
 	ListInit(&out->outgoing, 0, 0);
 	out->next = NULL;
+	out->prev = NULL;
+	out->hashNext = NULL;
 	return HTTP_SUCCESS;
 }
 
+void AddSubscription(service_info *service, subscription *sub)
+{
+	size_t bucket;
+
+	sub->prev = NULL;
+	sub->next = service->subscriptionList;
+	if (sub->next) {
+		sub->next->prev = sub;
+	}
+	service->subscriptionList = sub;
+	service->TotalSubscriptions++;
+	if (service->subscriptionIndex) {
+		bucket = sid_bucket(service, sub->sid);
+		sub->hashNext = service->subscriptionIndex[bucket];
+		service->subscriptionIndex[bucket] = sub;
+	}
+	if ((size_t)service->TotalSubscriptions >
+		service->subscriptionIndexSize) {
+		resizeSubscriptionIndex(service,
+			service->subscriptionIndexSize
+				? 2 * service->subscriptionIndexSize
+				: SUBSCRIPTION_INDEX_INITIAL);
+	}
+}
+
 /************************************************************************
  *	Function :	RemoveSubscriptionSID
  *
@@ -93,102 +493,66 @@ int copy_subscription(subscription *in, subscription *out)
  ************************************************************************/
 void RemoveSubscriptionSID(Upnp_SID sid, service_info *service)
 {
-	subscription *finger = service->subscriptionList;
-	subscription *previous = NULL;
+	subscription *found = findSubscription(service, sid);
 
-	while (finger) {
-		if (!strcmp(sid, finger->sid)) {
-			if (previous) {
-				previous->next = finger->next;
-			} else {
-				service->subscriptionList = finger->next;
-			}
-			finger->next = NULL;
-			freeSubscriptionList(finger);
-			finger = NULL;
-			service->TotalSubscriptions--;
-		} else {
-			previous = finger;
-			finger = finger->next;
-		}
+	if (found) {
+		removeSubscription(service, found);
 	}
 }
 
 subscription *GetSubscriptionSID(const Upnp_SID sid, service_info *service)
 {
-	subscription *next = service->subscriptionList;
-	subscription *previous = NULL;
-	subscription *found = NULL;
+	subscription *found = findSubscription(service, sid);
 	time_t current_time;
 
-	while (next && !found) {
-		if (!strcmp(next->sid, sid))
-			found = next;
-		else {
-			previous = next;
-			next = next->next;
-		}
-	}
 	if (found) {
 		/* get the current_time */
 		time(&current_time);
 		if (found->expireTime && found->expireTime < current_time) {
-			if (previous) {
-				previous->next = found->next;
-			} else {
-				service->subscriptionList = found->next;
-			}
-			found->next = NULL;
-			freeSubscriptionList(found);
+			removeSubscription(service, found);
 			found = NULL;
-			service->TotalSubscriptions--;
 		}
 	}
 	return found;
 }
 
-subscription *GetNextSubscription(service_info *service, subscription *current)
+/*!
+ * \brief Returns the first active subscription starting at a given one,
+ * removing the expired subscriptions met on the way.
+ */
+static subscription *firstActiveSubscription(
+	service_info *service, subscription *current)
 {
 	time_t current_time;
 	subscription *next = NULL;
-	subscription *previous = NULL;
-	int notDone = 1;
 
 	/* get the current_time */
 	time(&current_time);
-	while (notDone && current) {
-		previous = current;
-		current = current->next;
-
-		if (!current) {
-			notDone = 0;
-			next = current;
-		} else if (current->expireTime &&
-			   current->expireTime < current_time) {
-			previous->next = current->next;
-			current->next = NULL;
-			freeSubscriptionList(current);
-			current = previous;
-			service->TotalSubscriptions--;
+	while (current) {
+		next = current->next;
+		if (current->expireTime &&
+			current->expireTime < current_time) {
+			removeSubscription(service, current);
 		} else if (current->active) {
-			notDone = 0;
-			next = current;
+			return current;
 		}
+		current = next;
 	}
-	return next;
+	return NULL;
 }
 
-subscription *GetFirstSubscription(service_info *service)
+subscription *GetNextSubscription(service_info *service, subscription *current)
 {
-	subscription temp;
-	subscription *next = NULL;
+	if (!current) {
+		return NULL;
+	}
 
-	temp.next = service->subscriptionList;
-	next = GetNextSubscription(service, &temp);
-	service->subscriptionList = temp.next;
-	/* service->subscriptionList = next; */
+	return firstActiveSubscription(service, current->next);
+}
 
-	return next;
+subscription *GetFirstSubscription(service_info *service)
+{
+	return firstActiveSubscription(service, service->subscriptionList);
 }
 
 void freeSubscription(subscription *sub)
@@ -196,6 +560,8 @@ void freeSubscription(subscription *sub)
 	if (sub) {
 		free_URL_list(&sub->DeliveryURLs);
 		freeSubscriptionQueuedEvents(sub);
+		/* the list nodes kept for reuse */
+		FreeListDestroy(&sub->outgoing.freeNodeList);
 	}
 }
 
@@ -240,12 +606,32 @@ void freeSubscriptionList(subscription *head)
  * Return:
  *     service_info *: pointer to the matching service_info node.
  ******************************************************************************/
+/*!
+ * \brief Returns the hash of a serviceId and UDN pair.
+ */
+static size_t service_id_hash(const char *serviceId, const char *UDN)
+{
+	return hash_buffer(hash_buffer(HASH_SEED, serviceId, strlen(serviceId)),
+		UDN,
+		strlen(UDN));
+}
+
 service_info *FindServiceId(
 	service_table *table, const char *serviceId, const char *UDN)
 {
 	service_info *finger = NULL;
 
-	if (table) {
+	if (table && table->serviceIndex) {
+		finger = table->serviceIndex[service_id_hash(serviceId, UDN) &
+					     (table->serviceIndexSize - 1)];
+		while (finger) {
+			if (!strcmp(serviceId, finger->serviceId) &&
+				!strcmp(UDN, finger->UDN)) {
+				return finger;
+			}
+			finger = finger->idHashNext;
+		}
+	} else if (table) {
 		finger = table->serviceList;
 		while (finger) {
 			if (!strcmp(serviceId, finger->serviceId) &&
@@ -279,28 +665,39 @@ service_info *FindServiceEventURLPath(
 	service_table *table, const char *eventURLPath)
 {
 	service_info *finger = NULL;
-	uri_type parsed_url;
 	uri_type parsed_url_in;
+	size_t bucket;
 
 	if (!table || !eventURLPath) {
 		return NULL;
 	}
-	if (parse_uri(eventURLPath, strlen(eventURLPath), &parsed_url_in) ==
+	if (parse_uri(eventURLPath, strlen(eventURLPath), &parsed_url_in) !=
 		HTTP_SUCCESS) {
-		finger = table->serviceList;
+		return NULL;
+	}
+	if (table->serviceIndex) {
+		bucket = hash_buffer(HASH_SEED,
+				 parsed_url_in.pathquery.buff,
+				 parsed_url_in.pathquery.size) &
+			 (table->serviceIndexSize - 1);
+		finger = table->serviceIndex[2 * table->serviceIndexSize +
+					     bucket];
 		while (finger) {
-			if (finger->eventURL) {
-				if (parse_uri(finger->eventURL,
-					    strlen(finger->eventURL),
-					    &parsed_url) == HTTP_SUCCESS) {
-					if (!token_cmp(&parsed_url.pathquery,
-						    &parsed_url_in.pathquery)) {
-						return finger;
-					}
-				}
+			if (!token_cmp(&finger->eventPath,
+				    &parsed_url_in.pathquery)) {
+				return finger;
 			}
-			finger = finger->next;
+			finger = finger->eventHashNext;
+		}
+		return NULL;
+	}
+	finger = table->serviceList;
+	while (finger) {
+		if (finger->eventPath.buff &&
+			!token_cmp(&finger->eventPath, &parsed_url_in.pathquery)) {
+			return finger;
 		}
+		finger = finger->next;
 	}
 
 	return NULL;
@@ -326,28 +723,39 @@ service_info *FindServiceControlURLPath(
 	service_table *table, const char *controlURLPath)
 {
 	service_info *finger = NULL;
-	uri_type parsed_url;
 	uri_type parsed_url_in;
+	size_t bucket;
 
 	if (!table || !controlURLPath) {
 		return NULL;
 	}
-	if (parse_uri(controlURLPath, strlen(controlURLPath), &parsed_url_in) ==
+	if (parse_uri(controlURLPath, strlen(controlURLPath), &parsed_url_in) !=
 		HTTP_SUCCESS) {
-		finger = table->serviceList;
+		return NULL;
+	}
+	if (table->serviceIndex) {
+		bucket = hash_buffer(HASH_SEED,
+				 parsed_url_in.pathquery.buff,
+				 parsed_url_in.pathquery.size) &
+			 (table->serviceIndexSize - 1);
+		finger = table->serviceIndex[table->serviceIndexSize + bucket];
 		while (finger) {
-			if (finger->controlURL) {
-				if (parse_uri(finger->controlURL,
-					    strlen(finger->controlURL),
-					    &parsed_url) == HTTP_SUCCESS) {
-					if (!token_cmp(&parsed_url.pathquery,
-						    &parsed_url_in.pathquery)) {
-						return finger;
-					}
-				}
+			if (!token_cmp(&finger->controlPath,
+				    &parsed_url_in.pathquery)) {
+				return finger;
 			}
-			finger = finger->next;
+			finger = finger->controlHashNext;
 		}
+		return NULL;
+	}
+	finger = table->serviceList;
+	while (finger) {
+		if (finger->controlPath.buff &&
+			!token_cmp(
+				&finger->controlPath, &parsed_url_in.pathquery)) {
+			return finger;
+		}
+		finger = finger->next;
 	}
 
 	return NULL;
@@ -586,6 +994,7 @@ void freeService(service_info *in)
 
 		if (in->subscriptionList)
 			freeSubscriptionList(in->subscriptionList);
+		free(in->subscriptionIndex);
 
 		in->TotalSubscriptions = 0;
 		free(in);
@@ -624,6 +1033,7 @@ void freeServiceList(service_info *head)
 			ixmlFreeDOMString(head->UDN);
 		if (head->subscriptionList)
 			freeSubscriptionList(head->subscriptionList);
+		free(head->subscriptionIndex);
 
 		head->TotalSubscriptions = 0;
 		next = head->next;
@@ -652,6 +1062,9 @@ void freeServiceTable(service_table *table)
 	freeServiceList(table->serviceList);
 	table->serviceList = NULL;
 	table->endServiceList = NULL;
+	free(table->serviceIndex);
+	table->serviceIndex = NULL;
+	table->serviceIndexSize = 0;
 }
 
 /*******************************************************************************
@@ -722,211 +1135,246 @@ int getSubElement(const char *element_name, IXML_Node *node, IXML_Node **out)
 	return found;
 }
 
-/*******************************************************************************
- * Function: getServiceList
+/*!
+ * \brief Returns the clone of a value of the description index, resolved
+ * against the base URL when \b URLBase is not NULL.
  *
- * Parameters:
- *    IXML_Node *node;	  XML node information
- *    service_info **end; service added is returned to the output parameter
- *    char *URLBase;      provides Base URL to resolve relative URL
+ * \return The value, or NULL if it is missing or there is not enough memory.
+ */
+static char *cloneDescValue(
+	/*! [in] The value, can be NULL. */
+	const char *value,
+	/*! [in] Base URL of a relative URL, or NULL. */
+	const char *URLBase)
+{
+	if (!value) {
+		return NULL;
+	}
+	if (URLBase) {
+		return resolve_rel_url((char *)URLBase, (char *)value);
+	}
+
+	return ixmlCloneDOMString(value);
+}
+
+/*!
+ * \brief Builds the services of a device of the description index.
  *
- * Description: Returns pointer to service info after getting the sub-elements
- *    of the service info.
+ * Services without serviceType, serviceId or SCPDURL are left out.
  *
- * Return: service_info *: pointer to the service info node
- ******************************************************************************/
-service_info *getServiceList(IXML_Node *node, service_info **end, char *URLBase)
+ * \return The head of the service list, or NULL.
+ */
+static service_info *getServiceList(
+	/*! [in] The description index. */
+	const desc_index *index,
+	/*! [in] The device. */
+	const desc_device *device,
+	/*! [out] The last service of the list. */
+	service_info **end,
+	/*! [in] Base URL to resolve relative URLs. */
+	char *URLBase)
 {
-	IXML_Node *serviceList = NULL;
-	IXML_Node *current_service = NULL;
-	IXML_Node *UDN = NULL;
-
-	IXML_Node *serviceType = NULL;
-	IXML_Node *serviceId = NULL;
-	IXML_Node *SCPDURL = NULL;
-	IXML_Node *controlURL = NULL;
-	IXML_Node *eventURL = NULL;
-	DOMString tempDOMString = NULL;
+	const desc_service *desc;
 	service_info *head = NULL;
 	service_info *current = NULL;
-	service_info *previous = NULL;
-	IXML_NodeList *serviceNodeList = NULL;
-	long unsigned int NumOfServices = 0lu;
-	long unsigned int i = 0lu;
-	int fail = 0;
-
-	if (getSubElement("UDN", node, &UDN) &&
-		getSubElement("serviceList", node, &serviceList)) {
-		serviceNodeList = ixmlElement_getElementsByTagName(
-			(IXML_Element *)serviceList, "service");
-		if (serviceNodeList) {
-			NumOfServices = ixmlNodeList_length(serviceNodeList);
-			for (i = 0lu; i < NumOfServices; i++) {
-				current_service =
-					ixmlNodeList_item(serviceNodeList, i);
-				fail = 0;
-				if (current) {
-					current->next =
-						malloc(sizeof(service_info));
-					previous = current;
-					current = current->next;
-				} else {
-					head = malloc(sizeof(service_info));
-					current = head;
-				}
-				if (!current) {
-					freeServiceList(head);
-					ixmlNodeList_free(serviceNodeList);
-					return NULL;
-				}
-				current->next = NULL;
-				current->controlURL = NULL;
-				current->eventURL = NULL;
-				current->serviceType = NULL;
-				current->serviceId = NULL;
-				current->SCPDURL = NULL;
-				current->active = 1;
-				current->subscriptionList = NULL;
-				current->TotalSubscriptions = 0;
-				if (!(current->UDN = getElementValue(UDN)))
-					fail = 1;
-				if (!getSubElement("serviceType",
-					    current_service,
-					    &serviceType) ||
-					!(current->serviceType =
-							getElementValue(
-								serviceType)))
-					fail = 1;
-				if (!getSubElement("serviceId",
-					    current_service,
-					    &serviceId) ||
-					!(current->serviceId = getElementValue(
-						  serviceId)))
-					fail = 1;
-				if (!getSubElement("SCPDURL",
-					    current_service,
-					    &SCPDURL) ||
-					!(tempDOMString = getElementValue(
-						  SCPDURL)) ||
-					!(current->SCPDURL = resolve_rel_url(
-						  URLBase, tempDOMString)))
-					fail = 1;
-				ixmlFreeDOMString(tempDOMString);
-				tempDOMString = NULL;
-				if (!(getSubElement("controlURL",
-					    current_service,
-					    &controlURL)) ||
-					!(tempDOMString = getElementValue(
-						  controlURL)) ||
-					!(current->controlURL = resolve_rel_url(
-						  URLBase, tempDOMString))) {
-					UpnpPrintf(UPNP_INFO,
-						GENA,
-						__FILE__,
-						__LINE__,
-						"BAD OR MISSING CONTROL URL");
-					UpnpPrintf(UPNP_INFO,
-						GENA,
-						__FILE__,
-						__LINE__,
-						"CONTROL URL SET TO NULL IN "
-						"SERVICE INFO");
-					current->controlURL = NULL;
-					fail = 0;
-				}
-				ixmlFreeDOMString(tempDOMString);
-				tempDOMString = NULL;
-				if (!getSubElement("eventSubURL",
-					    current_service,
-					    &eventURL) ||
-					!(tempDOMString = getElementValue(
-						  eventURL)) ||
-					!(current->eventURL = resolve_rel_url(
-						  URLBase, tempDOMString))) {
-					UpnpPrintf(UPNP_INFO,
-						GENA,
-						__FILE__,
-						__LINE__,
-						"BAD OR MISSING EVENT URL");
-					UpnpPrintf(UPNP_INFO,
-						GENA,
-						__FILE__,
-						__LINE__,
-						"EVENT URL SET TO NULL IN "
-						"SERVICE INFO");
-					current->eventURL = NULL;
-					fail = 0;
-				}
-				ixmlFreeDOMString(tempDOMString);
-				tempDOMString = NULL;
-				if (fail) {
-					freeServiceList(current);
-					if (previous)
-						previous->next = NULL;
-					else
-						head = NULL;
-					current = previous;
-				}
-			}
-			ixmlNodeList_free(serviceNodeList);
-		}
-		(*end) = current;
-		return head;
-	} else {
-		(*end) = NULL;
+	service_info *service;
+	size_t i;
+
+	(*end) = NULL;
+	if (!device->UDN) {
 		return NULL;
 	}
+	for (i = device->firstService;
+		i < device->firstService + device->numServices;
+		i++) {
+		desc = &index->services[i];
+		service = calloc(1, sizeof(service_info));
+		if (!service) {
+			freeServiceList(head);
+			return NULL;
+		}
+		service->active = 1;
+		service->UDN = cloneDescValue(device->UDN, NULL);
+		service->serviceType = cloneDescValue(desc->serviceType, NULL);
+		service->serviceId = cloneDescValue(desc->serviceId, NULL);
+		service->SCPDURL = cloneDescValue(desc->SCPDURL, URLBase);
+		service->controlURL = cloneDescValue(desc->controlURL, URLBase);
+		if (!service->controlURL) {
+			UpnpPrintf(UPNP_INFO,
+				GENA,
+				__FILE__,
+				__LINE__,
+				"BAD OR MISSING CONTROL URL");
+			UpnpPrintf(UPNP_INFO,
+				GENA,
+				__FILE__,
+				__LINE__,
+				"CONTROL URL SET TO NULL IN SERVICE INFO");
+		}
+		service->eventURL = cloneDescValue(desc->eventURL, URLBase);
+		if (!service->eventURL) {
+			UpnpPrintf(UPNP_INFO,
+				GENA,
+				__FILE__,
+				__LINE__,
+				"BAD OR MISSING EVENT URL");
+			UpnpPrintf(UPNP_INFO,
+				GENA,
+				__FILE__,
+				__LINE__,
+				"EVENT URL SET TO NULL IN SERVICE INFO");
+		}
+		if (!service->UDN || !service->serviceType ||
+			!service->serviceId || !service->SCPDURL) {
+			freeService(service);
+			continue;
+		}
+		if (current) {
+			current->next = service;
+		} else {
+			head = service;
+		}
+		current = service;
+	}
+	(*end) = current;
+
+	return head;
 }
 
-/*******************************************************************************
- * Function: getAllServiceList
- *
- * Parameters:
- *    IXML_Node *node;        XML node information
- *    char *URLBase;          provides Base URL to resolve relative URL
- *    service_info **out_end; service added is returned to the output parameter
- *
- * Description: Returns pointer to service info after getting the sub-elements
- *    of the service info.
+/*!
+ * \brief Builds the services of all the devices of the description index.
  *
- * Return: service_info *
- ******************************************************************************/
-service_info *getAllServiceList(
-	IXML_Node *node, char *URLBase, service_info **out_end)
+ * \return The head of the service list, or NULL.
+ */
+static service_info *getAllServiceList(
+	/*! [in] The description index. */
+	const desc_index *index,
+	/*! [in] Base URL to resolve relative URLs. */
+	char *URLBase,
+	/*! [out] The last service of the list. */
+	service_info **out_end)
 {
 	service_info *head = NULL;
 	service_info *end = NULL;
+	service_info *next_head = NULL;
 	service_info *next_end = NULL;
-	IXML_NodeList *deviceList = NULL;
-	IXML_Node *currentDevice = NULL;
+	size_t i;
 
-	long unsigned int NumOfDevices = 0lu;
-	long unsigned int i = 0lu;
-
-	(*out_end) = NULL;
-	deviceList = ixmlElement_getElementsByTagName(
-		(IXML_Element *)node, "device");
-	if (deviceList) {
-		NumOfDevices = ixmlNodeList_length(deviceList);
-		for (i = 0lu; i < NumOfDevices; i++) {
-			currentDevice = ixmlNodeList_item(deviceList, i);
-			if (head) {
-				end->next = getServiceList(
-					currentDevice, &next_end, URLBase);
-				if (next_end)
-					end = next_end;
-			} else {
-				head = getServiceList(
-					currentDevice, &end, URLBase);
-			}
+	for (i = 0; i < index->numDevices; i++) {
+		next_head = getServiceList(
+			index, &index->devices[i], &next_end, URLBase);
+		if (!next_head) {
+			continue;
 		}
-		ixmlNodeList_free(deviceList);
+		if (end) {
+			end->next = next_head;
+		} else {
+			head = next_head;
+		}
+		end = next_end;
 	}
-
 	(*out_end) = end;
+
 	return head;
 }
 
+/*!
+ * \brief Returns the clone of the base URL of the description, or of the
+ * default base URL.
+ */
+static DOMString getURLBase(
+	/*! [in] The description index. */
+	const desc_index *index,
+	/*! [in] Default base URL, can be NULL. */
+	const char *DefaultURLBase)
+{
+	if (index->URLBase) {
+		return ixmlCloneDOMString(index->URLBase);
+	}
+	if (DefaultURLBase) {
+		return ixmlCloneDOMString(DefaultURLBase);
+	}
+
+	return ixmlCloneDOMString("");
+}
+
+/*!
+ * \brief Returns the path and query of a URL, pointing into the URL, or an
+ * empty token if the URL is missing or invalid.
+ */
+static token getURLPath(const char *url)
+{
+	uri_type parsed_url;
+	token path = {NULL, 0};
+
+	if (url &&
+		parse_uri(url, strlen(url), &parsed_url) == HTTP_SUCCESS) {
+		path = parsed_url.pathquery;
+	}
+
+	return path;
+}
+
+/*!
+ * \brief Rebuilds the hash indexes of the service table and the cached URL
+ * paths of its services.
+ *
+ * Must be called whenever the service list changes. Without memory for the
+ * indexes the lookups walk the service list instead.
+ */
+static void indexServiceTable(
+	/*! [in] Service table to index. */
+	service_table *table)
+{
+	service_info **index;
+	service_info *finger;
+	size_t count = 0;
+	size_t size = 1;
+	size_t bucket;
+
+	free(table->serviceIndex);
+	table->serviceIndex = NULL;
+	table->serviceIndexSize = 0;
+	for (finger = table->serviceList; finger; finger = finger->next) {
+		finger->controlPath = getURLPath(finger->controlURL);
+		finger->eventPath = getURLPath(finger->eventURL);
+		++count;
+	}
+	while (size < 2 * count) {
+		size <<= 1;
+	}
+	index = calloc(3 * size, sizeof *index);
+	if (!index) {
+		return;
+	}
+	for (finger = table->serviceList; finger; finger = finger->next) {
+		bucket = service_id_hash(finger->serviceId, finger->UDN) &
+			 (size - 1);
+		finger->idHashNext = index[bucket];
+		index[bucket] = finger;
+		finger->controlHashNext = NULL;
+		if (finger->controlPath.buff) {
+			bucket = hash_buffer(HASH_SEED,
+					 finger->controlPath.buff,
+					 finger->controlPath.size) &
+				 (size - 1);
+			finger->controlHashNext = index[size + bucket];
+			index[size + bucket] = finger;
+		}
+		finger->eventHashNext = NULL;
+		if (finger->eventPath.buff) {
+			bucket = hash_buffer(HASH_SEED,
+					 finger->eventPath.buff,
+					 finger->eventPath.size) &
+				 (size - 1);
+			finger->eventHashNext = index[2 * size + bucket];
+			index[2 * size + bucket] = finger;
+		}
+	}
+	table->serviceIndex = index;
+	table->serviceIndexSize = size;
+}
+
 /*******************************************************************************
  * Function: removeServiceTable
  *
@@ -1009,6 +1457,7 @@ int removeServiceTable(IXML_Node *node, service_table *in)
 
 			ixmlNodeList_free(deviceList);
 		}
+		indexServiceTable(in);
 	}
 	return 1;
 }
@@ -1017,7 +1466,7 @@ int removeServiceTable(IXML_Node *node, service_table *in)
  * Function: addServiceTable
  *
  * Parameters :
- *    IXML_Node *node;            XML node information
+ *    const desc_index *index;    Index of the description document
  *    service_table *in;          service table that will be initialized with
  *                                services
  *    const char *DefaultURLBase; Default base URL on which the URL will be
@@ -1028,32 +1477,20 @@ int removeServiceTable(IXML_Node *node, service_table *in)
  * Return: int
  ******************************************************************************/
 int addServiceTable(
-	IXML_Node *node, service_table *in, const char *DefaultURLBase)
+	const desc_index *index, service_table *in, const char *DefaultURLBase)
 {
-	IXML_Node *root = NULL;
-	IXML_Node *URLBase = NULL;
 	service_info *tempEnd = NULL;
 
 	if (in->URLBase) {
 		free(in->URLBase);
 		in->URLBase = NULL;
 	}
-	if (getSubElement("root", node, &root)) {
-		if (getSubElement("URLBase", root, &URLBase)) {
-			in->URLBase = getElementValue(URLBase);
-		} else {
-			if (DefaultURLBase) {
-				in->URLBase =
-					ixmlCloneDOMString(DefaultURLBase);
-			} else {
-				in->URLBase = ixmlCloneDOMString("");
-			}
-		}
-		if ((in->endServiceList->next = getAllServiceList(
-			     root, in->URLBase, &tempEnd))) {
-			in->endServiceList = tempEnd;
-			return 1;
-		}
+	in->URLBase = getURLBase(index, DefaultURLBase);
+	if ((in->endServiceList->next =
+			    getAllServiceList(index, in->URLBase, &tempEnd))) {
+		in->endServiceList = tempEnd;
+		indexServiceTable(in);
+		return 1;
 	}
 
 	return 0;
@@ -1063,7 +1500,7 @@ int addServiceTable(
  * Function : getServiceTable
  *
  * Parameters :
- * 	IXML_Node *node ;	XML node information
+ *	const desc_index *index ;	Index of the description document
  *	service_table *out ;	output parameter which will contain the
  *				service list and URL
  *	const char *DefaultURLBase ; Default base URL on which the URL
@@ -1076,30 +1513,14 @@ int addServiceTable(
  * Note :
  ************************************************************************/
 int getServiceTable(
-	IXML_Node *node, service_table *out, const char *DefaultURLBase)
+	const desc_index *index, service_table *out, const char *DefaultURLBase)
 {
-	IXML_Node *root = NULL;
-	IXML_Node *URLBase = NULL;
+	out->URLBase = getURLBase(index, DefaultURLBase);
+	out->serviceList =
+		getAllServiceList(index, out->URLBase, &out->endServiceList);
+	indexServiceTable(out);
 
-	if (getSubElement("root", node, &root)) {
-		if (getSubElement("URLBase", root, &URLBase)) {
-			out->URLBase = getElementValue(URLBase);
-		} else {
-			if (DefaultURLBase) {
-				out->URLBase =
-					ixmlCloneDOMString(DefaultURLBase);
-			} else {
-				out->URLBase = ixmlCloneDOMString("");
-			}
-		}
-		out->serviceList = getAllServiceList(
-			root, out->URLBase, &out->endServiceList);
-		if (out->serviceList) {
-			return 1;
-		}
-	}
-
-	return 0;
+	return out->serviceList != NULL;
 }
 	#endif /* EXCLUDE_GENA */
 
@@ -106,7 +106,6 @@ static UPNP_INLINE void membuffer_initialize(
 
 int membuffer_set_size(membuffer *m, size_t new_length)
 {
-	size_t diff;
 	size_t alloc_len;
 	char *temp_buf;
 
@@ -116,18 +115,21 @@ int membuffer_set_size(membuffer *m, size_t new_length)
 			return 0; /* have enough mem; done */
 		}
 
-		diff = new_length - m->length;
-		alloc_len = MAXVAL(m->size_inc, diff) + m->capacity;
+		/* grow geometrically, so that building a message with many
+		 * small appends costs a logarithmic number of reallocs */
+		alloc_len = m->capacity + MAXVAL(m->capacity, m->size_inc);
+		alloc_len = MAXVAL(alloc_len, new_length);
 	} else { /* decrease length */
 
 		assert(new_length <= m->length);
 
-		/* if diff is 0..m->size_inc, don't free */
-		if ((m->capacity - new_length) <= m->size_inc) {
+		/* only give memory back when most of it would be unused */
+		if ((m->capacity - new_length) <= m->size_inc ||
+			new_length >= m->capacity / (size_t)4) {
 			return 0;
 		}
 
-		alloc_len = new_length + m->size_inc;
+		alloc_len = (size_t)2 * new_length + m->size_inc;
 	}
 
 	assert(alloc_len >= new_length);
@@ -154,6 +156,25 @@ int membuffer_set_size(membuffer *m, size_t new_length)
 	return 0;
 }
 
+int membuffer_reserve(membuffer *m, size_t capacity)
+{
+	char *temp_buf;
+
+	assert(m != NULL);
+
+	if (capacity <= m->capacity) {
+		return 0;
+	}
+	temp_buf = realloc(m->buf, capacity + (size_t)1);
+	if (temp_buf == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	m->buf = temp_buf;
+	m->capacity = capacity;
+
+	return 0;
+}
+
 void membuffer_init(membuffer *m)
 {
 	assert(m != NULL);
@@ -122,6 +122,21 @@
 #define THREAD_STACK_SIZE (size_t)0
 /* @} */
 
+/*!
+ * \name THREAD_POOL_SCHEDULER
+ *
+ * The {\tt THREAD_POOL_SCHEDULER} constant selects how the thread pools
+ * inside the SDK hand jobs to their threads. {\tt TP_GLOBAL_QUEUE} keeps
+ * every job in queues shared by all the threads of a pool.
+ * {\tt TP_WORK_STEALING} gives each thread its own queues and lets idle
+ * threads take jobs from busy ones, which scales better on machines with
+ * many cores. The default value is {\tt TP_GLOBAL_QUEUE}.
+ *
+ * @{
+ */
+#define THREAD_POOL_SCHEDULER TP_GLOBAL_QUEUE
+/* @} */
+
 /*! \name MAX_JOBS_TOTAL
  *
  *  The {\tt MAX_JOBS_TOTAL} constant determines the maximum number of jobs
@@ -134,6 +149,20 @@
 #define MAX_JOBS_TOTAL 100
 /* @} */
 
+/*!
+ * \name NUM_HANDLE
+ *
+ * The {\tt NUM_HANDLE} constant is the maximum number of handle slots,
+ * handle 0 included, so one more than the number of client and device
+ * handles that can be registered at the same time. The handle table starts
+ * small and doubles as handles are registered, so a large value costs
+ * nothing until the handles are used. The default value is 65536.
+ *
+ * @{
+ */
+#define NUM_HANDLE 65536
+/* @} */
+
 /*! \name MAX_SUBSCRIPTION_QUEUED_EVENTS
  *
  *  The {\tt MAX_SUBSCRIPTION_QUEUED_EVENTS} determines the maximum number of
@@ -199,6 +228,58 @@
 #define SSDP_PAUSE 100u
 /* @} */
 
+/*!
+ * \name SSDP_MAX_PENDING_REPLIES
+ *
+ * The {\tt SSDP_MAX_PENDING_REPLIES} constant is the maximum number of
+ * M-SEARCH requests waiting for their random reply delay to expire. A search
+ * from the same address for the same target as a pending one is answered by
+ * the pending reply. Searches arriving when the limit is reached are
+ * dropped. The default value is 128.
+ *
+ * @{
+ */
+#define SSDP_MAX_PENDING_REPLIES 128
+/* @} */
+
+/*!
+ * \name SSDP_MAX_REPLIES_PER_SEC
+ *
+ * The {\tt SSDP_MAX_REPLIES_PER_SEC} constant is the maximum number of
+ * M-SEARCH requests accepted for a reply in any one second, from all sources
+ * together. Further searches in the same second are dropped. The default
+ * value is 64.
+ *
+ * @{
+ */
+#define SSDP_MAX_REPLIES_PER_SEC 64
+/* @} */
+
+/*!
+ * \name SSDP_MAX_REPLIES_PER_SOURCE
+ *
+ * The {\tt SSDP_MAX_REPLIES_PER_SOURCE} constant is the maximum number of
+ * M-SEARCH requests accepted for a reply in any one second from one source
+ * address, so that a single host can not use up SSDP_MAX_REPLIES_PER_SEC.
+ * The default value is 8.
+ *
+ * @{
+ */
+#define SSDP_MAX_REPLIES_PER_SOURCE 8
+/* @} */
+
+/*!
+ * \name SSDP_REPLY_SOURCES
+ *
+ * The {\tt SSDP_REPLY_SOURCES} constant is the number of source addresses
+ * whose budget is tracked in any one second. Searches from further sources
+ * in the same second are dropped. The default value is 32.
+ *
+ * @{
+ */
+#define SSDP_REPLY_SOURCES 32
+/* @} */
+
 /*!
  * \name WEB_SERVER_BUF_SIZE
  *
@@ -307,6 +388,33 @@
 #define SSDP_PACKET_DISTRIBUTE 1
 /* @} */
 
+/*!
+ * \name SSDP_ADVERTISE_JITTER
+ *
+ * The {\tt SSDP_ADVERTISE_JITTER} is the default percentage of the renewal
+ * interval over which the renewed advertisements of a device are spread:
+ * each renewal is sent up to that much earlier, at random, so that devices
+ * registered together do not keep advertising together. It can be changed
+ * per device with {\tt UpnpSetAdvertisementJitter}. The default is 10.
+ *
+ * @{
+ */
+#define SSDP_ADVERTISE_JITTER 10
+/* @} */
+
+/*!
+ * \name SSDP_ADVERTISE_RATE
+ *
+ * The {\tt SSDP_ADVERTISE_RATE} is the default number of SSDP packets per
+ * second that the renewed advertisements of all the devices may send
+ * together. Renewals over the budget are delayed. It can be changed with
+ * {\tt UpnpSetAdvertisementRate}. The default of 0 sets no budget.
+ *
+ * @{
+ */
+#define SSDP_ADVERTISE_RATE 0
+/* @} */
+
 /*!
  * \name GENA_NOTIFICATION_SENDING_TIMEOUT
  *
@@ -349,6 +457,71 @@
 #define GENA_NOTIFICATION_ANSWERING_TIMEOUT HTTP_DEFAULT_TIMEOUT
 /* @} */
 
+/*!
+ * \name HTTP_KEEPALIVE_TIMEOUT
+ *
+ * The {\tt HTTP_KEEPALIVE_TIMEOUT} specifies the number of seconds the
+ * miniserver keeps an idle HTTP/1.1 connection open waiting for the next
+ * request. Every idle connection holds a miniserver thread, so this should
+ * stay well below HTTP_DEFAULT_TIMEOUT. This can be adjusted dynamically
+ * with {\tt UpnpSetHttpKeepAlive}.
+ *
+ * @{
+ */
+#define HTTP_KEEPALIVE_TIMEOUT 5
+/* @} */
+
+/*!
+ * \name HTTP_KEEPALIVE_MAX_REQUESTS
+ *
+ * The {\tt HTTP_KEEPALIVE_MAX_REQUESTS} specifies how many requests the
+ * miniserver serves on one connection before closing it. A value of 1
+ * disables persistent connections. This can be adjusted dynamically with
+ * {\tt UpnpSetHttpKeepAlive}.
+ *
+ * @{
+ */
+#define HTTP_KEEPALIVE_MAX_REQUESTS 100
+/* @} */
+
+/*!
+ * \name HTTP_KEEPALIVE_MAX_PERCENT
+ *
+ * The {\tt HTTP_KEEPALIVE_MAX_PERCENT} specifies the share, in percent, of
+ * the miniserver threads that may serve HTTP/1.1 persistent connections.
+ * Once it is reached, new connections are answered with
+ * "Connection: close", so that idle clients can not take up the threads
+ * needed for new requests.
+ *
+ * @{
+ */
+#define HTTP_KEEPALIVE_MAX_PERCENT 25
+/* @} */
+
+/*!
+ * \name GENA_CONNPOOL_SIZE
+ *
+ * The {\tt GENA_CONNPOOL_SIZE} specifies how many idle connections to
+ * subscribers the device side keeps open for delivering further events.
+ *
+ * @{
+ */
+#define GENA_CONNPOOL_SIZE 16
+/* @} */
+
+/*!
+ * \name GENA_CONNPOOL_IDLE_TIMEOUT
+ *
+ * The {\tt GENA_CONNPOOL_IDLE_TIMEOUT} specifies the number of seconds an
+ * idle connection to a subscriber stays in the pool. It should be shorter
+ * than the keep-alive timeout of the control points, so that connections
+ * are seldom found closed by the peer.
+ *
+ * @{
+ */
+#define GENA_CONNPOOL_IDLE_TIMEOUT 4
+/* @} */
+
 /*!
  * \name Module Exclusion
  *
@@ -285,6 +285,38 @@ EXTERN_C int genaNotifyAllExt(
 	IXML_Document *PropSet);
 #endif /* INCLUDE_DEVICE_APIS */
 
+/*!
+ * \brief Returns a property set as a string, closed by its footer.
+ *
+ * \return The string, to be freed with ixmlFreeDOMString(), or NULL if there
+ * is not enough memory.
+ */
+#ifdef INCLUDE_DEVICE_APIS
+EXTERN_C DOMString genaPropertySetString(
+	/*! [in] The property set. */
+	const UpnpPropertySetBuilder *p);
+#endif /* INCLUDE_DEVICE_APIS */
+
+/*!
+ * \brief Sends a notification to all the subscribed control points.
+ *
+ * \return int
+ *
+ * \note This function is similar to the genaNotifyAllExt. The only difference
+ *	is it takes a property set built with UpnpPropertySetBuilder_add().
+ */
+#ifdef INCLUDE_DEVICE_APIS
+EXTERN_C int genaNotifyAllPropertySet(
+	/*! [in] Device handle. */
+	UpnpDevice_Handle device_handle,
+	/*! [in] Device udn. */
+	char *UDN,
+	/*! [in] Service ID. */
+	char *servId,
+	/*! [in] Event variable property set. */
+	const UpnpPropertySetBuilder *PropSet);
+#endif /* INCLUDE_DEVICE_APIS */
+
 /*!
  * \brief Sends the intial state table dump to newly subscribed control point.
  *
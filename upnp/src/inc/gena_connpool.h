@@ -0,0 +1,102 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * * Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef GENA_CONNPOOL_H
+#define GENA_CONNPOOL_H
+
+/*!
+ * \file
+ *
+ * \brief Pool of persistent outbound connections used to deliver GENA
+ * NOTIFY messages.
+ *
+ * Connections are keyed by the resolved address and port of the event
+ * delivery URL. A connection is borrowed for one NOTIFY exchange and handed
+ * back afterwards. Connections idle for GENA_CONNPOOL_IDLE_TIMEOUT seconds
+ * are closed whenever a connection is borrowed or handed back, and a borrowed connection is checked
+ * for a pending close from the peer before it is reused.
+ */
+
+#include "sock.h"
+#include "uri.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Initializes the connection pool.
+ *
+ * \return UPNP_E_SUCCESS.
+ */
+int gena_connpool_init(void);
+
+/*!
+ * \brief Closes all pooled connections and releases the pool.
+ */
+void gena_connpool_destroy(void);
+
+/*!
+ * \brief Gets a connection to the host of a delivery URL, reusing an idle
+ * pooled connection if there is a healthy one.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_URL or UPNP_E_SOCKET_CONNECT.
+ */
+int gena_connpool_get(
+	/*! [in] Delivery URL of the subscriber. */
+	uri_type *destination_url,
+	/*! [out] Delivery URL after being fixed, as used for the request. */
+	uri_type *url,
+	/*! [out] Socket information of the connection. */
+	SOCKINFO *info,
+	/*! [out] Non-zero if the connection came from the pool. */
+	int *reused);
+
+/*!
+ * \brief Hands a connection back after a NOTIFY exchange.
+ *
+ * The connection is kept for reuse if reusable is non-zero and closed
+ * otherwise. When the pool is full the least recently used connection is
+ * closed to make room.
+ */
+void gena_connpool_put(
+	/*! [in] URL returned by gena_connpool_get. */
+	const uri_type *url,
+	/*! [in] Socket information of the connection. */
+	SOCKINFO *info,
+	/*! [in] Non-zero if the connection can carry another request. */
+	int reusable);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* GENA_CONNPOOL_H */
@@ -39,6 +39,7 @@
 
 #include "LinkedList.h"
 #include "membuffer.h"
+#include "strintmap.h"
 #include "upnputil.h"
 #include "uri.h"
 
@@ -147,6 +148,15 @@ typedef enum
 #define HDR_RANGE 35
 #define HDR_TE 36
 
+/*! One past the highest header name id. */
+#define HDR_NUM_IDS 37
+
+/*! Number of entries in Http_Header_Names. */
+#define NUM_HTTP_HEADER_NAMES 33
+
+/*! Known header names and their ids, sorted by name. */
+extern str_int_entry Http_Header_Names[];
+
 /*! status of parsing */
 typedef enum
 {
@@ -204,6 +214,8 @@ typedef struct
 	int minor_version;
 	/*! . */
 	LinkedList headers;
+	/*! headers of the list with a known name id, indexed by id. */
+	http_header_t *known_headers[HDR_NUM_IDS];
 	/*! message body(entity). */
 	memptr entity;
 	/* private fields. */
@@ -518,6 +518,8 @@ close header depending on major, minor version. 'c':	(no args)
 	'G':	arg = range information		-- add range header
 	'h':	arg = off_t number		-- appends off_t number
 	'K':	(no args)			-- add chunky header
+	'k':	arg = SOCKINFO *		-- like 'C', unless the
+connection is kept alive
 	'L':	arg = language information	-- add Content-Language header
 if Accept-Language header is not empty and if WEB_SERVER_CONTENT_LANGUAGE is not
 empty 'N':	arg1 = off_t content_length	-- content-length header 'q':
@@ -62,7 +62,9 @@ typedef struct
 	size_t length;
 	/*! total allocated memory (read-only). */
 	size_t capacity;
-	/*! used to increase size; MUST be > 0; (read/write). */
+	/*! minimum size increase; MUST be > 0; (read/write). The capacity
+	 * at least doubles when it grows, so this only sizes the first
+	 * allocation and the slack kept when the buffer shrinks. */
 	size_t size_inc;
 	/*! default value of size_inc. */
 #define MEMBUF_DEF_SIZE_INC (size_t)5
@@ -123,6 +125,9 @@ int memptr_cmp_nocase(
  * \brief Increases or decreases buffer cap so that at least 'new_length'
  * bytes can be stored.
  *
+ * The capacity grows geometrically, and is only reduced when less than a
+ * quarter of it would be used.
+ *
  * \return
  * \li UPNP_E_SUCCESS - On Success
  * \li UPNP_E_OUTOF_MEMORY - On failure to allocate memory.
@@ -133,6 +138,20 @@ int membuffer_set_size(
 	/*! [in] new size to which the buffer will be modified. */
 	size_t new_length);
 
+/*!
+ * \brief Makes room for at least 'capacity' bytes without changing the
+ * contents, so that a message of known size is built with one allocation.
+ *
+ * \return
+ * \li UPNP_E_SUCCESS - On Success
+ * \li UPNP_E_OUTOF_MEMORY - On failure to allocate memory.
+ */
+int membuffer_reserve(
+	/*! [in,out] buffer whose capacity is to be increased. */
+	membuffer *m,
+	/*! [in] number of bytes the buffer must be able to hold. */
+	size_t capacity);
+
 /*!
  * \brief Wrapper to membuffer_initialize().
  *
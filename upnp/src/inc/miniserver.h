@@ -39,6 +39,7 @@
 #include "UpnpStdInt.h"
 #include "httpparser.h"
 #include "sock.h"
+#include "sockpoll.h"
 
 extern SOCKET gMiniServerStopSock;
 
@@ -76,6 +77,8 @@ typedef struct MServerSockArray
 	 * replies */
 	SOCKET ssdpReqSock6;
 #endif /* INCLUDE_CLIENT_APIS */
+	/*! Readiness notification for all of the sockets above. */
+	sockpoll poll;
 } MiniServerSockArray;
 
 /*! . */
@@ -65,6 +65,10 @@ typedef struct SUBSCRIPTION
 	   completion. */
 	LinkedList outgoing;
 	struct SUBSCRIPTION *next;
+	/*! Previous subscription of the service, NULL for the head. */
+	struct SUBSCRIPTION *prev;
+	/*! Next subscription in the same SID hash bucket. */
+	struct SUBSCRIPTION *hashNext;
 } subscription;
 
 typedef struct SERVICE_INFO
@@ -78,6 +82,21 @@ typedef struct SERVICE_INFO
 	int active;
 	int TotalSubscriptions;
 	subscription *subscriptionList;
+	/*! SID hash index over subscriptionList, NULL until the first
+	 * subscription is added. */
+	subscription **subscriptionIndex;
+	/*! Number of buckets in subscriptionIndex, a power of two. */
+	size_t subscriptionIndexSize;
+	/*! Path and query of controlURL, pointing into controlURL. */
+	token controlPath;
+	/*! Path and query of eventURL, pointing into eventURL. */
+	token eventPath;
+	/*! Next service in the same serviceId and UDN hash bucket. */
+	struct SERVICE_INFO *idHashNext;
+	/*! Next service in the same control path hash bucket. */
+	struct SERVICE_INFO *controlHashNext;
+	/*! Next service in the same event path hash bucket. */
+	struct SERVICE_INFO *eventHashNext;
 	struct SERVICE_INFO *next;
 } service_info;
 
@@ -85,11 +104,81 @@ typedef struct SERVICE_INFO
 
 extern void freeSubscriptionQueuedEvents(subscription *sub);
 
+/*! A device of a description document. */
+typedef struct DESC_DEVICE
+{
+	/*! Value of the deviceType element, or NULL. */
+	const char *deviceType;
+	/*! Value of the UDN element, or NULL. */
+	const char *UDN;
+	/*! Index of the first service of the device in desc_index.services. */
+	size_t firstService;
+	/*! Number of services in the serviceList of the device. */
+	size_t numServices;
+} desc_device;
+
+/*! A service of a description document, with the values of its elements
+ * as found in the document, or NULL. */
+typedef struct DESC_SERVICE
+{
+	const char *serviceType;
+	const char *serviceId;
+	const char *SCPDURL;
+	const char *controlURL;
+	const char *eventURL;
+} desc_service;
+
+/*!
+ * \brief Flat index of a description document.
+ *
+ * Built once when the device registers, so that the service table and SSDP
+ * do not walk the DOM. All the strings live in one pool, where equal values
+ * are stored once.
+ */
+typedef struct DESC_INDEX
+{
+	/*! Value of the URLBase element, or NULL. */
+	const char *URLBase;
+	/*! Devices in document order, the root device first. */
+	desc_device *devices;
+	/*! Number of entries in devices. */
+	size_t numDevices;
+	/*! Services of all the devices, grouped by device. */
+	desc_service *services;
+	/*! Number of entries in services. */
+	size_t numServices;
+	/*! The string pool. */
+	char *strings;
+} desc_index;
+
+/*!
+ * \brief Indexes the devices and services of a description document.
+ *
+ * \return The index, empty if the document has no root element, or NULL if
+ * there is not enough memory.
+ */
+desc_index *buildDescIndex(
+	/*! [in] The description document. */
+	IXML_Document *doc);
+
+/*!
+ * \brief Frees an index built by buildDescIndex().
+ */
+void freeDescIndex(
+	/*! [in] The index to free, can be NULL. */
+	desc_index *index);
+
 typedef struct SERVICE_TABLE
 {
 	DOMString URLBase;
 	service_info *serviceList;
 	service_info *endServiceList;
+	/*! Hash indexes over serviceList by serviceId and UDN, by control
+	 * path and by event path, each serviceIndexSize buckets long and
+	 * stored one after the other. Rebuilt whenever serviceList changes. */
+	service_info **serviceIndex;
+	/*! Number of buckets in each of the service indexes. */
+	size_t serviceIndexSize;
 } service_table;
 
 /* Functions for Subscriptions */
@@ -105,6 +194,16 @@ int copy_subscription(
 	/*! [in] Destination subscription. */
 	subscription *out);
 
+/*!
+ * \brief Adds a subscription to the head of the service subscription list
+ * and to the SID index.
+ */
+void AddSubscription(
+	/*! [in] Service object providing the list of subscriptions. */
+	service_info *service,
+	/*! [in] Subscription to add, it becomes owned by the service. */
+	subscription *sub);
+
 /*
  * \brief Remove the subscription represented by the const Upnp_SID sid
  * parameter from the service table and update the service table.
@@ -301,8 +400,8 @@ int removeServiceTable(
  * \brief Add Service to the table.
  */
 int addServiceTable(
-	/*! [in] XML node information. */
-	IXML_Node *node,
+	/*! [in] Index of the description document. */
+	const desc_index *index,
 	/*! [in] Service table that will be initialized with services. */
 	service_table *in,
 	/*! [in] Default base URL on which the URL will be returned to the
@@ -315,8 +414,8 @@ int addServiceTable(
  * \return An integer
  */
 int getServiceTable(
-	/*! [in] XML node information. */
-	IXML_Node *node,
+	/*! [in] Index of the description document. */
+	const desc_index *index,
 	/*! [in] Output parameter which will contain the service list and URL.
 	 */
 	service_table *out,
@@ -62,6 +62,10 @@ typedef struct
 	SOCKET socket;
 	/*! The following two fields are filled only in incoming requests. */
 	struct sockaddr_storage foreign_sockaddr;
+	/*! Server side only: non-zero if the connection will be reused for
+	 * another request after the current response. Response writers that
+	 * cannot delimit their body must clear it. */
+	int keep_alive;
 #ifdef UPNP_ENABLE_OPEN_SSL
 	SSL *ssl;
 #endif
@@ -187,6 +191,32 @@ int sock_write(
 	/*! [in,out] timeout value. */
 	int *timeoutSecs);
 
+#ifdef HAVE_SENDFILE
+/*!
+ * \brief Sends part of a file on the socket in sockinfo without copying it
+ * through user space.
+ *
+ * Must not be used on TLS connections.
+ *
+ * \return Integer:
+ * \li \c UPNP_E_SUCCESS - All count bytes were sent.
+ * \li \c UPNP_E_TIMEDOUT - Timeout.
+ * \li \c UPNP_E_SOCKET_ERROR - Error on socket calls.
+ * \li \c UPNP_E_FILE_READ_ERROR - The file ended before count bytes.
+ */
+int sock_sendfile(
+	/*! [in] Socket Information Object. */
+	SOCKINFO *info,
+	/*! [in] Descriptor of the file to send from. */
+	int fd,
+	/*! [in] Offset in the file of the first byte to send. */
+	off_t offset,
+	/*! [in] Number of bytes to send. */
+	off_t count,
+	/*! [in,out] timeout value. */
+	int *timeoutSecs);
+#endif /* HAVE_SENDFILE */
+
 /*!
  * \brief Make socket blocking.
  *
@@ -0,0 +1,166 @@
+#ifndef GENLIB_NET_SOCKPOLL_H
+#define GENLIB_NET_SOCKPOLL_H
+
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*!
+ * \addtogroup Sock
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Socket readiness notification.
+ *
+ * A sockpoll object watches a set of sockets for readability. On systems
+ * that provide epoll(7) the kernel keeps the interest list and a wakeup
+ * costs O(ready sockets); elsewhere the sockets are kept in an array and
+ * handed to select() on every wait, which is bounded by FD_SETSIZE.
+ */
+
+#include "UpnpInet.h" /* for SOCKET */
+#include "autoconfig.h"
+
+#include <stddef.h>
+
+/*! Maximum number of sockets a sockpoll object can watch. */
+#define SOCKPOLL_MAX_SOCKETS 64
+
+/*! */
+typedef struct
+{
+#ifdef HAVE_EPOLL
+	/*! epoll instance descriptor. */
+	int epfd;
+#endif
+	/*! Number of valid entries in socks. */
+	size_t count;
+	/*! Sockets being watched. */
+	SOCKET socks[SOCKPOLL_MAX_SOCKETS];
+} sockpoll;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Initializes an empty sockpoll object.
+ *
+ * \return Integer:
+ * \li \c UPNP_E_SUCCESS
+ * \li \c UPNP_E_OUTOF_SOCKET - The kernel poll object could not be created.
+ */
+int sockpoll_init(
+	/*! [out] The sockpoll object. */
+	sockpoll *sp);
+
+/*!
+ * \brief Releases the resources held by a sockpoll object.
+ *
+ * The watched sockets are not closed.
+ */
+void sockpoll_destroy(
+	/*! [in,out] The sockpoll object. */
+	sockpoll *sp);
+
+/*!
+ * \brief Adds a socket to the set of watched sockets.
+ *
+ * Passing INVALID_SOCKET is a no-op, so callers can register optional
+ * sockets without checking them first.
+ *
+ * \return Integer:
+ * \li \c UPNP_E_SUCCESS
+ * \li \c UPNP_E_OUTOF_SOCKET - The set is full.
+ * \li \c UPNP_E_SOCKET_ERROR - The kernel refused the socket.
+ */
+int sockpoll_add(
+	/*! [in,out] The sockpoll object. */
+	sockpoll *sp,
+	/*! [in] Socket to watch for readability. */
+	SOCKET sock);
+
+/*!
+ * \brief Removes a socket from the set of watched sockets.
+ *
+ * Must be called before the socket is closed.
+ */
+void sockpoll_remove(
+	/*! [in,out] The sockpoll object. */
+	sockpoll *sp,
+	/*! [in] Socket to forget. */
+	SOCKET sock);
+
+/*!
+ * \brief Waits until at least one watched socket is readable or in error.
+ *
+ * \return Integer:
+ * \li \c >0 - Number of sockets stored in ready.
+ * \li \c 0 - The timeout expired or the wait was interrupted by a signal.
+ * \li \c UPNP_E_SOCKET_ERROR - The wait failed, errno is set.
+ */
+int sockpoll_wait(
+	/*! [in] The sockpoll object. */
+	sockpoll *sp,
+	/*! [out] Ready sockets. */
+	SOCKET *ready,
+	/*! [in] Capacity of ready. */
+	size_t max_ready,
+	/*! [in] Timeout in milliseconds, or -1 to wait forever. */
+	int timeout_ms);
+
+/*!
+ * \brief Waits until a single socket is readable or in error.
+ *
+ * Unlike a select() on the socket, this works for any descriptor value, so
+ * it is safe for accepted and connected sockets, which can be numbered past
+ * FD_SETSIZE.
+ *
+ * \return Integer:
+ * \li \c 1 - The socket is readable, closed by the peer or in error.
+ * \li \c 0 - The timeout expired or the wait was interrupted by a signal.
+ * \li \c UPNP_E_SOCKET_ERROR - The wait failed, errno is set.
+ */
+int sockpoll_wait_one(
+	/*! [in] Socket to wait for. */
+	SOCKET sock,
+	/*! [in] Timeout in milliseconds, 0 to only check, or -1 to wait
+	 * forever. */
+	int timeout_ms);
+
+#ifdef __cplusplus
+} /* #extern "C" */
+#endif
+
+/* @} Sock Network Socket Library */
+
+#endif /* GENLIB_NET_SOCKPOLL_H */
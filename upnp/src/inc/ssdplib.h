@@ -135,11 +135,13 @@ typedef struct TData
 	struct sockaddr_storage DestAddr;
 } ThreadData;
 
+/*! A pending reply to an M-SEARCH, for all the device handles of the
+ * address family of the searcher. */
 typedef struct ssdpsearchreply
 {
-	int MaxAge;
-	UpnpDevice_Handle handle;
+	/*! Address of the searcher. */
 	struct sockaddr_storage dest_addr;
+	/*! The search. */
 	SsdpEvent event;
 } SsdpSearchReply;
 
@@ -157,11 +159,116 @@ typedef struct ssdpsearchexparg
 	int timeoutEventId;
 } SsdpSearchExpArg;
 
+/*! Maximum number of datagrams read from an SSDP socket at once. */
+#define SSDP_RECV_BATCH 8
+
+/*! Maximum number of datagrams sent with one sendmmsg() call. */
+#define SSDP_SEND_BATCH 32
+
+/*! Number of released receive batches kept for reuse. */
+#define SSDP_RECV_BATCH_CACHE 4
+
+/*! A datagram received on an SSDP socket. */
 typedef struct
 {
-	http_parser_t parser;
+	/*! The datagram. Its BUFSIZE bytes buffer is kept when the batch is
+	 * reused. */
+	membuffer msg;
+	/*! Sender of the datagram. */
 	struct sockaddr_storage dest_addr;
-} ssdp_thread_data;
+} ssdp_packet;
+
+/*! Datagrams read from one SSDP socket, handled by a single job. */
+typedef struct
+{
+	/*! Set if the datagrams are answers to our M-SEARCH requests. */
+	int is_response;
+	/*! Number of datagrams in packets. */
+	size_t count;
+	/*! The datagrams. */
+	ssdp_packet packets[SSDP_RECV_BATCH];
+} ssdp_recv_batch;
+
+/*! Kinds of SSDP messages sent by a device. */
+#define MSGTYPE_SHUTDOWN 0
+#define MSGTYPE_ADVERTISEMENT 1
+#define MSGTYPE_REPLY 2
+
+/*! Number of packet sets kept per device handle, one per message kind. */
+#define SSDP_CACHE_SETS 3
+
+/*! Size of the device and service type strings kept in the SSDP cache. */
+#define SSDP_CACHE_NAME_SIZE 100
+
+/*! A device of the description document, as seen by SSDP. */
+typedef struct
+{
+	/*! Device type, as found in the description. */
+	char DevType[SSDP_CACHE_NAME_SIZE];
+	/*! UDN of the device. */
+	char Udn[SSDP_CACHE_NAME_SIZE];
+	/*! Set for the root device. */
+	int RootDev;
+	/*! Index of the first service of the device in SsdpCache.Services. */
+	size_t FirstService;
+	/*! Number of services of the device. */
+	size_t NumServices;
+} SsdpCacheDevice;
+
+/*! A service of the description document, as seen by SSDP. */
+typedef struct
+{
+	/*! Service type, as found in the description. */
+	char ServType[SSDP_CACHE_NAME_SIZE];
+} SsdpCacheService;
+
+/*! The packets of one kind of message, rendered for every device and
+ * service of a handle. */
+typedef struct SsdpPacketSet
+{
+	/*! Number of users of the set, including the cache itself. */
+	int RefCount;
+	/*! MSGTYPE_SHUTDOWN, MSGTYPE_ADVERTISEMENT or MSGTYPE_REPLY. */
+	int MsgType;
+	/*! Value of the CACHE-CONTROL max-age header. */
+	int Duration;
+	/*! Address family the multicast HOST header was chosen for. */
+	int AddressFamily;
+	/*! UPnP Low Power headers. */
+	int PowerState;
+	int SleepPeriod;
+	int RegistrationState;
+	/*! Value of the LOCATION header. */
+	char Location[LINE_SIZE];
+	/*! The packets, in the order they are sent for ssdp:all. */
+	char **Packets;
+	/*! For every packet, the offset of its DATE header, or -1. */
+	int *DateOffset;
+	/*! Number of entries in Packets. */
+	int NumPackets;
+	/*! For every device, the index in Packets of its upnp:rootdevice, UDN
+	 * and device type packets, or -1. */
+	int *DevicePacket;
+	/*! For every service, the index in Packets of its packet, or -1. */
+	int *ServicePacket;
+} SsdpPacketSet;
+
+/*! SSDP view of the description of a device handle, and the packets
+ * rendered from it. */
+typedef struct SsdpCache
+{
+	/*! Devices of the description, in document order. */
+	SsdpCacheDevice *Devices;
+	/*! Number of entries in Devices. */
+	size_t NumDevices;
+	/*! Services of all the devices. */
+	SsdpCacheService *Services;
+	/*! Number of entries in Services. */
+	size_t NumServices;
+	/*! Last rendered packet set of each message kind, indexed by
+	 * MSGTYPE_*. */
+	SsdpPacketSet *Sets[SSDP_CACHE_SETS];
+} SsdpCache;
 
 /* globals */
 
@@ -238,9 +345,26 @@ int ssdp_request_type(
 	/* [out] The event structure partially filled by this function. */
 	SsdpEvent *Evt);
 
+/*!
+ * \brief Initializes the cache of SSDP receive batches.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int ssdp_recv_batches_init(void);
+
+/*!
+ * \brief Frees the cached SSDP receive batches.
+ *
+ * Must be called after the receive thread pool has been shut down.
+ */
+void ssdp_recv_batches_destroy(void);
+
 /*!
  * \brief This function reads the data from the ssdp socket.
  *
+ * All the datagrams waiting on the socket, up to SSDP_RECV_BATCH, are read
+ * at once and handed to a single job of the receive thread pool.
+ *
  * \return 0 on success; -1 on error.
  */
 int readFromSSDPSocket(
@@ -307,6 +431,35 @@ int SearchByTarget(
 	 * be returned to application in the callback. */
 	void *Cookie);
 
+/*!
+ * \brief Initializes the state shared by the SSDP control point functions.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int ssdp_ctrlpt_init(void);
+
+/*!
+ * \brief Releases the state shared by the SSDP control point functions.
+ *
+ * Must be called after the timer thread and the thread pools have been shut
+ * down.
+ */
+void ssdp_ctrlpt_destroy(void);
+
+/*!
+ * \brief Sets the SSDP request sockets of the control point: the M-SEARCH
+ * requests are sent through them.
+ *
+ * The miniserver sets them when it opens its sockets and resets them to
+ * INVALID_SOCKET before it closes them. The sockets are not closed while a
+ * search is being sent through them.
+ */
+void ssdp_set_req_sockets(
+	/* [in] IPv4 socket, or INVALID_SOCKET. */
+	SOCKET sock4,
+	/* [in] IPv6 socket, or INVALID_SOCKET. */
+	SOCKET sock6);
+
 /* @} SSDP Control Point Functions */
 
 /*!
@@ -317,16 +470,51 @@ int SearchByTarget(
 
 /*!
  * \brief Wrapper function to reply the search request coming from the
- * control point.
+ * control point, for every device handle of its address family.
  */
 void advertiseAndReplyThread(
 	/* [in] Structure containing the search request. */
 	void *data);
 
+/*!
+ * \brief Initializes the state shared by the SSDP device functions.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int ssdp_device_init(void);
+
+/*!
+ * \brief Releases the state shared by the SSDP device functions.
+ *
+ * Must be called after the timer thread and the thread pools have been shut
+ * down.
+ */
+void ssdp_device_destroy(void);
+
+/*!
+ * \brief Sets the SSDP sockets of the device, bound to the SSDP port: all
+ * the advertisements and replies are sent through them.
+ *
+ * The miniserver sets them when it opens its sockets and resets them to
+ * INVALID_SOCKET before it closes them. The sockets are not closed while a
+ * packet is being sent through them.
+ */
+void ssdp_set_send_sockets(
+	/* [in] IPv4 socket, or INVALID_SOCKET. */
+	SOCKET sock4,
+	/* [in] IPv6 socket, or INVALID_SOCKET. */
+	SOCKET sock6);
+
 /*!
  * \brief Handles the search request. It does the sanity checks of the
  * request and then schedules a thread to send a random time reply
  * (random within maximum time given by the control point to reply).
+ *
+ * A search from the same address for the same target as a pending one is
+ * answered by the pending reply. At most SSDP_MAX_PENDING_REPLIES replies
+ * are pending, and at most SSDP_MAX_REPLIES_PER_SEC searches are accepted
+ * per second, SSDP_MAX_REPLIES_PER_SOURCE of them from any one address;
+ * other searches are dropped.
  */
 #ifdef INCLUDE_DEVICE_APIS
 void ssdp_handle_device_request(
@@ -522,6 +710,153 @@ int DeviceShutdown(
 	/* [in] RegistrationState as defined by UPnP Low Power. */
 	int RegistrationState);
 
+#ifdef INCLUDE_DEVICE_APIS
+struct Handle_Info;
+
+/*!
+ * \brief Returns the packets of one kind of message for a device handle.
+ *
+ * The devices and services of the description are indexed the first time
+ * the handle is used. Packets are rendered once and reused for as long as
+ * the location, duration, address family and UPnP Low Power values stay the
+ * same; a change renders a new set.
+ *
+ * Must be called with the handle table locked. The set must be given back
+ * with ssdp_cache_release().
+ *
+ * \return The packet set or NULL if it cannot be allocated.
+ */
+SsdpPacketSet *ssdp_cache_acquire(
+	/* [in] Device handle. */
+	struct Handle_Info *SInfo,
+	/* [in] MSGTYPE_SHUTDOWN, MSGTYPE_ADVERTISEMENT or MSGTYPE_REPLY. */
+	int MsgType,
+	/* [in] Location of Device description document. */
+	char *Location,
+	/* [in] Service duration in sec. */
+	int Duration);
+
+/*!
+ * \brief Gives back a reference to a packet set, freeing the set with the
+ * last one.
+ */
+void ssdp_cache_release(
+	/* [in] Packet set, may be NULL. */
+	SsdpPacketSet *set);
+
+/*!
+ * \brief Frees the SSDP cache of a device handle.
+ */
+void ssdp_cache_free(
+	/* [in] The cache, may be NULL. */
+	SsdpCache *cache);
+
+/*!
+ * \brief Sends packets of a packet set.
+ *
+ * Replies are sent with their DATE header set to the current time.
+ *
+ * \return UPNP_E_SUCCESS if successful else appropriate error.
+ */
+int ssdp_cache_send(
+	/* [in] Packet set. */
+	SsdpPacketSet *set,
+	/* [in] Destination address, or NULL for the SSDP multicast address of
+	 * the device. */
+	struct sockaddr *DestAddr,
+	/* [in] Index of the first packet to be sent. */
+	int first,
+	/* [in] Number of packets to be sent. */
+	int count);
+
+/*!
+ * \brief Multicasts all the packets of a set NUM_SSDP_COPY times.
+ *
+ * The first copy is sent at once; the others are sent SSDP_PAUSE ms apart by
+ * the timer thread, which keeps a reference to the set until then.
+ *
+ * \return Result of sending the first copy.
+ */
+int ssdp_cache_multicast(
+	/* [in] Packet set. */
+	SsdpPacketSet *set);
+
+/*!
+ * \brief Books a round of packets against the budget shared by the periodic
+ * advertisements of all the devices.
+ *
+ * Rounds are granted in the order they are booked. A round that is not sent
+ * must give its share back with ssdp_pace_cancel().
+ *
+ * \return The delay, in ms, after which the round may be sent; 0 to send it
+ * now.
+ */
+int ssdp_pace_book(
+	/* [in] Number of packets of the round, counting every copy. */
+	int Packets,
+	/* [out] Share of the budget taken by the round, in ms; 0 when there is
+	 * no budget. */
+	int *Share);
+
+/*!
+ * \brief Gives back the share of a round booked with ssdp_pace_book() that
+ * will not be sent.
+ */
+void ssdp_pace_cancel(
+	/* [in] Share returned by ssdp_pace_book(). */
+	int Share);
+
+/*!
+ * \brief Counts a booked round that was sent in the statistics.
+ */
+void ssdp_pace_sent(
+	/* [in] Number of packets of the round. */
+	int Packets,
+	/* [in] Delay returned by ssdp_pace_book(). */
+	int Delay);
+
+/*!
+ * \brief Books a periodic advertisement of a device, see ssdp_pace_book().
+ *
+ * Must be called without the handle table locked. Nothing is booked if the
+ * handle is no longer a device.
+ *
+ * \return The delay, in ms, after which the advertisement may be sent; 0 to
+ * send it now.
+ */
+int ssdp_pace_advertisement(
+	/* [in] Device handle. */
+	int Hnd,
+	/* [in] Service duration in sec. */
+	int Exp,
+	/* [out] Number of packets of the advertisement, counting every
+	 * copy. */
+	int *Packets,
+	/* [out] Share of the budget taken, see ssdp_pace_book(). */
+	int *Share);
+
+/*!
+ * \brief Sets the budget of the periodic advertisements.
+ */
+void ssdp_pace_set_rate(
+	/* [in] Packets per second, 0 for no budget. */
+	int PacketsPerSecond);
+
+/*!
+ * \brief Returns the statistics of the periodic advertisements.
+ */
+void ssdp_pace_stats(
+	/* [out] Number of rounds sent, may be NULL. */
+	unsigned long *Rounds,
+	/* [out] Number of packets of these rounds, counting every copy, may be
+	 * NULL. */
+	unsigned long *Packets,
+	/* [out] Number of rounds delayed by the budget, may be NULL. */
+	unsigned long *Deferred,
+	/* [out] Longest delay, in ms, may be NULL. */
+	unsigned long *MaxDelay);
+#endif /* INCLUDE_DEVICE_APIS */
+
 /* @} SSDP Device Functions */
 
 /* @} SSDPlib SSDP Library */
@@ -53,7 +53,9 @@
 #define DEFAULT_SOAP_CONTENT_LENGTH 16000
 #define MAX_SOAP_CONTENT_LENGTH (size_t)32000
 
-#define NUM_HANDLE 200
+/*! Initial number of slots in the handle table. The table doubles in size
+ * whenever it runs out of free handles, up to NUM_HANDLE slots (config.h). */
+#define NUM_HANDLE_INITIAL 16
 
 extern size_t g_maxContentLength;
 extern int g_UpnpSdkEQMaxLen;
@@ -80,6 +82,10 @@ struct Handle_Info
 	char *Cookie;
 	/*! 0 = not installed; otherwise installed. */
 	int aliasInstalled;
+	/*! Serializes updates to this handle made by threads that only hold
+	 * the handle table read lock. Holders of the write lock already have
+	 * exclusive access and need not take it. */
+	ithread_mutex_t Mutex;
 
 	/* Device Only */
 #ifdef INCLUDE_DEVICE_APIS
@@ -104,6 +110,8 @@ struct Handle_Info
 	IXML_NodeList *DeviceList;
 	/*! List of services in the description document. */
 	IXML_NodeList *ServiceList;
+	/*! Devices and services of the description, indexed at registration. */
+	desc_index *DescIndex;
 	/*! Table holding subscriptions and URL information. */
 	service_table ServiceTable;
 	/*! . */
@@ -112,6 +120,13 @@ struct Handle_Info
 	int MaxSubscriptionTimeOut;
 	/*! Address family: AF_INET or AF_INET6. */
 	int DeviceAf;
+	/*! SSDP packets rendered from the description, built on first use. */
+	struct SsdpCache *SsdpCache;
+	/*! Percentage of the renewal interval over which the periodic
+	 * advertisements are spread. */
+	int AdvertiseJitter;
+	/*! Timer event of the next periodic advertisement, or -1. */
+	int AdvertiseEventId;
 #endif
 
 	/* Client only */
@@ -166,6 +181,16 @@ static void HandleLock(const char *file, int line)
 }
 #pragma GCC diagnostic pop
 
+/*!
+ * \brief Returns one past the highest handle currently in the table.
+ *
+ * Must be called with the handle lock held. The table never shrinks while the
+ * SDK is initialized, so a handle below this bound stays in range.
+ *
+ * \return The number of slots in the handle table.
+ */
+int GetHandleTableSize(void);
+
 /*!
  * \brief Get client handle info.
  *
@@ -311,6 +336,9 @@ void UpnpThreadDistribution(struct UpnpNonblockParam *Param);
 /*!
  * \brief This function is a timer thread scheduled by UpnpSendAdvertisement
  * to the send advetisement again.
+ *
+ * The advertisement is delayed when the periodic advertisements of all the
+ * devices would exceed the budget set with UpnpSetAdvertisementRate().
  */
 void AutoAdvertise(
 	/*! [in] Information provided to the thread. */
@@ -337,4 +365,10 @@ extern void *gWebCallback_HostValidateCookie;
 /*! */
 extern int gAllowLiteralHostRedirection;
 
+/*! */
+extern int gHttpKeepAliveTimeout;
+
+/*! */
+extern int gHttpKeepAliveMaxRequests;
+
 #endif /* UPNPAPI_H */
@@ -386,7 +386,8 @@ static int get_response_value(http_message_t *hmsg,
 		    hmsg->status_code != HTTP_INTERNAL_SERVER_ERROR) ||
 		!has_xml_content_type(hmsg))
 		goto error_handler;
-	if (ixmlParseBufferEx(hmsg->entity.buf, &doc) != IXML_SUCCESS)
+	/* doc is freed here; the action value is parsed again on the heap */
+	if (ixmlParseBufferArena(hmsg->entity.buf, &doc) != IXML_SUCCESS)
 		goto error_handler;
 	root_node = ixmlNode_getFirstChild((IXML_Node *)doc);
 	if (root_node == NULL)
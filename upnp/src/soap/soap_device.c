@@ -77,7 +77,7 @@ static const char *SOAP_URN = "http:/"
 			      "/schemas.xmlsoap.org/soap/envelope/";
 static const char *QUERY_STATE_VAR_URN = "urn:schemas-upnp-org:control-1-0";
 
-static const char *Soap_Invalid_Action = "Invalid Action";
+/*static const char* Soap_Invalid_Action = "Invalid Action"; */
 /*static const char* Soap_Invalid_Args = "Invalid Args"; */
 static const char *Soap_Action_Failed = "Action Failed";
 static const char *Soap_Invalid_Var = "Invalid Var";
@@ -384,39 +384,45 @@ static void handle_invoke_action(
 	http_message_t *request,
 	/*! [in] SOAP device/service information. */
 	soap_devserv_t *soap_info,
-	/*! [in] Node containing the SOAP action request. */
+	/*! [in] Node containing the SOAP action request. It is copied into
+	 * the document handed to the callback. */
 	IXML_Node *req_node)
 {
 	char save_char;
 	UpnpActionRequest *action = UpnpActionRequest_new();
 	IXML_Document *actionRequestDoc = NULL;
+	IXML_Node *action_node = NULL;
 	IXML_Document *actionResultDoc = NULL;
 	int err_code;
 	const char *err_str;
 	memptr action_name;
-	DOMString act_node = NULL;
 	memptr hdr_value;
 
 	/* null-terminate */
 	action_name = soap_info->action_name;
 	save_char = action_name.buf[action_name.length];
 	action_name.buf[action_name.length] = '\0';
-	/* get action node */
-	act_node = ixmlPrintNode(req_node);
-	if (!act_node) {
+	/* copy the action node into a document of its own; the request was
+	 * parsed in an arena, whose nodes cannot be moved out of it */
+	err_code = ixmlDocument_createDocumentEx(&actionRequestDoc);
+	if (err_code != IXML_SUCCESS) {
 		err_code = SOAP_MEMORY_OUT;
 		err_str = Soap_Memory_out;
 		goto error_handler;
 	}
-	err_code = ixmlParseBufferEx(act_node, &actionRequestDoc);
-	if (err_code != IXML_SUCCESS) {
-		if (IXML_INSUFFICIENT_MEMORY == err_code) {
-			err_code = SOAP_MEMORY_OUT;
-			err_str = Soap_Memory_out;
-		} else {
-			err_code = SOAP_INVALID_ACTION;
-			err_str = Soap_Invalid_Action;
+	err_code = ixmlDocument_importNode(
+		actionRequestDoc, req_node, 1, &action_node);
+	if (err_code == IXML_SUCCESS) {
+		err_code = ixmlNode_appendChild(
+			(IXML_Node *)actionRequestDoc, action_node);
+		if (err_code != IXML_SUCCESS) {
+			ixmlNode_free(action_node);
 		}
+	}
+	if (err_code != IXML_SUCCESS) {
+		/* the request was valid, the copy ran out of memory */
+		err_code = SOAP_ACTION_FAILED;
+		err_str = Soap_Action_Failed;
 		goto error_handler;
 	}
 	UpnpActionRequest_set_ErrCode(action, UPNP_E_SUCCESS);
@@ -459,7 +465,6 @@ static void handle_invoke_action(
 error_handler:
 	ixmlDocument_free(actionResultDoc);
 	ixmlDocument_free(actionRequestDoc);
-	ixmlFreeDOMString(act_node);
 	/* restore */
 	action_name.buf[action_name.length] = save_char;
 	if (err_code != 0)
@@ -787,8 +792,9 @@ void soap_device_callback(
 		}
 		goto error_handler;
 	}
-	/* parse XML */
-	err_code = ixmlParseBufferEx(request->entity.buf, &xml_doc);
+	/* parse XML; the document stays inside the SDK, see
+	 * handle_invoke_action() */
+	err_code = ixmlParseBufferArena(request->entity.buf, &xml_doc);
 	if (err_code != IXML_SUCCESS) {
 		if (IXML_INSUFFICIENT_MEMORY == err_code)
 			err_code = HTTP_INTERNAL_SERVER_ERROR;
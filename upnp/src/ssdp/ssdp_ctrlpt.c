@@ -59,6 +59,40 @@
 
 		#include "posix_overwrites.h" // IWYU pragma: keep
 
+/*! Keeps gSsdpReqSocket4 and gSsdpReqSocket6 open while searches are sent
+ * through them, see ssdp_set_req_sockets(). */
+static ithread_rwlock_t ReqSocketLock;
+
+int ssdp_ctrlpt_init(void)
+{
+	gSsdpReqSocket4 = INVALID_SOCKET;
+		#ifdef UPNP_ENABLE_IPV6
+	gSsdpReqSocket6 = INVALID_SOCKET;
+		#endif /* UPNP_ENABLE_IPV6 */
+	if (ithread_rwlock_init(&ReqSocketLock, NULL) != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void ssdp_ctrlpt_destroy(void)
+{
+	ithread_rwlock_destroy(&ReqSocketLock);
+}
+
+void ssdp_set_req_sockets(SOCKET sock4, SOCKET sock6)
+{
+	ithread_rwlock_wrlock(&ReqSocketLock);
+	gSsdpReqSocket4 = sock4;
+		#ifdef UPNP_ENABLE_IPV6
+	gSsdpReqSocket6 = sock6;
+		#else
+	(void)sock6;
+		#endif /* UPNP_ENABLE_IPV6 */
+	ithread_rwlock_unlock(&ReqSocketLock);
+}
+
 /*!
  * \brief Sends a callback to the control point application with a SEARCH
  * result.
@@ -110,8 +144,12 @@ void ssdp_handle_ctrlpt_msg(
 	HandleUnlock(__FILE__, __LINE__);
 	/* search timeout */
 	if (timeout) {
-		for (handle = handle_start; handle < NUM_HANDLE; handle++) {
-			HandleLock(__FILE__, __LINE__);
+		for (handle = handle_start;; handle++) {
+			HandleReadLock(__FILE__, __LINE__);
+			if (handle >= GetHandleTableSize()) {
+				HandleUnlock(__FILE__, __LINE__);
+				break;
+			}
 
 			/* get client info */
 			if (GetHandleInfo(handle, &ctrlpt_info) != HND_CLIENT) {
@@ -226,8 +264,12 @@ void ssdp_handle_ctrlpt_msg(
 			event_type = UPNP_DISCOVERY_ADVERTISEMENT_ALIVE;
 		}
 		/* call callback */
-		for (handle = handle_start; handle < NUM_HANDLE; handle++) {
-			HandleLock(__FILE__, __LINE__);
+		for (handle = handle_start;; handle++) {
+			HandleReadLock(__FILE__, __LINE__);
+			if (handle >= GetHandleTableSize()) {
+				HandleUnlock(__FILE__, __LINE__);
+				break;
+			}
 
 			/* get client info */
 			if (GetHandleInfo(handle, &ctrlpt_info) != HND_CLIENT) {
@@ -261,8 +303,12 @@ void ssdp_handle_ctrlpt_msg(
 			goto end_ssdp_handle_ctrlpt_msg;
 		}
 		/* check each current search */
-		for (handle = handle_start; handle < NUM_HANDLE; handle++) {
-			HandleLock(__FILE__, __LINE__);
+		for (handle = handle_start;; handle++) {
+			HandleReadLock(__FILE__, __LINE__);
+			if (handle >= GetHandleTableSize()) {
+				HandleUnlock(__FILE__, __LINE__);
+				break;
+			}
 
 			/* get client info */
 			if (GetHandleInfo(handle, &ctrlpt_info) != HND_CLIENT) {
@@ -521,6 +567,122 @@ static int CreateClientRequestPacketUlaGua(
 }
 		#endif /* UPNP_ENABLE_IPV6 */
 
+/*! An M-SEARCH whose copies are still to be multicast. */
+typedef struct SsdpSearchCopy
+{
+	/*! Destination, its family selects the request socket. */
+	struct sockaddr_storage dest;
+	/*! Number of copies still to be sent. */
+	int remaining;
+	/*! The request. */
+	char packet[BUFSIZE];
+} SsdpSearchCopy;
+
+/*!
+ * \brief Sends one copy of an M-SEARCH through the request socket of its
+ * address family.
+ */
+static void SendSearchCopy(
+	/* [in] The request. */
+	const char *packet,
+	/* [in] Multicast destination. */
+	const struct sockaddr_storage *dest)
+{
+	SOCKET sock = INVALID_SOCKET;
+	socklen_t socklen = 0;
+
+	/* The miniserver closes the sockets once this is released. */
+	ithread_rwlock_rdlock(&ReqSocketLock);
+	switch (dest->ss_family) {
+	case AF_INET:
+		sock = gSsdpReqSocket4;
+		socklen = (socklen_t)sizeof(struct sockaddr_in);
+		break;
+		#ifdef UPNP_ENABLE_IPV6
+	case AF_INET6:
+		sock = gSsdpReqSocket6;
+		socklen = (socklen_t)sizeof(struct sockaddr_in6);
+		break;
+		#endif
+	default:
+		break;
+	}
+	if (sock == INVALID_SOCKET) {
+		ithread_rwlock_unlock(&ReqSocketLock);
+		return;
+	}
+	UpnpPrintf(UPNP_INFO,
+		SSDP,
+		__FILE__,
+		__LINE__,
+		">>> SSDP SEND M-SEARCH >>>\n%s\n",
+		packet);
+	sendto(sock,
+		packet,
+		strlen(packet),
+		0,
+		(const struct sockaddr *)dest,
+		socklen);
+	ithread_rwlock_unlock(&ReqSocketLock);
+}
+
+/*!
+ * \brief Timer job sending the next copy of an M-SEARCH, and scheduling the
+ * one after it SSDP_PAUSE ms later.
+ */
+static void RepeatSearch(
+	/* [in] The SsdpSearchCopy. */
+	void *arg)
+{
+	SsdpSearchCopy *copy = (SsdpSearchCopy *)arg;
+	ThreadPoolJob job;
+
+	SendSearchCopy(copy->packet, &copy->dest);
+	if (--copy->remaining <= 0) {
+		free(copy);
+		return;
+	}
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)RepeatSearch, copy);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	TPJobSetFreeFunction(&job, (free_routine)free);
+	if (TimerThreadSchedule(&gTimerThread,
+		    SSDP_PAUSE,
+		    REL_MSEC,
+		    &job,
+		    SHORT_TERM,
+		    NULL) != 0) {
+		free(copy);
+	}
+}
+
+/*!
+ * \brief Multicasts an M-SEARCH NUM_SSDP_COPY times.
+ *
+ * The first copy is sent at once, the timer thread sends the others
+ * SSDP_PAUSE ms apart so that the caller does not wait for them.
+ */
+static void MulticastSearch(
+	/* [in] The request. */
+	const char *packet,
+	/* [in] Multicast destination. */
+	const struct sockaddr_storage *dest)
+{
+	SsdpSearchCopy *copy;
+
+	copy = (SsdpSearchCopy *)malloc(sizeof(SsdpSearchCopy));
+	if (!copy) {
+		SendSearchCopy(packet, dest);
+		return;
+	}
+	memcpy(&copy->dest, dest, sizeof(copy->dest));
+	copy->remaining = NUM_SSDP_COPY;
+	strncpy(copy->packet, packet, sizeof(copy->packet) - 1);
+	copy->packet[sizeof(copy->packet) - 1] = '\0';
+	/* Sends the first copy and schedules the next one. */
+	RepeatSearch(copy);
+}
+
 /*!
  * \brief
  */
@@ -713,63 +875,14 @@ int SearchByTarget(int Hnd, int Mx, char *St, void *Cookie)
 		#ifdef UPNP_ENABLE_IPV6
 	if (gSsdpReqSocket6 != INVALID_SOCKET &&
 		FD_ISSET(gSsdpReqSocket6, &wrSet)) {
-		int NumCopy = 0;
-
-		while (NumCopy < NUM_SSDP_COPY) {
-			UpnpPrintf(UPNP_INFO,
-				SSDP,
-				__FILE__,
-				__LINE__,
-				">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				ReqBufv6UlaGua);
-			sendto(gSsdpReqSocket6,
-				ReqBufv6UlaGua,
-				strlen(ReqBufv6UlaGua),
-				0,
-				(struct sockaddr *)&__ss_v6,
-				sizeof(struct sockaddr_in6));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
-		NumCopy = 0;
+		MulticastSearch(ReqBufv6UlaGua, &__ss_v6);
 		inet_pton(AF_INET6, SSDP_IPV6_LINKLOCAL, &destAddr6->sin6_addr);
-		while (NumCopy < NUM_SSDP_COPY) {
-			UpnpPrintf(UPNP_INFO,
-				SSDP,
-				__FILE__,
-				__LINE__,
-				">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				ReqBufv6);
-			sendto(gSsdpReqSocket6,
-				ReqBufv6,
-				strlen(ReqBufv6),
-				0,
-				(struct sockaddr *)&__ss_v6,
-				sizeof(struct sockaddr_in6));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
+		MulticastSearch(ReqBufv6, &__ss_v6);
 	}
 		#endif /* IPv6 */
 	if (gSsdpReqSocket4 != INVALID_SOCKET &&
 		FD_ISSET(gSsdpReqSocket4, &wrSet)) {
-		int NumCopy = 0;
-		while (NumCopy < NUM_SSDP_COPY) {
-			UpnpPrintf(UPNP_INFO,
-				SSDP,
-				__FILE__,
-				__LINE__,
-				">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				ReqBufv4);
-			sendto(gSsdpReqSocket4,
-				ReqBufv4,
-				strlen(ReqBufv4),
-				0,
-				(struct sockaddr *)&__ss_v4,
-				sizeof(struct sockaddr_in));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
+		MulticastSearch(ReqBufv4, &__ss_v4);
 	}
 
 	return 1;
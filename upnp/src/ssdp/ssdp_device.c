@@ -38,6 +38,10 @@
  * \file
  */
 
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE /* For sendmmsg() in sys/socket.h */
+#endif
+
 #include "config.h"
 
 #ifdef INCLUDE_DEVICE_APIS
@@ -52,27 +56,276 @@
 		#include "upnpapi.h"
 
 		#include <assert.h>
+		#include <limits.h>
 		#include <stdio.h>
 		#include <string.h>
 
 		#include "posix_overwrites.h" // IWYU pragma: keep
 
-		#define MSGTYPE_SHUTDOWN 0
-		#define MSGTYPE_ADVERTISEMENT 1
-		#define MSGTYPE_REPLY 2
+/*! Replies waiting for their delay to expire. */
+static SsdpSearchReply *PendingReplies[SSDP_MAX_PENDING_REPLIES];
+/*! Number of entries in PendingReplies. */
+static int NumPendingReplies = 0;
+/*! Second in which RepliesInWindow searches have been accepted. */
+static time_t ReplyWindow = 0;
+/*! Number of searches accepted in the second ReplyWindow. */
+static int RepliesInWindow = 0;
+
+/*! Searches accepted from one source address. */
+typedef struct SsdpReplySource
+{
+	/*! The address, the port is ignored. */
+	struct sockaddr_storage addr;
+	/*! Second in which count searches have been accepted. */
+	time_t window;
+	/*! Number of searches accepted in the second window. */
+	int count;
+} SsdpReplySource;
+
+/*! SSDP sockets of the device, see ssdp_set_send_sockets(). */
+static SOCKET SendSocket4 = INVALID_SOCKET;
+static SOCKET SendSocket6 = INVALID_SOCKET;
+/*! Keeps the sockets above open while packets are sent through them. */
+static ithread_rwlock_t SendSocketLock;
+
+/*! Budgets of the sources heard from lately. */
+static SsdpReplySource ReplySources[SSDP_REPLY_SOURCES];
+/*! Protects the variables above. */
+static ithread_mutex_t PendingRepliesMutex;
+/*! Protects the reference counts of the packet sets, which outlive the
+ * handle lock while their copies are being repeated. */
+static ithread_mutex_t PacketSetMutex;
+
+/*! Serialises the bookings of the periodic advertisements. */
+static ithread_mutex_t PaceMutex;
+/*! Budget of the periodic advertisements, in packets per second, or 0. */
+static int PaceRate;
+/*! Time, in ms of PaceNow(), from which the budget is free again. */
+static int64_t PaceNextSlot;
+/*! Statistics of the periodic advertisements, see ssdp_pace_stats(). */
+static unsigned long PaceRounds;
+static unsigned long PacePackets;
+static unsigned long PaceDeferred;
+static unsigned long PaceMaxDelay;
+
+/*! A packet set whose copies are still to be multicast. */
+typedef struct SsdpRepeat
+{
+	/*! The set, referenced by the repeat. */
+	SsdpPacketSet *set;
+	/*! Number of copies still to be sent. */
+	int remaining;
+} SsdpRepeat;
+
+/*!
+ * \brief Checks whether two searches come from the same address and ask for
+ * the same target.
+ *
+ * \return 1 if they do, 0 otherwise.
+ */
+static int SameSearch(const SsdpSearchReply *a,
+	const struct sockaddr_storage *dest_addr,
+	const SsdpEvent *event)
+{
+	const struct sockaddr_in *a4 = (const struct sockaddr_in *)&a->dest_addr;
+	const struct sockaddr_in *b4 = (const struct sockaddr_in *)dest_addr;
+	const struct sockaddr_in6 *a6 =
+		(const struct sockaddr_in6 *)&a->dest_addr;
+	const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)dest_addr;
+
+	if (a->dest_addr.ss_family != dest_addr->ss_family ||
+		a->event.RequestType != event->RequestType)
+		return 0;
+	switch (dest_addr->ss_family) {
+	case AF_INET:
+		if (a4->sin_port != b4->sin_port ||
+			a4->sin_addr.s_addr != b4->sin_addr.s_addr)
+			return 0;
+		break;
+	case AF_INET6:
+		if (a6->sin6_port != b6->sin6_port ||
+			memcmp(&a6->sin6_addr,
+				&b6->sin6_addr,
+				sizeof(a6->sin6_addr)))
+			return 0;
+		break;
+	default:
+		return 0;
+	}
+
+	return !strcmp(a->event.UDN, event->UDN) &&
+	       !strcmp(a->event.DeviceType, event->DeviceType) &&
+	       !strcmp(a->event.ServiceType, event->ServiceType);
+}
+
+/*!
+ * \brief Checks whether two socket addresses have the same IP address.
+ *
+ * \return 1 if they do, 0 otherwise.
+ */
+static int SameSource(const struct sockaddr_storage *a,
+	const struct sockaddr_storage *b)
+{
+	if (a->ss_family != b->ss_family)
+		return 0;
+	switch (a->ss_family) {
+	case AF_INET:
+		return ((const struct sockaddr_in *)a)->sin_addr.s_addr ==
+		       ((const struct sockaddr_in *)b)->sin_addr.s_addr;
+	case AF_INET6:
+		return !memcmp(&((const struct sockaddr_in6 *)a)->sin6_addr,
+			&((const struct sockaddr_in6 *)b)->sin6_addr,
+			sizeof(struct in6_addr));
+	default:
+		return 0;
+	}
+}
+
+/*!
+ * \brief Takes a search from the budget of its source address for the
+ * current second.
+ *
+ * Entries of the sources not heard from in the current second are reused.
+ * PendingRepliesMutex must be locked.
+ *
+ * \return 1 if the search may be answered, 0 if the source used up its
+ * budget or too many sources were heard from in the current second.
+ */
+static int TakeSourceBudget(const struct sockaddr_storage *addr, time_t now)
+{
+	SsdpReplySource *unused = NULL;
+	int i;
+
+	for (i = 0; i < SSDP_REPLY_SOURCES; i++) {
+		if (ReplySources[i].window != now) {
+			if (!unused)
+				unused = &ReplySources[i];
+		} else if (SameSource(&ReplySources[i].addr, addr)) {
+			if (ReplySources[i].count >=
+				SSDP_MAX_REPLIES_PER_SOURCE)
+				return 0;
+			ReplySources[i].count++;
+			return 1;
+		}
+	}
+	if (!unused)
+		return 0;
+	memcpy(&unused->addr, addr, sizeof(unused->addr));
+	unused->window = now;
+	unused->count = 1;
+
+	return 1;
+}
+
+/*!
+ * \brief Removes a reply from the pending replies, if it is there.
+ */
+static void RemovePendingReply(SsdpSearchReply *arg)
+{
+	int i;
+
+	ithread_mutex_lock(&PendingRepliesMutex);
+	for (i = 0; i < NumPendingReplies; i++) {
+		if (PendingReplies[i] == arg) {
+			PendingReplies[i] = PendingReplies[--NumPendingReplies];
+			break;
+		}
+	}
+	ithread_mutex_unlock(&PendingRepliesMutex);
+}
+
+/*!
+ * \brief Frees a pending reply that will not be sent.
+ */
+static void FreePendingReply(void *data)
+{
+	RemovePendingReply((SsdpSearchReply *)data);
+	free(data);
+}
+
+int ssdp_device_init(void)
+{
+	NumPendingReplies = 0;
+	ReplyWindow = 0;
+	RepliesInWindow = 0;
+	memset(ReplySources, 0, sizeof(ReplySources));
+	PaceRate = SSDP_ADVERTISE_RATE;
+	PaceNextSlot = 0;
+	PaceRounds = 0;
+	PacePackets = 0;
+	PaceDeferred = 0;
+	PaceMaxDelay = 0;
+	if (ithread_mutex_init(&PendingRepliesMutex, NULL) != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+	if (ithread_mutex_init(&PacketSetMutex, NULL) != 0) {
+		ithread_mutex_destroy(&PendingRepliesMutex);
+		return UPNP_E_INIT_FAILED;
+	}
+	SendSocket4 = INVALID_SOCKET;
+	SendSocket6 = INVALID_SOCKET;
+	if (ithread_rwlock_init(&SendSocketLock, NULL) != 0) {
+		ithread_mutex_destroy(&PacketSetMutex);
+		ithread_mutex_destroy(&PendingRepliesMutex);
+		return UPNP_E_INIT_FAILED;
+	}
+	if (ithread_mutex_init(&PaceMutex, NULL) != 0) {
+		ithread_rwlock_destroy(&SendSocketLock);
+		ithread_mutex_destroy(&PacketSetMutex);
+		ithread_mutex_destroy(&PendingRepliesMutex);
+		return UPNP_E_INIT_FAILED;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void ssdp_device_destroy(void)
+{
+	ithread_mutex_destroy(&PaceMutex);
+	ithread_rwlock_destroy(&SendSocketLock);
+	ithread_mutex_destroy(&PacketSetMutex);
+	ithread_mutex_destroy(&PendingRepliesMutex);
+}
+
+void ssdp_set_send_sockets(SOCKET sock4, SOCKET sock6)
+{
+	ithread_rwlock_wrlock(&SendSocketLock);
+	SendSocket4 = sock4;
+	SendSocket6 = sock6;
+	ithread_rwlock_unlock(&SendSocketLock);
+}
 
 void advertiseAndReplyThread(void *data)
 {
 	SsdpSearchReply *arg = (SsdpSearchReply *)data;
+	struct Handle_Info *dev_info = NULL;
+	int handle;
+	int start = 0;
+	int maxAge;
 
-	AdvertiseAndReply(0,
-		arg->handle,
-		arg->event.RequestType,
-		(struct sockaddr *)&arg->dest_addr,
-		arg->event.DeviceType,
-		arg->event.UDN,
-		arg->event.ServiceType,
-		arg->MaxAge);
+	/* Searches arriving from now on need a reply of their own. */
+	RemovePendingReply(arg);
+	for (;;) {
+		HandleReadLock(__FILE__, __LINE__);
+		if (GetDeviceHandleInfo(start,
+			    (int)arg->dest_addr.ss_family,
+			    &handle,
+			    &dev_info) != HND_DEVICE) {
+			HandleUnlock(__FILE__, __LINE__);
+			break;
+		}
+		maxAge = dev_info->MaxAge;
+		HandleUnlock(__FILE__, __LINE__);
+		AdvertiseAndReply(0,
+			handle,
+			arg->event.RequestType,
+			(struct sockaddr *)&arg->dest_addr,
+			arg->event.DeviceType,
+			arg->event.UDN,
+			arg->event.ServiceType,
+			maxAge);
+		start = handle;
+	}
 	free(arg);
 }
 
@@ -81,7 +334,7 @@ void ssdp_handle_device_request(
 	http_message_t *hmsg, struct sockaddr_storage *dest_addr)
 {
 			#define MX_FUDGE_FACTOR 10
-	int handle, start;
+	int handle;
 	struct Handle_Info *dev_info = NULL;
 	memptr hdr_value;
 	int mx;
@@ -91,7 +344,8 @@ void ssdp_handle_device_request(
 	SsdpSearchReply *threadArg = NULL;
 	ThreadPoolJob job;
 	int replyTime;
-	int maxAge;
+	int i;
+	time_t now;
 
 	memset(&job, 0, sizeof(job));
 
@@ -116,80 +370,97 @@ void ssdp_handle_device_request(
 		/* bad ST header. */
 		return;
 
-	start = 0;
-	for (;;) {
-		HandleLock(__FILE__, __LINE__);
-		/* device info. */
-		switch (GetDeviceHandleInfo(
-			start, (int)dest_addr->ss_family, &handle, &dev_info)) {
-		case HND_DEVICE:
-			break;
-		default:
-			HandleUnlock(__FILE__, __LINE__);
-			/* no info found. */
+	HandleReadLock(__FILE__, __LINE__);
+	/* device info. */
+	ret_code = GetDeviceHandleInfo(
+		0, (int)dest_addr->ss_family, &handle, &dev_info);
+	HandleUnlock(__FILE__, __LINE__);
+	if (ret_code != HND_DEVICE)
+		/* no info found. */
+		return;
+
+	UpnpPrintf(
+		UPNP_INFO, API, __FILE__, __LINE__, "MX          =  %d\n", event.Mx);
+	UpnpPrintf(UPNP_INFO,
+		API,
+		__FILE__,
+		__LINE__,
+		"DeviceType   =  %s\n",
+		event.DeviceType);
+	UpnpPrintf(UPNP_INFO,
+		API,
+		__FILE__,
+		__LINE__,
+		"DeviceUuid   =  %s\n",
+		event.UDN);
+	UpnpPrintf(UPNP_INFO,
+		API,
+		__FILE__,
+		__LINE__,
+		"ServiceType =  %s\n",
+		event.ServiceType);
+
+	ithread_mutex_lock(&PendingRepliesMutex);
+	for (i = 0; i < NumPendingReplies; i++) {
+		if (SameSearch(PendingReplies[i], dest_addr, &event)) {
+			ithread_mutex_unlock(&PendingRepliesMutex);
+			UpnpPrintf(UPNP_INFO,
+				SSDP,
+				__FILE__,
+				__LINE__,
+				"Search already has a pending reply\n");
 			return;
 		}
-		maxAge = dev_info->MaxAge;
-		HandleUnlock(__FILE__, __LINE__);
-
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"MAX-AGE     =  %d\n",
-			maxAge);
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"MX          =  %d\n",
-			event.Mx);
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"DeviceType   =  %s\n",
-			event.DeviceType);
-		UpnpPrintf(UPNP_INFO,
-			API,
-			__FILE__,
-			__LINE__,
-			"DeviceUuid   =  %s\n",
-			event.UDN);
+	}
+	now = time(NULL);
+	if (now != ReplyWindow) {
+		ReplyWindow = now;
+		RepliesInWindow = 0;
+	}
+	if (NumPendingReplies >= SSDP_MAX_PENDING_REPLIES ||
+		RepliesInWindow >= SSDP_MAX_REPLIES_PER_SEC ||
+		!TakeSourceBudget(dest_addr, now)) {
+		ithread_mutex_unlock(&PendingRepliesMutex);
 		UpnpPrintf(UPNP_INFO,
-			API,
+			SSDP,
 			__FILE__,
 			__LINE__,
-			"ServiceType =  %s\n",
-			event.ServiceType);
-		threadArg = (SsdpSearchReply *)malloc(sizeof(SsdpSearchReply));
-		if (threadArg == NULL)
-			return;
-		threadArg->handle = handle;
-		memcpy(&threadArg->dest_addr,
-			dest_addr,
-			sizeof(threadArg->dest_addr));
-		threadArg->event = event;
-		threadArg->MaxAge = maxAge;
-
-		TPJobInit(&job, advertiseAndReplyThread, threadArg);
-		TPJobSetFreeFunction(&job, (free_routine)free);
-
-		/* Subtract a percentage from the mx to allow for network and
-		 * processing delays (i.e. if search is for 30 seconds, respond
-		 * within 0 - 27 seconds). */
-		if (mx >= 2)
-			mx -= MAXVAL(1, mx / MX_FUDGE_FACTOR);
-		if (mx < 1)
-			mx = 1;
-		replyTime = rand() % mx;
-		TimerThreadSchedule(&gTimerThread,
-			replyTime,
-			REL_SEC,
-			&job,
-			SHORT_TERM,
-			NULL);
-		start = handle;
+			"Too many searches, search dropped\n");
+		return;
+	}
+	threadArg = (SsdpSearchReply *)malloc(sizeof(SsdpSearchReply));
+	if (threadArg == NULL) {
+		ithread_mutex_unlock(&PendingRepliesMutex);
+		return;
+	}
+	memcpy(&threadArg->dest_addr, dest_addr, sizeof(threadArg->dest_addr));
+	threadArg->event = event;
+	PendingReplies[NumPendingReplies++] = threadArg;
+	RepliesInWindow++;
+	ithread_mutex_unlock(&PendingRepliesMutex);
+
+	TPJobInit(&job, advertiseAndReplyThread, threadArg);
+	TPJobSetFreeFunction(&job, FreePendingReply);
+
+	/* Subtract a percentage from the mx to allow for network and
+	 * processing delays (i.e. if search is for 30 seconds, respond
+	 * within 0 - 27 seconds). */
+	if (mx >= 2)
+		mx -= MAXVAL(1, mx / MX_FUDGE_FACTOR);
+	if (mx < 1)
+		mx = 1;
+	if (mx > INT_MAX / 1000)
+		mx = INT_MAX / 1000;
+	/* Spread the replies over the whole window rather than
+	 * on whole seconds. */
+	replyTime = rand() % (mx * 1000);
+	if (TimerThreadSchedule(&gTimerThread,
+		    replyTime,
+		    REL_MSEC,
+		    &job,
+		    SHORT_TERM,
+		    NULL) != 0) {
+		FreePendingReply(threadArg);
 	}
 }
 		#endif
@@ -210,72 +481,34 @@ static void ProcessSocketError(
 		errorBuffer);
 }
 
-		#define PROCESS_SOCKET_ERROR(file, line, rc, error, func_name) \
-			do { \
-				if (rc == -1) { \
-					ProcessSocketError( \
-						file, line, func_name); \
-					ret = error; \
-					goto end_SendToCaller; \
-				} \
-			} while (0)
-
 /*!
- * \brief Handles the request for one potential target port
+ * \brief Sends packets to one destination.
+ *
+ * With sendmmsg(), up to SSDP_SEND_BATCH packets go out with each call, so
+ * an advertisement round or an ssdp:all reply costs one or two system calls.
  *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
 static int SendToCaller(
-	/*! [in] Address detail for socket */
-	struct addrinfo *res,
+	/*! [in] Socket to send from. */
+	SOCKET ReplySock,
 	/*! [in] Socket address, to send the reply. */
 	struct sockaddr *DestAddr,
 	/*! [in] Number of packet to be sent. */
 	int NumPacket,
 	/*! [in] Request content */
-	char **RqPacket,
-	/*! [in] Ip address, to send the reply. */
-	struct in_addr *replyAddr)
+	char **RqPacket)
 {
-	int rc;
-	SOCKET ReplySock;
-	socklen_t socklen = sizeof(struct sockaddr_storage);
+	socklen_t socklen;
 	int Index;
-	static const int yes = 1;
-	/* a/c to UPNP Spec */
-	static const int ttl = 4;
-		#ifdef UPNP_ENABLE_IPV6
-	static const int hops = 1;
-		#endif
 	char buf_ntop[INET6_ADDRSTRLEN];
-	int ret = UPNP_E_SUCCESS;
-
-	ReplySock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-	if (ReplySock == INVALID_SOCKET) {
-		ProcessSocketError(__FILE__, __LINE__, "socket");
-		ret = UPNP_E_OUTOF_SOCKET;
-		goto end_SendToCallerDontClose;
-	}
-	rc = setsockopt(ReplySock,
-		SOL_SOCKET,
-		SO_REUSEADDR,
-		(OPTION_VALUE_CAST)&yes,
-		sizeof(yes));
-	PROCESS_SOCKET_ERROR(
-		__FILE__, __LINE__, rc, UPNP_E_SOCKET_ERROR, "setsockopt-1");
-		#if (defined(BSD) && !defined(__GNU__)) || \
-			defined(__APPLE__) || defined(__linux__)
-	rc = setsockopt(ReplySock,
-		SOL_SOCKET,
-		SO_REUSEPORT,
-		(OPTION_VALUE_CAST)&yes,
-		sizeof(yes));
-	PROCESS_SOCKET_ERROR(
-		__FILE__, __LINE__, rc, UPNP_E_SOCKET_ERROR, "setsockopt-1x");
-		#endif /* BSD, __APPLE__, __linux__ */
-	ssize_t bindrc = bind(ReplySock, res->ai_addr, res->ai_addrlen);
-	PROCESS_SOCKET_ERROR(
-		__FILE__, __LINE__, bindrc, UPNP_E_SOCKET_BIND, "bind");
+		#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[SSDP_SEND_BATCH];
+	struct iovec iov[SSDP_SEND_BATCH];
+	int n;
+	int i;
+	int sent;
+		#endif
 
 	switch (DestAddr->sa_family) {
 	case AF_INET:
@@ -283,26 +516,6 @@ static int SendToCaller(
 			&((struct sockaddr_in *)DestAddr)->sin_addr,
 			buf_ntop,
 			sizeof(buf_ntop));
-		rc = setsockopt(ReplySock,
-			IPPROTO_IP,
-			IP_MULTICAST_IF,
-			(OPTION_VALUE_CAST)replyAddr,
-			sizeof(*replyAddr));
-		PROCESS_SOCKET_ERROR(__FILE__,
-			__LINE__,
-			rc,
-			UPNP_E_SOCKET_ERROR,
-			"setsockopt-2");
-		rc = setsockopt(ReplySock,
-			IPPROTO_IP,
-			IP_MULTICAST_TTL,
-			(OPTION_VALUE_CAST)&ttl,
-			sizeof(ttl));
-		PROCESS_SOCKET_ERROR(__FILE__,
-			__LINE__,
-			rc,
-			UPNP_E_SOCKET_ERROR,
-			"setsockopt-3");
 		socklen = sizeof(struct sockaddr_in);
 		break;
 		#ifdef UPNP_ENABLE_IPV6
@@ -311,32 +524,14 @@ static int SendToCaller(
 			&((struct sockaddr_in6 *)DestAddr)->sin6_addr,
 			buf_ntop,
 			sizeof(buf_ntop));
-		rc = setsockopt(ReplySock,
-			IPPROTO_IPV6,
-			IPV6_MULTICAST_IF,
-			(OPTION_VALUE_CAST)&gIF_INDEX,
-			sizeof(gIF_INDEX));
-		PROCESS_SOCKET_ERROR(__FILE__,
-			__LINE__,
-			rc,
-			UPNP_E_SOCKET_ERROR,
-			"setsockopt-2");
-		rc = setsockopt(ReplySock,
-			IPPROTO_IPV6,
-			IPV6_MULTICAST_HOPS,
-			(OPTION_VALUE_CAST)&hops,
-			sizeof(hops));
-		PROCESS_SOCKET_ERROR(__FILE__,
-			__LINE__,
-			rc,
-			UPNP_E_SOCKET_ERROR,
-			"setsockopt-3");
+		socklen = sizeof(struct sockaddr_in6);
 		break;
 		#endif
+	default:
+		return UPNP_E_NETWORK_ERROR;
 	}
 
 	for (Index = 0; Index < NumPacket; Index++) {
-		ssize_t sendrc;
 		UpnpPrintf(UPNP_INFO,
 			SSDP,
 			__FILE__,
@@ -344,31 +539,52 @@ static int SendToCaller(
 			">>> SSDP SEND to %s >>>\n%s\n",
 			buf_ntop,
 			*(RqPacket + Index));
-		sendrc = sendto(ReplySock,
-			*(RqPacket + Index),
-			strlen(*(RqPacket + Index)),
-			0,
-			DestAddr,
-			socklen);
-		PROCESS_SOCKET_ERROR(__FILE__,
-			__LINE__,
-			sendrc,
-			UPNP_E_SOCKET_WRITE,
-			"sendto");
 	}
+		#ifdef HAVE_SENDMMSG
+	memset(msgs, 0, sizeof(msgs));
+	for (Index = 0; Index < NumPacket; Index += sent) {
+		n = NumPacket - Index;
+		if (n > SSDP_SEND_BATCH)
+			n = SSDP_SEND_BATCH;
+		for (i = 0; i < n; i++) {
+			iov[i].iov_base = RqPacket[Index + i];
+			iov[i].iov_len = strlen(RqPacket[Index + i]);
+			msgs[i].msg_hdr.msg_name = DestAddr;
+			msgs[i].msg_hdr.msg_namelen = socklen;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		sent = sendmmsg(ReplySock, msgs, (unsigned int)n, 0);
+		if (sent <= 0) {
+			ProcessSocketError(__FILE__, __LINE__, "sendmmsg");
+			return UPNP_E_SOCKET_WRITE;
+		}
+	}
+		#else
+	for (Index = 0; Index < NumPacket; Index++) {
+		if (sendto(ReplySock,
+			    *(RqPacket + Index),
+			    strlen(*(RqPacket + Index)),
+			    0,
+			    DestAddr,
+			    socklen) == -1) {
+			ProcessSocketError(__FILE__, __LINE__, "sendto");
+			return UPNP_E_SOCKET_WRITE;
+		}
+	}
+		#endif
 
-end_SendToCaller:
-	UpnpCloseSocket(ReplySock);
-
-end_SendToCallerDontClose:
-
-	return ret;
+	return UPNP_E_SUCCESS;
 }
 
 /*!
  * \brief Works as a request handler which passes the HTTP request string
  * to multicast channel.
  *
+ * The packets go out through the SSDP socket of the address family, which
+ * is bound to the SSDP port and set up for multicast when the SDK starts,
+ * so a reply costs no socket of its own.
+ *
  * \return UPNP_E_SUCCESS if successful else appropriate error.
  */
 static int NewRequestHandler(
@@ -379,66 +595,40 @@ static int NewRequestHandler(
 	/*! [in] Request content */
 	char **RqPacket)
 {
-	int rc;
-	struct in_addr replyAddr;
-	struct addrinfo hints, *result, *res;
-	int ret = UPNP_E_SOCKET_ERROR;
-
-	if (strlen(gIF_IPV4) > (size_t)0 &&
-		!inet_pton(AF_INET, gIF_IPV4, &replyAddr)) {
-		return UPNP_E_INVALID_PARAM;
-	}
-
-	memset(&hints, 0, sizeof(hints));
-	hints.ai_family = DestAddr->sa_family;
-	hints.ai_socktype = SOCK_DGRAM;
-	hints.ai_flags = AI_PASSIVE;
-	hints.ai_protocol = 0;
-	hints.ai_canonname = NULL;
-	hints.ai_addr = NULL;
-	hints.ai_next = NULL;
+	SOCKET ReplySock;
+	int ret;
 
+	switch (DestAddr->sa_family) {
+	case AF_INET:
+		break;
 		#ifdef UPNP_ENABLE_IPV6
-	if (DestAddr->sa_family != AF_INET6 && DestAddr->sa_family != AF_INET)
-		#else
-	if (DestAddr->sa_family != AF_INET)
+	case AF_INET6:
+		break;
 		#endif
-	{
+	default:
 		UpnpPrintf(UPNP_CRITICAL,
 			SSDP,
 			__FILE__,
 			__LINE__,
 			"Invalid destination address specified.");
-		ret = UPNP_E_NETWORK_ERROR;
-		goto end_NewRequestHandler;
+		return UPNP_E_NETWORK_ERROR;
 	}
-
-	// getaddrinfo() returns a list of address structures.
-	// Try each address until we successfully bind(2).
-	// If socket(2) (or bind(2)) fails, we (close the socket
-	// and) try the next address
-	if ((rc = getaddrinfo(NULL, SSDP_PORT_STR, &hints, &result)) != 0) {
+	/* The miniserver closes the sockets once this is released. */
+	ithread_rwlock_rdlock(&SendSocketLock);
+	ReplySock = DestAddr->sa_family == AF_INET ? SendSocket4 : SendSocket6;
+	if (ReplySock == INVALID_SOCKET) {
+		ithread_rwlock_unlock(&SendSocketLock);
 		UpnpPrintf(UPNP_INFO,
 			SSDP,
 			__FILE__,
 			__LINE__,
 			"SSDP_LIB: New Request Handler:"
-			"Error in getaddrinfo(): %s\n",
-			gai_strerror(rc));
-		ret = UPNP_E_SOCKET_ERROR;
-		goto end_NewRequestHandler;
-	}
-
-	for (res = result; res != NULL; res = res->ai_next) {
-		if (SendToCaller(
-			    res, DestAddr, NumPacket, RqPacket, &replyAddr) ==
-			UPNP_E_SUCCESS)
-			ret = UPNP_E_SUCCESS; // one successful send makes
-					      // response successful
+			"No SSDP socket for address family %d\n",
+			(int)DestAddr->sa_family);
+		return UPNP_E_SOCKET_ERROR;
 	}
-	freeaddrinfo(result);
-
-end_NewRequestHandler:
+	ret = SendToCaller(ReplySock, DestAddr, NumPacket, RqPacket);
+	ithread_rwlock_unlock(&SendSocketLock);
 
 	return ret;
 }
@@ -857,6 +1047,590 @@ static void CreateServicePacket(
 	return;
 }
 
+/*!
+ * \brief Fills in the SSDP multicast address for an address family.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INVALID_PARAM.
+ */
+static int MulticastAddr(
+	/*! [in] Device address family. */
+	int AddressFamily,
+	/*! [in] Location URL, selects the IPv6 scope. */
+	char *Location,
+	/*! [out] The multicast address. */
+	struct sockaddr_storage *ss)
+{
+	struct sockaddr_in *DestAddr4 = (struct sockaddr_in *)ss;
+	struct sockaddr_in6 *DestAddr6 = (struct sockaddr_in6 *)ss;
+
+	memset(ss, 0, sizeof(*ss));
+	switch (AddressFamily) {
+	case AF_INET:
+		DestAddr4->sin_family = (sa_family_t)AF_INET;
+		inet_pton(AF_INET, SSDP_IP, &DestAddr4->sin_addr);
+		DestAddr4->sin_port = htons(SSDP_PORT);
+		break;
+	case AF_INET6:
+		DestAddr6->sin6_family = (sa_family_t)AF_INET6;
+		inet_pton(AF_INET6,
+			(isUrlV6UlaGua(Location)) ? SSDP_IPV6_SITELOCAL
+						  : SSDP_IPV6_LINKLOCAL,
+			&DestAddr6->sin6_addr);
+		DestAddr6->sin6_port = htons(SSDP_PORT);
+		DestAddr6->sin6_scope_id = gIF_INDEX;
+		break;
+	default:
+		UpnpPrintf(UPNP_CRITICAL,
+			SSDP,
+			__FILE__,
+			__LINE__,
+			"Invalid device address family.\n");
+		return UPNP_E_INVALID_PARAM;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+int ssdp_cache_send(
+	SsdpPacketSet *set, struct sockaddr *DestAddr, int first, int count)
+{
+	struct sockaddr_storage __ss;
+	membuffer date;
+	char **packets = NULL;
+	char *copies = NULL;
+	char *p;
+	size_t total = 0;
+	size_t len;
+	int i;
+	int ret_code = UPNP_E_SUCCESS;
+
+	if (first < 0 || count <= 0 || first + count > set->NumPackets)
+		return UPNP_E_SUCCESS;
+	if (!DestAddr) {
+		ret_code = MulticastAddr(set->AddressFamily, set->Location, &__ss);
+		if (ret_code != UPNP_E_SUCCESS)
+			return ret_code;
+		DestAddr = (struct sockaddr *)&__ss;
+	}
+	if (set->MsgType != MSGTYPE_REPLY)
+		return NewRequestHandler(DestAddr, count, &set->Packets[first]);
+	/* Replies carry a DATE header: send copies with the current date. */
+	membuffer_init(&date);
+	if (http_MakeMessage(&date, 1, 1, "D") != 0) {
+		ret_code = UPNP_E_OUTOF_MEMORY;
+		goto error_handler;
+	}
+	for (i = first; i < first + count; i++)
+		total += strlen(set->Packets[i]) + (size_t)1;
+	packets = malloc((size_t)count * sizeof *packets);
+	copies = malloc(total);
+	if (!packets || !copies) {
+		ret_code = UPNP_E_OUTOF_MEMORY;
+		goto error_handler;
+	}
+	p = copies;
+	for (i = first; i < first + count; i++) {
+		len = strlen(set->Packets[i]) + (size_t)1;
+		memcpy(p, set->Packets[i], len);
+		if (set->DateOffset[i] >= 0 &&
+			strcspn(set->Packets[i] + set->DateOffset[i], "\n") +
+					(size_t)1 ==
+				date.length) {
+			memcpy(p + set->DateOffset[i], date.buf, date.length);
+		}
+		packets[i - first] = p;
+		p += len;
+	}
+	ret_code = NewRequestHandler(DestAddr, count, packets);
+
+error_handler:
+	free(packets);
+	free(copies);
+	membuffer_destroy(&date);
+
+	return ret_code;
+}
+
+/*!
+ * \brief Builds the SSDP cache from the index of the description.
+ *
+ * Devices without deviceType or UDN, and services without serviceType, are
+ * left out as they cannot be advertised.
+ *
+ * \return The cache or NULL if it cannot be allocated.
+ */
+static SsdpCache *BuildCache(
+	/*! [in] Index of the description document. */
+	const desc_index *index)
+{
+	SsdpCache *cache;
+	SsdpCacheDevice *device;
+	const desc_device *desc;
+	size_t i;
+	size_t j;
+
+	cache = calloc(1, sizeof *cache);
+	if (!cache)
+		return NULL;
+	if (!index)
+		return cache;
+	if (index->numDevices > 0) {
+		cache->Devices = calloc(index->numDevices, sizeof *cache->Devices);
+		if (!cache->Devices)
+			goto error_handler;
+	}
+	if (index->numServices > 0) {
+		cache->Services =
+			calloc(index->numServices, sizeof *cache->Services);
+		if (!cache->Services)
+			goto error_handler;
+	}
+	for (i = 0; i < index->numDevices; i++) {
+		desc = &index->devices[i];
+		if (!desc->deviceType)
+			continue;
+		if (!desc->UDN) {
+			UpnpPrintf(UPNP_CRITICAL,
+				API,
+				__FILE__,
+				__LINE__,
+				"UDN not found!\n");
+			continue;
+		}
+		device = &cache->Devices[cache->NumDevices++];
+		strncpy(device->DevType,
+			desc->deviceType,
+			sizeof(device->DevType) - 1);
+		strncpy(device->Udn, desc->UDN, sizeof(device->Udn) - 1);
+		device->RootDev = i == 0;
+		device->FirstService = cache->NumServices;
+		for (j = desc->firstService;
+			j < desc->firstService + desc->numServices;
+			j++) {
+			if (!index->services[j].serviceType) {
+				UpnpPrintf(UPNP_CRITICAL,
+					API,
+					__FILE__,
+					__LINE__,
+					"ServiceType not found\n");
+				continue;
+			}
+			strncpy(cache->Services[cache->NumServices++].ServType,
+				index->services[j].serviceType,
+				sizeof(cache->Services->ServType) - 1);
+		}
+		device->NumServices = cache->NumServices - device->FirstService;
+	}
+
+	return cache;
+
+error_handler:
+	ssdp_cache_free(cache);
+
+	return NULL;
+}
+
+/*!
+ * \brief Frees a packet set.
+ */
+static void FreePacketSet(SsdpPacketSet *set)
+{
+	int i;
+
+	for (i = 0; i < set->NumPackets; i++)
+		free(set->Packets[i]);
+	free(set->Packets);
+	free(set->DateOffset);
+	free(set->DevicePacket);
+	free(set->ServicePacket);
+	free(set);
+}
+
+/*!
+ * \brief Renders one packet and appends it to the set.
+ *
+ * \return The index of the packet in the set, or -1 if it cannot be built.
+ */
+static int AddPacket(
+	/*! [in,out] The packet set. */
+	SsdpPacketSet *set,
+	/*! [in] ssdp type. */
+	const char *nt,
+	/*! [in] First part of the USN. */
+	const char *udn,
+	/*! [in] Second part of the USN, after "::", or NULL. */
+	const char *suffix)
+{
+	char Mil_Usn[LINE_SIZE];
+	char *packet = NULL;
+	char *date;
+	int rc;
+
+	if (suffix)
+		rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s::%s", udn, suffix);
+	else
+		rc = snprintf(Mil_Usn, sizeof(Mil_Usn), "%s", udn);
+	if (rc < 0 || (unsigned int)rc >= sizeof(Mil_Usn))
+		return -1;
+	CreateServicePacket(set->MsgType,
+		nt,
+		Mil_Usn,
+		set->Location,
+		set->Duration,
+		&packet,
+		set->AddressFamily,
+		set->PowerState,
+		set->SleepPeriod,
+		set->RegistrationState);
+	if (!packet)
+		return -1;
+	date = strstr(packet, "\r\nDATE: ");
+	set->DateOffset[set->NumPackets] =
+		date ? (int)(date - packet) + 2 : -1;
+	set->Packets[set->NumPackets] = packet;
+
+	return set->NumPackets++;
+}
+
+/*!
+ * \brief Renders the packets of one kind of message for every device and
+ * service of the cache.
+ *
+ * \return The packet set or NULL if it cannot be allocated.
+ */
+static SsdpPacketSet *RenderPacketSet(
+	/*! [in] The cache. */
+	SsdpCache *cache,
+	/*! [in] Device handle. */
+	struct Handle_Info *SInfo,
+	/*! [in] Kind of message. */
+	int MsgType,
+	/*! [in] Location of Device description document. */
+	char *Location,
+	/*! [in] Service duration in sec. */
+	int Duration)
+{
+	SsdpPacketSet *set;
+	SsdpCacheDevice *device;
+	size_t maxPackets = 3 * cache->NumDevices + cache->NumServices;
+	size_t i;
+	size_t j;
+
+	set = calloc(1, sizeof *set);
+	if (!set)
+		return NULL;
+	set->RefCount = 1;
+	set->MsgType = MsgType;
+	set->Duration = Duration;
+	set->AddressFamily = SInfo->DeviceAf;
+	set->PowerState = SInfo->PowerState;
+	set->SleepPeriod = SInfo->SleepPeriod;
+	set->RegistrationState = SInfo->RegistrationState;
+	strncpy(set->Location, Location, sizeof(set->Location) - 1);
+	set->Packets = calloc(maxPackets + 1, sizeof *set->Packets);
+	set->DateOffset = malloc((maxPackets + 1) * sizeof *set->DateOffset);
+	set->DevicePacket =
+		malloc((3 * cache->NumDevices + 1) * sizeof *set->DevicePacket);
+	set->ServicePacket =
+		malloc((cache->NumServices + 1) * sizeof *set->ServicePacket);
+	if (!set->Packets || !set->DateOffset || !set->DevicePacket ||
+		!set->ServicePacket) {
+		FreePacketSet(set);
+		return NULL;
+	}
+	for (i = 0; i < cache->NumDevices; i++) {
+		device = &cache->Devices[i];
+		set->DevicePacket[3 * i] = device->RootDev
+			? AddPacket(set,
+				  "upnp:rootdevice",
+				  device->Udn,
+				  "upnp:rootdevice")
+			: -1;
+		set->DevicePacket[3 * i + 1] =
+			AddPacket(set, device->Udn, device->Udn, NULL);
+		set->DevicePacket[3 * i + 2] = AddPacket(
+			set, device->DevType, device->Udn, device->DevType);
+		for (j = device->FirstService;
+			j < device->FirstService + device->NumServices;
+			j++) {
+			set->ServicePacket[j] =
+				AddPacket(set,
+					cache->Services[j].ServType,
+					device->Udn,
+					cache->Services[j].ServType);
+		}
+	}
+	UpnpPrintf(UPNP_INFO,
+		SSDP,
+		__FILE__,
+		__LINE__,
+		"Rendered %d SSDP packets of type %d for %s\n",
+		set->NumPackets,
+		MsgType,
+		Location);
+
+	return set;
+}
+
+SsdpPacketSet *ssdp_cache_acquire(
+	struct Handle_Info *SInfo, int MsgType, char *Location, int Duration)
+{
+	SsdpPacketSet *set = NULL;
+	SsdpCache *cache;
+
+	if (MsgType < 0 || MsgType >= SSDP_CACHE_SETS)
+		return NULL;
+	ithread_mutex_lock(&SInfo->Mutex);
+	if (!SInfo->SsdpCache)
+		SInfo->SsdpCache = BuildCache(SInfo->DescIndex);
+	cache = SInfo->SsdpCache;
+	if (!cache)
+		goto exit_function;
+	set = cache->Sets[MsgType];
+	if (set && (set->Duration != Duration ||
+			   set->AddressFamily != SInfo->DeviceAf ||
+			   set->PowerState != SInfo->PowerState ||
+			   set->SleepPeriod != SInfo->SleepPeriod ||
+			   set->RegistrationState !=
+				   SInfo->RegistrationState ||
+			   strncmp(set->Location,
+				   Location,
+				   sizeof(set->Location) - 1))) {
+		/* Stale, current users keep their reference. */
+		ssdp_cache_release(set);
+		cache->Sets[MsgType] = set = NULL;
+	}
+	if (!set) {
+		set = RenderPacketSet(cache, SInfo, MsgType, Location, Duration);
+		cache->Sets[MsgType] = set;
+	}
+	if (set) {
+		ithread_mutex_lock(&PacketSetMutex);
+		set->RefCount++;
+		ithread_mutex_unlock(&PacketSetMutex);
+	}
+
+exit_function:
+	ithread_mutex_unlock(&SInfo->Mutex);
+
+	return set;
+}
+
+void ssdp_cache_release(SsdpPacketSet *set)
+{
+	int RefCount;
+
+	if (!set)
+		return;
+	ithread_mutex_lock(&PacketSetMutex);
+	RefCount = --set->RefCount;
+	ithread_mutex_unlock(&PacketSetMutex);
+	if (RefCount == 0)
+		FreePacketSet(set);
+}
+
+void ssdp_cache_free(SsdpCache *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < SSDP_CACHE_SETS; i++)
+		ssdp_cache_release(cache->Sets[i]);
+	free(cache->Devices);
+	free(cache->Services);
+	free(cache);
+}
+
+static void SendRepeat(void *data);
+
+/*!
+ * \brief Sends the copies of a repeat still due without waiting, and frees
+ * the repeat.
+ *
+ * Used when the repeat cannot be scheduled, or when the timer thread is shut
+ * down before the copies were sent, so that a shutdown still goes out
+ * NUM_SSDP_COPY times.
+ */
+static void FreeRepeat(void *data)
+{
+	SsdpRepeat *repeat = (SsdpRepeat *)data;
+
+	for (; repeat->remaining > 0; repeat->remaining--)
+		ssdp_cache_send(repeat->set, NULL, 0, repeat->set->NumPackets);
+	ssdp_cache_release(repeat->set);
+	free(repeat);
+}
+
+/*!
+ * \brief Schedules the next copy of a repeat SSDP_PAUSE ms from now.
+ */
+static void ScheduleRepeat(SsdpRepeat *repeat)
+{
+	ThreadPoolJob job;
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, SendRepeat, repeat);
+	TPJobSetFreeFunction(&job, FreeRepeat);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (TimerThreadSchedule(&gTimerThread,
+		    SSDP_PAUSE,
+		    REL_MSEC,
+		    &job,
+		    SHORT_TERM,
+		    NULL) != 0) {
+		FreeRepeat(repeat);
+	}
+}
+
+/*!
+ * \brief Timer job sending one copy of a repeat.
+ */
+static void SendRepeat(void *data)
+{
+	SsdpRepeat *repeat = (SsdpRepeat *)data;
+
+	ssdp_cache_send(repeat->set, NULL, 0, repeat->set->NumPackets);
+	if (--repeat->remaining > 0) {
+		ScheduleRepeat(repeat);
+		return;
+	}
+	ssdp_cache_release(repeat->set);
+	free(repeat);
+}
+
+int ssdp_cache_multicast(SsdpPacketSet *set)
+{
+	SsdpRepeat *repeat;
+	int ret_code;
+
+	ret_code = ssdp_cache_send(set, NULL, 0, set->NumPackets);
+	if (NUM_SSDP_COPY < 2)
+		return ret_code;
+	repeat = malloc(sizeof(SsdpRepeat));
+	if (!repeat)
+		return UPNP_E_OUTOF_MEMORY;
+	ithread_mutex_lock(&PacketSetMutex);
+	set->RefCount++;
+	ithread_mutex_unlock(&PacketSetMutex);
+	repeat->set = set;
+	repeat->remaining = NUM_SSDP_COPY - 1;
+	ScheduleRepeat(repeat);
+
+	return ret_code;
+}
+
+/*!
+ * \brief Returns the current time of the pacing clock in milliseconds.
+ */
+static int64_t PaceNow(void)
+{
+		#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+		#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+		#endif
+}
+
+int ssdp_pace_book(int Packets, int *Share)
+{
+	int64_t now;
+	int64_t start;
+	int64_t share = 0;
+
+	ithread_mutex_lock(&PaceMutex);
+	now = PaceNow();
+	start = now;
+	if (PaceRate > 0 && Packets > 0) {
+		/* Rounds are booked one after the other, each taking the
+		 * share of the budget its packets need. */
+		if (PaceNextSlot > start)
+			start = PaceNextSlot;
+		share = ((int64_t)Packets * 1000 + PaceRate - 1) / PaceRate;
+		if (share > INT_MAX)
+			share = INT_MAX;
+		PaceNextSlot = start + share;
+	}
+	ithread_mutex_unlock(&PaceMutex);
+	*Share = (int)share;
+
+	return start - now > INT_MAX ? INT_MAX : (int)(start - now);
+}
+
+void ssdp_pace_cancel(int Share)
+{
+	ithread_mutex_lock(&PaceMutex);
+	/* Without a budget the bookings were dropped already. */
+	if (PaceRate > 0 && Share > 0)
+		PaceNextSlot -= Share;
+	ithread_mutex_unlock(&PaceMutex);
+}
+
+void ssdp_pace_sent(int Packets, int Delay)
+{
+	ithread_mutex_lock(&PaceMutex);
+	PaceRounds++;
+	PacePackets += (unsigned long)Packets;
+	if (Delay > 0) {
+		PaceDeferred++;
+		if ((unsigned long)Delay > PaceMaxDelay)
+			PaceMaxDelay = (unsigned long)Delay;
+	}
+	ithread_mutex_unlock(&PaceMutex);
+}
+
+int ssdp_pace_advertisement(int Hnd, int Exp, int *Packets, int *Share)
+{
+	struct Handle_Info *SInfo = NULL;
+	SsdpPacketSet *set = NULL;
+
+	/* Renders the set the advertisement will send, if it is not already
+	 * cached, to know its size. */
+	*Packets = 0;
+	HandleReadLock(__FILE__, __LINE__);
+	if (GetHandleInfo(Hnd, &SInfo) == HND_DEVICE)
+		set = ssdp_cache_acquire(
+			SInfo, MSGTYPE_ADVERTISEMENT, SInfo->DescURL, Exp);
+	if (set)
+		*Packets = set->NumPackets * NUM_SSDP_COPY;
+	ssdp_cache_release(set);
+	HandleUnlock(__FILE__, __LINE__);
+
+	return ssdp_pace_book(*Packets, Share);
+}
+
+void ssdp_pace_set_rate(int PacketsPerSecond)
+{
+	ithread_mutex_lock(&PaceMutex);
+	PaceRate = PacketsPerSecond;
+	if (PaceRate == 0)
+		PaceNextSlot = 0;
+	ithread_mutex_unlock(&PaceMutex);
+}
+
+void ssdp_pace_stats(unsigned long *Rounds,
+	unsigned long *Packets,
+	unsigned long *Deferred,
+	unsigned long *MaxDelay)
+{
+	ithread_mutex_lock(&PaceMutex);
+	if (Rounds)
+		*Rounds = PaceRounds;
+	if (Packets)
+		*Packets = PacePackets;
+	if (Deferred)
+		*Deferred = PaceDeferred;
+	if (MaxDelay)
+		*MaxDelay = PaceMaxDelay;
+	ithread_mutex_unlock(&PaceMutex);
+}
+
 int DeviceAdvertisement(char *DevType,
 	int RootDev,
 	char *Udn,
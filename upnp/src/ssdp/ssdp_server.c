@@ -38,6 +38,10 @@
  * \file
  */
 
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE /* For recvmmsg() in sys/socket.h */
+#endif
+
 #include "config.h"
 
 #if EXCLUDE_SSDP == 0
@@ -51,6 +55,7 @@
 	#include "sock.h"
 	#include "upnpapi.h"
 
+	#include <errno.h>
 	#include <stdio.h>
 
 	#include "posix_overwrites.h" // IWYU pragma: keep
@@ -84,7 +89,104 @@ struct SSDPSockArray
 };
 
 	#ifdef INCLUDE_DEVICE_APIS
-static const char SERVICELIST_STR[] = "serviceList";
+/*!
+ * \brief Checks a search target against the type of a device or service.
+ *
+ * \return 1 if the target asks for a lower version than \b type, 0 if it
+ * asks for the same version and -1 if it does not match.
+ */
+static int MatchTypeVersion(
+	/* [in] Type from the search target. */
+	const char *target,
+	/* [in] Type from the description. */
+	const char *type)
+{
+	int targetVersion;
+	int typeVersion;
+
+	if (strncasecmp(target, type, strlen(target) - (size_t)2))
+		return -1;
+	targetVersion = atoi(strrchr(target, ':') + 1);
+	typeVersion = atoi(&type[strlen(type) - (size_t)1]);
+	if (targetVersion < typeVersion)
+		return 1;
+	if (targetVersion == typeVersion)
+		return 0;
+	return -1;
+}
+
+/*!
+ * \brief Answers a search that names a device or service type.
+ *
+ * Searches for the exact type get the cached packet. Searches for a lower
+ * version, or spelled differently, get a packet built for the occasion.
+ */
+static void ReplyByType(SsdpPacketSet *set,
+	int index,
+	struct sockaddr *DestAddr,
+	struct Handle_Info *SInfo,
+	char *Target,
+	char *Type,
+	char *Udn,
+	int defaultExp)
+{
+	switch (MatchTypeVersion(Target, Type)) {
+	case 1:
+		/* the requested version is lower than the device version
+		 * must reply with the lower version number and the lower
+		 * description URL */
+		UpnpPrintf(UPNP_INFO,
+			API,
+			__FILE__,
+			__LINE__,
+			"Type=%s and search type=%s MATCH\n",
+			Type,
+			Target);
+		SendReply(DestAddr,
+			Target,
+			0,
+			Udn,
+			SInfo->LowerDescURL,
+			defaultExp,
+			1,
+			SInfo->PowerState,
+			SInfo->SleepPeriod,
+			SInfo->RegistrationState);
+		break;
+	case 0:
+		UpnpPrintf(UPNP_INFO,
+			API,
+			__FILE__,
+			__LINE__,
+			"Type=%s and search type=%s MATCH\n",
+			Type,
+			Target);
+		if (!strcmp(Target, Type)) {
+			ssdp_cache_send(set, DestAddr, index, 1);
+		} else {
+			SendReply(DestAddr,
+				Target,
+				0,
+				Udn,
+				SInfo->DescURL,
+				defaultExp,
+				1,
+				SInfo->PowerState,
+				SInfo->SleepPeriod,
+				SInfo->RegistrationState);
+		}
+		break;
+	default:
+		UpnpPrintf(UPNP_INFO,
+			API,
+			__FILE__,
+			__LINE__,
+			"Type=%s and search type=%s DID NOT MATCH\n",
+			Type,
+			Target);
+		break;
+	}
+}
 
 int AdvertiseAndReply(int AdFlag,
 	UpnpDevice_Handle Hnd,
@@ -96,25 +198,13 @@ int AdvertiseAndReply(int AdFlag,
 	int Exp)
 {
 	int retVal = UPNP_E_SUCCESS;
-	long unsigned int i;
-	long unsigned int j;
+	size_t i;
+	size_t j;
 	int defaultExp = DEFAULT_MAXAGE;
 	struct Handle_Info *SInfo = NULL;
-	char UDNstr[100];
-	char devType[100];
-	char servType[100];
-	IXML_NodeList *nodeList = NULL;
-	IXML_NodeList *tmpNodeList = NULL;
-	IXML_Node *tmpNode = NULL;
-	IXML_Node *tmpNode2 = NULL;
-	IXML_Node *textNode = NULL;
-	const DOMString tmpStr;
-	const DOMString dbgStr;
-	int NumCopy = 0;
-
-	memset(UDNstr, 0, sizeof(UDNstr));
-	memset(devType, 0, sizeof(devType));
-	memset(servType, 0, sizeof(servType));
+	SsdpCache *cache;
+	SsdpCacheDevice *device;
+	SsdpPacketSet *set = NULL;
 
 	UpnpPrintf(UPNP_ALL,
 		API,
@@ -130,404 +220,101 @@ int AdvertiseAndReply(int AdFlag,
 		goto end_function;
 	}
 	defaultExp = SInfo->MaxAge;
-	/* parse the device list and send advertisements/replies */
-	while (NumCopy == 0 || (AdFlag && NumCopy < NUM_SSDP_COPY)) {
-		if (NumCopy != 0)
-			imillisleep(SSDP_PAUSE);
-		NumCopy++;
-		for (i = 0lu;; i++) {
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Entering new device list with i = %lu\n\n",
-				i);
-			tmpNode = ixmlNodeList_item(SInfo->DeviceList, i);
-			if (!tmpNode) {
-				UpnpPrintf(UPNP_ALL,
-					API,
-					__FILE__,
-					__LINE__,
-					"Exiting new device list with i = "
-					"%lu\n\n",
-					i);
-				break;
-			}
-			dbgStr = ixmlNode_getNodeName(tmpNode);
-			UpnpPrintf(UPNP_INFO,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type once for %s\n",
-				dbgStr);
-			ixmlNodeList_free(nodeList);
-			nodeList = ixmlElement_getElementsByTagName(
-				(IXML_Element *)tmpNode, "deviceType");
-			if (!nodeList)
-				continue;
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting UDN for %s\n",
-				dbgStr);
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type\n");
-			tmpNode2 = ixmlNodeList_item(nodeList, 0lu);
-			if (!tmpNode2)
-				continue;
-			textNode = ixmlNode_getFirstChild(tmpNode2);
-			if (!textNode)
-				continue;
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type \n");
-			tmpStr = ixmlNode_getNodeValue(textNode);
-			if (!tmpStr)
-				continue;
-			strncpy(devType, tmpStr, sizeof(devType) - 1);
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting device type = %s\n",
-				devType);
-			if (!tmpNode) {
-				UpnpPrintf(UPNP_ALL,
-					API,
-					__FILE__,
-					__LINE__,
-					"TempNode is NULL\n");
-			}
-			dbgStr = ixmlNode_getNodeName(tmpNode);
-			UpnpPrintf(UPNP_ALL,
-				API,
-				__FILE__,
-				__LINE__,
-				"Extracting UDN for %s\n",
-				dbgStr);
-			ixmlNodeList_free(nodeList);
-			nodeList = ixmlElement_getElementsByTagName(
-				(IXML_Element *)tmpNode, "UDN");
-			if (!nodeList) {
-				UpnpPrintf(UPNP_CRITICAL,
-					API,
-					__FILE__,
-					__LINE__,
-					"UDN not found!\n");
-				continue;
-			}
-			tmpNode2 = ixmlNodeList_item(nodeList, 0lu);
-			if (!tmpNode2) {
-				UpnpPrintf(UPNP_CRITICAL,
-					API,
-					__FILE__,
-					__LINE__,
-					"UDN not found!\n");
-				continue;
-			}
-			textNode = ixmlNode_getFirstChild(tmpNode2);
-			if (!textNode) {
-				UpnpPrintf(UPNP_CRITICAL,
-					API,
-					__FILE__,
-					__LINE__,
-					"UDN not found!\n");
-				continue;
-			}
-			tmpStr = ixmlNode_getNodeValue(textNode);
-			if (!tmpStr) {
-				UpnpPrintf(UPNP_CRITICAL,
+	if (AdFlag) {
+		set = ssdp_cache_acquire(SInfo,
+			AdFlag == 1 ? MSGTYPE_ADVERTISEMENT : MSGTYPE_SHUTDOWN,
+			SInfo->DescURL,
+			Exp);
+	} else {
+		set = ssdp_cache_acquire(
+			SInfo, MSGTYPE_REPLY, SInfo->DescURL, defaultExp);
+	}
+	if (!set) {
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto end_function;
+	}
+	/* The cache is not modified once built, and it is only freed with
+	 * the handle, under the write lock. */
+	cache = SInfo->SsdpCache;
+	if (AdFlag) {
+		/* send the advertisements or shutdowns of all the devices and
+		 * services in one go, the timer thread repeats them */
+		ssdp_cache_multicast(set);
+		goto end_function;
+	}
+	switch (SearchType) {
+	case SSDP_ALL:
+		ssdp_cache_send(set, DestAddr, 0, set->NumPackets);
+		break;
+	case SSDP_ROOTDEVICE:
+		if (cache->NumDevices > 0 && cache->Devices[0].RootDev)
+			ssdp_cache_send(set, DestAddr, set->DevicePacket[0], 1);
+		break;
+	case SSDP_DEVICEUDN:
+		if (!DeviceUDN || strlen(DeviceUDN) == (size_t)0)
+			break;
+		for (i = 0; i < cache->NumDevices; i++) {
+			device = &cache->Devices[i];
+			if (strcasecmp(DeviceUDN, device->Udn)) {
+				UpnpPrintf(UPNP_INFO,
 					API,
 					__FILE__,
 					__LINE__,
-					"UDN not found!\n");
+					"DeviceUDN=%s and search UDN=%s DID NOT "
+					"match\n",
+					device->Udn,
+					DeviceUDN);
 				continue;
 			}
-			strncpy(UDNstr, tmpStr, sizeof(UDNstr) - 1);
-			UpnpPrintf(UPNP_INFO,
-				API,
-				__FILE__,
-				__LINE__,
-				"Sending UDNStr = %s \n",
-				UDNstr);
-			if (AdFlag) {
-				/* send the device advertisement */
-				if (AdFlag == 1) {
-					DeviceAdvertisement(devType,
-						i == 0lu,
-						UDNstr,
-						SInfo->DescURL,
-						Exp,
-						SInfo->DeviceAf,
-						SInfo->PowerState,
-						SInfo->SleepPeriod,
-						SInfo->RegistrationState);
-				} else {
-					/* AdFlag == -1 */
-					DeviceShutdown(devType,
-						i == 0lu,
-						UDNstr,
-						SInfo->DescURL,
-						Exp,
-						SInfo->DeviceAf,
-						SInfo->PowerState,
-						SInfo->SleepPeriod,
-						SInfo->RegistrationState);
-				}
-			} else {
-				switch (SearchType) {
-				case SSDP_ALL:
-					DeviceReply(DestAddr,
-						devType,
-						i == 0lu,
-						UDNstr,
-						SInfo->DescURL,
-						defaultExp,
-						SInfo->PowerState,
-						SInfo->SleepPeriod,
-						SInfo->RegistrationState);
-					break;
-				case SSDP_ROOTDEVICE:
-					if (i == 0lu) {
-						SendReply(DestAddr,
-							devType,
-							1,
-							UDNstr,
-							SInfo->DescURL,
-							defaultExp,
-							0,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-					}
-					break;
-				case SSDP_DEVICEUDN: {
-					/* clang-format off */
-					if (DeviceUDN && strlen(DeviceUDN) != (size_t)0) {
-						if (strcasecmp(DeviceUDN, UDNstr)) {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								"DeviceUDN=%s and search UDN=%s DID NOT match\n",
-								UDNstr, DeviceUDN);
-						} else {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								"DeviceUDN=%s and search UDN=%s MATCH\n",
-								UDNstr, DeviceUDN);
-							SendReply(DestAddr, devType, 0, UDNstr, SInfo->DescURL, defaultExp, 0,
-								SInfo->PowerState,
-								SInfo->SleepPeriod,
-								SInfo->RegistrationState);
-						}
-					}
-					/* clang-format on */
-					break;
-				}
-				case SSDP_DEVICETYPE: {
-					/* clang-format off */
-					if (!strncasecmp(DeviceType, devType, strlen(DeviceType) - (size_t)2)) {
-						if (atoi(strrchr(DeviceType, ':') + 1)
-						    < atoi(&devType[strlen(devType) - (size_t)1])) {
-							/* the requested version is lower than the device version
-							 * must reply with the lower version number and the lower
-							 * description URL */
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								   "DeviceType=%s and search devType=%s MATCH\n",
-								   devType, DeviceType);
-							SendReply(DestAddr, DeviceType, 0, UDNstr, SInfo->LowerDescURL,
-								  defaultExp, 1,
-								  SInfo->PowerState,
-								  SInfo->SleepPeriod,
-								  SInfo->RegistrationState);
-						} else if (atoi(strrchr(DeviceType, ':') + 1)
-							   == atoi(&devType[strlen(devType) - (size_t)1])) {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								   "DeviceType=%s and search devType=%s MATCH\n",
-								   devType, DeviceType);
-							SendReply(DestAddr, DeviceType, 0, UDNstr, SInfo->DescURL,
-								  defaultExp, 1,
-								  SInfo->PowerState,
-								  SInfo->SleepPeriod,
-								  SInfo->RegistrationState);
-						} else {
-							UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-								   "DeviceType=%s and search devType=%s DID NOT MATCH\n",
-								   devType, DeviceType);
-						}
-					} else {
-						UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-							   "DeviceType=%s and search devType=%s DID NOT MATCH\n",
-							   devType, DeviceType);
-					}
-					/* clang-format on */
-					break;
-				}
-				default:
-					break;
-				}
-			}
-			/* send service advertisements for services
-			 * corresponding to the same device */
 			UpnpPrintf(UPNP_INFO,
 				API,
 				__FILE__,
 				__LINE__,
-				"Sending service Advertisement\n");
-			/* Correct service traversal such that each device's
-			 * serviceList is directly traversed as a child of its
-			 * parent device. This ensures that the service's alive
-			 * message uses the UDN of the parent device. */
-			tmpNode = ixmlNode_getFirstChild(tmpNode);
-			while (tmpNode) {
-				dbgStr = ixmlNode_getNodeName(tmpNode);
-				if (!strncmp(dbgStr,
-					    SERVICELIST_STR,
-					    sizeof SERVICELIST_STR)) {
-					break;
-				}
-				tmpNode = ixmlNode_getNextSibling(tmpNode);
-			}
-			ixmlNodeList_free(nodeList);
-			if (!tmpNode) {
-				nodeList = NULL;
-				continue;
-			}
-			nodeList = ixmlElement_getElementsByTagName(
-				(IXML_Element *)tmpNode, "service");
-			if (!nodeList) {
-				UpnpPrintf(UPNP_INFO,
-					API,
-					__FILE__,
-					__LINE__,
-					"Service not found 3\n");
-				continue;
-			}
-			for (j = 0lu;; j++) {
-				tmpNode = ixmlNodeList_item(nodeList, j);
-				if (!tmpNode) {
-					break;
-				}
-				ixmlNodeList_free(tmpNodeList);
-				tmpNodeList = ixmlElement_getElementsByTagName(
-					(IXML_Element *)tmpNode, "serviceType");
-				if (!tmpNodeList) {
-					UpnpPrintf(UPNP_CRITICAL,
-						API,
-						__FILE__,
-						__LINE__,
-						"ServiceType not found \n");
-					continue;
-				}
-				tmpNode2 = ixmlNodeList_item(tmpNodeList, 0lu);
-				if (!tmpNode2)
-					continue;
-				textNode = ixmlNode_getFirstChild(tmpNode2);
-				if (!textNode)
-					continue;
-				/* servType is of format
-				 * Servicetype:ServiceVersion */
-				tmpStr = ixmlNode_getNodeValue(textNode);
-				if (!tmpStr)
-					continue;
-				strncpy(servType, tmpStr, sizeof(servType) - 1);
-				UpnpPrintf(UPNP_INFO,
-					API,
-					__FILE__,
-					__LINE__,
-					"ServiceType = %s\n",
-					servType);
-				if (AdFlag) {
-					if (AdFlag == 1) {
-						ServiceAdvertisement(UDNstr,
-							servType,
-							SInfo->DescURL,
-							Exp,
-							SInfo->DeviceAf,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-					} else {
-						/* AdFlag == -1 */
-						ServiceShutdown(UDNstr,
-							servType,
-							SInfo->DescURL,
-							Exp,
-							SInfo->DeviceAf,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-					}
-				} else {
-					switch (SearchType) {
-					case SSDP_ALL:
-						ServiceReply(DestAddr,
-							servType,
-							UDNstr,
-							SInfo->DescURL,
-							defaultExp,
-							SInfo->PowerState,
-							SInfo->SleepPeriod,
-							SInfo->RegistrationState);
-						break;
-					case SSDP_SERVICE:
-						/* clang-format off */
-						if (ServiceType) {
-							if (!strncasecmp(ServiceType, servType, strlen(ServiceType) - (size_t)2)) {
-								if (atoi(strrchr(ServiceType, ':') + 1) <
-								    atoi(&servType[strlen(servType) - (size_t)1])) {
-									/* the requested version is lower than the service version
-									 * must reply with the lower version number and the lower
-									 * description URL */
-									UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-										   "ServiceType=%s and search servType=%s MATCH\n",
-										   ServiceType, servType);
-									SendReply(DestAddr, ServiceType, 0, UDNstr, SInfo->LowerDescURL,
-										  defaultExp, 1,
-										  SInfo->PowerState,
-										  SInfo->SleepPeriod,
-										  SInfo->RegistrationState);
-								} else if (atoi(strrchr (ServiceType, ':') + 1) ==
-									   atoi(&servType[strlen(servType) - (size_t)1])) {
-									UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-										   "ServiceType=%s and search servType=%s MATCH\n",
-										   ServiceType, servType);
-									SendReply(DestAddr, ServiceType, 0, UDNstr, SInfo->DescURL,
-										  defaultExp, 1,
-										  SInfo->PowerState,
-										  SInfo->SleepPeriod,
-										  SInfo->RegistrationState);
-								} else {
-									UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-									   "ServiceType=%s and search servType=%s DID NOT MATCH\n",
-									   ServiceType, servType);
-								}
-							} else {
-								UpnpPrintf(UPNP_INFO, API, __FILE__, __LINE__,
-									   "ServiceType=%s and search servType=%s DID NOT MATCH\n",
-									   ServiceType, servType);
-							}
-						}
-						/* clang-format on */
-						break;
-					default:
-						break;
-					}
-				}
+				"DeviceUDN=%s and search UDN=%s MATCH\n",
+				device->Udn,
+				DeviceUDN);
+			ssdp_cache_send(
+				set, DestAddr, set->DevicePacket[3 * i + 1], 1);
+		}
+		break;
+	case SSDP_DEVICETYPE:
+		for (i = 0; i < cache->NumDevices; i++) {
+			device = &cache->Devices[i];
+			ReplyByType(set,
+				set->DevicePacket[3 * i + 2],
+				DestAddr,
+				SInfo,
+				DeviceType,
+				device->DevType,
+				device->Udn,
+				defaultExp);
+		}
+		break;
+	case SSDP_SERVICE:
+		if (!ServiceType)
+			break;
+		for (i = 0; i < cache->NumDevices; i++) {
+			device = &cache->Devices[i];
+			for (j = device->FirstService;
+				j < device->FirstService + device->NumServices;
+				j++) {
+				ReplyByType(set,
+					set->ServicePacket[j],
+					DestAddr,
+					SInfo,
+					ServiceType,
+					cache->Services[j].ServType,
+					device->Udn,
+					defaultExp);
 			}
-			ixmlNodeList_free(tmpNodeList);
-			tmpNodeList = NULL;
-			ixmlNodeList_free(nodeList);
-			nodeList = NULL;
 		}
+		break;
+	default:
+		break;
 	}
 
 end_function:
-	ixmlNodeList_free(tmpNodeList);
-	ixmlNodeList_free(nodeList);
+	ssdp_cache_release(set);
 	UpnpPrintf(UPNP_ALL,
 		API,
 		__FILE__,
@@ -659,21 +446,99 @@ int ssdp_request_type(char *cmd, SsdpEvent *Evt)
 	return 0;
 }
 
+/*! Released receive batches kept for reuse. */
+static ssdp_recv_batch *gSsdpBatchCache[SSDP_RECV_BATCH_CACHE];
+/*! Number of batches in gSsdpBatchCache. */
+static int gSsdpBatchCacheCount = 0;
+/*! Protects gSsdpBatchCache. */
+static ithread_mutex_t gSsdpBatchMutex;
+
+int ssdp_recv_batches_init(void)
+{
+	gSsdpBatchCacheCount = 0;
+	if (ithread_mutex_init(&gSsdpBatchMutex, NULL) != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Frees a receive batch and the buffers of its datagrams.
+ */
+static void free_recv_batch(
+	/*! [in] The batch. */
+	ssdp_recv_batch *batch)
+{
+	size_t i;
+
+	for (i = 0; i < SSDP_RECV_BATCH; ++i) {
+		membuffer_destroy(&batch->packets[i].msg);
+	}
+	free(batch);
+}
+
+void ssdp_recv_batches_destroy(void)
+{
+	ithread_mutex_lock(&gSsdpBatchMutex);
+	while (gSsdpBatchCacheCount > 0) {
+		free_recv_batch(gSsdpBatchCache[--gSsdpBatchCacheCount]);
+	}
+	ithread_mutex_unlock(&gSsdpBatchMutex);
+	ithread_mutex_destroy(&gSsdpBatchMutex);
+}
+
 /*!
- * \brief Frees the ssdp request.
+ * \brief Takes a receive batch from the cache, or allocates a new one.
+ *
+ * \return The batch, or NULL if there is not enough memory.
+ */
+static ssdp_recv_batch *alloc_recv_batch(void)
+{
+	ssdp_recv_batch *batch = NULL;
+	size_t i;
+
+	ithread_mutex_lock(&gSsdpBatchMutex);
+	if (gSsdpBatchCacheCount > 0) {
+		batch = gSsdpBatchCache[--gSsdpBatchCacheCount];
+	}
+	ithread_mutex_unlock(&gSsdpBatchMutex);
+	if (batch == NULL) {
+		batch = malloc(sizeof(ssdp_recv_batch));
+		if (batch == NULL) {
+			return NULL;
+		}
+		for (i = 0; i < SSDP_RECV_BATCH; ++i) {
+			membuffer_init(&batch->packets[i].msg);
+		}
+	}
+	batch->is_response = 0;
+	batch->count = 0;
+
+	return batch;
+}
+
+/*!
+ * \brief Returns a receive batch to the cache, or frees it if the cache is
+ * full.
  */
 static void free_ssdp_event_handler_data(
-	/*! [in] ssdp_thread_data structure. This structure contains SSDP
-	 * request message. */
+	/*! [in] ssdp_recv_batch structure. */
 	void *the_data)
 {
-	ssdp_thread_data *data = (ssdp_thread_data *)the_data;
+	ssdp_recv_batch *batch = (ssdp_recv_batch *)the_data;
 
-	if (data != NULL) {
-		http_message_t *hmsg = &data->parser.msg;
-		/* free data */
-		httpmsg_destroy(hmsg);
-		free(data);
+	if (batch == NULL) {
+		return;
+	}
+	ithread_mutex_lock(&gSsdpBatchMutex);
+	if (gSsdpBatchCacheCount < SSDP_RECV_BATCH_CACHE) {
+		gSsdpBatchCache[gSsdpBatchCacheCount++] = batch;
+		batch = NULL;
+	}
+	ithread_mutex_unlock(&gSsdpBatchMutex);
+	if (batch != NULL) {
+		free_recv_batch(batch);
 	}
 }
 
@@ -683,8 +548,7 @@ static void free_ssdp_event_handler_data(
  * \return 1 if msg is valid, else 0.
  */
 static UPNP_INLINE int valid_ssdp_msg(
-	/*! [in] ssdp_thread_data structure. This structure contains SSDP
-	 * request message. */
+	/*! [in] SSDP request message. */
 	http_message_t *hmsg)
 {
 	memptr hdr_value;
@@ -726,21 +590,16 @@ static UPNP_INLINE int valid_ssdp_msg(
 }
 
 /*!
- * \brief Parses the message and dispatches it to a handler which handles the
- * ssdp request msg.
+ * \brief Parses the message and checks that it is a valid SSDP message.
  *
  * \return 0 if successful, -1 if error.
  */
 static UPNP_INLINE int start_event_handler(
-	/*! [in] ssdp_thread_data structure. This structure contains SSDP
-	 * request message. */
-	void *Data)
+	/*! [in] Parser holding the SSDP message. */
+	http_parser_t *parser)
 {
-	http_parser_t *parser = NULL;
 	parse_status_t status;
-	ssdp_thread_data *data = (ssdp_thread_data *)Data;
 
-	parser = &data->parser;
 	status = parser_parse(parser);
 	if (status == (parse_status_t)PARSE_FAILURE) {
 		if (parser->msg.method != (http_method_t)HTTPMETHOD_NOTIFY ||
@@ -752,7 +611,7 @@ static UPNP_INLINE int start_event_handler(
 				"SSDP recvd bad msg code = %u\n",
 				status);
 			/* ignore bad msg, or not enuf mem */
-			goto error_handler;
+			return -1;
 		}
 		/* valid notify msg */
 	} else if (status != (parse_status_t)PARSE_SUCCESS) {
@@ -763,143 +622,264 @@ static UPNP_INLINE int start_event_handler(
 			"SSDP recvd bad msg code = %u\n",
 			status);
 
-		goto error_handler;
+		return -1;
 	}
 	/* check msg */
 	if (valid_ssdp_msg(&parser->msg) != 1) {
-		goto error_handler;
+		return -1;
 	}
-	/* done; thread will free 'data' */
+
 	return 0;
+}
 
-error_handler:
-	free_ssdp_event_handler_data(data);
-	return -1;
+/*!
+ * \brief Parses one received datagram and dispatches it to the device or
+ * control point handler.
+ */
+static void ssdp_handle_packet(
+	/*! [in] Set if the datagram is an answer to an M-SEARCH request. */
+	int is_response,
+	/*! [in,out] The datagram. */
+	ssdp_packet *pkt)
+{
+	http_parser_t parser;
+	http_message_t *hmsg = &parser.msg;
+
+	if (is_response) {
+		parser_response_init(&parser, HTTPMETHOD_MSEARCH);
+	} else {
+		parser_request_init(&parser);
+	}
+	/* lend the datagram buffer to the parser */
+	parser.msg.msg = pkt->msg;
+	if (start_event_handler(&parser) == 0) {
+		/* send msg to device or ctrlpt */
+		if (hmsg->method == (http_method_t)HTTPMETHOD_NOTIFY ||
+			hmsg->request_method ==
+				(http_method_t)HTTPMETHOD_MSEARCH) {
+	#ifdef INCLUDE_CLIENT_APIS
+			ssdp_handle_ctrlpt_msg(hmsg, &pkt->dest_addr, 0);
+	#endif /* INCLUDE_CLIENT_APIS */
+		} else {
+			ssdp_handle_device_request(hmsg, &pkt->dest_addr);
+		}
+	}
+	/* take the buffer back, the parser may have reallocated it */
+	pkt->msg = parser.msg.msg;
+	membuffer_init(&parser.msg.msg);
+	httpmsg_destroy(hmsg);
 }
 
 /*!
- * \brief This function is a thread that handles SSDP requests.
+ * \brief This function is a thread that handles a batch of SSDP messages.
  */
 static void ssdp_event_handler_thread(
-	/*! [] ssdp_thread_data structure. This structure contains SSDP
-	 * request message. */
+	/*! [] ssdp_recv_batch structure. This structure contains the SSDP
+	 * messages. */
 	void *the_data)
 {
-	ssdp_thread_data *data = (ssdp_thread_data *)the_data;
-	http_message_t *hmsg = &data->parser.msg;
+	ssdp_recv_batch *batch = (ssdp_recv_batch *)the_data;
+	size_t i;
 
-	if (start_event_handler(the_data) != 0)
-		return;
-	/* send msg to device or ctrlpt */
-	if (hmsg->method == (http_method_t)HTTPMETHOD_NOTIFY ||
-		hmsg->request_method == (http_method_t)HTTPMETHOD_MSEARCH) {
-	#ifdef INCLUDE_CLIENT_APIS
-		ssdp_handle_ctrlpt_msg(hmsg, &data->dest_addr, 0);
-	#endif /* INCLUDE_CLIENT_APIS */
-	} else {
-		ssdp_handle_device_request(hmsg, &data->dest_addr);
+	for (i = 0; i < batch->count; ++i) {
+		ssdp_handle_packet(batch->is_response, &batch->packets[i]);
 	}
+	free_ssdp_event_handler_data(batch);
+}
+
+/*!
+ * \brief Logs a received datagram.
+ */
+static void log_ssdp_packet(
+	/*! [in] The datagram. */
+	ssdp_packet *pkt)
+{
+	char ntop_buf[INET6_ADDRSTRLEN];
 
-	/* free data */
-	free_ssdp_event_handler_data(data);
+	switch (pkt->dest_addr.ss_family) {
+	case AF_INET:
+		inet_ntop(AF_INET,
+			&((struct sockaddr_in *)&pkt->dest_addr)->sin_addr,
+			ntop_buf,
+			sizeof(ntop_buf));
+		break;
+	#ifdef UPNP_ENABLE_IPV6
+	case AF_INET6:
+		inet_ntop(AF_INET6,
+			&((struct sockaddr_in6 *)&pkt->dest_addr)->sin6_addr,
+			ntop_buf,
+			sizeof(ntop_buf));
+		break;
+	#endif /* UPNP_ENABLE_IPV6 */
+	default:
+		memset(ntop_buf, 0, sizeof(ntop_buf));
+		strncpy(ntop_buf,
+			"<Invalid address family>",
+			sizeof(ntop_buf) - 1);
+	}
+	/* clang-format off */
+	UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
+		   "Start of received response ----------------------------------------------------\n"
+		   "%s\n"
+		   "End of received response ------------------------------------------------------\n"
+		   "From host %s\n", pkt->msg.buf, ntop_buf);
+	/* clang-format on */
 }
 
-int readFromSSDPSocket(SOCKET socket)
+/*!
+ * \brief Reads one datagram into a static buffer and drops it, so that the
+ * socket is drained even when memory can't be allocated.
+ *
+ * \return 0 on success; -1 on error.
+ */
+static int drain_ssdp_socket(
+	/*! [in] SSDP socket. */
+	SOCKET socket)
 {
-	char *requestBuf = NULL;
 	char staticBuf[BUFSIZE];
 	struct sockaddr_storage __ss;
-	ThreadPoolJob job;
-	ssdp_thread_data *data = NULL;
 	socklen_t socklen = sizeof(__ss);
-	ssize_t byteReceived = 0;
-	char ntop_buf[INET6_ADDRSTRLEN];
-
-	memset(&job, 0, sizeof(job));
+	ssize_t byteReceived;
 
-	requestBuf = staticBuf;
-	/* in case memory can't be allocated, still drain the socket using a
-	 * static buffer. */
-	data = malloc(sizeof(ssdp_thread_data));
-	if (data) {
-		/* initialize parser */
-	#ifdef INCLUDE_CLIENT_APIS
-		if (socket == gSsdpReqSocket4
-		#ifdef UPNP_ENABLE_IPV6
-			|| socket == gSsdpReqSocket6
-		#endif /* UPNP_ENABLE_IPV6 */
-		)
-			parser_response_init(&data->parser, HTTPMETHOD_MSEARCH);
-		else
-			parser_request_init(&data->parser);
-	#else  /* INCLUDE_CLIENT_APIS */
-		parser_request_init(&data->parser);
-	#endif /* INCLUDE_CLIENT_APIS */
-		/* set size of parser buffer */
-		if (membuffer_set_size(&data->parser.msg.msg, BUFSIZE) == 0)
-			/* use this as the buffer for recv */
-			requestBuf = data->parser.msg.msg.buf;
-		else {
-			free(data);
-			data = NULL;
-		}
-	}
 	byteReceived = recvfrom(socket,
-		requestBuf,
+		staticBuf,
 		BUFSIZE - (size_t)1,
 		0,
 		(struct sockaddr *)&__ss,
 		&socklen);
-	if (byteReceived > 0) {
-		requestBuf[byteReceived] = '\0';
-		switch (__ss.ss_family) {
-		case AF_INET:
-			inet_ntop(AF_INET,
-				&((struct sockaddr_in *)&__ss)->sin_addr,
-				ntop_buf,
-				sizeof(ntop_buf));
-			break;
-	#ifdef UPNP_ENABLE_IPV6
-		case AF_INET6:
-			inet_ntop(AF_INET6,
-				&((struct sockaddr_in6 *)&__ss)->sin6_addr,
-				ntop_buf,
-				sizeof(ntop_buf));
+
+	return (byteReceived < 0) ? -1 : 0;
+}
+
+/*!
+ * \brief Reads the datagrams waiting on an SSDP socket into a batch.
+ *
+ * \return Number of datagrams read, 0 if none was waiting, -1 on error.
+ */
+static int recv_ssdp_batch(
+	/*! [in] SSDP socket. */
+	SOCKET socket,
+	/*! [in,out] The batch. */
+	ssdp_recv_batch *batch)
+{
+	size_t n;
+	#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[SSDP_RECV_BATCH];
+	struct iovec iov[SSDP_RECV_BATCH];
+	int received;
+	size_t i;
+	#else
+	socklen_t socklen = sizeof(struct sockaddr_storage);
+	ssize_t byteReceived;
+	#endif
+
+	/* make room for the datagrams, the buffers of a reused batch are
+	 * already there */
+	for (n = 0; n < SSDP_RECV_BATCH; ++n) {
+		if (batch->packets[n].msg.capacity < BUFSIZE &&
+			membuffer_set_size(&batch->packets[n].msg, BUFSIZE) !=
+				0) {
 			break;
-	#endif /* UPNP_ENABLE_IPV6 */
-		default:
-			memset(ntop_buf, 0, sizeof(ntop_buf));
-			strncpy(ntop_buf,
-				"<Invalid address family>",
-				sizeof(ntop_buf) - 1);
 		}
-		/* clang-format off */
-		UpnpPrintf(UPNP_INFO, SSDP, __FILE__, __LINE__,
-			   "Start of received response ----------------------------------------------------\n"
-			   "%s\n"
-			   "End of received response ------------------------------------------------------\n"
-			   "From host %s\n", requestBuf, ntop_buf);
-		/* clang-format on */
-		/* add thread pool job to handle request */
-		if (data != NULL) {
-			data->parser.msg.msg.length += (size_t)byteReceived;
-			/* null-terminate */
-			data->parser.msg.msg.buf[byteReceived] = 0;
-			memcpy(&data->dest_addr, &__ss, sizeof(__ss));
-			TPJobInit(&job,
-				(start_routine)ssdp_event_handler_thread,
-				data);
-			TPJobSetFreeFunction(
-				&job, free_ssdp_event_handler_data);
-			TPJobSetPriority(&job, MED_PRIORITY);
-			if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
-				free_ssdp_event_handler_data(data);
+	}
+	if (n == 0) {
+		return drain_ssdp_socket(socket);
+	}
+	#ifdef HAVE_RECVMMSG
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < n; ++i) {
+		iov[i].iov_base = batch->packets[i].msg.buf;
+		iov[i].iov_len = BUFSIZE - (size_t)1;
+		msgs[i].msg_hdr.msg_name = &batch->packets[i].dest_addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	received = recvmmsg(socket, msgs, (unsigned int)n, MSG_DONTWAIT, NULL);
+	if (received < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK ||
+			       errno == EINTR)
+			       ? 0
+			       : -1;
+	}
+	for (i = 0; i < (size_t)received; ++i) {
+		if (msgs[i].msg_len == 0) {
+			continue;
 		}
-		return 0;
+		if (batch->count != i) {
+			/* skip empty datagrams */
+			membuffer tmp = batch->packets[batch->count].msg;
+
+			batch->packets[batch->count].msg =
+				batch->packets[i].msg;
+			batch->packets[i].msg = tmp;
+			batch->packets[batch->count].dest_addr =
+				batch->packets[i].dest_addr;
+		}
+		batch->packets[batch->count].msg.length = msgs[i].msg_len;
+		batch->packets[batch->count].msg.buf[msgs[i].msg_len] = '\0';
+		batch->count++;
+	}
+	#else
+	byteReceived = recvfrom(socket,
+		batch->packets[0].msg.buf,
+		BUFSIZE - (size_t)1,
+		0,
+		(struct sockaddr *)&batch->packets[0].dest_addr,
+		&socklen);
+	if (byteReceived < 0) {
+		return -1;
 	}
-	free_ssdp_event_handler_data(data);
+	if (byteReceived > 0) {
+		batch->packets[0].msg.length = (size_t)byteReceived;
+		batch->packets[0].msg.buf[byteReceived] = '\0';
+		batch->count = 1;
+	}
+	#endif
 
-	return (byteReceived < 0) ? -1 : 0;
+	return (int)batch->count;
+}
+
+int readFromSSDPSocket(SOCKET socket)
+{
+	ThreadPoolJob job;
+	ssdp_recv_batch *batch = NULL;
+	size_t i;
+	int ret;
+
+	memset(&job, 0, sizeof(job));
+
+	batch = alloc_recv_batch();
+	if (batch == NULL) {
+		return drain_ssdp_socket(socket);
+	}
+	#ifdef INCLUDE_CLIENT_APIS
+	if (socket == gSsdpReqSocket4
+		#ifdef UPNP_ENABLE_IPV6
+		|| socket == gSsdpReqSocket6
+		#endif /* UPNP_ENABLE_IPV6 */
+	) {
+		batch->is_response = 1;
+	}
+	#endif /* INCLUDE_CLIENT_APIS */
+	ret = recv_ssdp_batch(socket, batch);
+	if (ret <= 0) {
+		free_ssdp_event_handler_data(batch);
+
+		return ret;
+	}
+	for (i = 0; i < batch->count; ++i) {
+		log_ssdp_packet(&batch->packets[i]);
+	}
+	/* add thread pool job to handle the requests */
+	TPJobInit(&job, (start_routine)ssdp_event_handler_thread, batch);
+	TPJobSetFreeFunction(&job, free_ssdp_event_handler_data);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0) {
+		free_ssdp_event_handler_data(batch);
+	}
+
+	return 0;
 }
 
 /*!
@@ -1106,6 +1086,41 @@ static int create_ssdp_sock_reqv4(
 
 	#ifdef UPNP_ENABLE_IPV6
 /*!
+ * \brief Sets the multicast interface and hop limit of an SSDP IPv6 socket,
+ * which is also used by the device to send its advertisements and replies.
+ */
+static void set_ssdp_sock_v6_send_options(
+	/*! [in] SSDP IPv6 socket. */
+	SOCKET ssdpSock)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+	/* a/c to UPNP Spec */
+	int hops = 1;
+
+	if (setsockopt(ssdpSock,
+		    IPPROTO_IPV6,
+		    IPV6_MULTICAST_IF,
+		    (OPTION_VALUE_CAST)&gIF_INDEX,
+		    sizeof(gIF_INDEX)) == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		UpnpPrintf(UPNP_INFO,
+			SSDP,
+			__FILE__,
+			__LINE__,
+			"Error in setsockopt() IPV6_MULTICAST_IF (set multicast "
+			"interface): %s\n",
+			errorBuffer);
+	}
+	setsockopt(ssdpSock,
+		IPPROTO_IPV6,
+		IPV6_MULTICAST_HOPS,
+		(OPTION_VALUE_CAST)&hops,
+		sizeof(hops));
+}
+	#endif /* IPv6 */
+
+	#ifdef UPNP_ENABLE_IPV6
+/*!
  * \brief This function ...
  */
 static int create_ssdp_sock_v6(
@@ -1255,6 +1270,7 @@ static int create_ssdp_sock_v6(
 		ret = UPNP_E_SOCKET_ERROR;
 		goto error_handler;
 	}
+	set_ssdp_sock_v6_send_options(*ssdpSock);
 	onOff = 1;
 	ret = setsockopt(*ssdpSock,
 		SOL_SOCKET,
@@ -1405,6 +1421,7 @@ static int create_ssdp_sock_v6_ula_gua(
 		ret = UPNP_E_SOCKET_ERROR;
 		goto error_handler;
 	}
+	set_ssdp_sock_v6_send_options(*ssdpSock);
 	onOff = 1;
 	ret = setsockopt(*ssdpSock,
 		SOL_SOCKET,
@@ -1486,8 +1503,6 @@ int get_ssdp_sockets(MiniServerSockArray *out)
 		retVal = create_ssdp_sock_reqv4(&out->ssdpReqSock4);
 		if (retVal != UPNP_E_SUCCESS)
 			return retVal;
-		/* For use by ssdp control point. */
-		gSsdpReqSocket4 = out->ssdpReqSock4;
 	} else
 		out->ssdpReqSock4 = INVALID_SOCKET;
 		/* Create the IPv6 socket for SSDP REQUESTS */
@@ -1498,8 +1513,6 @@ int get_ssdp_sockets(MiniServerSockArray *out)
 			UpnpCloseSocket(out->ssdpReqSock4);
 			return retVal;
 		}
-		/* For use by ssdp control point. */
-		gSsdpReqSocket6 = out->ssdpReqSock6;
 	} else
 		out->ssdpReqSock6 = INVALID_SOCKET;
 		#endif /* IPv6 */
@@ -1544,6 +1557,20 @@ int get_ssdp_sockets(MiniServerSockArray *out)
 	} else
 		out->ssdpSock6UlaGua = INVALID_SOCKET;
 	#endif /* UPNP_ENABLE_IPV6 */
+	#ifdef INCLUDE_CLIENT_APIS
+	/* For use by ssdp control point. */
+	ssdp_set_req_sockets(out->ssdpReqSock4, out->ssdpReqSock6);
+	#endif /* INCLUDE_CLIENT_APIS */
+	#ifdef INCLUDE_DEVICE_APIS
+	/* For use by ssdp device: it sends from the SSDP port. */
+		#ifdef UPNP_ENABLE_IPV6
+	ssdp_set_send_sockets(out->ssdpSock4,
+		out->ssdpSock6 != INVALID_SOCKET ? out->ssdpSock6
+						 : out->ssdpSock6UlaGua);
+		#else
+	ssdp_set_send_sockets(out->ssdpSock4, INVALID_SOCKET);
+		#endif /* UPNP_ENABLE_IPV6 */
+	#endif	       /* INCLUDE_DEVICE_APIS */
 
 	return UPNP_E_SUCCESS;
 }
@@ -43,10 +43,67 @@
 #include "FreeList.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> /* for memset()*/
 
+/*!
+ * \brief Adds v to *p atomically and returns the new value.
+ *
+ * Used by the work-stealing scheduler for the counters shared by all its
+ * queues. Without atomic operations ThreadPoolInit() falls back to the
+ * global queue scheduler and this function is never called.
+ *
+ * \internal
+ */
+#if defined(_WIN32)
+	#define TP_HAVE_ATOMICS 1
+static UPNP_INLINE long TPAtomicAdd(volatile long *p, long v)
+{
+	return InterlockedExchangeAdd(p, v) + v;
+}
+#elif defined(__GNUC__)
+	#define TP_HAVE_ATOMICS 1
+static UPNP_INLINE long TPAtomicAdd(volatile long *p, long v)
+{
+	return __sync_add_and_fetch(p, v);
+}
+#else
+static UPNP_INLINE long TPAtomicAdd(volatile long *p, long v)
+{
+	return *p += v;
+}
+#endif
+
+/*!
+ * \brief Job queues owned by one worker of the work-stealing scheduler.
+ *
+ * A job goes to the queue of a waiting worker, or round-robin over the
+ * queues when every worker is busy. A worker runs the most urgent job of
+ * all the queues and prefers its own queue on a tie, so that the workers
+ * seldom meet on a lock while priorities still hold across the queues.
+ */
+struct TPWorkQueue
+{
+	/*! Protects every field but owned. */
+	ithread_mutex_t mutex;
+	/*! The owner waits here for a job. */
+	ithread_cond_t condition;
+	/*! high priority job Q */
+	LinkedList highJobQ;
+	/*! med priority job Q */
+	LinkedList medJobQ;
+	/*! low priority job Q */
+	LinkedList lowJobQ;
+	/*! free list of jobs */
+	FreeList jobFreeList;
+	/*! set while the owner waits on condition */
+	int idle;
+	/*! set while a worker owns the queue, protected by the pool mutex */
+	int owned;
+};
+
 /*!
  * \brief Returns the difference in milliseconds between two timeval structures.
  *
@@ -602,6 +659,334 @@ exit_function:
 	return NULL;
 }
 
+/*!
+ * \brief Moves the jobs of a worker queue that waited too long to the next
+ * higher priority, like BumpPriority() does for the global queues.
+ *
+ * The queue mutex must be locked.
+ *
+ * \internal
+ */
+static void BumpQueuePriority(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	struct TPWorkQueue *q)
+{
+	struct timeval now;
+	ThreadPoolJob *tempJob = NULL;
+
+	gettimeofday(&now, NULL);
+	while (q->lowJobQ.size) {
+		tempJob = (ThreadPoolJob *)q->lowJobQ.head.next->item;
+		if (DiffMillis(&now, &tempJob->requestTime) <
+			tp->attr.maxIdleTime) {
+			break;
+		}
+		ListDelNode(&q->lowJobQ, q->lowJobQ.head.next, 0);
+		ListAddTail(&q->medJobQ, tempJob);
+	}
+	while (q->medJobQ.size) {
+		tempJob = (ThreadPoolJob *)q->medJobQ.head.next->item;
+		if (DiffMillis(&now, &tempJob->requestTime) <
+			tp->attr.starvationTime) {
+			break;
+		}
+		ListDelNode(&q->medJobQ, q->medJobQ.head.next, 0);
+		ListAddTail(&q->highJobQ, tempJob);
+	}
+}
+
+/*!
+ * \brief Returns the priority of the job PopJob() would take from a worker
+ * queue, after bumping the jobs that waited too long.
+ *
+ * The queue mutex must be locked.
+ *
+ * \internal
+ *
+ * \return 0 for high, 1 for med and 2 for low priority, 3 if the queue is
+ * empty.
+ */
+static int QueueLevel(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	struct TPWorkQueue *q)
+{
+	if (q->medJobQ.size || q->lowJobQ.size)
+		BumpQueuePriority(tp, q);
+	if (q->highJobQ.size)
+		return 0;
+	if (q->medJobQ.size)
+		return 1;
+	if (q->lowJobQ.size)
+		return 2;
+
+	return 3;
+}
+
+/*!
+ * \brief Takes the oldest job of the highest priority from a worker queue.
+ *
+ * The queue mutex must be locked.
+ *
+ * \internal
+ *
+ * \return The job, or NULL if the queue is empty.
+ */
+static ThreadPoolJob *PopJob(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	struct TPWorkQueue *q)
+{
+	LinkedList *jobQ = NULL;
+	ListNode *head = NULL;
+	ThreadPoolJob *job = NULL;
+
+	switch (QueueLevel(tp, q)) {
+	case 0:
+		jobQ = &q->highJobQ;
+		break;
+	case 1:
+		jobQ = &q->medJobQ;
+		break;
+	case 2:
+		jobQ = &q->lowJobQ;
+		break;
+	default:
+		return NULL;
+	}
+	head = ListHead(jobQ);
+	job = (ThreadPoolJob *)head->item;
+	ListDelNode(jobQ, head, 0);
+	TPAtomicAdd(&tp->queuedJobs, -1);
+
+	return job;
+}
+
+/*!
+ * \brief Takes the most urgent job of all the worker queues.
+ *
+ * A high priority job of the worker's own queue is taken right away.
+ * Otherwise every queue is looked at, starting with the worker's own one so
+ * that it wins a tie and so that the thieves do not all fall on the same
+ * victim. Priorities thus hold across the queues, and the jobs of a worker
+ * stuck in a long job are run by the others.
+ *
+ * \internal
+ *
+ * \return The job, or NULL if every queue is empty.
+ */
+static ThreadPoolJob *TakeJob(
+	/*! . */
+	ThreadPool *tp,
+	/*! index of the queue of the calling worker. */
+	int self)
+{
+	int i;
+	int level;
+	int best;
+	int bestLevel;
+	struct TPWorkQueue *q = NULL;
+	ThreadPoolJob *job = NULL;
+
+	do {
+		best = -1;
+		bestLevel = 3;
+		for (i = 0; i < tp->numWorkQueues && bestLevel > 0; ++i) {
+			q = &tp->workQueues[(self + i) % tp->numWorkQueues];
+			ithread_mutex_lock(&q->mutex);
+			level = QueueLevel(tp, q);
+			if (level == 0)
+				job = PopJob(tp, q);
+			ithread_mutex_unlock(&q->mutex);
+			if (level < bestLevel) {
+				best = (self + i) % tp->numWorkQueues;
+				bestLevel = level;
+			}
+		}
+		if (job || best < 0)
+			break;
+		/* Another worker may get there first, then look again */
+		q = &tp->workQueues[best];
+		ithread_mutex_lock(&q->mutex);
+		job = PopJob(tp, q);
+		ithread_mutex_unlock(&q->mutex);
+	} while (!job);
+
+	return job;
+}
+
+/*!
+ * \brief Wakes up one waiting worker of the work-stealing scheduler.
+ *
+ * \internal
+ *
+ * \return 1 if a worker was woken up, 0 if no worker was waiting.
+ */
+static int WakeIdleWorker(
+	/*! . */
+	ThreadPool *tp,
+	/*! index of the first queue to look at. */
+	int start)
+{
+	int i;
+	struct TPWorkQueue *q = NULL;
+
+	for (i = 0; i < tp->numWorkQueues &&
+		TPAtomicAdd(&tp->idleWorkers, 0) > 0;
+		++i) {
+		q = &tp->workQueues[(start + i) % tp->numWorkQueues];
+		ithread_mutex_lock(&q->mutex);
+		if (q->idle) {
+			q->idle = 0;
+			TPAtomicAdd(&tp->idleWorkers, -1);
+			ithread_cond_signal(&q->condition);
+			ithread_mutex_unlock(&q->mutex);
+			return 1;
+		}
+		ithread_mutex_unlock(&q->mutex);
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Implements a worker of the work-stealing scheduler.
+ *
+ * The worker runs the most urgent job of all the queues, see TakeJob(),
+ * then picks up a pending persistent job. It waits on its own condition
+ * variable when there is nothing to do. The pool mutex is only taken to
+ * start, to retire and to pick up persistent jobs.
+ *
+ * If the worker remains idle for more than the specified max, it is
+ * released.
+ *
+ * \internal
+ */
+static void *StealingWorkerThread(
+	/*! arg -> is cast to (ThreadPool *). */
+	void *arg)
+{
+	ThreadPool *tp = (ThreadPool *)arg;
+	struct TPWorkQueue *q = NULL;
+	ThreadPoolJob *job = NULL;
+	struct timespec timeout;
+	int self;
+	int idleTime;
+	int retCode;
+	int persistent = 0;
+	long addedJobs;
+
+	ithread_initialize_thread();
+
+	ithread_mutex_lock(&tp->mutex);
+	self = tp->pendingWorkerQueue;
+	q = &tp->workQueues[self];
+	idleTime = tp->attr.maxIdleTime;
+	tp->totalThreads++;
+	TPAtomicAdd(&tp->runningWorkers, 1);
+	tp->pendingWorkerThreadStart = 0;
+	ithread_cond_broadcast(&tp->start_and_shutdown);
+	ithread_mutex_unlock(&tp->mutex);
+
+	SetSeed();
+	while (1) {
+		ithread_mutex_lock(&q->mutex);
+		if (job) {
+			FreeListFree(&q->jobFreeList, job);
+			job = NULL;
+		}
+		ithread_mutex_unlock(&q->mutex);
+		if (TPAtomicAdd(&tp->stopWorkers, 0)) {
+			ithread_mutex_lock(&tp->mutex);
+			goto exit_function;
+		}
+		addedJobs = TPAtomicAdd(&tp->addedJobs, 0);
+		job = TakeJob(tp, self);
+		if (!job && TPAtomicAdd(&tp->queuedJobs, 0) > 0) {
+			/* Either a persistent job is pending or another
+			 * worker got there first */
+			ithread_mutex_lock(&tp->mutex);
+			if (tp->persistentJob) {
+				job = tp->persistentJob;
+				tp->persistentJob = NULL;
+				tp->persistentThreads++;
+				persistent = 1;
+				TPAtomicAdd(&tp->queuedJobs, -1);
+				ithread_cond_broadcast(&tp->start_and_shutdown);
+			}
+			ithread_mutex_unlock(&tp->mutex);
+		}
+		if (job) {
+			SetPriority(job->priority);
+			job->func(job->arg);
+			SetPriority(DEFAULT_PRIORITY);
+			if (persistent) {
+				/* Persistent thread becomes a regular thread */
+				ithread_mutex_lock(&tp->mutex);
+				tp->persistentThreads--;
+				ithread_mutex_unlock(&tp->mutex);
+				persistent = 0;
+			}
+			continue;
+		}
+
+		/* Nothing to do: wait until a job is queued. The jobs counted
+		 * in queuedJobs that we did not find were taken by others, so
+		 * we only look again if a job was added meanwhile. addedJobs
+		 * is checked after idleWorkers is raised, and producers check
+		 * idleWorkers after raising addedJobs, so a job can not be
+		 * queued unnoticed while we go to sleep. */
+		retCode = 0;
+		ithread_mutex_lock(&q->mutex);
+		q->idle = 1;
+		TPAtomicAdd(&tp->idleWorkers, 1);
+		if (TPAtomicAdd(&tp->addedJobs, 0) == addedJobs &&
+			!TPAtomicAdd(&tp->stopWorkers, 0)) {
+			SetRelTimeout(&timeout, idleTime);
+			retCode = ithread_cond_timedwait(
+				&q->condition, &q->mutex, &timeout);
+		}
+		if (q->idle) {
+			q->idle = 0;
+			TPAtomicAdd(&tp->idleWorkers, -1);
+		}
+		ithread_mutex_unlock(&q->mutex);
+		if (retCode != ETIMEDOUT)
+			continue;
+
+		/* If we currently have more than the min threads, or more
+		 * than the max threads (only possible if the attributes have
+		 * been reset) let this thread die. */
+		ithread_mutex_lock(&tp->mutex);
+		idleTime = tp->attr.maxIdleTime;
+		if (tp->totalThreads > tp->attr.minThreads ||
+			(tp->attr.maxThreads != INFINITE_THREADS &&
+				tp->totalThreads > tp->attr.maxThreads)) {
+			/* Producers only start a new worker if they see too
+			 * few running, so check for work once more after
+			 * leaving */
+			TPAtomicAdd(&tp->runningWorkers, -1);
+			if (TPAtomicAdd(&tp->queuedJobs, 0) == 0)
+				goto exit_function;
+			TPAtomicAdd(&tp->runningWorkers, 1);
+		}
+		ithread_mutex_unlock(&tp->mutex);
+	}
+
+exit_function:
+	q->owned = 0;
+	tp->totalThreads--;
+	ithread_cond_broadcast(&tp->start_and_shutdown);
+	ithread_mutex_unlock(&tp->mutex);
+	ithread_cleanup_thread();
+
+	return NULL;
+}
+
 /*!
  * \brief Creates a Thread Pool Job. (Dynamically allocated)
  *
@@ -649,6 +1034,7 @@ static int CreateWorker(
 {
 	ithread_t temp;
 	int rc = 0;
+	int i = 0;
 	ithread_attr_t attr;
 
 	/* if a new worker is the process of starting, wait until it fully
@@ -661,11 +1047,28 @@ static int CreateWorker(
 		tp->totalThreads + 1 > tp->attr.maxThreads) {
 		return EMAXTHREADS;
 	}
+	if (tp->workQueues) {
+		/* every work-stealing worker needs a queue of its own */
+		for (i = 0; i < tp->numWorkQueues; ++i) {
+			if (!tp->workQueues[i].owned)
+				break;
+		}
+		if (i == tp->numWorkQueues)
+			return EMAXTHREADS;
+		tp->workQueues[i].owned = 1;
+		tp->pendingWorkerQueue = i;
+	}
 	ithread_attr_init(&attr);
 	ithread_attr_setstacksize(&attr, tp->attr.stackSize);
 	ithread_attr_setdetachstate(&attr, ITHREAD_CREATE_DETACHED);
-	rc = ithread_create(&temp, &attr, WorkerThread, tp);
+	rc = ithread_create(&temp,
+		&attr,
+		tp->workQueues ? StealingWorkerThread : WorkerThread,
+		tp);
 	ithread_attr_destroy(&attr);
+	if (rc != 0 && tp->workQueues) {
+		tp->workQueues[i].owned = 0;
+	}
 	if (rc == 0) {
 		tp->pendingWorkerThreadStart = 1;
 		/* wait until the new worker thread starts */
@@ -707,6 +1110,302 @@ static void AddWorker(
 	}
 }
 
+/*!
+ * \brief Frees the jobs of a job Q, calling their free functions.
+ *
+ * \internal
+ */
+static void DrainJobQ(
+	/*! . */
+	LinkedList *jobQ,
+	/*! list the jobs are returned to. */
+	FreeList *jobFreeList)
+{
+	ListNode *head = NULL;
+	ThreadPoolJob *temp = NULL;
+
+	while ((head = ListHead(jobQ)) != NULL) {
+		temp = (ThreadPoolJob *)head->item;
+		if (temp->free_func)
+			temp->free_func(temp->arg);
+		ListDelNode(jobQ, head, 0);
+		FreeListFree(jobFreeList, temp);
+	}
+}
+
+/*!
+ * \brief Frees the jobs of a worker queue, calling their free functions.
+ *
+ * \internal
+ */
+static void DrainWorkQueue(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	struct TPWorkQueue *q)
+{
+	long jobs;
+
+	ithread_mutex_lock(&q->mutex);
+	jobs = q->highJobQ.size + q->medJobQ.size + q->lowJobQ.size;
+	DrainJobQ(&q->highJobQ, &q->jobFreeList);
+	DrainJobQ(&q->medJobQ, &q->jobFreeList);
+	DrainJobQ(&q->lowJobQ, &q->jobFreeList);
+	TPAtomicAdd(&tp->queuedJobs, -jobs);
+	ithread_mutex_unlock(&q->mutex);
+}
+
+/*!
+ * \brief Allocates the worker queues of the work-stealing scheduler.
+ *
+ * There is one queue per possible worker, so maxThreads is capped to
+ * TP_MAX_WORK_QUEUES.
+ *
+ * \internal
+ *
+ * \return 0 on success, EAGAIN on failure.
+ */
+static int WorkQueuesInit(
+	/*! . */
+	ThreadPool *tp)
+{
+	int i;
+	int retCode = 0;
+	struct TPWorkQueue *q = NULL;
+
+	tp->numWorkQueues = tp->attr.maxThreads;
+	if (tp->numWorkQueues <= 0 || tp->numWorkQueues > TP_MAX_WORK_QUEUES) {
+		tp->numWorkQueues = TP_MAX_WORK_QUEUES;
+	}
+	tp->workQueues = (struct TPWorkQueue *)calloc(
+		(size_t)tp->numWorkQueues, sizeof(struct TPWorkQueue));
+	if (!tp->workQueues) {
+		tp->numWorkQueues = 0;
+		return EAGAIN;
+	}
+	for (i = 0; i < tp->numWorkQueues; ++i) {
+		q = &tp->workQueues[i];
+		retCode += ithread_mutex_init(&q->mutex, NULL);
+		retCode += ithread_cond_init(&q->condition, NULL);
+		retCode += ListInit(&q->highJobQ, CmpThreadPoolJob, NULL);
+		retCode += ListInit(&q->medJobQ, CmpThreadPoolJob, NULL);
+		retCode += ListInit(&q->lowJobQ, CmpThreadPoolJob, NULL);
+		retCode += FreeListInit(&q->jobFreeList,
+			sizeof(ThreadPoolJob),
+			JOBFREELISTSIZE);
+	}
+
+	return retCode ? EAGAIN : 0;
+}
+
+/*!
+ * \brief Frees the worker queues of the work-stealing scheduler.
+ *
+ * The workers must have exited.
+ *
+ * \internal
+ */
+static void WorkQueuesDestroy(
+	/*! . */
+	ThreadPool *tp)
+{
+	int i;
+	struct TPWorkQueue *q = NULL;
+
+	for (i = 0; i < tp->numWorkQueues; ++i) {
+		q = &tp->workQueues[i];
+		DrainWorkQueue(tp, q);
+		ListDestroy(&q->highJobQ, 0);
+		ListDestroy(&q->medJobQ, 0);
+		ListDestroy(&q->lowJobQ, 0);
+		FreeListDestroy(&q->jobFreeList);
+		ithread_cond_destroy(&q->condition);
+		ithread_mutex_destroy(&q->mutex);
+	}
+	free(tp->workQueues);
+	tp->workQueues = NULL;
+	tp->numWorkQueues = 0;
+}
+
+/*!
+ * \brief Puts a job in a worker queue.
+ *
+ * The queue mutex must be locked.
+ *
+ * \internal
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+static int QueueJob(
+	/*! . */
+	ThreadPool *tp,
+	/*! . */
+	struct TPWorkQueue *q,
+	/*! job is copied. */
+	ThreadPoolJob *job,
+	/*! out parameter. */
+	int *jobId)
+{
+	LinkedList *jobQ = NULL;
+	ThreadPoolJob *temp = NULL;
+
+	temp = (ThreadPoolJob *)FreeListAlloc(&q->jobFreeList);
+	if (!temp)
+		return EOUTOFMEM;
+	*temp = *job;
+	temp->jobId = (int)(TPAtomicAdd(&tp->nextJobId, 1) & INT_MAX);
+	gettimeofday(&temp->requestTime, NULL);
+	switch (job->priority) {
+	case HIGH_PRIORITY:
+		jobQ = &q->highJobQ;
+		break;
+	case MED_PRIORITY:
+		jobQ = &q->medJobQ;
+		break;
+	default:
+		jobQ = &q->lowJobQ;
+	}
+	if (!ListAddTail(jobQ, temp)) {
+		FreeListFree(&q->jobFreeList, temp);
+		return EOUTOFMEM;
+	}
+	TPAtomicAdd(&tp->queuedJobs, 1);
+	TPAtomicAdd(&tp->addedJobs, 1);
+	*jobId = temp->jobId;
+
+	return 0;
+}
+
+/*!
+ * \brief Adds a job with the work-stealing scheduler.
+ *
+ * The job goes to the queue of a waiting worker, which is woken up. If
+ * every worker is busy it goes to the next queue in round-robin order, and
+ * a new worker is started if there is room. Either way only one queue is
+ * locked to add the job, and whoever frees up first takes it, see
+ * TakeJob().
+ *
+ * \internal
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+static int AddStealingJob(
+	/*! . */
+	ThreadPool *tp,
+	/*! job is copied. */
+	ThreadPoolJob *job,
+	/*! out parameter, can be NULL. */
+	int *jobId)
+{
+	int rc = EOUTOFMEM;
+	int tempId = -1;
+	int start;
+	int i;
+	int placed = 0;
+	int woken = 0;
+	long totalJobs;
+	struct TPWorkQueue *q = NULL;
+
+	/* The limit is only approximate, concurrent callers may all see
+	 * room for their job */
+	totalJobs = TPAtomicAdd(&tp->queuedJobs, 0);
+	if (totalJobs >= tp->attr.maxJobsTotal) {
+		fprintf(stderr,
+			"libupnp ThreadPoolAdd too many jobs: %ld\n",
+			totalJobs);
+		return rc;
+	}
+	if (!jobId)
+		jobId = &tempId;
+	*jobId = INVALID_JOB_ID;
+	start = (int)((unsigned long)TPAtomicAdd(&tp->nextQueue, 1) %
+		      (unsigned long)tp->numWorkQueues);
+
+	/* Prefer a waiting worker over one that may be stuck in a long or
+	 * persistent job */
+	for (i = 0; i < tp->numWorkQueues && !placed &&
+		TPAtomicAdd(&tp->idleWorkers, 0) > 0;
+		++i) {
+		q = &tp->workQueues[(start + i) % tp->numWorkQueues];
+		ithread_mutex_lock(&q->mutex);
+		if (q->idle) {
+			placed = 1;
+			rc = QueueJob(tp, q, job, jobId);
+			if (rc == 0) {
+				q->idle = 0;
+				TPAtomicAdd(&tp->idleWorkers, -1);
+				ithread_cond_signal(&q->condition);
+				woken = 1;
+			}
+		}
+		ithread_mutex_unlock(&q->mutex);
+	}
+	if (!placed) {
+		q = &tp->workQueues[start];
+		ithread_mutex_lock(&q->mutex);
+		rc = QueueJob(tp, q, job, jobId);
+		ithread_mutex_unlock(&q->mutex);
+	}
+
+	if (rc == 0 && !woken && !WakeIdleWorker(tp, start + 1) &&
+		TPAtomicAdd(&tp->runningWorkers, 0) < tp->numWorkQueues) {
+		/* everybody is busy, add a worker if there is room */
+		ithread_mutex_lock(&tp->mutex);
+		CreateWorker(tp);
+		ithread_mutex_unlock(&tp->mutex);
+	}
+
+	return rc;
+}
+
+/*!
+ * \brief Removes a job queued with the work-stealing scheduler.
+ *
+ * \internal
+ *
+ * \return 0 on success, INVALID_JOB_ID if the job is not queued.
+ */
+static int RemoveStealingJob(
+	/*! . */
+	ThreadPool *tp,
+	/*! a job with jobId set. */
+	ThreadPoolJob *dummy,
+	/*! out parameter, the removed job. */
+	ThreadPoolJob *out)
+{
+	int i;
+	int j;
+	int ret = INVALID_JOB_ID;
+	LinkedList *jobQs[3];
+	LinkedList *jobQ = NULL;
+	ListNode *tempNode = NULL;
+	ThreadPoolJob *temp = NULL;
+	struct TPWorkQueue *q = NULL;
+
+	for (i = 0; i < tp->numWorkQueues && ret != 0; ++i) {
+		q = &tp->workQueues[i];
+		jobQs[0] = &q->highJobQ;
+		jobQs[1] = &q->medJobQ;
+		jobQs[2] = &q->lowJobQ;
+		ithread_mutex_lock(&q->mutex);
+		for (j = 0; j < 3 && !tempNode; ++j) {
+			jobQ = jobQs[j];
+			tempNode = ListFind(jobQ, NULL, dummy);
+		}
+		if (tempNode) {
+			temp = (ThreadPoolJob *)tempNode->item;
+			*out = *temp;
+			ListDelNode(jobQ, tempNode, 0);
+			FreeListFree(&q->jobFreeList, temp);
+			TPAtomicAdd(&tp->queuedJobs, -1);
+			ret = 0;
+		}
+		ithread_mutex_unlock(&q->mutex);
+	}
+
+	return ret;
+}
+
 int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 {
 	int retCode = 0;
@@ -747,6 +1446,22 @@ int ThreadPoolInit(ThreadPool *tp, ThreadPoolAttr *attr)
 	retCode += ListInit(&tp->highJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->medJobQ, CmpThreadPoolJob, NULL);
 	retCode += ListInit(&tp->lowJobQ, CmpThreadPoolJob, NULL);
+#ifndef TP_HAVE_ATOMICS
+	tp->attr.scheduler = TP_GLOBAL_QUEUE;
+#endif
+	tp->workQueues = NULL;
+	tp->numWorkQueues = 0;
+	tp->pendingWorkerQueue = 0;
+	tp->queuedJobs = 0;
+	tp->idleWorkers = 0;
+	tp->runningWorkers = 0;
+	tp->nextQueue = 0;
+	tp->nextJobId = 0;
+	tp->addedJobs = 0;
+	tp->stopWorkers = 0;
+	if (!retCode && tp->attr.scheduler == TP_WORK_STEALING) {
+		retCode = WorkQueuesInit(tp);
+	}
 	if (retCode) {
 		retCode = EAGAIN;
 	} else {
@@ -779,6 +1494,7 @@ int ThreadPoolAddPersistent(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 {
 	int ret = 0;
 	int tempId = -1;
+	int id;
 	ThreadPoolJob *temp = NULL;
 
 	if (!tp || !job) {
@@ -802,7 +1518,13 @@ int ThreadPoolAddPersistent(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 			goto exit_function;
 		}
 	}
-	temp = CreateThreadPoolJob(job, tp->lastJobId, tp);
+	/* share the id counter of ThreadPoolAdd() so that ThreadPoolRemove()
+	 * can tell the jobs apart */
+	if (tp->workQueues)
+		id = (int)(TPAtomicAdd(&tp->nextJobId, 1) & INT_MAX);
+	else
+		id = tp->lastJobId++;
+	temp = CreateThreadPoolJob(job, id, tp);
 	if (!temp) {
 		ret = EOUTOFMEM;
 		goto exit_function;
@@ -810,12 +1532,18 @@ int ThreadPoolAddPersistent(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 	tp->persistentJob = temp;
 
 	/* Notify a waiting thread */
-	ithread_cond_signal(&tp->condition);
+	if (tp->workQueues) {
+		TPAtomicAdd(&tp->queuedJobs, 1);
+		TPAtomicAdd(&tp->addedJobs, 1);
+		WakeIdleWorker(tp, 0);
+	} else {
+		ithread_cond_signal(&tp->condition);
+	}
 
 	/* wait until long job has been picked up */
 	while (tp->persistentJob)
 		ithread_cond_wait(&tp->start_and_shutdown, &tp->mutex);
-	*jobId = tp->lastJobId++;
+	*jobId = id;
 
 exit_function:
 	ithread_mutex_unlock(&tp->mutex);
@@ -832,6 +1560,8 @@ int ThreadPoolAdd(ThreadPool *tp, ThreadPoolJob *job, int *jobId)
 
 	if (!tp || !job)
 		return EINVAL;
+	if (tp->workQueues)
+		return AddStealingJob(tp, job, jobId);
 
 	ithread_mutex_lock(&tp->mutex);
 
@@ -888,6 +1618,8 @@ int ThreadPoolRemove(ThreadPool *tp, int jobId, ThreadPoolJob *out)
 	if (!out)
 		out = &dummy;
 	dummy.jobId = jobId;
+	if (tp->workQueues && RemoveStealingJob(tp, &dummy, out) == 0)
+		return 0;
 
 	ithread_mutex_lock(&tp->mutex);
 
@@ -923,6 +1655,8 @@ int ThreadPoolRemove(ThreadPool *tp, int jobId, ThreadPoolJob *out)
 		*out = *tp->persistentJob;
 		FreeThreadPoolJob(tp, tp->persistentJob);
 		tp->persistentJob = NULL;
+		if (tp->workQueues)
+			TPAtomicAdd(&tp->queuedJobs, -1);
 		ret = 0;
 		goto exit_function;
 	}
@@ -965,6 +1699,8 @@ int ThreadPoolSetAttr(ThreadPool *tp, ThreadPoolAttr *attr)
 		ithread_mutex_unlock(&tp->mutex);
 		return INVALID_POLICY;
 	}
+	/* the scheduler can not be changed on a running pool */
+	temp.scheduler = tp->attr.scheduler;
 	tp->attr = temp;
 	/* add threads */
 	if (tp->totalThreads < tp->attr.minThreads) {
@@ -991,10 +1727,21 @@ int ThreadPoolShutdown(ThreadPool *tp)
 {
 	ListNode *head = NULL;
 	ThreadPoolJob *temp = NULL;
+	int i;
 
 	if (!tp)
 		return EINVAL;
 	ithread_mutex_lock(&tp->mutex);
+	if (tp->workQueues) {
+		/* stop the workers and clean up the jobs of their queues */
+		TPAtomicAdd(&tp->stopWorkers, 1);
+		for (i = 0; i < tp->numWorkQueues; ++i) {
+			DrainWorkQueue(tp, &tp->workQueues[i]);
+			ithread_mutex_lock(&tp->workQueues[i].mutex);
+			ithread_cond_broadcast(&tp->workQueues[i].condition);
+			ithread_mutex_unlock(&tp->workQueues[i].mutex);
+		}
+	}
 	/* clean up high priority jobs */
 	while (tp->highJobQ.size) {
 		head = ListHead(&tp->highJobQ);
@@ -1056,6 +1803,8 @@ int ThreadPoolShutdown(ThreadPool *tp)
 	}
 	while (ithread_cond_destroy(&tp->start_and_shutdown) != 0) {
 	}
+	if (tp->workQueues)
+		WorkQueuesDestroy(tp);
 	FreeListDestroy(&tp->jobFreeList);
 
 	ithread_mutex_unlock(&tp->mutex);
@@ -1083,6 +1832,7 @@ int TPAttrInit(ThreadPoolAttr *attr)
 	attr->schedPolicy = DEFAULT_POLICY;
 	attr->starvationTime = DEFAULT_STARVATION_TIME;
 	attr->maxJobsTotal = maxJobsTotal;
+	attr->scheduler = DEFAULT_SCHEDULER;
 
 	return 0;
 }
@@ -1186,6 +1936,15 @@ int TPAttrSetSchedPolicy(ThreadPoolAttr *attr, PolicyType schedPolicy)
 	return 0;
 }
 
+int TPAttrSetScheduler(ThreadPoolAttr *attr, SchedulerType scheduler)
+{
+	if (!attr)
+		return EINVAL;
+	attr->scheduler = scheduler;
+
+	return 0;
+}
+
 int TPAttrSetMaxJobsTotal(ThreadPoolAttr *attr, int maxJobsTotal)
 {
 	if (!attr)
@@ -1234,6 +1993,9 @@ void ThreadPoolPrintStats(ThreadPoolStats *stats)
 
 int ThreadPoolGetStats(ThreadPool *tp, ThreadPoolStats *stats)
 {
+	int i;
+	struct TPWorkQueue *q = NULL;
+
 	if (tp == NULL || stats == NULL)
 		return EINVAL;
 	/* if not shutdown then acquire mutex */
@@ -1261,6 +2023,16 @@ int ThreadPoolGetStats(ThreadPool *tp, ThreadPoolStats *stats)
 	stats->currentJobsHQ = (int)ListSize(&tp->highJobQ);
 	stats->currentJobsLQ = (int)ListSize(&tp->lowJobQ);
 	stats->currentJobsMQ = (int)ListSize(&tp->medJobQ);
+	for (i = 0; i < tp->numWorkQueues; ++i) {
+		q = &tp->workQueues[i];
+		ithread_mutex_lock(&q->mutex);
+		stats->currentJobsHQ += (int)ListSize(&q->highJobQ);
+		stats->currentJobsLQ += (int)ListSize(&q->lowJobQ);
+		stats->currentJobsMQ += (int)ListSize(&q->medJobQ);
+		ithread_mutex_unlock(&q->mutex);
+	}
+	if (tp->workQueues)
+		stats->idleThreads = (int)TPAtomicAdd(&tp->idleWorkers, 0);
 
 	/* if not shutdown then release mutex */
 	if (!tp->shutdown)
@@ -137,6 +137,25 @@ typedef int PolicyType;
 
 #define DEFAULT_POLICY SCHED_OTHER
 
+/*! Job scheduling strategy of a thread pool. */
+typedef enum scheduler
+{
+	/*! All jobs go through three priority queues shared by every worker
+	 * and protected by the pool mutex. */
+	TP_GLOBAL_QUEUE,
+	/*! Every worker owns a set of priority queues with its own lock.
+	 * Jobs are spread over the queues and idle workers steal from the
+	 * queues of busy ones. */
+	TP_WORK_STEALING
+} SchedulerType;
+
+/*! default scheduler used by TPAttrInit */
+#define DEFAULT_SCHEDULER TP_GLOBAL_QUEUE
+
+/*! Maximum number of worker queues, and so of worker threads, of a pool
+ * using the work-stealing scheduler. */
+#define TP_MAX_WORK_QUEUES 64
+
 /*! Function for freeing a thread argument. */
 typedef void (*free_routine)(void *arg);
 
@@ -162,6 +181,8 @@ typedef struct THREADPOOLATTR
 	int starvationTime;
 	/*! scheduling policy to use. */
 	PolicyType schedPolicy;
+	/*! job scheduler to use, only read by ThreadPoolInit(). */
+	SchedulerType scheduler;
 } ThreadPoolAttr;
 
 /*! Internal ThreadPool Job. */
@@ -175,6 +196,9 @@ typedef struct THREADPOOLJOB
 	int jobId;
 } ThreadPoolJob;
 
+/*! Per-worker job queues of the work-stealing scheduler. */
+struct TPWorkQueue;
+
 /*! Structure to hold statistics. */
 typedef struct TPOOLSTATS
 {
@@ -248,6 +272,30 @@ typedef struct THREADPOOL
 	ThreadPoolAttr attr;
 	/*! statistics */
 	ThreadPoolStats stats;
+	/*! worker queues, only used by the work-stealing scheduler */
+	struct TPWorkQueue *workQueues;
+	/*! number of worker queues */
+	int numWorkQueues;
+	/*! worker queue handed to the worker thread being started */
+	int pendingWorkerQueue;
+	/*! The following counters are only used by the work-stealing
+	 * scheduler. They are updated with atomic operations so that adding
+	 * and picking up jobs does not need the pool mutex. */
+	/*! jobs sitting in the worker queues, plus a pending persistent job */
+	volatile long queuedJobs;
+	/*! workers waiting for a job */
+	volatile long idleWorkers;
+	/*! workers running */
+	volatile long runningWorkers;
+	/*! round-robin position of the next job */
+	volatile long nextQueue;
+	/*! id of the next job, persistent ones included */
+	volatile long nextJobId;
+	/*! number of jobs queued so far, a worker that found nothing only
+	 * goes to sleep if it did not change while it looked */
+	volatile long addedJobs;
+	/*! set when the workers must exit */
+	volatile long stopWorkers;
 } ThreadPool;
 
 /*!
@@ -495,6 +543,20 @@ int TPAttrSetSchedPolicy(
 	/*! must be a valid policy type. */
 	PolicyType schedPolicy);
 
+/*!
+ * \brief Sets the job scheduler for the thread pool attributes.
+ *
+ * The scheduler is picked once by ThreadPoolInit(); ThreadPoolSetAttr()
+ * does not switch a running pool to another scheduler.
+ *
+ * \return Always returns 0.
+ */
+int TPAttrSetScheduler(
+	/*! must be valid thread pool attributes. */
+	ThreadPoolAttr *attr,
+	/*! TP_GLOBAL_QUEUE or TP_WORK_STEALING. */
+	SchedulerType scheduler);
+
 /*!
  * \brief Sets the maximum number jobs that can be qeued totally.
  *
@@ -36,7 +36,38 @@
 
 #include "TimerThread.h"
 
+#include "autoconfig.h"
+
 #include <assert.h>
+#include <stdlib.h>
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(HAVE_PTHREAD_CONDATTR_SETCLOCK) && \
+	defined(CLOCK_MONOTONIC)
+	/*! Deadlines follow CLOCK_MONOTONIC, so that setting the wall clock does
+	 * not move them. */
+	#define TIMER_MONOTONIC_CLOCK 1
+#endif
+
+/*! Initial capacity of the event heap. */
+#define TIMER_HEAP_INITIAL_CAPACITY (size_t)64
+
+/*!
+ * \brief Returns the current time of the timer clock in microseconds.
+ */
+static int64_t TimerNow(void)
+{
+#ifdef TIMER_MONOTONIC_CLOCK
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
 
 /*!
  * \brief Deallocates a dynamically allocated TimerEvent.
@@ -52,6 +83,188 @@ static void FreeTimerEvent(
 	FreeListFree(&timer->freeEvents, event);
 }
 
+/*!
+ * \brief Returns nonzero if event a is due before event b.
+ */
+static int EventBefore(const TimerEvent *a, const TimerEvent *b)
+{
+	if (a->eventTime != b->eventTime) {
+		return a->eventTime < b->eventTime;
+	}
+
+	return a->id < b->id;
+}
+
+/*!
+ * \brief Stores an event at a heap position.
+ */
+static void HeapSet(TimerThread *timer, size_t i, TimerEvent *event)
+{
+	timer->heap[i] = event;
+	event->heapIndex = i;
+}
+
+/*!
+ * \brief Moves the event at position i towards the root until the heap
+ * order holds.
+ */
+static void HeapSiftUp(TimerThread *timer, size_t i)
+{
+	TimerEvent *event = timer->heap[i];
+	size_t parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!EventBefore(event, timer->heap[parent])) {
+			break;
+		}
+		HeapSet(timer, i, timer->heap[parent]);
+		i = parent;
+	}
+	HeapSet(timer, i, event);
+}
+
+/*!
+ * \brief Moves the event at position i towards the leaves until the heap
+ * order holds.
+ */
+static void HeapSiftDown(TimerThread *timer, size_t i)
+{
+	TimerEvent *event = timer->heap[i];
+	size_t child;
+
+	while ((child = 2 * i + 1) < timer->heapSize) {
+		if (child + 1 < timer->heapSize &&
+			EventBefore(timer->heap[child + 1], timer->heap[child])) {
+			++child;
+		}
+		if (!EventBefore(timer->heap[child], event)) {
+			break;
+		}
+		HeapSet(timer, i, timer->heap[child]);
+		i = child;
+	}
+	HeapSet(timer, i, event);
+}
+
+/*!
+ * \brief Returns the idIndex bucket of an event id.
+ */
+static size_t IdBucket(const TimerThread *timer, int id)
+{
+	return (size_t)(unsigned int)id & (timer->heapCapacity - 1);
+}
+
+/*!
+ * \brief Doubles the capacity of the heap and rehashes the id index.
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+static int GrowEventQ(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer)
+{
+	size_t capacity = 2 * timer->heapCapacity;
+	TimerEvent **heap;
+	TimerEvent **idIndex;
+	size_t bucket;
+	size_t i;
+
+	idIndex = calloc(capacity, sizeof *idIndex);
+	if (idIndex == NULL) {
+		return EOUTOFMEM;
+	}
+	heap = realloc(timer->heap, capacity * sizeof *heap);
+	if (heap == NULL) {
+		free(idIndex);
+		return EOUTOFMEM;
+	}
+	free(timer->idIndex);
+	timer->heap = heap;
+	timer->idIndex = idIndex;
+	timer->heapCapacity = capacity;
+	for (i = 0; i < timer->heapSize; ++i) {
+		bucket = IdBucket(timer, heap[i]->id);
+		heap[i]->idNext = idIndex[bucket];
+		idIndex[bucket] = heap[i];
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Adds an event to the heap and the id index.
+ *
+ * \return 0 on success, EOUTOFMEM on failure.
+ */
+static int EventQInsert(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event to add. */
+	TimerEvent *event)
+{
+	size_t bucket;
+
+	if (timer->heapSize == timer->heapCapacity && GrowEventQ(timer) != 0) {
+		return EOUTOFMEM;
+	}
+	bucket = IdBucket(timer, event->id);
+	event->idNext = timer->idIndex[bucket];
+	timer->idIndex[bucket] = event;
+	HeapSet(timer, timer->heapSize++, event);
+	HeapSiftUp(timer, event->heapIndex);
+
+	return 0;
+}
+
+/*!
+ * \brief Removes an event from the heap and the id index.
+ */
+static void EventQRemove(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event in the queue. */
+	TimerEvent *event)
+{
+	TimerEvent **link = &timer->idIndex[IdBucket(timer, event->id)];
+	TimerEvent *last;
+	size_t i = event->heapIndex;
+
+	while (*link != event) {
+		link = &(*link)->idNext;
+	}
+	*link = event->idNext;
+	last = timer->heap[--timer->heapSize];
+	if (last != event) {
+		HeapSet(timer, i, last);
+		if (i > 0 && EventBefore(last, timer->heap[(i - 1) / 2])) {
+			HeapSiftUp(timer, i);
+		} else {
+			HeapSiftDown(timer, i);
+		}
+	}
+}
+
+/*!
+ * \brief Finds a pending event by id.
+ *
+ * \return The event, or NULL if there is none with this id.
+ */
+static TimerEvent *EventQFind(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Id of the event. */
+	int id)
+{
+	TimerEvent *event = timer->idIndex[IdBucket(timer, id)];
+
+	while (event != NULL && event->id != id) {
+		event = event->idNext;
+	}
+
+	return event;
+}
+
 /*!
  * \brief Implements timer thread.
  *
@@ -62,10 +275,8 @@ static void TimerThreadWorker(
 	void *arg)
 {
 	TimerThread *timer = (TimerThread *)arg;
-	ListNode *head = NULL;
 	TimerEvent *nextEvent = NULL;
-	time_t currentTime = 0;
-	time_t nextEventTime = 0;
+	int64_t currentTime = 0;
 	struct timespec timeToWait;
 	int tempId;
 
@@ -83,18 +294,12 @@ static void TimerThreadWorker(
 		}
 		nextEvent = NULL;
 		/* Get the next event if possible. */
-		if (timer->eventQ.size > 0) {
-			head = ListHead(&timer->eventQ);
-			if (head == NULL) {
-				ithread_mutex_unlock(&timer->mutex);
-				return;
-			}
-			nextEvent = (TimerEvent *)head->item;
-			nextEventTime = nextEvent->eventTime;
+		if (timer->heapSize > 0) {
+			nextEvent = timer->heap[0];
 		}
-		currentTime = time(NULL);
+		currentTime = TimerNow();
 		/* If time has elapsed, schedule job. */
-		if (nextEvent && currentTime >= nextEventTime) {
+		if (nextEvent && currentTime >= nextEvent->eventTime) {
 			if (nextEvent->persistent) {
 				if (ThreadPoolAddPersistent(timer->tp,
 					    &nextEvent->job,
@@ -118,13 +323,15 @@ static void TimerThreadWorker(
 					}
 				}
 			}
-			ListDelNode(&timer->eventQ, head, 0);
+			EventQRemove(timer, nextEvent);
 			FreeTimerEvent(timer, nextEvent);
 			continue;
 		}
 		if (nextEvent) {
-			timeToWait.tv_nsec = 0;
-			timeToWait.tv_sec = (long)nextEvent->eventTime;
+			timeToWait.tv_sec =
+				(time_t)(nextEvent->eventTime / 1000000);
+			timeToWait.tv_nsec =
+				(long)(nextEvent->eventTime % 1000000) * 1000;
 			ithread_cond_timedwait(
 				&timer->condition, &timer->mutex, &timeToWait);
 		} else {
@@ -134,31 +341,25 @@ static void TimerThreadWorker(
 }
 
 /*!
- * \brief Calculates the appropriate timeout in absolute seconds
- * since Jan 1, 1970.
+ * \brief Calculates the deadline of an event on the timer clock.
  *
- * \return
+ * \return The deadline in microseconds.
  */
-static int CalculateEventTime(
+static int64_t CalculateEventTime(
 	/*! [in] Timeout. */
-	time_t *timeout,
+	time_t timeout,
 	/*! [in] Timeout type. */
 	TimeoutType type)
 {
-	time_t now;
-
-	assert(timeout != NULL);
-
 	switch (type) {
 	case ABS_SEC:
-		return 0;
+		return TimerNow() +
+		       ((int64_t)timeout - (int64_t)time(NULL)) * 1000000;
+	case REL_MSEC:
+		return TimerNow() + (int64_t)timeout * 1000;
 	default: /* REL_SEC) */
-		time(&now);
-		(*timeout) += now;
-		return 0;
+		return TimerNow() + (int64_t)timeout * 1000000;
 	}
-
-	return -1;
 }
 
 /*!
@@ -173,8 +374,8 @@ static TimerEvent *CreateTimerEvent(
 	ThreadPoolJob *job,
 	/*! [in] . */
 	Duration persistent,
-	/*! [in] The absoule time of the event in seconds from Jan, 1970. */
-	time_t eventTime,
+	/*! [in] The deadline of the event on the timer clock. */
+	int64_t eventTime,
 	/*! [in] Id of job. */
 	int id)
 {
@@ -190,6 +391,8 @@ static TimerEvent *CreateTimerEvent(
 	temp->persistent = persistent;
 	temp->eventTime = eventTime;
 	temp->id = id;
+	temp->heapIndex = 0;
+	temp->idNext = NULL;
 
 	return temp;
 }
@@ -200,6 +403,9 @@ int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
 	int rc = 0;
 
 	ThreadPoolJob timerThreadWorker;
+#ifdef TIMER_MONOTONIC_CLOCK
+	pthread_condattr_t condAttr;
+#endif
 
 	assert(timer != NULL);
 	assert(tp != NULL);
@@ -215,7 +421,14 @@ int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
 	rc += ithread_mutex_lock(&timer->mutex);
 	assert(rc == 0);
 
+#ifdef TIMER_MONOTONIC_CLOCK
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	rc += ithread_cond_init(&timer->condition, &condAttr);
+	pthread_condattr_destroy(&condAttr);
+#else
 	rc += ithread_cond_init(&timer->condition, NULL);
+#endif
 	assert(rc == 0);
 
 	rc += FreeListInit(&timer->freeEvents, sizeof(TimerEvent), 100);
@@ -224,7 +437,13 @@ int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
 	timer->shutdown = 0;
 	timer->tp = tp;
 	timer->lastEventId = 0;
-	rc += ListInit(&timer->eventQ, NULL, NULL);
+	timer->heapSize = 0;
+	timer->heapCapacity = TIMER_HEAP_INITIAL_CAPACITY;
+	timer->heap = malloc(timer->heapCapacity * sizeof *timer->heap);
+	timer->idIndex = calloc(timer->heapCapacity, sizeof *timer->idIndex);
+	if (timer->heap == NULL || timer->idIndex == NULL) {
+		rc += EOUTOFMEM;
+	}
 
 	assert(rc == 0);
 
@@ -244,7 +463,10 @@ int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
 		ithread_cond_destroy(&timer->condition);
 		ithread_mutex_destroy(&timer->mutex);
 		FreeListDestroy(&timer->freeEvents);
-		ListDestroy(&timer->eventQ, 0);
+		free(timer->heap);
+		free(timer->idIndex);
+		timer->heap = NULL;
+		timer->idIndex = NULL;
 	}
 
 	return rc;
@@ -258,11 +480,9 @@ int TimerThreadSchedule(TimerThread *timer,
 	int *id)
 {
 	int rc = EOUTOFMEM;
-	int found = 0;
 	int tempId = 0;
+	int64_t eventTime;
 
-	ListNode *tempNode = NULL;
-	TimerEvent *temp = NULL;
 	TimerEvent *newEvent = NULL;
 
 	assert(timer != NULL);
@@ -272,7 +492,7 @@ int TimerThreadSchedule(TimerThread *timer,
 		return EINVAL;
 	}
 
-	CalculateEventTime(&timeout, type);
+	eventTime = CalculateEventTime(timeout, type);
 	ithread_mutex_lock(&timer->mutex);
 
 	if (id == NULL)
@@ -281,34 +501,19 @@ int TimerThreadSchedule(TimerThread *timer,
 	(*id) = INVALID_EVENT_ID;
 
 	newEvent = CreateTimerEvent(
-		timer, job, duration, timeout, timer->lastEventId);
+		timer, job, duration, eventTime, timer->lastEventId);
 
 	if (newEvent == NULL) {
 		ithread_mutex_unlock(&timer->mutex);
 		return rc;
 	}
 
-	tempNode = ListHead(&timer->eventQ);
-	/* add job to Q. Q is ordered by eventTime with the head of the Q being
-	 * the next event. */
-	while (tempNode != NULL) {
-		temp = (TimerEvent *)tempNode->item;
-		if (temp->eventTime >= timeout) {
-			if (ListAddBefore(&timer->eventQ, newEvent, tempNode))
-				rc = 0;
-			found = 1;
-			break;
-		}
-		tempNode = ListNext(&timer->eventQ, tempNode);
-	}
-	/* add to the end of Q. */
-	if (!found) {
-		if (ListAddTail(&timer->eventQ, newEvent) != NULL)
-			rc = 0;
-	}
-	/* signal change in Q. */
+	rc = EventQInsert(timer, newEvent);
+	/* signal change in Q, the worker only cares about a new head. */
 	if (rc == 0) {
-		ithread_cond_signal(&timer->condition);
+		if (newEvent->heapIndex == 0) {
+			ithread_cond_signal(&timer->condition);
+		}
 	} else {
 		FreeTimerEvent(timer, newEvent);
 	}
@@ -321,7 +526,6 @@ int TimerThreadSchedule(TimerThread *timer,
 int TimerThreadRemove(TimerThread *timer, int id, ThreadPoolJob *out)
 {
 	int rc = INVALID_EVENT_ID;
-	ListNode *tempNode = NULL;
 	TimerEvent *temp = NULL;
 
 	assert(timer != NULL);
@@ -332,20 +536,13 @@ int TimerThreadRemove(TimerThread *timer, int id, ThreadPoolJob *out)
 
 	ithread_mutex_lock(&timer->mutex);
 
-	tempNode = ListHead(&timer->eventQ);
-
-	while (tempNode != NULL) {
-		temp = (TimerEvent *)tempNode->item;
-		if (temp->id == id) {
-
-			ListDelNode(&timer->eventQ, tempNode, 0);
-			if (out != NULL)
-				(*out) = temp->job;
-			FreeTimerEvent(timer, temp);
-			rc = 0;
-			break;
-		}
-		tempNode = ListNext(&timer->eventQ, tempNode);
+	temp = EventQFind(timer, id);
+	if (temp != NULL) {
+		EventQRemove(timer, temp);
+		if (out != NULL)
+			(*out) = temp->job;
+		FreeTimerEvent(timer, temp);
+		rc = 0;
 	}
 
 	ithread_mutex_unlock(&timer->mutex);
@@ -354,8 +551,7 @@ int TimerThreadRemove(TimerThread *timer, int id, ThreadPoolJob *out)
 
 int TimerThreadShutdown(TimerThread *timer)
 {
-	ListNode *tempNode2 = NULL;
-	ListNode *tempNode = NULL;
+	size_t i;
 
 	assert(timer != NULL);
 
@@ -366,22 +562,22 @@ int TimerThreadShutdown(TimerThread *timer)
 	ithread_mutex_lock(&timer->mutex);
 
 	timer->shutdown = 1;
-	tempNode = ListHead(&timer->eventQ);
 
-	/* Delete nodes in Q. Call registered free function on argument. */
-	while (tempNode != NULL) {
-		TimerEvent *temp = (TimerEvent *)tempNode->item;
+	/* Delete events in Q. Call registered free function on argument. */
+	for (i = 0; i < timer->heapSize; ++i) {
+		TimerEvent *temp = timer->heap[i];
 
-		tempNode2 = ListNext(&timer->eventQ, tempNode);
-		ListDelNode(&timer->eventQ, tempNode, 0);
 		if (temp->job.free_func) {
 			temp->job.free_func(temp->job.arg);
 		}
 		FreeTimerEvent(timer, temp);
-		tempNode = tempNode2;
 	}
-
-	ListDestroy(&timer->eventQ, 0);
+	timer->heapSize = 0;
+	free(timer->heap);
+	free(timer->idIndex);
+	timer->heap = NULL;
+	timer->idIndex = NULL;
+	timer->heapCapacity = 0;
 	FreeListDestroy(&timer->freeEvents);
 
 	ithread_cond_broadcast(&timer->condition);
@@ -39,6 +39,7 @@
 #include "FreeList.h"
 #include "LinkedList.h"
 #include "ThreadPool.h"
+#include "UpnpStdInt.h"
 #include "ithread.h"
 
 #ifdef __cplusplus
@@ -53,7 +54,9 @@ typedef enum timeoutType
 	/*! seconds from Jan 1, 1970. */
 	ABS_SEC,
 	/*! seconds from current time. */
-	REL_SEC
+	REL_SEC,
+	/*! milliseconds from current time. */
+	REL_MSEC
 } TimeoutType;
 
 /*!
@@ -63,6 +66,11 @@ typedef enum timeoutType
  * Because the timer thread uses the thread pool there is no
  * gurantee of timing, only approximate timing.
  *
+ * Pending events are kept in a binary min-heap ordered by deadline, with a
+ * hash index by event id, so scheduling and removal take O(log n). Deadlines
+ * have microsecond resolution and use the monotonic clock when the platform
+ * lets condition variables wait on it.
+ *
  * Uses ThreadPool, Mutex, Condition, Thread.
  */
 typedef struct TIMERTHREAD
@@ -70,7 +78,15 @@ typedef struct TIMERTHREAD
 	ithread_mutex_t mutex;
 	ithread_cond_t condition;
 	int lastEventId;
-	LinkedList eventQ;
+	/*! Pending events, heap ordered by eventTime then id. */
+	struct TIMEREVENT **heap;
+	/*! Number of events in heap. */
+	size_t heapSize;
+	/*! Capacity of heap and number of buckets of idIndex, a power of two.
+	 */
+	size_t heapCapacity;
+	/*! Pending events hashed by id. */
+	struct TIMEREVENT **idIndex;
 	int shutdown;
 	FreeList freeEvents;
 	ThreadPool *tp;
@@ -84,11 +100,15 @@ typedef struct TIMERTHREAD
 typedef struct TIMEREVENT
 {
 	ThreadPoolJob job;
-	/*! [in] Absolute time for event in seconds since Jan 1, 1970. */
-	time_t eventTime;
+	/*! [in] Deadline of the event in microseconds of the timer clock. */
+	int64_t eventTime;
 	/*! [in] Long term or short term job. */
 	Duration persistent;
 	int id;
+	/*! Position of the event in the heap. */
+	size_t heapIndex;
+	/*! Next event in the same idIndex bucket. */
+	struct TIMEREVENT *idNext;
 } TimerEvent;
 
 /*!
@@ -114,9 +134,9 @@ int TimerThreadSchedule(
 	/*! [in] Valid timer thread pointer. */
 	TimerThread *timer,
 	/*! [in] time of event. Either in absolute seconds, or relative
-	 * seconds in the future. */
+	 * seconds or milliseconds in the future. */
 	time_t time,
-	/*! [in] either ABS_SEC, or REL_SEC. If REL_SEC, then the event
+	/*! [in] either ABS_SEC, REL_SEC or REL_MSEC. If REL_SEC, then the event
 	 * will be scheduled at the current time + REL_SEC. */
 	TimeoutType type,
 	/*! [in] Valid Thread pool job with following fields. */
@@ -0,0 +1,200 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ * Copyright (c) 2012 France Telecom All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*
+ * Counts the reallocations done while building a typical GENA NOTIFY
+ * request and a typical SOAP action response, and times the builds.
+ *
+ * The program must be linked statically against the library with
+ * -Wl,--wrap=realloc so that the reallocations done inside the library are
+ * seen by __wrap_realloc().
+ */
+
+#include "httpparser.h"
+#include "httpreadwrite.h"
+#include "ixml.h"
+#include "membuffer.h"
+#include "uri.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 100000
+
+void *__real_realloc(void *ptr, size_t size);
+
+static unsigned long realloc_count = 0;
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	++realloc_count;
+	return __real_realloc(ptr, size);
+}
+
+static const char *gena_headers =
+	"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+	"CONTENT-LENGTH: 354\r\n"
+	"NT: upnp:event\r\n"
+	"NTS: upnp:propchange\r\n";
+
+static const char *action_result =
+	"<u:GetPositionInfoResponse "
+	"xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\">"
+	"<Track>1</Track>"
+	"<TrackDuration>00:04:12</TrackDuration>"
+	"<TrackMetaData>NOT_IMPLEMENTED</TrackMetaData>"
+	"<TrackURI>http://192.168.1.20:8200/MediaItems/42.flac</TrackURI>"
+	"<RelTime>00:01:07</RelTime>"
+	"<AbsTime>NOT_IMPLEMENTED</AbsTime>"
+	"<RelCount>2147483647</RelCount>"
+	"<AbsCount>2147483647</AbsCount>"
+	"</u:GetPositionInfoResponse>";
+
+/* Same steps as genaNotify() and notify_send_and_recv(). */
+static int build_notify(uri_type *url)
+{
+	const char *sid = "uuid:3e1ac8c2-7d5a-11ee-8000-00155d4c0a21";
+	membuffer mid_msg;
+	membuffer start_msg;
+	int ret;
+
+	membuffer_init(&mid_msg);
+	membuffer_init(&start_msg);
+	ret = membuffer_reserve(
+		&mid_msg, strlen(gena_headers) + strlen(sid) + (size_t)32);
+	if (ret == 0) {
+		ret = http_MakeMessage(&mid_msg,
+			1,
+			1,
+			"s"
+			"ssc"
+			"sdcc",
+			gena_headers,
+			"SID: ",
+			sid,
+			"SEQ: ",
+			42);
+	}
+	if (ret == 0) {
+		ret = membuffer_reserve(&start_msg,
+			mid_msg.length + url->pathquery.size +
+				url->hostport.text.size + (size_t)32);
+	}
+	if (ret == 0) {
+		ret = http_MakeMessage(&start_msg,
+			1,
+			1,
+			"q"
+			"s",
+			HTTPMETHOD_NOTIFY,
+			url,
+			mid_msg.buf);
+	}
+	membuffer_destroy(&start_msg);
+	membuffer_destroy(&mid_msg);
+
+	return ret;
+}
+
+/* Same steps as send_action_response(). */
+static int build_soap_response(IXML_Document *doc)
+{
+	membuffer headers;
+	char *xml_response;
+	int ret = -1;
+
+	membuffer_init(&headers);
+	xml_response = ixmlPrintNode((IXML_Node *)doc);
+	if (xml_response) {
+		ret = http_MakeMessage(&headers,
+			1,
+			1,
+			"RNsDsSXcc",
+			200,
+			(off_t)(strlen(xml_response) + 140),
+			"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n",
+			"EXT:\r\n",
+			"redsonic");
+	}
+	ixmlFreeDOMString(xml_response);
+	membuffer_destroy(&headers);
+
+	return ret;
+}
+
+static void report(const char *name, unsigned long reallocs, clock_t ticks)
+{
+	printf("%-14s %4lu reallocs/message %8.0f ns/message\n",
+		name,
+		reallocs,
+		(double)ticks * 1e9 / CLOCKS_PER_SEC / ITERATIONS);
+}
+
+int main(void)
+{
+	const char *url_str = "http://192.168.1.30:49153/event/AVTransport";
+	uri_type url;
+	IXML_Document *doc = NULL;
+	unsigned long reallocs;
+	clock_t start;
+	int i;
+
+	if (parse_uri(url_str, strlen(url_str), &url) != HTTP_SUCCESS ||
+		ixmlParseBufferEx(action_result, &doc) != IXML_SUCCESS) {
+		fprintf(stderr, "setup failed\n");
+		return EXIT_FAILURE;
+	}
+
+	realloc_count = 0;
+	build_notify(&url);
+	reallocs = realloc_count;
+	start = clock();
+	for (i = 0; i < ITERATIONS; ++i) {
+		build_notify(&url);
+	}
+	report("NOTIFY", reallocs, clock() - start);
+
+	realloc_count = 0;
+	build_soap_response(doc);
+	reallocs = realloc_count;
+	start = clock();
+	for (i = 0; i < ITERATIONS; ++i) {
+		build_soap_response(doc);
+	}
+	report("SOAP response", reallocs, clock() - start);
+
+	ixmlDocument_free(doc);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,235 @@
+/**************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation
+ * All rights reserved.
+ * Copyright (c) 2012 France Telecom All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * - Neither name of Intel Corporation nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **************************************************************************/
+
+/*
+ * Counts the system calls used to send an ssdp:all search reply and an
+ * advertisement round for a root device with ten services, and measures how
+ * long the advertisement keeps the caller.
+ *
+ * The program must be linked statically against the library with
+ * -Wl,--wrap=sendto,--wrap=sendmmsg so that the sends done inside the
+ * library are seen by the wrappers. It needs a network interface, and sends
+ * the replies to the discard port of the loopback address.
+ */
+
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE /* For sendmmsg() in sys/socket.h */
+#endif
+
+#include "ssdplib.h"
+#include "upnp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ITERATIONS 1000
+#define NUM_SERVICES 10
+#define MAX_AGE 1800
+
+ssize_t __real_sendto(int sockfd,
+	const void *buf,
+	size_t len,
+	int flags,
+	const struct sockaddr *dest_addr,
+	socklen_t addrlen);
+int __real_sendmmsg(
+	int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+
+static unsigned long call_count = 0;
+static unsigned long packet_count = 0;
+
+ssize_t __wrap_sendto(int sockfd,
+	const void *buf,
+	size_t len,
+	int flags,
+	const struct sockaddr *dest_addr,
+	socklen_t addrlen)
+{
+	ssize_t rc = __real_sendto(sockfd, buf, len, flags, dest_addr, addrlen);
+
+	++call_count;
+	if (rc >= 0) {
+		++packet_count;
+	}
+	return rc;
+}
+
+int __wrap_sendmmsg(
+	int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	int rc = __real_sendmmsg(sockfd, msgvec, vlen, flags);
+
+	++call_count;
+	if (rc > 0) {
+		packet_count += (unsigned long)rc;
+	}
+	return rc;
+}
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	(void)EventType;
+	(void)Event;
+	(void)Cookie;
+
+	return 0;
+}
+
+static char *make_description(void)
+{
+	static const char *head =
+		"<?xml version=\"1.0\"?>"
+		"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+		"<specVersion><major>1</major><minor>0</minor></specVersion>"
+		"<device>"
+		"<deviceType>urn:schemas-upnp-org:device:Bench:1</deviceType>"
+		"<friendlyName>bench</friendlyName>"
+		"<UDN>uuid:5e2b1f5c-1dd2-11b2-8000-00155d4c0a21</UDN>"
+		"<serviceList>";
+	static const char *tail = "</serviceList></device></root>";
+	char *desc;
+	size_t length;
+	int i;
+
+	desc = malloc((size_t)8192);
+	if (!desc) {
+		return NULL;
+	}
+	strcpy(desc, head);
+	for (i = 0; i < NUM_SERVICES; ++i) {
+		length = strlen(desc);
+		snprintf(desc + length,
+			(size_t)8192 - length,
+			"<service>"
+			"<serviceType>urn:schemas-upnp-org:service:Bench%d:1"
+			"</serviceType>"
+			"<serviceId>urn:upnp-org:serviceId:Bench%d</serviceId>"
+			"<SCPDURL>/bench%d.xml</SCPDURL>"
+			"<controlURL>/control/bench%d</controlURL>"
+			"<eventSubURL>/event/bench%d</eventSubURL>"
+			"</service>",
+			i,
+			i,
+			i,
+			i,
+			i);
+	}
+	strcat(desc, tail);
+
+	return desc;
+}
+
+int main(void)
+{
+	UpnpDevice_Handle handle;
+	struct sockaddr_in dest;
+	struct timespec start;
+	struct timespec end;
+	char *desc;
+	int i;
+	int rc;
+
+	rc = UpnpInit2(NULL, 0);
+	if (rc != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpInit2: %d\n", rc);
+		return EXIT_FAILURE;
+	}
+	desc = make_description();
+	if (!desc) {
+		UpnpFinish();
+		return EXIT_FAILURE;
+	}
+	rc = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC,
+		desc,
+		strlen(desc),
+		1,
+		callback,
+		NULL,
+		&handle);
+	free(desc);
+	if (rc != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpRegisterRootDevice2: %d\n", rc);
+		UpnpFinish();
+		return EXIT_FAILURE;
+	}
+	memset(&dest, 0, sizeof(dest));
+	dest.sin_family = AF_INET;
+	dest.sin_port = htons(9);
+	dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	/* the first reply renders the packets */
+	AdvertiseAndReply(0,
+		handle,
+		SSDP_ALL,
+		(struct sockaddr *)&dest,
+		NULL,
+		NULL,
+		NULL,
+		MAX_AGE);
+	call_count = 0;
+	packet_count = 0;
+	for (i = 0; i < ITERATIONS; ++i) {
+		AdvertiseAndReply(0,
+			handle,
+			SSDP_ALL,
+			(struct sockaddr *)&dest,
+			NULL,
+			NULL,
+			NULL,
+			MAX_AGE);
+	}
+	printf("ssdp:all reply      %5.1f packets %5.1f send calls\n",
+		(double)packet_count / ITERATIONS,
+		(double)call_count / ITERATIONS);
+
+	call_count = 0;
+	packet_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	AdvertiseAndReply(1, handle, SSDP_ALL, NULL, NULL, NULL, NULL, MAX_AGE);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	/* let the timer thread send the other copies */
+	usleep((NUM_SSDP_COPY * SSDP_PAUSE + 200) * 1000);
+	printf("advertisement round %5lu packets %5lu send calls %.3f ms in "
+	       "caller\n",
+		packet_count,
+		call_count,
+		(double)(end.tv_sec - start.tv_sec) * 1e3 +
+			(double)(end.tv_nsec - start.tv_nsec) / 1e6);
+
+	UpnpUnRegisterRootDevice(handle);
+	UpnpFinish();
+
+	return EXIT_SUCCESS;
+}
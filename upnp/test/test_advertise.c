@@ -0,0 +1,214 @@
+/*
+ * Checks the budget of the periodic advertisements: the delays and shares of
+ * booked rounds, shares given back by rounds that are not sent, and the
+ * statistics and rate being reset by UpnpFinish() and UpnpInit2(). Then
+ * checks that UpnpSendAdvertisement() replaces the pending renewal of a
+ * device, and that unregistering the device cancels it and gives its booking
+ * back.
+ *
+ * The SSDP and handle internals are not exported, so the program is linked
+ * statically. It needs a network interface.
+ */
+
+#include "ssdplib.h"
+#include "upnp.h"
+#include "upnpapi.h"
+
+/* Force asserts enabled for the test; config.h, included by the headers
+ * above, may define NDEBUG. */
+#ifdef NDEBUG
+	#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Shortest expiration accepted, renewed AUTO_ADVERTISEMENT_TIME seconds
+ * early: one second after the advertisement. */
+#define EXP ((AUTO_ADVERTISEMENT_TIME + 1) * 2)
+
+static const char desc[] =
+	"<?xml version=\"1.0\"?>"
+	"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+	"<specVersion><major>1</major><minor>0</minor></specVersion>"
+	"<device>"
+	"<deviceType>urn:schemas-upnp-org:device:Test:1</deviceType>"
+	"<friendlyName>test</friendlyName>"
+	"<UDN>uuid:0b7c0e9a-1dd2-11b2-8000-00155d4c0a21</UDN>"
+	"</device></root>";
+
+static int callback(Upnp_EventType EventType, void *Event, void *Cookie)
+{
+	(void)EventType;
+	(void)Event;
+	(void)Cookie;
+
+	return 0;
+}
+
+static void check_stats(unsigned long rounds,
+	unsigned long packets,
+	unsigned long deferred,
+	unsigned long maxDelay)
+{
+	unsigned long r;
+	unsigned long p;
+	unsigned long d;
+	unsigned long m;
+
+	assert(UpnpGetAdvertisementStats(&r, &p, &d, &m) == UPNP_E_SUCCESS);
+	assert(r == rounds);
+	assert(p == packets);
+	assert(d == deferred);
+	assert(m == maxDelay);
+}
+
+/* Delays are measured against a clock that moves on while the test runs;
+ * they may be a little shorter than booked, never longer. */
+static void check_delay(int delay, int expect)
+{
+	assert(delay <= expect);
+	assert(delay > expect - 50);
+}
+
+static void test_booking(void)
+{
+	int share;
+	int share2;
+	int delay;
+
+	/* no budget */
+	delay = ssdp_pace_book(10, &share);
+	assert(delay == 0);
+	assert(share == 0);
+
+	/* 100 packets per second, 10 ms per packet */
+	assert(UpnpSetAdvertisementRate(100) == UPNP_E_SUCCESS);
+	delay = ssdp_pace_book(10, &share);
+	assert(delay == 0);
+	assert(share == 100);
+	delay = ssdp_pace_book(10, &share);
+	check_delay(delay, 100);
+	assert(share == 100);
+	delay = ssdp_pace_book(5, &share2);
+	check_delay(delay, 200);
+	assert(share2 == 50);
+	/* a round that is not sent leaves its share to the next one */
+	ssdp_pace_cancel(share2);
+	delay = ssdp_pace_book(5, &share2);
+	check_delay(delay, 200);
+	ssdp_pace_cancel(share2);
+	ssdp_pace_cancel(share);
+	delay = ssdp_pace_book(1, &share);
+	check_delay(delay, 100);
+	assert(share == 10);
+	ssdp_pace_cancel(share);
+	/* nothing to send takes nothing */
+	delay = ssdp_pace_book(0, &share);
+	assert(delay == 0);
+	assert(share == 0);
+	/* removing the budget drops the bookings */
+	assert(UpnpSetAdvertisementRate(0) == UPNP_E_SUCCESS);
+	delay = ssdp_pace_book(1, &share);
+	assert(delay == 0);
+	assert(share == 0);
+	/* shares are rounded up */
+	assert(UpnpSetAdvertisementRate(3) == UPNP_E_SUCCESS);
+	delay = ssdp_pace_book(1, &share);
+	assert(delay == 0);
+	assert(share == 334);
+
+	/* only the rounds sent are counted */
+	check_stats(0, 0, 0, 0);
+	ssdp_pace_sent(10, 0);
+	ssdp_pace_sent(10, 120);
+	ssdp_pace_sent(4, 80);
+	check_stats(3, 24, 2, 120);
+}
+
+static int advertise_event_id(UpnpDevice_Handle handle)
+{
+	struct Handle_Info *info;
+	int id = -1;
+
+	HandleReadLock(__FILE__, __LINE__);
+	if (GetHandleInfo(handle, &info) == HND_DEVICE)
+		id = info->AdvertiseEventId;
+	HandleUnlock(__FILE__, __LINE__);
+
+	return id;
+}
+
+static void test_renewal(void)
+{
+	UpnpDevice_Handle handle;
+	int first;
+	int second;
+	int share;
+	int spare;
+	int delay;
+	int i;
+
+	assert(UpnpRegisterRootDevice2(UPNPREG_BUF_DESC,
+		       desc,
+		       strlen(desc),
+		       1,
+		       callback,
+		       NULL,
+		       &handle) == UPNP_E_SUCCESS);
+	assert(UpnpSetAdvertisementJitter(handle, 0) == UPNP_E_SUCCESS);
+	assert(advertise_event_id(handle) == -1);
+
+	/* a new advertisement replaces the pending renewal */
+	assert(UpnpSendAdvertisement(handle, EXP) == UPNP_E_SUCCESS);
+	first = advertise_event_id(handle);
+	assert(first != -1);
+	assert(UpnpSendAdvertisement(handle, EXP) == UPNP_E_SUCCESS);
+	second = advertise_event_id(handle);
+	assert(second != -1);
+	assert(second != first);
+	assert(TimerThreadRemove(&gTimerThread, first, NULL) != 0);
+
+	/* Fill the budget, one packet per second, for a minute. When the
+	 * renewal is due it books its round after that, and waits. */
+	assert(UpnpSetAdvertisementRate(1) == UPNP_E_SUCCESS);
+	delay = ssdp_pace_book(60, &spare);
+	assert(delay == 0);
+	for (i = 0; i < 50 && advertise_event_id(handle) == second; ++i)
+		usleep(100000);
+	first = advertise_event_id(handle);
+	assert(first != second);
+	assert(first != -1);
+
+	/* unregistering cancels the renewal and gives its share back */
+	assert(UpnpUnRegisterRootDevice(handle) == UPNP_E_SUCCESS);
+	assert(TimerThreadRemove(&gTimerThread, first, NULL) != 0);
+	ssdp_pace_cancel(spare);
+	delay = ssdp_pace_book(1, &share);
+	assert(delay == 0);
+	assert(share == 1000);
+	check_stats(0, 0, 0, 0);
+}
+
+int main(void)
+{
+	int share;
+
+	assert(UpnpInit2(NULL, 0) == UPNP_E_SUCCESS);
+	test_booking();
+	UpnpFinish();
+
+	/* the rate and the statistics start over */
+	assert(UpnpInit2(NULL, 0) == UPNP_E_SUCCESS);
+	check_stats(0, 0, 0, 0);
+	assert(ssdp_pace_book(10, &share) == 0);
+	assert(share == 0);
+	test_renewal();
+	UpnpFinish();
+	printf("test_advertise: all tests passed\n");
+
+	return 0;
+}
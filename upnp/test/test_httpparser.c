@@ -0,0 +1,275 @@
+/*
+ * Parses HTTP requests with the request line and header fast paths and the
+ * general path and checks that every known header name is found by its id.
+ *
+ * The parser is internal to the library, so the program is linked
+ * statically.
+ */
+
+#include "httpparser.h"
+#include "membuffer.h"
+#include "statcodes.h"
+
+/* Force asserts enabled for the test; config.h, included by the headers
+ * above, may define NDEBUG. */
+#ifdef NDEBUG
+	#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void parse_request(http_parser_t *parser, const char *msg)
+{
+	parse_status_t status;
+
+	parser_request_init(parser);
+	status = parser_append(parser, msg, strlen(msg));
+	assert(status == PARSE_SUCCESS);
+}
+
+/* Checks that the header with the given id has the given value. */
+static void check_header(http_message_t *msg, int id, const char *expect)
+{
+	memptr value;
+	http_header_t *header;
+
+	header = httpmsg_find_hdr(msg, id, &value);
+	if (header == NULL || value.length != strlen(expect) ||
+		strncmp(value.buf, expect, value.length) != 0) {
+		fprintf(stderr,
+			"header %d: expected \"%s\", got \"%.*s\"\n",
+			id,
+			expect,
+			header ? (int)value.length : 0,
+			header ? value.buf : "");
+		assert(0);
+	}
+}
+
+/* Every known name, in mixed case, must map to its own id. SOAPACTION
+ * turns the request into a SOAP call and is checked separately. */
+static void test_known_names(void)
+{
+	http_parser_t parser;
+	char msg[4096];
+	char name[64];
+	size_t i;
+	size_t j;
+	int n;
+
+	n = snprintf(msg, sizeof msg, "GET /x HTTP/1.1\r\n");
+	for (i = 0; i < NUM_HTTP_HEADER_NAMES; i++) {
+		assert(Http_Header_Names[i].id > 0);
+		assert(Http_Header_Names[i].id < HDR_NUM_IDS);
+		if (Http_Header_Names[i].id == HDR_SOAPACTION)
+			continue;
+		strcpy(name, Http_Header_Names[i].name);
+		for (j = 0; name[j]; j++) {
+			if ((i + j) % 2)
+				name[j] = (char)tolower((unsigned char)name[j]);
+		}
+		n += snprintf(msg + n,
+			sizeof msg - (size_t)n,
+			"%s: value%d\r\n",
+			name,
+			(int)i);
+	}
+	snprintf(msg + n, sizeof msg - (size_t)n, "\r\n");
+	parse_request(&parser, msg);
+	for (i = 0; i < NUM_HTTP_HEADER_NAMES; i++) {
+		if (Http_Header_Names[i].id == HDR_SOAPACTION)
+			continue;
+		snprintf(name, sizeof name, "value%d", (int)i);
+		check_header(&parser.msg, Http_Header_Names[i].id, name);
+	}
+	httpmsg_destroy(&parser.msg);
+}
+
+/* Lines the fast path leaves to the general path must give the same
+ * result. */
+static void test_header_lines(void)
+{
+	http_parser_t parser;
+	memptr value;
+
+	parse_request(&parser,
+		"NOTIFY /event HTTP/1.1\r\n"
+		"HOST:10.0.0.1:80  \r\n"
+		"NT :\tupnp:event\n"
+		"NTS: upnp:propchange\r\n"
+		"SID: uuid:1\r\n"
+		"SEQ: 0\r\n"
+		"CONTENT-LENGTH: 0\r\n"
+		"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+		"USER-AGENT: a,\r\n"
+		"  b\r\n"
+		"Accept: x\r\n"
+		"Accept: y\r\n"
+		"X-Empty:\r\n"
+		"X-Other: z\r\n"
+		"SoapAction: \"urn:x#y\"\r\n"
+		"\r\n");
+	assert(parser.msg.method == SOAPMETHOD_POST);
+	check_header(&parser.msg, HDR_HOST, "10.0.0.1:80");
+	check_header(&parser.msg, HDR_NT, "upnp:event");
+	check_header(&parser.msg, HDR_NTS, "upnp:propchange");
+	check_header(&parser.msg, HDR_SID, "uuid:1");
+	check_header(&parser.msg, HDR_SEQ, "0");
+	check_header(
+		&parser.msg, HDR_CONTENT_TYPE, "text/xml; charset=\"utf-8\"");
+	check_header(&parser.msg, HDR_USER_AGENT, "a,\r\n  b");
+	check_header(&parser.msg, HDR_ACCEPT, "x, y");
+	check_header(&parser.msg, HDR_SOAPACTION, "\"urn:x#y\"");
+	assert(httpmsg_find_hdr(&parser.msg, HDR_CALLBACK, &value) == NULL);
+	assert(httpmsg_find_hdr_str(&parser.msg, "x-other") != NULL);
+	assert(httpmsg_find_hdr_str(&parser.msg, "X-EMPTY") != NULL);
+	httpmsg_destroy(&parser.msg);
+}
+
+/* A message split at every position parses the same way. */
+static void test_incremental(void)
+{
+	static const char msg[] = "M-SEARCH * HTTP/1.1\r\n"
+				  "HOST: 239.255.255.250:1900\r\n"
+				  "MAN: \"ssdp:discover\"\r\n"
+				  "MX: 2\r\n"
+				  "ST: ssdp:all\r\n"
+				  "\r\n";
+	http_parser_t parser;
+	parse_status_t status;
+	size_t split;
+
+	for (split = 1; split < sizeof msg - 1; split++) {
+		parser_request_init(&parser);
+		status = parser_append(&parser, msg, split);
+		assert(status == PARSE_INCOMPLETE);
+		status = parser_append(
+			&parser, msg + split, sizeof msg - 1 - split);
+		assert(status == PARSE_SUCCESS);
+		assert(parser.msg.method == HTTPMETHOD_MSEARCH);
+		check_header(&parser.msg, HDR_HOST, "239.255.255.250:1900");
+		check_header(&parser.msg, HDR_MAN, "\"ssdp:discover\"");
+		check_header(&parser.msg, HDR_MX, "2");
+		check_header(&parser.msg, HDR_ST, "ssdp:all");
+		httpmsg_destroy(&parser.msg);
+	}
+}
+
+/* A header added to the list without going through the parser has no slot
+ * and must still be found by its id. */
+static void test_list_fallback(void)
+{
+	http_parser_t parser;
+	http_header_t *header;
+
+	parse_request(&parser, "GET /x HTTP/1.1\r\nHOST: a\r\n\r\n");
+	header = (http_header_t *)malloc(sizeof(http_header_t));
+	assert(header != NULL);
+	membuffer_init(&header->name_buf);
+	membuffer_init(&header->value);
+	assert(membuffer_assign_str(&header->name_buf, "CALLBACK") == 0);
+	assert(membuffer_assign_str(&header->value, "<http://b/>") == 0);
+	header->name.buf = header->name_buf.buf;
+	header->name.length = header->name_buf.length;
+	header->name_id = HDR_CALLBACK;
+	assert(ListAddTail(&parser.msg.headers, header) != NULL);
+	check_header(&parser.msg, HDR_CALLBACK, "<http://b/>");
+	check_header(&parser.msg, HDR_HOST, "a");
+	httpmsg_destroy(&parser.msg);
+}
+
+/* Parses a request line and checks the method, version and url. */
+static void check_request_line(const char *msg,
+	http_method_t method,
+	int major,
+	int minor,
+	const char *url)
+{
+	http_parser_t parser;
+	size_t i;
+
+	parse_request(&parser, msg);
+	assert(parser.msg.method == method);
+	assert(parser.msg.major_version == major);
+	assert(parser.msg.minor_version == minor);
+	assert(strcmp(parser.msg.urlbuf, url) == 0);
+	httpmsg_destroy(&parser.msg);
+	for (i = 0; i < HDR_NUM_IDS; i++)
+		assert(parser.msg.known_headers[i] == NULL);
+}
+
+/* Checks that a request line is rejected with the given error code. */
+static void check_bad_request_line(const char *msg, int code)
+{
+	http_parser_t parser;
+	parse_status_t status;
+
+	parser_request_init(&parser);
+	status = parser_append(&parser, msg, strlen(msg));
+	assert(status == PARSE_FAILURE);
+	assert(parser.http_error_code == code);
+	httpmsg_destroy(&parser.msg);
+}
+
+/* Request lines taken by the fast path and by the general path. */
+static void test_request_lines(void)
+{
+	check_request_line("M-SEARCH * HTTP/1.1\r\nHOST: a\r\n\r\n",
+		HTTPMETHOD_MSEARCH,
+		1,
+		1,
+		"*");
+	check_request_line("GET //a HTTP/1.0\r\nHOST: a\r\n\r\n",
+		HTTPMETHOD_GET,
+		1,
+		0,
+		"/a");
+	check_request_line("SUBSCRIBE /e HTTP/1.1\r\nHOST: a\r\n\r\n",
+		HTTPMETHOD_SUBSCRIBE,
+		1,
+		1,
+		"/e");
+	check_request_line("NOTIFY * HTTP/1.1\nCONTENT-LENGTH: 0\n\n",
+		HTTPMETHOD_NOTIFY,
+		1,
+		1,
+		"*");
+	check_request_line("POST /c HTTP/12.345\r\nHOST: a\r\n\r\n",
+		HTTPMETHOD_POST,
+		12,
+		345,
+		"/c");
+	/* not taken by the fast path */
+	check_request_line("GET /x http/1.1\r\nHOST: a\r\n\r\n",
+		HTTPMETHOD_GET,
+		1,
+		1,
+		"/x");
+	check_request_line("GET  /x  HTTP/1.1\r\nHOST: a\r\n\r\n",
+		HTTPMETHOD_GET,
+		1,
+		1,
+		"/x");
+	check_bad_request_line("M-SEARCH * HTTP/1.0\r\nHOST: a\r\n\r\n",
+		HTTP_HTTP_VERSION_NOT_SUPPORTED);
+	check_bad_request_line("FOO / HTTP/1.1\r\nHOST: a\r\n\r\n",
+		HTTP_NOT_IMPLEMENTED);
+	/* the method is case sensitive */
+	check_bad_request_line("get /x HTTP/1.1\r\nHOST: a\r\n\r\n",
+		HTTP_NOT_IMPLEMENTED);
+}
+
+int main(void)
+{
+	test_known_names();
+	test_header_lines();
+	test_incremental();
+	test_list_fallback();
+	test_request_lines();
+
+	return 0;
+}
@@ -0,0 +1,329 @@
+/*
+ * Builds GENA property sets and checks their exact text: values passed to
+ * UpnpPropertySetBuilder_add() are escaped, values passed to
+ * UpnpAcceptSubscription() are sent verbatim, and a failed add leaves the
+ * property set unchanged.
+ *
+ * The NOTIFY messages are read from a local subscriber. The property set
+ * text is internal to the library and the reallocations are made to fail
+ * through -Wl,--wrap=realloc, so the program is linked statically.
+ */
+
+#include "gena.h"
+#include "ixml.h"
+#include "upnp.h"
+
+/* Force asserts enabled for the test; config.h, included by the headers
+ * above, may define NDEBUG. */
+#ifdef NDEBUG
+	#undef NDEBUG
+#endif
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HEADER XML_PROPERTYSET_HEADER
+#define FOOTER "</e:propertyset>\n\n"
+#define PROPERTY(name, value) \
+	"<e:property>\n<" name ">" value "</" name ">\n</e:property>\n"
+
+#define UDN "uuid:propertyset-test"
+#define SERVICE_ID "urn:upnp-org:serviceId:test1"
+
+void *__real_realloc(void *ptr, size_t size);
+
+/* Non-zero to make every reallocation fail. */
+static int fail_realloc = 0;
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	if (fail_realloc)
+		return NULL;
+	return __real_realloc(ptr, size);
+}
+
+static UpnpDevice_Handle device = -1;
+
+/* Checks the text of a property set and frees it. */
+static void check_text(const UpnpPropertySetBuilder *p, const char *expect)
+{
+	DOMString s;
+
+	s = genaPropertySetString(p);
+	assert(s != NULL);
+	if (strcmp(s, expect) != 0) {
+		fprintf(stderr, "got:\n%s\nexpected:\n%s\n", s, expect);
+		assert(0);
+	}
+	ixmlFreeDOMString(s);
+}
+
+static void test_plain(void)
+{
+	UpnpPropertySetBuilder *p = UpnpPropertySetBuilder_new();
+
+	assert(p != NULL);
+	check_text(p, HEADER FOOTER);
+	assert(UpnpPropertySetBuilder_add(p, "Volume", "5") == UPNP_E_SUCCESS);
+	assert(UpnpPropertySetBuilder_add(p, "Power", "") == UPNP_E_SUCCESS);
+	check_text(p,
+		HEADER PROPERTY("Volume", "5") PROPERTY("Power", "") FOOTER);
+	/* cleared and reused for the next event */
+	UpnpPropertySetBuilder_clear(p);
+	check_text(p, HEADER FOOTER);
+	assert(UpnpPropertySetBuilder_add(p, "x:Channel-1.a", "7") ==
+		UPNP_E_SUCCESS);
+	check_text(p, HEADER PROPERTY("x:Channel-1.a", "7") FOOTER);
+	UpnpPropertySetBuilder_delete(p);
+	UpnpPropertySetBuilder_clear(NULL);
+	UpnpPropertySetBuilder_delete(NULL);
+}
+
+static void test_escaped(void)
+{
+	UpnpPropertySetBuilder *p = UpnpPropertySetBuilder_new();
+
+	assert(p != NULL);
+	assert(UpnpPropertySetBuilder_add(p,
+		       "LastChange",
+		       "<Event a=\"1\" b='2'>&amp;</Event>") == UPNP_E_SUCCESS);
+	check_text(p,
+		HEADER PROPERTY("LastChange",
+			"&lt;Event a=&quot;1&quot; b=&apos;2&apos;&gt;"
+			"&amp;amp;&lt;/Event&gt;") FOOTER);
+	UpnpPropertySetBuilder_delete(p);
+}
+
+static void test_invalid(void)
+{
+	static const char *names[] = {
+		"", "1a", "-a", ".a", "a b", "a<b", "a>", "a&b", "a/b", "a\"b"};
+	UpnpPropertySetBuilder *p = UpnpPropertySetBuilder_new();
+	size_t i;
+
+	assert(p != NULL);
+	assert(UpnpPropertySetBuilder_add(p, "A", "1") == UPNP_E_SUCCESS);
+	for (i = 0; i < sizeof names / sizeof names[0]; i++) {
+		assert(UpnpPropertySetBuilder_add(p, names[i], "x") ==
+			UPNP_E_INVALID_PARAM);
+	}
+	assert(UpnpPropertySetBuilder_add(NULL, "A", "1") ==
+		UPNP_E_INVALID_PARAM);
+	assert(UpnpPropertySetBuilder_add(p, NULL, "1") ==
+		UPNP_E_INVALID_PARAM);
+	assert(UpnpPropertySetBuilder_add(p, "A", NULL) ==
+		UPNP_E_INVALID_PARAM);
+	check_text(p, HEADER PROPERTY("A", "1") FOOTER);
+	UpnpPropertySetBuilder_delete(p);
+}
+
+/* A failed add leaves the property set as it was. */
+static void test_out_of_memory(void)
+{
+	UpnpPropertySetBuilder *p = UpnpPropertySetBuilder_new();
+	char *big;
+
+	assert(p != NULL);
+	big = malloc((size_t)65536);
+	assert(big != NULL);
+	memset(big, '<', (size_t)65535);
+	big[65535] = '\0';
+	assert(UpnpPropertySetBuilder_add(p, "A", "1") == UPNP_E_SUCCESS);
+	fail_realloc = 1;
+	assert(UpnpPropertySetBuilder_add(p, "Big", big) ==
+		UPNP_E_OUTOF_MEMORY);
+	fail_realloc = 0;
+	check_text(p, HEADER PROPERTY("A", "1") FOOTER);
+	assert(UpnpPropertySetBuilder_add(p, "B", "2") == UPNP_E_SUCCESS);
+	check_text(p, HEADER PROPERTY("A", "1") PROPERTY("B", "2") FOOTER);
+	free(big);
+	UpnpPropertySetBuilder_delete(p);
+}
+
+/* Accepts subscriptions with a state variable holding markup. */
+static int device_callback(Upnp_EventType type, const void *event, void *cookie)
+{
+	const UpnpSubscriptionRequest *req = event;
+	const char *names[] = {"A"};
+	const char *values[] = {"<b>1</b>"};
+
+	(void)cookie;
+	if (type == UPNP_EVENT_SUBSCRIPTION_REQUEST) {
+		assert(UpnpAcceptSubscription(device,
+			       UpnpSubscriptionRequest_get_UDN_cstr(req),
+			       UpnpSubscriptionRequest_get_ServiceId_cstr(req),
+			       names,
+			       values,
+			       1,
+			       UpnpSubscriptionRequest_get_SID_cstr(req)) ==
+			UPNP_E_SUCCESS);
+	}
+
+	return 0;
+}
+
+/* Reads one HTTP message into buf and returns its body. */
+static char *read_message(int fd, char *buf, size_t size)
+{
+	size_t n = 0;
+	ssize_t r;
+	char *body = NULL;
+	const char *length;
+
+	for (;;) {
+		assert(n < size - 1);
+		r = recv(fd, buf + n, size - 1 - n, 0);
+		assert(r > 0);
+		n += (size_t)r;
+		buf[n] = '\0';
+		if (!body) {
+			body = strstr(buf, "\r\n\r\n");
+			if (!body)
+				continue;
+			body += 4;
+		}
+		length = strstr(buf, "CONTENT-LENGTH: ");
+		assert(length != NULL);
+		if (n - (size_t)(body - buf) >=
+			(size_t)atoi(length + strlen("CONTENT-LENGTH: ")))
+			return body;
+	}
+}
+
+/* Accepts the next NOTIFY on the listening socket and checks its body. */
+static void check_notify(int listener, const char *expect)
+{
+	static const char ok[] = "HTTP/1.1 200 OK\r\n"
+				 "CONTENT-LENGTH: 0\r\n"
+				 "CONNECTION: close\r\n"
+				 "\r\n";
+	char buf[4096];
+	char *body;
+	int fd;
+
+	fd = accept(listener, NULL, NULL);
+	assert(fd >= 0);
+	body = read_message(fd, buf, sizeof buf);
+	assert(strncmp(buf, "NOTIFY ", strlen("NOTIFY ")) == 0);
+	if (strcmp(body, expect) != 0) {
+		fprintf(stderr, "got:\n%s\nexpected:\n%s\n", body, expect);
+		assert(0);
+	}
+	assert(send(fd, ok, sizeof ok - 1, 0) == (ssize_t)(sizeof ok - 1));
+	close(fd);
+}
+
+/* Subscribes a local control point and checks the events it gets. */
+static void test_notify(void)
+{
+	static const char desc[] =
+		"<?xml version=\"1.0\"?>"
+		"<root xmlns=\"urn:schemas-upnp-org:device-1-0\">"
+		"<specVersion><major>1</major><minor>0</minor></specVersion>"
+		"<device>"
+		"<deviceType>urn:schemas-upnp-org:device:test:1</deviceType>"
+		"<friendlyName>test</friendlyName>"
+		"<UDN>" UDN "</UDN>"
+		"<serviceList><service>"
+		"<serviceType>urn:schemas-upnp-org:service:test:1</serviceType>"
+		"<serviceId>" SERVICE_ID "</serviceId>"
+		"<SCPDURL>/scpd.xml</SCPDURL>"
+		"<controlURL>/control</controlURL>"
+		"<eventSubURL>/event</eventSubURL>"
+		"</service></serviceList>"
+		"</device>"
+		"</root>";
+	const char *ip;
+	unsigned short port;
+	char buf[4096];
+	struct sockaddr_in addr;
+	socklen_t len = sizeof addr;
+	unsigned short callback_port;
+	int listener;
+	int fd;
+	UpnpPropertySetBuilder *p;
+
+	if (UpnpInit2(NULL, 0) != UPNP_E_SUCCESS) {
+		printf("no network interface, NOTIFY not tested\n");
+		return;
+	}
+	ip = UpnpGetServerIpAddress();
+	port = UpnpGetServerPort();
+	assert(UpnpRegisterRootDevice2(UPNPREG_BUF_DESC,
+		       desc,
+		       sizeof desc - 1,
+		       1,
+		       (Upnp_FunPtr)device_callback,
+		       NULL,
+		       &device) == UPNP_E_SUCCESS);
+
+	/* control point */
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	assert(listener >= 0);
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	assert(inet_pton(AF_INET, ip, &addr.sin_addr) == 1);
+	assert(bind(listener, (struct sockaddr *)&addr, sizeof addr) == 0);
+	assert(listen(listener, 4) == 0);
+	assert(getsockname(listener, (struct sockaddr *)&addr, &len) == 0);
+	callback_port = ntohs(addr.sin_port);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(fd >= 0);
+	addr.sin_port = htons(port);
+	assert(connect(fd, (struct sockaddr *)&addr, sizeof addr) == 0);
+	snprintf(buf,
+		sizeof buf,
+		"SUBSCRIBE /event HTTP/1.1\r\n"
+		"HOST: %s:%d\r\n"
+		"CALLBACK: <http://%s:%d/cb>\r\n"
+		"NT: upnp:event\r\n"
+		"TIMEOUT: Second-1800\r\n"
+		"\r\n",
+		ip,
+		port,
+		ip,
+		callback_port);
+	assert(send(fd, buf, strlen(buf), 0) == (ssize_t)strlen(buf));
+	assert(recv(fd, buf, sizeof buf - 1, 0) > 0);
+	assert(strncmp(buf, "HTTP/1.1 200", strlen("HTTP/1.1 200")) == 0);
+	close(fd);
+
+	/* UpnpAcceptSubscription() keeps the markup of the value */
+	check_notify(listener, HEADER PROPERTY("A", "<b>1</b>") FOOTER "\r\n");
+
+	p = UpnpPropertySetBuilder_new();
+	assert(p != NULL);
+	assert(UpnpPropertySetBuilder_add(p, "A", "<b>2</b>") ==
+		UPNP_E_SUCCESS);
+	assert(UpnpNotifyPropertySet(device, UDN, "bad", p) ==
+		GENA_E_BAD_SERVICE);
+	assert(UpnpNotifyPropertySet(device, UDN, SERVICE_ID, NULL) ==
+		UPNP_E_INVALID_PARAM);
+	assert(UpnpNotifyPropertySet(device, UDN, SERVICE_ID, p) ==
+		UPNP_E_SUCCESS);
+	check_notify(listener,
+		HEADER PROPERTY("A", "&lt;b&gt;2&lt;/b&gt;") FOOTER "\r\n");
+	UpnpPropertySetBuilder_delete(p);
+
+	close(listener);
+	UpnpUnRegisterRootDevice(device);
+	UpnpFinish();
+}
+
+int main(void)
+{
+	test_plain();
+	test_escaped();
+	test_invalid();
+	test_out_of_memory();
+	test_notify();
+
+	return 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * Runs the thread pool with the work-stealing scheduler: jobs run by
+ * priority across the worker queues, removed jobs do not run, persistent
+ * and regular jobs get distinct ids, a worker stuck in a persistent job
+ * does not hold back the jobs of its queue, and shutdown frees the queued
+ * jobs. Ends with producers adding and removing jobs concurrently.
+ *
+ * The thread pool is not exported, so the program is linked statically.
+ */
+
+#include "ThreadPool.h"
+
+/* Force asserts enabled for the test; config.h, included by the headers
+ * above, may define NDEBUG. */
+#ifdef NDEBUG
+	#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WORKERS 4
+#define JOBS 60
+#define PRODUCERS 4
+#define PRODUCER_JOBS 2000
+
+static ithread_mutex_t lock;
+static ithread_cond_t cond;
+/* blockers allowed to return */
+static int tokens;
+/* blockers running */
+static int blocked;
+/* jobs run, in order, and their number */
+static int order[JOBS];
+static int ran;
+/* jobs whose free function was called */
+static int freed;
+/* persistent job state */
+static int persistentRunning;
+static int persistentStop;
+
+static void blocker(void *arg)
+{
+	(void)arg;
+	ithread_mutex_lock(&lock);
+	blocked++;
+	ithread_cond_broadcast(&cond);
+	while (tokens == 0)
+		ithread_cond_wait(&cond, &lock);
+	tokens--;
+	blocked--;
+	ithread_cond_broadcast(&cond);
+	ithread_mutex_unlock(&lock);
+}
+
+static void record(void *arg)
+{
+	ithread_mutex_lock(&lock);
+	if (ran < JOBS)
+		order[ran] = (int)(intptr_t)arg;
+	ran++;
+	ithread_cond_broadcast(&cond);
+	ithread_mutex_unlock(&lock);
+}
+
+static void count_free(void *arg)
+{
+	(void)arg;
+	ithread_mutex_lock(&lock);
+	freed++;
+	ithread_cond_broadcast(&cond);
+	ithread_mutex_unlock(&lock);
+}
+
+static void persistent(void *arg)
+{
+	(void)arg;
+	ithread_mutex_lock(&lock);
+	persistentRunning = 1;
+	ithread_cond_broadcast(&cond);
+	while (!persistentStop)
+		ithread_cond_wait(&cond, &lock);
+	persistentRunning = 0;
+	ithread_cond_broadcast(&cond);
+	ithread_mutex_unlock(&lock);
+}
+
+/* Waits until *v reaches value. */
+static void wait_for(int *v, int value)
+{
+	ithread_mutex_lock(&lock);
+	while (*v != value)
+		ithread_cond_wait(&cond, &lock);
+	ithread_mutex_unlock(&lock);
+}
+
+static void release(int n)
+{
+	ithread_mutex_lock(&lock);
+	tokens += n;
+	ithread_cond_broadcast(&cond);
+	ithread_mutex_unlock(&lock);
+}
+
+static void reset(void)
+{
+	ithread_mutex_lock(&lock);
+	tokens = 0;
+	blocked = 0;
+	ran = 0;
+	freed = 0;
+	persistentRunning = 0;
+	persistentStop = 0;
+	memset(order, 0, sizeof order);
+	ithread_mutex_unlock(&lock);
+}
+
+static void start_pool(ThreadPool *tp)
+{
+	ThreadPoolAttr attr;
+
+	TPAttrInit(&attr);
+	TPAttrSetMinThreads(&attr, 1);
+	TPAttrSetMaxThreads(&attr, WORKERS);
+	/* nothing gets bumped to a higher priority while the test runs */
+	TPAttrSetIdleTime(&attr, 60000);
+	TPAttrSetStarvationTime(&attr, 60000);
+	TPAttrSetScheduler(&attr, TP_WORK_STEALING);
+	TPAttrSetMaxJobsTotal(&attr, PRODUCERS * PRODUCER_JOBS);
+	assert(ThreadPoolInit(tp, &attr) == 0);
+	assert(tp->workQueues != NULL);
+	reset();
+}
+
+static int add(ThreadPool *tp,
+	start_routine func,
+	intptr_t arg,
+	ThreadPriority priority,
+	free_routine free_func)
+{
+	ThreadPoolJob job;
+	int id = INVALID_JOB_ID;
+
+	TPJobInit(&job, func, (void *)arg);
+	TPJobSetPriority(&job, priority);
+	if (free_func)
+		TPJobSetFreeFunction(&job, free_func);
+	assert(ThreadPoolAdd(tp, &job, &id) == 0);
+	assert(id != INVALID_JOB_ID);
+
+	return id;
+}
+
+/* Occupies every worker. */
+static void block_workers(ThreadPool *tp, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i)
+		add(tp, blocker, 0, HIGH_PRIORITY, NULL);
+	wait_for(&blocked, n);
+}
+
+/* Jobs queued on busy workers are spread over their queues; the one worker
+ * let go must take them by priority, not its own queue first. */
+static void test_priorities(void)
+{
+	ThreadPool tp;
+	int i;
+
+	start_pool(&tp);
+	block_workers(&tp, WORKERS);
+	for (i = 0; i < JOBS; ++i)
+		add(&tp, record, i % 3, (ThreadPriority)(i % 3), NULL);
+	release(1);
+	wait_for(&ran, JOBS);
+	for (i = 0; i < JOBS; ++i)
+		assert(order[i] == 2 - i * 3 / JOBS);
+	release(WORKERS - 1);
+	wait_for(&blocked, 0);
+	assert(ThreadPoolShutdown(&tp) == 0);
+}
+
+static void test_remove(void)
+{
+	ThreadPool tp;
+	ThreadPoolJob out;
+	int ids[JOBS];
+	int i;
+	int j;
+
+	start_pool(&tp);
+	block_workers(&tp, WORKERS);
+	for (i = 0; i < JOBS; ++i)
+		ids[i] = add(&tp, record, i, (ThreadPriority)(i % 3), NULL);
+	for (i = 0; i < JOBS; ++i)
+		for (j = i + 1; j < JOBS; ++j)
+			assert(ids[i] != ids[j]);
+	for (i = 0; i < JOBS; i += 2) {
+		assert(ThreadPoolRemove(&tp, ids[i], &out) == 0);
+		assert(out.jobId == ids[i]);
+		assert(out.arg == (void *)(intptr_t)i);
+		assert(ThreadPoolRemove(&tp, ids[i], &out) == INVALID_JOB_ID);
+	}
+	release(WORKERS);
+	wait_for(&ran, JOBS / 2);
+	wait_for(&blocked, 0);
+	for (i = 0; i < JOBS / 2; ++i)
+		assert(order[i] % 2 == 1);
+	assert(ThreadPoolShutdown(&tp) == 0);
+}
+
+static void test_persistent(void)
+{
+	ThreadPool tp;
+	ThreadPoolJob job;
+	int persistentId = INVALID_JOB_ID;
+	int id;
+	int i;
+
+	start_pool(&tp);
+	TPJobInit(&job, persistent, NULL);
+	assert(ThreadPoolAddPersistent(&tp, &job, &persistentId) == 0);
+	wait_for(&persistentRunning, 1);
+	/* the persistent job is running, it can not be removed */
+	assert(ThreadPoolRemove(&tp, persistentId, NULL) == INVALID_JOB_ID);
+	block_workers(&tp, WORKERS - 1);
+	/* some of these go to the queue of the persistent worker */
+	for (i = 0; i < JOBS; ++i) {
+		id = add(&tp, record, i, MED_PRIORITY, NULL);
+		assert(id != persistentId);
+	}
+	release(WORKERS - 1);
+	wait_for(&ran, JOBS);
+	wait_for(&blocked, 0);
+	ithread_mutex_lock(&lock);
+	assert(persistentRunning);
+	persistentStop = 1;
+	ithread_cond_broadcast(&cond);
+	ithread_mutex_unlock(&lock);
+	wait_for(&persistentRunning, 0);
+	assert(ThreadPoolShutdown(&tp) == 0);
+}
+
+/* Lets the blockers go once shutdown has freed the queued jobs. */
+static void *releaser(void *arg)
+{
+	(void)arg;
+	wait_for(&freed, JOBS);
+	release(WORKERS);
+
+	return NULL;
+}
+
+static void test_shutdown(void)
+{
+	ThreadPool tp;
+	ithread_t thread;
+	int i;
+
+	start_pool(&tp);
+	block_workers(&tp, WORKERS);
+	for (i = 0; i < JOBS; ++i)
+		add(&tp, record, i, (ThreadPriority)(i % 3), count_free);
+	assert(ithread_create(&thread, NULL, releaser, NULL) == 0);
+	assert(ThreadPoolShutdown(&tp) == 0);
+	ithread_join(thread, NULL);
+	assert(freed == JOBS);
+	assert(ran == 0);
+}
+
+struct producer
+{
+	ThreadPool *tp;
+	int added;
+	int removed;
+};
+
+static void *produce(void *arg)
+{
+	struct producer *p = (struct producer *)arg;
+	ThreadPoolJob job;
+	int id;
+	int i;
+
+	for (i = 0; i < PRODUCER_JOBS; ++i) {
+		TPJobInit(&job, record, (void *)(intptr_t)i);
+		TPJobSetPriority(&job, (ThreadPriority)(i % 3));
+		if (ThreadPoolAdd(p->tp, &job, &id) != 0)
+			continue;
+		p->added++;
+		if (i % 3 == 0 && ThreadPoolRemove(p->tp, id, NULL) == 0)
+			p->removed++;
+	}
+
+	return NULL;
+}
+
+static void test_stress(void)
+{
+	ThreadPool tp;
+	ithread_t threads[PRODUCERS];
+	struct producer producers[PRODUCERS];
+	int expected = 0;
+	int i;
+
+	start_pool(&tp);
+	for (i = 0; i < PRODUCERS; ++i) {
+		producers[i].tp = &tp;
+		producers[i].added = 0;
+		producers[i].removed = 0;
+		assert(ithread_create(
+			       &threads[i], NULL, produce, &producers[i]) == 0);
+	}
+	for (i = 0; i < PRODUCERS; ++i) {
+		ithread_join(threads[i], NULL);
+		expected += producers[i].added - producers[i].removed;
+	}
+	assert(expected > 0);
+	wait_for(&ran, expected);
+	assert(ThreadPoolShutdown(&tp) == 0);
+	assert(ran == expected);
+}
+
+int main(void)
+{
+	ithread_mutex_init(&lock, NULL);
+	ithread_cond_init(&cond, NULL);
+
+	test_priorities();
+	test_remove();
+	test_persistent();
+	test_shutdown();
+	test_stress();
+
+	ithread_cond_destroy(&cond);
+	ithread_mutex_destroy(&lock);
+	printf("test_threadpool: all tests passed\n");
+
+	return 0;
+}